@@ -0,0 +1,174 @@
+#include "acpi.h"
+#include "memory.h"
+#include "pgtable.h"
+#include "printk.h"
+#include "cpu.h"
+
+static uint64_t acpi_root_phys = 0;         // RSDT/XSDT物理地址
+static uint8_t acpi_root_xsdt = 0;          // 根表是否为XSDT(8字节表指针)
+static uint8_t acpi_root_probed = 0;        // 是否已查找过RSDP
+static uint8_t acpi_early_mapped = 0;       // 早期映射窗口是否在使用
+
+/**
+ * @brief 取得管理直接映射区0~1G的启动页目录(PD)
+ * @return 页目录线性地址，该范围已改用1G大页映射时返回NULL
+ */
+static uint64_t *acpi_early_pd(void) {
+    uint64_t *pml4 = (uint64_t *)PHYS_TO_VIRT(read_cr3() & PTE_ADDR_MASK);
+    uint64_t pml4e = pml4[PT_INDEX(PHYS_TO_VIRT(0), PT_LEVEL_PML4E)];
+
+    if (!(pml4e & PTE_PRESENT))
+        return NULL;
+
+    uint64_t pdpte = ((uint64_t *)PHYS_TO_VIRT(pml4e & PTE_ADDR_MASK))[PT_INDEX(PHYS_TO_VIRT(0), PT_LEVEL_PDPTE)];
+    if (!(pdpte & PTE_PRESENT) || (pdpte & PTE_PS))
+        return NULL;
+    return (uint64_t *)PHYS_TO_VIRT(pdpte & PTE_ADDR_MASK);
+}
+
+/**
+ * @brief 通过早期映射窗口临时映射一段物理内存
+ *
+ * 窗口只有一个，再次调用会覆盖上一次的映射。只能在init_direct_map之前使用，
+ * 用完须调用acpi_early_unmap，避免与之后建立的直接映射冲突。
+ * @return 对应的线性地址，范围超出窗口或窗口不可用时返回NULL
+ */
+void *acpi_early_map(uint64_t phys_addr, uint64_t size) {
+    uint64_t base = phys_addr & PAGE_2M_MASK;
+    uint64_t *pd = acpi_early_pd();
+
+    if (!pd || phys_addr - base + size > ACPI_EARLY_MAP_SIZE)
+        return NULL;
+    if (!acpi_early_mapped && (pd[ACPI_EARLY_MAP_SLOT] & PTE_PRESENT)) {
+        errk("ACPI early map slot already in use\n");
+        return NULL;
+    }
+
+    uint64_t vaddr = (uint64_t)PHYS_TO_VIRT((uint64_t)ACPI_EARLY_MAP_SLOT * PAGE_2M_SIZE);
+    pd[ACPI_EARLY_MAP_SLOT] = base | PTE_PRESENT | PTE_WRITABLE | PTE_PS;
+    pd[ACPI_EARLY_MAP_SLOT + 1] = (base + PAGE_2M_SIZE) | PTE_PRESENT | PTE_WRITABLE | PTE_PS;
+    flush_tlb(vaddr);
+    flush_tlb(vaddr + PAGE_2M_SIZE);
+    acpi_early_mapped = 1;
+
+    return (void *)(vaddr + (phys_addr - base));
+}
+
+void acpi_early_unmap(void) {
+    uint64_t *pd = acpi_early_pd();
+
+    if (!acpi_early_mapped || !pd)
+        return;
+
+    uint64_t vaddr = (uint64_t)PHYS_TO_VIRT((uint64_t)ACPI_EARLY_MAP_SLOT * PAGE_2M_SIZE);
+    pd[ACPI_EARLY_MAP_SLOT] = 0;
+    pd[ACPI_EARLY_MAP_SLOT + 1] = 0;
+    flush_tlb(vaddr);
+    flush_tlb(vaddr + PAGE_2M_SIZE);
+    acpi_early_mapped = 0;
+}
+
+static uint8_t acpi_checksum(const void *table, uint64_t length) {
+    const uint8_t *bytes = (const uint8_t *)table;
+    uint8_t sum = 0;
+
+    for (uint64_t i = 0; i < length; i++)
+        sum += bytes[i];
+    return sum;
+}
+
+static uint8_t acpi_signature_match(const char *a, const char *b, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (a[i] != b[i])
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 在[start, start + length)低端物理内存中按16字节对齐查找RSDP
+ */
+static struct acpi_rsdp_struct *acpi_scan_rsdp(uint64_t start, uint64_t length) {
+    for (uint64_t addr = start; addr + sizeof(struct acpi_rsdp_struct) <= start + length; addr += 16) {
+        struct acpi_rsdp_struct *rsdp = (struct acpi_rsdp_struct *)PHYS_TO_VIRT(addr);
+        if (acpi_signature_match(rsdp->signature, "RSD PTR ", 8) && !acpi_checksum(rsdp, 20))
+            return rsdp;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 查找RSDP并确定根表(ACPI 2.0及以上优先使用XSDT)
+ */
+static void acpi_probe_root(void) {
+    struct acpi_rsdp_struct *rsdp = NULL;
+    uint64_t ebda = (uint64_t)*(uint16_t *)PHYS_TO_VIRT(ACPI_EBDA_PTR) << 4;
+
+    acpi_root_probed = 1;
+    if (ebda && ebda < ACPI_BIOS_START)
+        rsdp = acpi_scan_rsdp(ebda, 1024);
+    if (!rsdp)
+        rsdp = acpi_scan_rsdp(ACPI_BIOS_START, ACPI_BIOS_END - ACPI_BIOS_START);
+    if (!rsdp) {
+        warnk("ACPI: RSDP not found\n");
+        return;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address && !acpi_checksum(rsdp, rsdp->length)) {
+        acpi_root_phys = rsdp->xsdt_address;
+        acpi_root_xsdt = 1;
+    } else {
+        acpi_root_phys = rsdp->rsdt_address;
+    }
+    logk("ACPI: RSDP at %#lx, revision %d, %s at %#lx\n", VIRT_TO_PHYS((uint64_t)rsdp), rsdp->revision,
+         acpi_root_xsdt ? "XSDT" : "RSDT", acpi_root_phys);
+}
+
+/**
+ * @brief 按签名查找ACPI表并校验
+ *
+ * 返回的指针位于早期映射窗口中，在下一次acpi_early_map/acpi_find_table调用前有效。
+ * @param signature 4字符表签名，如"SRAT"
+ * @return 表的线性地址，未找到返回NULL
+ */
+void *acpi_find_table(const char *signature) {
+    uint64_t tables[ACPI_MAX_TABLES];
+    uint32_t nr_tables;
+
+    if (!acpi_root_probed)
+        acpi_probe_root();
+    if (!acpi_root_phys)
+        return NULL;
+
+    struct acpi_table_header_struct *root = acpi_early_map(acpi_root_phys, sizeof(*root));
+    if (!root)
+        return NULL;
+    root = acpi_early_map(acpi_root_phys, root->length);
+    if (!root || acpi_checksum(root, root->length)) {
+        warnk("ACPI: bad root table at %#lx\n", acpi_root_phys);
+        return NULL;
+    }
+
+    // 先拷出表指针，之后映射其他表时窗口会被覆盖
+    nr_tables = (root->length - sizeof(*root)) / (acpi_root_xsdt ? 8 : 4);
+    if (nr_tables > ACPI_MAX_TABLES)
+        nr_tables = ACPI_MAX_TABLES;
+    for (uint32_t i = 0; i < nr_tables; i++) {
+        uint8_t *entry = (uint8_t *)(root + 1);
+        tables[i] = acpi_root_xsdt ? ((uint64_t *)entry)[i] : ((uint32_t *)entry)[i];
+    }
+
+    for (uint32_t i = 0; i < nr_tables; i++) {
+        struct acpi_table_header_struct *table = acpi_early_map(tables[i], sizeof(*table));
+        if (!table || !acpi_signature_match(table->signature, signature, 4))
+            continue;
+
+        table = acpi_early_map(tables[i], table->length);
+        if (!table || acpi_checksum(table, table->length)) {
+            warnk("ACPI: %s at %#lx failed checksum\n", signature, tables[i]);
+            continue;
+        }
+        return table;
+    }
+    return NULL;
+}
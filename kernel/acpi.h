@@ -0,0 +1,110 @@
+#ifndef __ACPI_H__
+#define __ACPI_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define ACPI_EBDA_PTR       0x40e       // BDA中保存EBDA段地址的位置
+#define ACPI_BIOS_START     0xe0000     // BIOS只读区，RSDP按16字节对齐存放在此范围内
+#define ACPI_BIOS_END       0x100000
+#define ACPI_MAX_TABLES     64          // RSDT/XSDT中最多检查的表数量
+
+// 早期映射窗口：借用启动页目录(管理0~1G直接映射区)末尾的两个2M项，
+// 在页表管理初始化之前临时访问ACPI表(表可能位于保留区，不在启动映射范围内)
+#define ACPI_EARLY_MAP_SLOT 510
+#define ACPI_EARLY_MAP_SIZE (2 * 0x200000UL)
+
+// RSDP(根系统描述指针)
+struct acpi_rsdp_struct {
+    char signature[8];                  // "RSD PTR "
+    uint8_t checksum;                   // 前20字节校验和
+    char oem_id[6];
+    uint8_t revision;                   // 0为ACPI 1.0，2及以上带XSDT
+    uint32_t rsdt_address;              // RSDT物理地址
+    uint32_t length;                    // 以下为ACPI 2.0扩展字段
+    uint64_t xsdt_address;              // XSDT物理地址
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+// 所有系统描述表共用的表头
+struct acpi_table_header_struct {
+    char signature[4];
+    uint32_t length;                    // 含表头在内的表长度
+    uint8_t revision;
+    uint8_t checksum;                   // 整表校验和
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// SRAT(系统资源亲和表)
+struct acpi_srat_struct {
+    struct acpi_table_header_struct header;
+    uint32_t table_revision;
+    uint64_t reserved;
+} __attribute__((packed));
+
+#define ACPI_SRAT_CPU_AFFINITY      0   // 处理器Local APIC亲和结构
+#define ACPI_SRAT_MEMORY_AFFINITY   1   // 内存亲和结构
+#define ACPI_SRAT_X2APIC_AFFINITY   2   // 处理器x2APIC亲和结构
+
+#define ACPI_SRAT_ENABLED           0x1 // 亲和结构有效
+
+struct acpi_srat_entry_header_struct {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct acpi_srat_cpu_affinity_struct {
+    struct acpi_srat_entry_header_struct header;
+    uint8_t proximity_domain_lo;        // 邻近域低8位
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t local_sapic_eid;
+    uint8_t proximity_domain_hi[3];     // 邻近域高24位
+    uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_memory_affinity_struct {
+    struct acpi_srat_entry_header_struct header;
+    uint32_t proximity_domain;
+    uint16_t reserved1;
+    uint64_t base_address;
+    uint64_t length;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint64_t reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic_affinity_struct {
+    struct acpi_srat_entry_header_struct header;
+    uint16_t reserved1;
+    uint32_t proximity_domain;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((packed));
+
+// SLIT(系统局部距离信息表)：locality_count x locality_count的距离矩阵，按邻近域编号索引
+struct acpi_slit_struct {
+    struct acpi_table_header_struct header;
+    uint64_t locality_count;
+    uint8_t entry[];
+} __attribute__((packed));
+
+void *acpi_early_map(uint64_t phys_addr, uint64_t size);
+void acpi_early_unmap(void);
+void *acpi_find_table(const char *signature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
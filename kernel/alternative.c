@@ -0,0 +1,95 @@
+#include "alternative.h"
+#include "jump_label.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "printk.h"
+
+// Intel推荐的1~8字节NOP，按长度索引
+static const uint8_t x86_nops[9][8] = {
+    [1] = { 0x90 },
+    [2] = { 0x66, 0x90 },
+    [3] = { 0x0f, 0x1f, 0x00 },
+    [4] = { 0x0f, 0x1f, 0x40, 0x00 },
+    [5] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+    [6] = { 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+    [7] = { 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+    [8] = { 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+static uint32_t nr_alt_patched = 0;     // 已替换的指令序列数
+
+/**
+ * @brief 用尽量少的多字节NOP填满buf
+ */
+static void add_nops(uint8_t *buf, uint32_t len) {
+    while (len) {
+        uint32_t n = len > 8 ? 8 : len;
+        for (uint32_t i = 0; i < n; i++)
+            buf[i] = x86_nops[n][i];
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief 改写内核代码
+ *
+ * 关中断并临时清除CR0.WP，即使代码页映射为只读也能写入；逐字节写入，不依赖可能正被改写的memcpy。
+ * 写完后执行串行化指令，保证之后取到的是新指令。目前只有BSP在运行，启动AP后须改为先通知其他CPU。
+ */
+void text_poke(void *addr, const void *opcode, uint32_t len) {
+    uint64_t flags = local_irq_save();
+    uint64_t cr0 = read_cr0();
+
+    write_cr0(cr0 & ~CR0_WP);
+    for (uint32_t i = 0; i < len; i++)
+        ((volatile uint8_t *)addr)[i] = ((const uint8_t *)opcode)[i];
+    write_cr0(cr0);
+    sync_core();
+    local_irq_restore(flags);
+}
+
+/**
+ * @brief 按特性位图替换.altinstructions登记的所有指令序列
+ *
+ * 同一处的多条记录按顺序应用，后面的覆盖前面的。替换序列以call/jmp rel32开头时按新位置修正偏移。
+ */
+void apply_alternatives(void) {
+    uint8_t buf[ALT_MAX_LEN];
+
+    for (struct alt_instr_struct *a = __alt_instructions; a < __alt_instructions_end; a++) {
+        if (!cpu_has(a->feature))
+            continue;
+        if (a->replacementlen > a->instrlen || a->instrlen > ALT_MAX_LEN) {
+            errk("alternatives: bad entry at %#018lx (len %u, replacement %u)\n", a->instr, a->instrlen,
+                 a->replacementlen);
+            continue;
+        }
+
+        const uint8_t *replacement = (const uint8_t *)a->replacement;
+        for (uint32_t i = 0; i < a->replacementlen; i++)
+            buf[i] = replacement[i];
+        if (a->replacementlen >= 5 && (buf[0] == 0xe8 || buf[0] == 0xe9)) {
+            int32_t rel = *(int32_t *)(buf + 1);
+            rel += (int64_t)a->replacement - (int64_t)a->instr;
+            *(int32_t *)(buf + 1) = rel;
+        }
+        add_nops(buf + a->replacementlen, a->instrlen - a->replacementlen);
+
+        text_poke((void *)a->instr, buf, a->instrlen);
+        nr_alt_patched++;
+    }
+}
+
+/**
+ * @brief 启动时改写代码：替换指令序列并使静态键判断处与键的初始状态一致
+ *
+ * 须在cpu_features_init之后、依赖这些判断处的模块初始化之前调用。
+ */
+void alternative_instructions(void) {
+    apply_alternatives();
+    jump_label_init();
+    logk("alternatives: %u of %lu sequences patched, %lu static branches\n", nr_alt_patched,
+         (uint64_t)(__alt_instructions_end - __alt_instructions),
+         (uint64_t)(__stop___jump_table - __start___jump_table));
+}
@@ -0,0 +1,90 @@
+#ifndef __ALTERNATIVE_H__
+#define __ALTERNATIVE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "cpufeature.h"
+
+#define __stringify_1(x)        #x
+#define __stringify(x)          __stringify_1(x)
+
+#define ALT_MAX_LEN             64      // 一处可替换指令序列(含填充)的最大长度
+
+// .altinstructions中的一条记录：CPU具有feature时，用replacement处的指令覆盖instr处的指令，余下部分填NOP
+struct alt_instr_struct {
+    uint64_t instr;                     // 原指令地址
+    uint64_t replacement;               // 替换指令地址(位于.altinstr_replacement)
+    uint16_t feature;                   // X86_FEATURE_*
+    uint8_t instrlen;                   // 原指令长度(含填充)
+    uint8_t replacementlen;             // 替换指令长度
+    uint32_t pad;
+};
+
+// 链接脚本导出的记录表边界
+extern struct alt_instr_struct __alt_instructions[], __alt_instructions_end[];
+
+/*
+ * 原指令之后用0x90填充到所有候选中最长的长度，保证替换不会越界。GAS的比较运算真为-1、假为0，
+ * .skip -(x > 0) * x 即在x为正时填充x个字节。
+ */
+#define alt_rlen(n)             "(66" #n "2f - 66" #n "1f)"
+#define alt_olen                "(662b - 661b)"
+#define alt_pad(n)              "(" alt_rlen(n) " - " alt_olen ")"
+#define alt_max(a, b)           "((" a ") ^ (((" a ") ^ (" b ")) & -(-((" a ") < (" b ")))))"
+
+#define ALTINSTR_ENTRY(feature, n)                                                                                     \
+    " .balign 8\n"                                                                                                     \
+    " .quad 661b\n"                                                                                                    \
+    " .quad 66" #n "1f\n"                                                                                              \
+    " .word " __stringify(feature) "\n"                                                                                \
+    " .byte 663b - 661b\n"                                                                                             \
+    " .byte " alt_rlen(n) "\n"                                                                                         \
+    " .long 0\n"
+
+#define ALTINSTR_REPLACEMENT(newinstr, n) "66" #n "1:\n\t" newinstr "\n66" #n "2:\n"
+
+/**
+ * @brief 启动时按CPU特性选择的指令序列
+ *
+ * 默认执行oldinstr；apply_alternatives发现CPU具有feature时原地换成newinstr。newinstr只能以
+ * call/jmp rel32开头时含相对寻址(会被修正)，其余指令须与位置无关。
+ */
+#define ALTERNATIVE(oldinstr, newinstr, feature)                                                                       \
+    "661:\n\t" oldinstr "\n662:\n"                                                                                     \
+    " .skip -(" alt_pad(6) " > 0) * " alt_pad(6) ", 0x90\n"                                                            \
+    "663:\n"                                                                                                           \
+    " .pushsection .altinstructions, \"a\"\n"                                                                          \
+    ALTINSTR_ENTRY(feature, 6)                                                                                         \
+    " .popsection\n"                                                                                                   \
+    " .pushsection .altinstr_replacement, \"ax\"\n"                                                                    \
+    ALTINSTR_REPLACEMENT(newinstr, 6)                                                                                  \
+    " .popsection\n"
+
+/**
+ * @brief 两个候选的ALTERNATIVE，按顺序应用，两个特性都具备时newinstr2生效
+ */
+#define ALTERNATIVE_2(oldinstr, newinstr1, feature1, newinstr2, feature2)                                              \
+    "661:\n\t" oldinstr "\n662:\n"                                                                                     \
+    " .skip -(" alt_max(alt_pad(6), alt_pad(7)) " > 0) * " alt_max(alt_pad(6), alt_pad(7)) ", 0x90\n"                  \
+    "663:\n"                                                                                                           \
+    " .pushsection .altinstructions, \"a\"\n"                                                                          \
+    ALTINSTR_ENTRY(feature1, 6)                                                                                        \
+    ALTINSTR_ENTRY(feature2, 7)                                                                                        \
+    " .popsection\n"                                                                                                   \
+    " .pushsection .altinstr_replacement, \"ax\"\n"                                                                    \
+    ALTINSTR_REPLACEMENT(newinstr1, 6)                                                                                 \
+    ALTINSTR_REPLACEMENT(newinstr2, 7)                                                                                 \
+    " .popsection\n"
+
+void text_poke(void *addr, const void *opcode, uint32_t len);
+void apply_alternatives(void);
+void alternative_instructions(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+#include "bench.h"
+#include "memory.h"
+#include "printk.h"
+#include "cpu.h"
+#include "lib.h"
+#include "mm.h"
+#include "pgtable.h"
+#include "string.h"
+#include "fpu.h"
+
+// 仓库原有的32字节页框描述符布局，只用于与当前布局对比元信息大小和遍历开销
+struct bench_original_page_frame_struct {
+    struct memory_zone_struct *zone;
+    uint64_t pfn;
+    uint16_t ref_count;
+    uint32_t flags;
+    enum page_size page_size;
+};
+
+// 压缩之前为buddy链表、阶数和私有数据扩充到56字节的布局
+struct bench_grown_page_frame_struct {
+    struct memory_zone_struct *zone;
+    uint64_t pfn;
+    uint16_t ref_count;
+    uint32_t flags;
+    enum page_size page_size;
+    uint8_t order;
+    uint64_t private;
+    struct list_head list;
+};
+
+static const struct {
+    const char *name;
+    uint64_t size;
+    uint64_t flags_offset;
+} bench_frame_layouts[] = {
+    { "original", sizeof(struct bench_original_page_frame_struct),
+      offsetof(struct bench_original_page_frame_struct, flags) },
+    { "grown", sizeof(struct bench_grown_page_frame_struct), offsetof(struct bench_grown_page_frame_struct, flags) },
+    { "packed", sizeof(struct page_frame_struct), offsetof(struct page_frame_struct, flags) },
+};
+
+/**
+ * @brief 按给定布局遍历nr个描述符的flags，统计空闲页框数
+ * @return 遍历用的周期数
+ */
+static uint64_t bench_walk_frames(const uint8_t *base, uint64_t stride, uint64_t flags_offset, uint64_t nr,
+                                  uint64_t *nr_free) {
+    uint64_t start = rdtsc();
+
+    *nr_free = 0;
+    for (uint64_t i = 0; i < nr; i++) {
+        if (!(*(const uint32_t *)(base + i * stride + flags_offset) & (PAGE_USED | PAGE_RESERVED)))
+            (*nr_free)++;
+    }
+    return rdtsc() - start;
+}
+
+/**
+ * @brief 页框描述符布局对比：每GB内存的元信息字节数，以及同样页框数下顺序遍历的开销
+ *
+ * 基准是仓库原有的32字节布局；56字节的中间布局一并列出。每种布局在同一块缓冲区中建一个
+ * BENCH_WALK_FRAMES项的数组，每4个页框标记1个已使用。
+ */
+static void bench_frame_layout(void) {
+    uint32_t nr_layouts = sizeof(bench_frame_layouts) / sizeof(bench_frame_layouts[0]);
+    uint64_t frames_per_gb = PAGE_1G_SIZE / PAGE_2M_SIZE;
+    uint64_t max_size = 0;
+
+    for (uint32_t l = 0; l < nr_layouts; l++) {
+        if (bench_frame_layouts[l].size > max_size)
+            max_size = bench_frame_layouts[l].size;
+    }
+
+    uint32_t nr_pages = (BENCH_WALK_FRAMES * max_size + PAGE_2M_SIZE - 1) / PAGE_2M_SIZE;
+    struct page_frame_struct *buf = alloc_pages(ZONE_NORMAL, nr_pages, PAGE_KERNEL);
+    if (!buf) {
+        warnk("[bench] frame walk: out of memory for descriptor arrays\n");
+        return;
+    }
+    uint8_t *base = page_to_virt(buf);
+
+    for (uint32_t l = 0; l < nr_layouts; l++) {
+        uint64_t size = bench_frame_layouts[l].size;
+        uint64_t offset = bench_frame_layouts[l].flags_offset;
+        uint64_t nr_free;
+
+        memset(base, 0, BENCH_WALK_FRAMES * size);
+        for (uint64_t i = 0; i < BENCH_WALK_FRAMES; i += 4)
+            *(uint32_t *)(base + i * size + offset) = PAGE_USED;
+
+        uint64_t cycles = bench_walk_frames(base, size, offset, BENCH_WALK_FRAMES, &nr_free);
+        logk("[bench] frame layout %-8s: %2lu bytes, %5lu bytes/GB, walk %u frames (%lu KB) %lu cycles/frame\n",
+             bench_frame_layouts[l].name, size, size * frames_per_gb, BENCH_WALK_FRAMES,
+             (BENCH_WALK_FRAMES * size) >> 10, cycles / BENCH_WALK_FRAMES);
+    }
+
+    free_pages(buf, nr_pages);
+}
+
+/**
+ * @brief 页框元信息与页框分配性能测试
+ *
+ * 输出页框描述符占用及与原有32字节布局的对比、遍历全部描述符的开销，单页/多页alloc_pages与free_pages的
+ * 平均周期数，以及预清零池与分配后memset两种方式取得清零页的开销。
+ */
+void bench_page_frames(void) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint64_t count = global_memory_manager_struct.page.count;
+    uint64_t nr_free = 0;
+    uint64_t start, cycles;
+
+    logk("[bench] page frame: %lu bytes x %lu frames, %lu KB metadata mapped (%lu KB if dense)\n",
+         sizeof(struct page_frame_struct), count, global_memory_manager_struct.page.size >> 10,
+         (sizeof(struct page_frame_struct) * count) >> 10);
+    bench_frame_layout();
+
+    // 1. 遍历已初始化section的页框描述符(模拟统计、扫描类操作的访存模式)
+    start = rdtsc();
+    for (uint64_t pfn = 0; pfn < count; pfn++) {
+        if (!section_initialized(pfn_to_section(pfn))) {
+            pfn |= PAGE_SECTION_PAGES - 1;
+            continue;
+        }
+        if (!(pages[pfn].flags & (PAGE_USED | PAGE_RESERVED)))
+            nr_free++;
+    }
+    cycles = rdtsc() - start;
+    logk("[bench] frame walk: %lu frames (%lu free) in %lu cycles, %lu cycles/frame\n", count, nr_free, cycles,
+         count ? cycles / count : 0);
+
+    // 2. 单页分配/释放(走per-CPU缓存)
+    struct page_frame_struct *batch[BENCH_ROUNDS / 8];
+    uint32_t allocated = 0;
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+        struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL);
+        if (!page)
+            break;
+        free_pages(page, 1);
+        allocated++;
+    }
+    cycles = rdtsc() - start;
+    logk("[bench] alloc/free 1 page: %u rounds, %lu cycles/round\n", allocated, allocated ? cycles / allocated : 0);
+
+    // 3. 批量单页分配后统一释放(超出per-CPU缓存，触发buddy拆分与合并)
+    uint32_t nr_batch = sizeof(batch) / sizeof(batch[0]);
+    allocated = 0;
+    start = rdtsc();
+    for (uint32_t i = 0; i < nr_batch; i++) {
+        batch[i] = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL);
+        if (!batch[i])
+            break;
+        allocated++;
+    }
+    for (uint32_t i = 0; i < allocated; i++)
+        free_pages(batch[i], 1);
+    cycles = rdtsc() - start;
+    logk("[bench] batch alloc+free %u pages: %lu cycles/page\n", allocated, allocated ? cycles / allocated : 0);
+
+    // 4. 多页(16个2M页)分配/释放
+    allocated = 0;
+    start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+        struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 16, PAGE_KERNEL);
+        if (!page)
+            break;
+        free_pages(page, 16);
+        allocated++;
+    }
+    cycles = rdtsc() - start;
+    logk("[bench] alloc/free 16 pages: %u rounds, %lu cycles/round\n", allocated, allocated ? cycles / allocated : 0);
+
+    // 5. 清零单页：预清零池 vs 分配后memset(先同步填满池，模拟空闲时已补充完毕)
+    struct page_frame_struct *zeroed[ZERO_POOL_PAGES];
+    uint64_t pool_cycles, memset_cycles;
+
+    while (zero_pool_refill())
+        ;
+    allocated = 0;
+    start = rdtsc();
+    for (uint32_t i = 0; i < ZERO_POOL_PAGES; i++) {
+        zeroed[i] = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | ALLOC_ZERO);
+        if (!zeroed[i])
+            break;
+        allocated++;
+    }
+    pool_cycles = rdtsc() - start;
+    for (uint32_t i = 0; i < allocated; i++)
+        free_pages(zeroed[i], 1);
+
+    uint32_t nr_memset = 0;
+    start = rdtsc();
+    for (uint32_t i = 0; i < ZERO_POOL_PAGES; i++) {
+        zeroed[i] = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL);
+        if (!zeroed[i])
+            break;
+        memset(page_to_virt(zeroed[i]), 0, PAGE_2M_SIZE);
+        nr_memset++;
+    }
+    memset_cycles = rdtsc() - start;
+    for (uint32_t i = 0; i < nr_memset; i++)
+        free_pages(zeroed[i], 1);
+
+    logk("[bench] zeroed page: pool %lu cycles/page (%u pages), alloc+memset %lu cycles/page (%u pages)\n",
+         allocated ? pool_cycles / allocated : 0, allocated, nr_memset ? memset_cycles / nr_memset : 0, nr_memset);
+}
+
+/**
+ * @brief 地址空间切换性能测试
+ *
+ * 两个地址空间各映射16个4K页，来回切换并逐页读取一遍，输出每次切换加访问的平均周期数。
+ * 开启PCID后切换回来时TLB条目仍然有效，访问不再触发页表遍历。
+ */
+void bench_tlb(void) {
+    struct mm_struct *mm[2] = { mm_create(), mm_create() };
+    uint64_t phys[2] = { alloc_pages_4k(BENCH_TLB_PAGES), alloc_pages_4k(BENCH_TLB_PAGES) };
+    uint64_t base = 0x40000000UL;
+    uint64_t start, cycles, sum = 0;
+
+    if (!mm[0] || !mm[1] || !phys[0] || !phys[1])
+        goto out;
+
+    for (uint32_t i = 0; i < 2; i++) {
+        if (map_pages(mm[i]->pml4, base, phys[i], BENCH_TLB_PAGES * PAGE_4K_SIZE, PAGE_4K,
+                      PAGE_PRESENT | PAGE_WRITABLE))
+            goto out;
+    }
+
+    start = rdtsc();
+    for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+        mm_switch(mm[round & 1]);
+        for (uint32_t page = 0; page < BENCH_TLB_PAGES; page++)
+            sum += *(volatile uint64_t *)(base + page * PAGE_4K_SIZE);
+    }
+    cycles = rdtsc() - start;
+    mm_switch(&init_mm);
+    logk("[bench] mm switch + %u page reads: %lu cycles/round (sum %lu)\n", BENCH_TLB_PAGES, cycles / BENCH_ROUNDS,
+         sum);
+    tlb_info();
+
+out:
+    for (uint32_t i = 0; i < 2; i++) {
+        mm_destroy(mm[i]);
+        if (phys[i])
+            free_pages_4k(phys[i], BENCH_TLB_PAGES);
+    }
+}
+
+/**
+ * @brief 按长度扫描各memcpy/memset实现的开销
+ *
+ * 每个长度下依次测试CPU支持的每种实现以及按长度分派后的memcpy/memset(auto)，输出每次调用的平均周期数，
+ * 用于确认string.h中各档分界和memops_init的选择。源和目标各8MB，大长度时超出多数CPU的末级缓存。
+ */
+void bench_memops(void) {
+    static const uint64_t sizes[] = { 64, 256, 1024, 4096, 65536, 1UL << 20, PAGE_2M_SIZE, 8UL << 20 };
+    struct page_frame_struct *src_pages = alloc_pages(ZONE_NORMAL, BENCH_MEMOPS_PAGES, PAGE_KERNEL);
+    struct page_frame_struct *dst_pages = alloc_pages(ZONE_NORMAL, BENCH_MEMOPS_PAGES, PAGE_KERNEL);
+    uint64_t start;
+
+    if (!src_pages || !dst_pages)
+        goto out;
+
+    uint8_t *src = page_to_virt(src_pages);
+    uint8_t *dst = page_to_virt(dst_pages);
+    memset(src, 0xa5, BENCH_MEMOPS_PAGES * PAGE_2M_SIZE);
+
+    for (uint32_t op = 0; op < 2; op++) {
+        for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            uint64_t size = sizes[i];
+            uint64_t rounds = BENCH_MEMOPS_BYTES / size;
+            uint64_t stride = size < PAGE_2M_SIZE ? size : 0;   // 小长度依次写不同位置，避免一直命中同一组缓存行
+
+            printk("[bench] %s %7lu B:", op ? "memset" : "memcpy", size);
+            for (uint32_t v = 0; v <= MEMOPS_NR_VARIANTS; v++) {
+                const char *name = v < MEMOPS_NR_VARIANTS ? memops_variants[v].name : "auto";
+                if (v < MEMOPS_NR_VARIANTS && (memops_variants[v].requires & ~memops.features))
+                    continue;
+
+                uint64_t offset = 0;
+                start = rdtsc();
+                for (uint64_t r = 0; r < rounds; r++) {
+                    if (v == MEMOPS_NR_VARIANTS)
+                        op ? memset(dst + offset, r, size) : memcpy(dst + offset, src + offset, size);
+                    else if (op)
+                        memops_variants[v].set(dst + offset, r, size);
+                    else
+                        memops_variants[v].copy(dst + offset, src + offset, size);
+                    offset += stride;
+                    if (offset + size > BENCH_MEMOPS_PAGES * PAGE_2M_SIZE)
+                        offset = 0;
+                }
+                printk(" %s %lu", name, (rdtsc() - start) / rounds);
+            }
+            printk(" cycles/call\n");
+        }
+    }
+
+    // 重叠复制：目标在源之后(反向)与之前(正向)
+    start = rdtsc();
+    for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+        memmove(dst + 64, dst, 65536);
+    uint64_t backward = (rdtsc() - start) / BENCH_ROUNDS;
+    start = rdtsc();
+    for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+        memmove(dst, dst + 64, 65536);
+    logk("[bench] memmove 65536 B: backward %lu, forward %lu cycles/call\n", backward,
+         (rdtsc() - start) / BENCH_ROUNDS);
+
+out:
+    if (src_pages)
+        free_pages(src_pages, BENCH_MEMOPS_PAGES);
+    if (dst_pages)
+        free_pages(dst_pages, BENCH_MEMOPS_PAGES);
+}
+
+/**
+ * @brief 各字符串实现的开销：逐字节参考实现、按字与SSE2，输出每次调用的平均周期数
+ *
+ * strlen/strcmp的字符串与memchr/memcmp的缓冲区都在缓存中(4K页内)，目标字节位于末尾。
+ */
+void bench_strings(void) {
+    static const uint32_t lengths[] = { 16, 64, 256, 4000 };
+    uint64_t phys = alloc_pages_4k(2);
+    uint64_t start;
+
+    if (!phys)
+        return;
+
+    char *a = PHYS_TO_VIRT(phys);
+    char *b = a + PAGE_4K_SIZE;
+    for (uint32_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        uint32_t len = lengths[i];
+        memset(a, 'x', len);
+        a[len] = '\0';
+        memcpy(b, a, len + 1);
+
+        for (uint32_t v = 0; v < STROPS_NR_VARIANTS; v++) {
+            const struct strops_variant_struct *x = &strops_variants[v];
+            uint64_t cycles[4];
+            uint64_t sum = 0;
+
+            if (x->requires & ~memops.features)
+                continue;
+            start = rdtsc();
+            for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+                sum += x->strlen(a);
+            cycles[0] = rdtsc() - start;
+            start = rdtsc();
+            for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+                sum += x->strcmp(a, b);
+            cycles[1] = rdtsc() - start;
+            start = rdtsc();
+            for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+                sum += (uint64_t)x->memchr(a, '\0', len + 1);
+            cycles[2] = rdtsc() - start;
+            start = rdtsc();
+            for (uint32_t r = 0; r < BENCH_ROUNDS; r++)
+                sum += x->memcmp(a, b, len);
+            cycles[3] = rdtsc() - start;
+
+            logk("[bench] %4u B %s: strlen %lu, strcmp %lu, memchr %lu, memcmp %lu cycles/call (sum %lu)\n", len,
+                 x->name, cycles[0] / BENCH_ROUNDS, cycles[1] / BENCH_ROUNDS, cycles[2] / BENCH_ROUNDS,
+                 cycles[3] / BENCH_ROUNDS, sum);
+        }
+    }
+    free_pages_4k(phys, 2);
+}
+
+/**
+ * @brief 进出SIMD段的开销：最外层(只切换MXCSR)与嵌套一层(保存并恢复被打断的扩展状态)
+ */
+void bench_kernel_fpu(void) {
+    uint64_t start, outer, nested;
+
+    start = rdtsc();
+    for (uint32_t r = 0; r < BENCH_ROUNDS; r++) {
+        kernel_fpu_begin();
+        kernel_fpu_end();
+    }
+    outer = rdtsc() - start;
+
+    kernel_fpu_begin();
+    start = rdtsc();
+    for (uint32_t r = 0; r < BENCH_ROUNDS; r++) {
+        kernel_fpu_begin();
+        kernel_fpu_end();
+    }
+    nested = rdtsc() - start;
+    kernel_fpu_end();
+
+    logk("[bench] kernel_fpu_begin/end (%s, %u B): outer %lu, nested %lu cycles/pair\n", fpu_info.method,
+         fpu_info.state_size, outer / BENCH_ROUNDS, nested / BENCH_ROUNDS);
+}
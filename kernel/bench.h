@@ -0,0 +1,26 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define BENCH_ROUNDS 256            // 每项测试的重复次数
+#define BENCH_WALK_FRAMES 262144    // 新旧页框描述符布局对比遍历的页框数(相当于512GB内存)
+#define BENCH_TLB_PAGES 16          // 地址空间切换测试中每个地址空间访问的页数
+#define BENCH_MEMOPS_PAGES 4        // memcpy/memset测试的源和目标缓冲区各占的2M页数
+#define BENCH_MEMOPS_BYTES (64UL << 20)     // 每个长度每种实现累计处理的字节数(决定重复次数)
+
+void bench_page_frames(void);
+void bench_tlb(void);
+void bench_memops(void);
+void bench_strings(void);
+void bench_kernel_fpu(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,7 +13,7 @@ extern "C" {
 /**
  * @brief CPUID指令封装
  */
-void cpuid(int32_t code, int32_t *eax, int32_t *ebx, int32_t *ecx, int32_t *edx) {
+static inline void cpuid(int32_t code, int32_t *eax, int32_t *ebx, int32_t *ecx, int32_t *edx) {
     __asm__ __volatile__ ("cpuid"
                           : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
                           : "a"(code));
@@ -22,7 +22,7 @@ void cpuid(int32_t code, int32_t *eax, int32_t *ebx, int32_t *ecx, int32_t *edx)
 /**
  * @brief 支持 leaf 和 subleaf 的 CPUID 封装
  */
-void cpuid_count(int32_t leaf, int32_t subleaf, int32_t *eax, int32_t *ebx, int32_t *ecx, int32_t *edx) {
+static inline void cpuid_count(int32_t leaf, int32_t subleaf, int32_t *eax, int32_t *ebx, int32_t *ecx, int32_t *edx) {
     __asm__ __volatile__ (
         "cpuid"
         : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
@@ -30,10 +30,104 @@ void cpuid_count(int32_t leaf, int32_t subleaf, int32_t *eax, int32_t *ebx, int3
     );
 }
 
+/**
+ * @brief 读取MSR寄存器
+ */
+static inline uint64_t __attribute__((always_inline)) rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    __asm__ __volatile__("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 写入MSR寄存器
+ */
+static inline void __attribute__((always_inline)) wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+static inline uint64_t __attribute__((always_inline)) read_cr0(void) {
+    uint64_t value;
+    __asm__ __volatile__("movq %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void __attribute__((always_inline)) write_cr0(uint64_t value) {
+    __asm__ __volatile__("movq %0, %%cr0" : : "r"(value) : "memory");
+}
+
+#define CR0_MP          (1UL << 1)      // WAIT/FWAIT遵循CR0.TS
+#define CR0_EM          (1UL << 2)      // 无x87/SSE硬件(置位时SSE指令#UD)
+#define CR0_TS          (1UL << 3)      // 任务已切换，置位时x87/SSE/AVX指令触发#NM
+#define CR0_WP          (1UL << 16)     // 内核态写只读页同样触发#PF
+
+static inline uint64_t __attribute__((always_inline)) read_cr3(void) {
+    uint64_t value;
+    __asm__ __volatile__("movq %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void __attribute__((always_inline)) write_cr3(uint64_t value) {
+    __asm__ __volatile__("movq %0, %%cr3" : : "r"(value) : "memory");
+}
+
+#define CR4_OSFXSR      (1UL << 9)      // 操作系统支持FXSAVE/FXRSTOR，允许使用SSE指令
+#define CR4_OSXMMEXCPT  (1UL << 10)     // 未屏蔽的SIMD浮点异常以#XM报告
+#define CR4_OSXSAVE     (1UL << 18)     // 操作系统支持XSAVE系列指令与XCR0
+
+static inline uint64_t __attribute__((always_inline)) read_cr4(void) {
+    uint64_t value;
+    __asm__ __volatile__("movq %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void __attribute__((always_inline)) write_cr4(uint64_t value) {
+    __asm__ __volatile__("movq %0, %%cr4" : : "r"(value) : "memory");
+}
+
+/**
+ * @brief 读取时间戳计数器(lfence保证之前的指令已执行完毕)
+ */
+static inline uint64_t __attribute__((always_inline)) rdtsc(void) {
+    uint32_t low, high;
+    __asm__ __volatile__("lfence\n\trdtsc" : "=a"(low), "=d"(high) : : "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 串行化指令流(CPUID)，保证之后取到的是改写后的指令
+ */
+static inline void __attribute__((always_inline)) sync_core(void) {
+    int32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+}
+
+/**
+ * @brief 读取扩展控制寄存器(需要CR4.OSXSAVE，可由CPUID.1:ECX[27]判断)
+ */
+static inline uint64_t __attribute__((always_inline)) xgetbv(uint32_t index) {
+    uint32_t low, high;
+    __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(index));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief 写入扩展控制寄存器(需要CR4.OSXSAVE)
+ */
+static inline void __attribute__((always_inline)) xsetbv(uint32_t index, uint64_t value) {
+    __asm__ __volatile__("xsetbv" : : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+#define XCR0_SSE        (1UL << 1)      // XMM状态
+#define XCR0_AVX        (1UL << 2)      // YMM高128位状态
+
+#define MSR_EFER        0xC0000080      // IA32_EFER
+#define EFER_NXE        (1UL << 11)     // 允许使用页表NX位
+
 /**
  * @brief 获取CPU名称
  */
-void cpu_name(char *cpu_name) {
+static inline void cpu_name(char *cpu_name) {
     int32_t cpu_info[4];
 
     cpuid(0x80000002, &cpu_info[0], &cpu_info[1], &cpu_info[2], &cpu_info[3]);
@@ -49,7 +143,7 @@ void cpu_name(char *cpu_name) {
 /**
  * @brief 获取CPU物理核心数量
  */
-uint32_t cpu_physical_cores() {
+static inline uint32_t cpu_physical_cores() {
     int32_t eax, ebx, ecx, edx;
 
     // 检查是否支持 CPUID 0x0B
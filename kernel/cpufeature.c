@@ -0,0 +1,59 @@
+#include "cpufeature.h"
+#include "cpu.h"
+#include "printk.h"
+
+uint32_t cpu_caps[NCAPINTS];
+
+// 启动日志中列出的特性
+static const struct {
+    uint32_t feature;
+    const char *name;
+} cpu_feature_names[] = {
+    { X86_FEATURE_PGE, "pge" },           { X86_FEATURE_XMM2, "sse2" },         { X86_FEATURE_XMM4_2, "sse4_2" },
+    { X86_FEATURE_MWAIT, "mwait" },       { X86_FEATURE_PCID, "pcid" },         { X86_FEATURE_INVPCID, "invpcid" },
+    { X86_FEATURE_XSAVE, "xsave" },       { X86_FEATURE_XSAVEOPT, "xsaveopt" }, { X86_FEATURE_XSAVES, "xsaves" },
+    { X86_FEATURE_AVX, "avx" },           { X86_FEATURE_AVX2, "avx2" },         { X86_FEATURE_ERMS, "erms" },
+    { X86_FEATURE_FSRM, "fsrm" },         { X86_FEATURE_SMEP, "smep" },         { X86_FEATURE_SMAP, "smap" },
+    { X86_FEATURE_NX, "nx" },             { X86_FEATURE_GBPAGES, "gbpages" },
+};
+
+/**
+ * @brief 执行CPUID填充特性位图
+ *
+ * 须在fpu_init、memops_init和apply_alternatives之前调用。需要操作系统开启寄存器状态的特性
+ * (AVX/AVX2)由fpu_init根据XCR0的结果修正。
+ */
+void cpu_features_init(void) {
+    int32_t eax, ebx, ecx, edx;
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    cpu_caps[CPUID_1_EDX] = edx;
+    cpu_caps[CPUID_1_ECX] = ecx;
+
+    if (max_leaf >= 7) {
+        cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+        cpu_caps[CPUID_7_0_EBX] = ebx;
+        cpu_caps[CPUID_7_0_ECX] = ecx;
+        cpu_caps[CPUID_7_0_EDX] = edx;
+    }
+    if (max_leaf >= 0xd) {
+        cpuid_count(0xd, 1, &eax, &ebx, &ecx, &edx);
+        cpu_caps[CPUID_D_1_EAX] = eax;
+    }
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if ((uint32_t)eax >= 0x80000001) {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        cpu_caps[CPUID_8000_0001_EDX] = edx;
+    }
+
+    logk("CPU features:");
+    for (uint32_t i = 0; i < sizeof(cpu_feature_names) / sizeof(cpu_feature_names[0]); i++) {
+        if (cpu_has(cpu_feature_names[i].feature))
+            printk(" %s", cpu_feature_names[i].name);
+    }
+    printk("\n");
+}
@@ -0,0 +1,69 @@
+#ifndef __CPUFEATURE_H__
+#define __CPUFEATURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// 特性位图：启动时执行一次CPUID填充，之后各模块只查位图，不再各自执行CPUID
+#define CPUID_1_EDX             0       // CPUID.1:EDX
+#define CPUID_1_ECX             1       // CPUID.1:ECX
+#define CPUID_7_0_EBX           2       // CPUID.(EAX=07H,ECX=0):EBX
+#define CPUID_7_0_ECX           3       // CPUID.(EAX=07H,ECX=0):ECX
+#define CPUID_7_0_EDX           4       // CPUID.(EAX=07H,ECX=0):EDX
+#define CPUID_8000_0001_EDX     5       // CPUID.80000001H:EDX
+#define CPUID_D_1_EAX           6       // CPUID.(EAX=0DH,ECX=1):EAX
+#define NCAPINTS                7       // 位图字数
+
+// 特性编号 = 字号 * 32 + 位号；写成算术表达式，同时可以在汇编(ALTERNATIVE)中使用
+#define X86_FEATURE_FPU         (CPUID_1_EDX * 32 + 0)          // x87
+#define X86_FEATURE_PGE         (CPUID_1_EDX * 32 + 13)         // 全局页
+#define X86_FEATURE_FXSR        (CPUID_1_EDX * 32 + 24)         // FXSAVE/FXRSTOR
+#define X86_FEATURE_XMM         (CPUID_1_EDX * 32 + 25)         // SSE
+#define X86_FEATURE_XMM2        (CPUID_1_EDX * 32 + 26)         // SSE2
+#define X86_FEATURE_XMM3        (CPUID_1_ECX * 32 + 0)          // SSE3
+#define X86_FEATURE_MWAIT       (CPUID_1_ECX * 32 + 3)          // MONITOR/MWAIT
+#define X86_FEATURE_PCID        (CPUID_1_ECX * 32 + 17)         // 进程上下文标识符
+#define X86_FEATURE_XMM4_2      (CPUID_1_ECX * 32 + 20)         // SSE4.2
+#define X86_FEATURE_XSAVE       (CPUID_1_ECX * 32 + 26)         // XSAVE/XRSTOR/XGETBV/XSETBV
+#define X86_FEATURE_OSXSAVE     (CPUID_1_ECX * 32 + 27)         // CR4.OSXSAVE已开启(由fpu_init设置)
+#define X86_FEATURE_AVX         (CPUID_1_ECX * 32 + 28)         // AVX(fpu_init确认XCR0已开启YMM状态)
+#define X86_FEATURE_AVX2        (CPUID_7_0_EBX * 32 + 5)        // AVX2(fpu_init确认XCR0已开启YMM状态)
+#define X86_FEATURE_SMEP        (CPUID_7_0_EBX * 32 + 7)        // 禁止内核执行用户页
+#define X86_FEATURE_ERMS        (CPUID_7_0_EBX * 32 + 9)        // 增强rep movsb/stosb
+#define X86_FEATURE_INVPCID     (CPUID_7_0_EBX * 32 + 10)       // INVPCID指令
+#define X86_FEATURE_SMAP        (CPUID_7_0_EBX * 32 + 20)       // 禁止内核访问用户页
+#define X86_FEATURE_FSRM        (CPUID_7_0_EDX * 32 + 4)        // 短rep movsb同样快速
+#define X86_FEATURE_NX          (CPUID_8000_0001_EDX * 32 + 20) // 页表NX位
+#define X86_FEATURE_GBPAGES     (CPUID_8000_0001_EDX * 32 + 26) // 1G页
+#define X86_FEATURE_LM          (CPUID_8000_0001_EDX * 32 + 29) // 长模式
+#define X86_FEATURE_XSAVEOPT    (CPUID_D_1_EAX * 32 + 0)        // XSAVEOPT
+#define X86_FEATURE_XSAVEC      (CPUID_D_1_EAX * 32 + 1)        // XSAVEC(压缩格式)
+#define X86_FEATURE_XSAVES      (CPUID_D_1_EAX * 32 + 3)        // XSAVES/XRSTORS
+
+extern uint32_t cpu_caps[NCAPINTS];
+
+/**
+ * @brief 查询特性位图(须在cpu_features_init之后调用)
+ */
+static inline uint8_t __attribute__((always_inline)) cpu_has(uint32_t feature) {
+    return (cpu_caps[feature / 32] >> (feature % 32)) & 1;
+}
+
+static inline void __attribute__((always_inline)) setup_clear_cpu_cap(uint32_t feature) {
+    cpu_caps[feature / 32] &= ~(1U << (feature % 32));
+}
+
+static inline void __attribute__((always_inline)) setup_force_cpu_cap(uint32_t feature) {
+    cpu_caps[feature / 32] |= 1U << (feature % 32);
+}
+
+void cpu_features_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "cpufeature.h"
+#include "alternative.h"
+#include "jump_label.h"
+#include "spinlock.h"
+#include "printk.h"
+
+struct fpu_info_struct fpu_info = { .method = "none" };
+
+static struct fpu_cpu_struct fpu_cpu[NR_CPUS];
+
+static DEFINE_STATIC_KEY_FALSE(fpu_xsave_key);     // 已开启CR4.OSXSAVE，用XSAVE系列指令保存(否则FXSAVE)
+
+/*
+ * 保存区地址固定放在rdi，各候选指令的编码长度相同；XSAVE系列按EDX:EAX给出的状态位保存。
+ * 启动时按CPUID改写为XSAVES(压缩格式、跳过初始状态)或XSAVEOPT(跳过自上次XRSTOR以来未修改的状态)。
+ */
+static inline void __attribute__((always_inline)) fpu_save(struct fpu_state_struct *state) {
+    uint32_t low = fpu_info.xfeatures, high = fpu_info.xfeatures >> 32;
+
+    if (static_branch_likely(&fpu_xsave_key)) {
+        __asm__ __volatile__(ALTERNATIVE_2("xsave64 (%%rdi)", "xsaveopt64 (%%rdi)", X86_FEATURE_XSAVEOPT,
+                                           "xsaves64 (%%rdi)", X86_FEATURE_XSAVES)
+                             :
+                             : "D"(state->area), "a"(low), "d"(high)
+                             : "memory");
+    } else {
+        __asm__ __volatile__("fxsave64 (%%rdi)" : : "D"(state->area) : "memory");
+    }
+}
+
+static inline void __attribute__((always_inline)) fpu_restore(struct fpu_state_struct *state) {
+    uint32_t low = fpu_info.xfeatures, high = fpu_info.xfeatures >> 32;
+
+    if (static_branch_likely(&fpu_xsave_key)) {
+        __asm__ __volatile__(ALTERNATIVE("xrstor64 (%%rdi)", "xrstors64 (%%rdi)", X86_FEATURE_XSAVES)
+                             :
+                             : "D"(state->area), "a"(low), "d"(high)
+                             : "memory");
+    } else {
+        __asm__ __volatile__("fxrstor64 (%%rdi)" : : "D"(state->area) : "memory");
+    }
+}
+
+/**
+ * @brief 开启x87/SSE/AVX状态并选择保存指令
+ *
+ * 须在cpu_features_init之后、alternative_instructions之前调用。XCR0未能开启YMM状态时
+ * 从特性位图中清除AVX/AVX2，位图中的向量特性在SIMD段内都可以直接使用。
+ */
+void fpu_init(void) {
+    int32_t eax, ebx, ecx, edx;
+
+    // 关闭x87模拟与惰性切换(不使用CR0.TS)，开启FXSAVE/SSE
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    __asm__ __volatile__("fninit");
+
+    if (cpu_has(X86_FEATURE_XSAVE)) {
+        write_cr4(read_cr4() | CR4_OSXSAVE);
+        setup_force_cpu_cap(X86_FEATURE_OSXSAVE);
+
+        // CPUID.(EAX=0DH,ECX=0):EDX:EAX为XCR0中可以开启的状态位
+        cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx);
+        fpu_info.xfeatures = (((uint64_t)(uint32_t)edx << 32) | (uint32_t)eax) & XFEATURE_MASK_KERNEL;
+        xsetbv(0, fpu_info.xfeatures);
+
+        if (cpu_has(X86_FEATURE_XSAVES)) {
+            // 压缩格式大小按XCR0 | IA32_XSS计算，须在写入两者之后读取
+            wrmsr(MSR_IA32_XSS, 0);
+            cpuid_count(0xd, 1, &eax, &ebx, &ecx, &edx);
+            fpu_info.method = "xsaves";
+        } else {
+            // 标准格式大小按当前XCR0计算
+            cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx);
+            fpu_info.method = cpu_has(X86_FEATURE_XSAVEOPT) ? "xsaveopt" : "xsave";
+        }
+        fpu_info.state_size = ebx;
+        static_key_enable(&fpu_xsave_key);
+    } else {
+        fpu_info.xfeatures = XFEATURE_MASK_FP | XFEATURE_MASK_SSE;
+        fpu_info.state_size = 512;
+        fpu_info.method = "fxsave";
+    }
+
+    if (!(fpu_info.xfeatures & XFEATURE_MASK_YMM)) {
+        setup_clear_cpu_cap(X86_FEATURE_AVX);
+        setup_clear_cpu_cap(X86_FEATURE_AVX2);
+    }
+
+    if (fpu_info.state_size > FPU_STATE_SIZE) {
+        fatalk("FPU: extended state needs %u bytes, save area is %u\n", fpu_info.state_size, FPU_STATE_SIZE);
+        while (1)
+            __asm__ volatile("hlt");
+        ;
+    }
+
+    logk("FPU: xcr0 %#lx, %s, %u bytes per save area\n", fpu_info.xfeatures, fpu_info.method, fpu_info.state_size);
+}
+
+/**
+ * @brief 进入SIMD段，之后可以使用x87/SSE/AVX寄存器，直到kernel_fpu_end
+ *
+ * 最外层不需要保存(段外的代码不使用向量寄存器)；嵌套进入(中断打断了另一个SIMD段)时先保存被打断的
+ * 寄存器。每层都从默认MXCSR开始。可以在中断处理中调用，不可在NMI中调用。
+ */
+void kernel_fpu_begin(void) {
+    uint64_t flags = local_irq_save();
+    struct fpu_cpu_struct *fpu = &fpu_cpu[smp_processor_id()];
+
+    if (fpu->depth >= FPU_NESTING_MAX) {
+        fatalk("kernel_fpu_begin: nesting deeper than %u\n", FPU_NESTING_MAX);
+        while (1)
+            __asm__ volatile("hlt");
+        ;
+    }
+    if (fpu->depth)
+        fpu_save(&fpu->save[fpu->depth - 1]);
+    fpu->depth++;
+
+    uint32_t mxcsr = MXCSR_DEFAULT;
+    __asm__ __volatile__("ldmxcsr %0" : : "m"(mxcsr));
+    local_irq_restore(flags);
+}
+
+/**
+ * @brief 离开SIMD段：嵌套时恢复被打断一层的寄存器；最外层清零YMM高半部分，避免之后的SSE指令付出状态切换代价
+ */
+void kernel_fpu_end(void) {
+    uint64_t flags = local_irq_save();
+    struct fpu_cpu_struct *fpu = &fpu_cpu[smp_processor_id()];
+
+    if (!fpu->depth) {
+        errk("kernel_fpu_end without kernel_fpu_begin\n");
+        local_irq_restore(flags);
+        return;
+    }
+    fpu->depth--;
+    if (fpu->depth)
+        fpu_restore(&fpu->save[fpu->depth - 1]);
+    else
+        __asm__ __volatile__(ALTERNATIVE("", "vzeroupper", X86_FEATURE_AVX));
+    local_irq_restore(flags);
+}
+
+/**
+ * @brief 当前CPU的SIMD段嵌套层数(0表示不在SIMD段内)
+ */
+uint8_t kernel_fpu_depth(void) {
+    return fpu_cpu[smp_processor_id()].depth;
+}
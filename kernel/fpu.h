@@ -0,0 +1,56 @@
+#ifndef __FPU_H__
+#define __FPU_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "smp.h"
+
+/*
+ * 内核以-mgeneral-regs-only编译，编译器生成的代码不会碰x87/SSE/AVX寄存器。需要向量指令的代码
+ * (复制、校验和、压缩、图形)放在kernel_fpu_begin/end之间；中断中的SIMD段会先保存被打断的那一段
+ * 的扩展状态，结束时恢复。
+ */
+#define XFEATURE_MASK_FP        (1UL << 0)      // x87
+#define XFEATURE_MASK_SSE       (1UL << 1)      // XMM、MXCSR
+#define XFEATURE_MASK_YMM       (1UL << 2)      // YMM高128位
+#define XFEATURE_MASK_KERNEL    (XFEATURE_MASK_FP | XFEATURE_MASK_SSE | XFEATURE_MASK_YMM)  // 开启并保存的状态
+
+#define FPU_STATE_SIZE          1024    // 每个保存区的大小(x87+SSE+AVX的标准格式为832字节)
+#define FPU_NESTING_MAX         3       // 普通上下文、中断、中断处理中的异常
+#define MXCSR_DEFAULT           0x1f80  // 屏蔽全部SIMD浮点异常，就近舍入
+
+#define MSR_IA32_XSS            0xda0   // XSAVES管理的监管态状态(内核不使用，置0)
+
+// 扩展状态保存区，XSAVE系列要求64字节对齐
+struct fpu_state_struct {
+    uint8_t area[FPU_STATE_SIZE];
+} __attribute__((aligned(64)));
+
+// 每个CPU的SIMD段嵌套状态
+struct fpu_cpu_struct {
+    uint32_t depth;                                     // 当前嵌套层数
+    struct fpu_state_struct save[FPU_NESTING_MAX - 1];  // 第i + 1层进入时保存的第i层寄存器
+};
+
+// 全局扩展状态信息
+struct fpu_info_struct {
+    uint64_t xfeatures;                 // 写入XCR0的状态位
+    uint32_t state_size;                // 按所选保存指令计算的保存区大小
+    const char *method;                 // 保存指令(xsaves/xsaveopt/xsave/fxsave)
+};
+
+extern struct fpu_info_struct fpu_info;
+
+void fpu_init(void);
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+uint8_t kernel_fpu_depth(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#include "idle.h"
+#include "alternative.h"
+#include "printk.h"
+#include "spinlock.h"
+#include "smp.h"
+
+static struct idle_task_struct idle_tasks[IDLE_TASKS_MAX];
+static uint32_t idle_task_count = 0;
+static spinlock_t idle_lock = SPIN_LOCK_UNLOCKED;
+
+// 每个CPU独占一个缓存行的唤醒字，MWAIT期间写入它即可唤醒该CPU(无需发送中断)
+static struct {
+    volatile uint64_t word;
+} __attribute__((aligned(64))) idle_wake[NR_CPUS];
+
+/**
+ * @brief 注册空闲任务
+ * @return 成功返回0，任务表已满返回-1
+ */
+int32_t idle_task_register(const char *name, idle_task_fn fn) {
+    uint64_t irq_flags = spin_lock_irqsave(&idle_lock);
+
+    if (idle_task_count >= IDLE_TASKS_MAX) {
+        spin_unlock_irqrestore(&idle_lock, irq_flags);
+        warnk("Idle task table full, drop %s\n", name);
+        return -1;
+    }
+
+    idle_tasks[idle_task_count].name = name;
+    idle_tasks[idle_task_count].fn = fn;
+    idle_tasks[idle_task_count].runs = 0;
+    idle_task_count++;
+    spin_unlock_irqrestore(&idle_lock, irq_flags);
+    return 0;
+}
+
+/**
+ * @brief 依次运行所有空闲任务一次
+ * @return 有任务做了工作返回1，全部无事可做返回0(此时可以hlt)
+ */
+uint8_t run_idle_tasks(void) {
+    uint8_t worked = 0;
+
+    for (uint32_t i = 0; i < idle_task_count; i++) {
+        if (idle_tasks[i].fn()) {
+            idle_tasks[i].runs++;
+            worked = 1;
+        }
+    }
+    return worked;
+}
+
+/**
+ * @brief 无事可做时让CPU进入等待，直到中断(或写入本CPU的唤醒字)
+ *
+ * 默认hlt；CPU支持MONITOR/MWAIT时启动时改写为监视唤醒字后MWAIT(EAX=0即C1，ECX=0时IF=1的中断照常唤醒)。
+ */
+void cpu_idle(void) {
+    volatile uint64_t *monitor = &idle_wake[smp_processor_id()].word;
+
+    __asm__ __volatile__(ALTERNATIVE("hlt", "monitor\n\t"
+                                            "xorl %%eax, %%eax\n\t"
+                                            "mwait",
+                                     X86_FEATURE_MWAIT)
+                         : "+a"(monitor)
+                         : "c"(0), "d"(0)
+                         : "memory");
+}
+
+/**
+ * @brief 唤醒在cpu_idle中以MWAIT等待的CPU(hlt等待的CPU只能由中断唤醒)
+ */
+void cpu_idle_wake(uint32_t cpu) {
+    idle_wake[cpu].word++;
+}
@@ -0,0 +1,30 @@
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define IDLE_TASKS_MAX 16               // 最多可注册的空闲任务数
+
+// 空闲任务：CPU空闲时被调用，每次只做一小段工作，返回非0表示本次做了工作
+typedef uint8_t (*idle_task_fn)(void);
+
+struct idle_task_struct {
+    const char *name;                   // 任务名称
+    idle_task_fn fn;                    // 任务函数
+    uint64_t runs;                      // 做了工作的调用次数
+};
+
+int32_t idle_task_register(const char *name, idle_task_fn fn);
+uint8_t run_idle_tasks(void);
+void cpu_idle(void);
+void cpu_idle_wake(uint32_t cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+#include "jump_label.h"
+#include "alternative.h"
+#include "spinlock.h"
+#include "printk.h"
+
+static spinlock_t jump_label_lock = SPIN_LOCK_UNLOCKED;
+
+static const uint8_t jump_label_nop[JUMP_LABEL_NOP_SIZE] = { JUMP_LABEL_NOP };
+
+/**
+ * @brief 按键的当前状态改写一处判断：状态与默认走向不同时为jmp rel32，否则为NOP
+ */
+static void jump_label_update_entry(struct jump_entry_struct *entry) {
+    struct static_key_struct *key = (struct static_key_struct *)(entry->key & ~JUMP_ENTRY_BRANCH);
+    uint8_t branch = entry->key & JUMP_ENTRY_BRANCH;
+    uint8_t code[JUMP_LABEL_NOP_SIZE];
+
+    if (static_key_enabled(key) != branch) {
+        int32_t rel = (int32_t)(entry->target - (entry->code + JUMP_LABEL_NOP_SIZE));
+        code[0] = 0xe9;
+        *(int32_t *)(code + 1) = rel;
+    } else {
+        for (uint32_t i = 0; i < JUMP_LABEL_NOP_SIZE; i++)
+            code[i] = jump_label_nop[i];
+    }
+
+    // 内容未变时不改写，避免无谓的串行化
+    const uint8_t *old = (const uint8_t *)entry->code;
+    for (uint32_t i = 0; i < JUMP_LABEL_NOP_SIZE; i++) {
+        if (old[i] != code[i]) {
+            text_poke((void *)entry->code, code, JUMP_LABEL_NOP_SIZE);
+            return;
+        }
+    }
+}
+
+static void jump_label_update(struct static_key_struct *key) {
+    for (struct jump_entry_struct *entry = __start___jump_table; entry < __stop___jump_table; entry++) {
+        if ((entry->key & ~JUMP_ENTRY_BRANCH) == (uint64_t)key)
+            jump_label_update_entry(entry);
+    }
+}
+
+/**
+ * @brief 使所有判断处与其键的初始状态一致(编译时一律生成NOP)
+ */
+void jump_label_init(void) {
+    uint64_t irq_flags = spin_lock_irqsave(&jump_label_lock);
+
+    for (struct jump_entry_struct *entry = __start___jump_table; entry < __stop___jump_table; entry++)
+        jump_label_update_entry(entry);
+    spin_unlock_irqrestore(&jump_label_lock, irq_flags);
+}
+
+/**
+ * @brief 开启静态键，改写所有引用它的判断处
+ */
+void static_key_enable(struct static_key_struct *key) {
+    uint64_t irq_flags = spin_lock_irqsave(&jump_label_lock);
+
+    if (!key->enabled) {
+        key->enabled = 1;
+        jump_label_update(key);
+    }
+    spin_unlock_irqrestore(&jump_label_lock, irq_flags);
+}
+
+/**
+ * @brief 关闭静态键，改写所有引用它的判断处
+ */
+void static_key_disable(struct static_key_struct *key) {
+    uint64_t irq_flags = spin_lock_irqsave(&jump_label_lock);
+
+    if (key->enabled) {
+        key->enabled = 0;
+        jump_label_update(key);
+    }
+    spin_unlock_irqrestore(&jump_label_lock, irq_flags);
+}
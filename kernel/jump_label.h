@@ -0,0 +1,77 @@
+#ifndef __JUMP_LABEL_H__
+#define __JUMP_LABEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 静态键：判断处编译为一条5字节NOP(或jmp rel32)，切换键时改写所有引用该键的判断处的指令。
+ * 不生效的分支只付出一条NOP的代价，适合调试/跟踪开关以及启动后不再改变的模式选择。
+ */
+#define JUMP_LABEL_NOP_SIZE     5
+#define JUMP_LABEL_NOP          0x0f, 0x1f, 0x44, 0x00, 0x00    // nopl 0x0(%rax,%rax,1)
+
+struct static_key_struct {
+    int32_t enabled;
+};
+
+// __jump_table中的一条记录，key的最低位表示判断处的默认走向取反(static_branch_likely)
+struct jump_entry_struct {
+    uint64_t code;                      // NOP/jmp所在地址
+    uint64_t target;                    // 跳转目标
+    uint64_t key;                       // struct static_key_struct地址 | 取反位
+};
+
+#define JUMP_ENTRY_BRANCH       1UL
+
+extern struct jump_entry_struct __start___jump_table[], __stop___jump_table[];
+
+#define DEFINE_STATIC_KEY_FALSE(name) struct static_key_struct name = { .enabled = 0 }
+#define DEFINE_STATIC_KEY_TRUE(name) struct static_key_struct name = { .enabled = 1 }
+
+/*
+ * 判断处：默认是NOP顺序执行(返回branch)，键的状态与branch不同时改写为跳到l_yes(返回!branch)。
+ * 用语句表达式而不是内联函数：-O0下内联函数的参数不是编译期常量，不能用作"i"操作数。
+ */
+#define __static_branch(key, branch)                                                                                   \
+    ({                                                                                                                 \
+        __label__ l_yes, l_done;                                                                                       \
+        uint8_t __ret = (branch);                                                                                      \
+        __asm__ goto("1:\n\t"                                                                                          \
+                     ".byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"                                                          \
+                     ".pushsection __jump_table, \"aw\"\n\t"                                                           \
+                     ".balign 8\n\t"                                                                                   \
+                     ".quad 1b, %l[l_yes], %P0 + %P1\n\t"                                                              \
+                     ".popsection\n\t"                                                                                 \
+                     :                                                                                                 \
+                     : "i"(key), "i"(branch)                                                                           \
+                     :                                                                                                 \
+                     : l_yes);                                                                                         \
+        goto l_done;                                                                                                   \
+    l_yes:                                                                                                             \
+        __ret = !(branch);                                                                                             \
+    l_done:                                                                                                            \
+        __ret;                                                                                                         \
+    })
+
+// 默认关闭的键：关闭时为NOP，顺序执行的是假分支
+#define static_branch_unlikely(key) __static_branch(key, 0)
+// 默认开启的键：开启时为NOP，顺序执行的是真分支
+#define static_branch_likely(key) __static_branch(key, 1)
+
+static inline uint8_t __attribute__((always_inline)) static_key_enabled(struct static_key_struct *key) {
+    return key->enabled > 0;
+}
+
+void jump_label_init(void);
+void static_key_enable(struct static_key_struct *key);
+void static_key_disable(struct static_key_struct *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,416 @@
+#include "ksm.h"
+#include "pgtable.h"
+#include "slab.h"
+#include "idle.h"
+#include "printk.h"
+#include "cpu.h"
+#include "lib.h"
+
+#define KSM_HASH_SIZE (1U << KSM_HASH_BITS)
+
+static spinlock_t ksm_lock = SPIN_LOCK_UNLOCKED;
+static struct list_head ksm_stable[KSM_HASH_SIZE];
+static struct list_head ksm_unstable[KSM_HASH_SIZE];
+static struct list_head ksm_mm_list = LIST_HEAD_INIT(ksm_mm_list);
+
+// 扫描游标：当前地址空间及其中下一个要扫描的地址
+static struct ksm_mm_slot_struct *scan_slot = NULL;
+static uint64_t scan_addr = 0;
+
+// 可调参数
+static uint32_t pages_to_scan = KSM_PAGES_TO_SCAN;
+static uint64_t scan_interval = 0;      // 两次扫描之间至少间隔的周期数
+static uint64_t last_scan = 0;
+
+// 统计
+static uint64_t nr_full_scans = 0;      // 完成的整轮扫描数
+static uint64_t nr_pages_scanned = 0;
+static uint64_t nr_merges = 0;          // 累计合并(释放)的页数
+static uint64_t nr_stable = 0;
+static uint64_t nr_unstable = 0;
+static uint64_t scan_cycles = 0;
+
+// 页表遍历时收集待扫描页的上下文
+struct ksm_collect_ctx {
+    uint64_t addr[KSM_SCAN_BATCH];
+    uint32_t nr;
+    uint32_t max;
+};
+
+void ksm_init(void) {
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        list_init(&ksm_stable[i]);
+        list_init(&ksm_unstable[i]);
+    }
+    idle_task_register("ksm", ksm_scan_step);
+    logk("ksm: %u hash buckets, scanning %u pages per idle step\n", KSM_HASH_SIZE, pages_to_scan);
+}
+
+/**
+ * @brief 设置扫描速度
+ * @param pages_to_scan   每次空闲调用扫描的页数(0表示停止扫描)
+ * @param interval_cycles 两次扫描之间至少间隔的TSC周期数
+ */
+void ksm_set_rate(uint32_t nr_pages, uint64_t interval_cycles) {
+    uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+    pages_to_scan = nr_pages;
+    scan_interval = interval_cycles;
+    spin_unlock_irqrestore(&ksm_lock, irq_flags);
+}
+
+/**
+ * @brief 把地址空间加入扫描列表(已在列表中时忽略)，由mm_reserve在预留VM_MERGEABLE区域时调用
+ */
+void ksm_register_mm(struct mm_struct *mm) {
+    struct ksm_mm_slot_struct *slot;
+
+    uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+    list_for_each_entry(slot, &ksm_mm_list, list) {
+        if (slot->mm == mm) {
+            spin_unlock_irqrestore(&ksm_lock, irq_flags);
+            return;
+        }
+    }
+
+    slot = kmalloc(sizeof(struct ksm_mm_slot_struct));
+    if (slot) {
+        slot->mm = mm;
+        list_add_tail(&slot->list, &ksm_mm_list);
+    }
+    spin_unlock_irqrestore(&ksm_lock, irq_flags);
+}
+
+/**
+ * @brief 地址空间销毁前移出扫描列表，并丢弃指向它的不稳定表项
+ */
+void ksm_unregister_mm(struct mm_struct *mm) {
+    struct ksm_mm_slot_struct *slot, *found = NULL;
+    struct ksm_unstable_struct *item, *n;
+
+    uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+    list_for_each_entry(slot, &ksm_mm_list, list) {
+        if (slot->mm == mm) {
+            found = slot;
+            break;
+        }
+    }
+    if (!found) {
+        spin_unlock_irqrestore(&ksm_lock, irq_flags);
+        return;
+    }
+
+    if (scan_slot == found) {
+        scan_slot = found->list.next == &ksm_mm_list ? NULL
+                                                     : list_entry(found->list.next, struct ksm_mm_slot_struct, list);
+        scan_addr = 0;
+    }
+    list_del(&found->list);
+    kfree(found);
+
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        list_for_each_entry_safe(item, n, &ksm_unstable[i], list) {
+            if (item->mm == mm) {
+                list_del(&item->list);
+                kfree(item);
+                nr_unstable--;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&ksm_lock, irq_flags);
+}
+
+static uint64_t ksm_page_hash(const uint64_t *words) {
+    uint64_t hash = 0xcbf29ce484222325UL;
+
+    for (uint32_t i = 0; i < PAGE_4K_SIZE / sizeof(uint64_t); i++) {
+        hash ^= words[i];
+        hash *= 0x100000001b3UL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+/**
+ * @brief 表项是否映射了一个可以合并的页：页框分配器管理的私有4K页
+ */
+static uint8_t ksm_page_mergeable(uint64_t *entry, uint32_t level) {
+    if (!entry || level != PT_LEVEL_PTE)
+        return 0;
+
+    uint64_t phys = *entry & PTE_ADDR_MASK;
+    uint64_t pfn = phys >> PAGE_2M_SHIFT;
+    if (!pfn_valid(pfn))
+        return 0;
+    struct page_frame_struct *page = pfn_to_page(pfn);
+    return (page->flags & PAGE_USED) && page_get_size(page) == PAGE_4K && page_ref_count(phys) == 1;
+}
+
+static void ksm_flush(struct mm_struct *mm, uint64_t vaddr) {
+    struct tlb_batch_struct batch;
+
+    tlb_batch_init(&batch, VIRT_TO_PHYS(mm->pml4));
+    tlb_batch_add(&batch, vaddr);
+    tlb_batch_flush(&batch);
+}
+
+/**
+ * @brief 将可写表项改为只读并打上PTE_COW，之后的写入由写时复制缺页拆开
+ */
+static void ksm_write_protect(struct mm_struct *mm, uint64_t *entry, uint64_t vaddr) {
+    uint64_t pte = *entry;
+
+    if (!(pte & PTE_WRITABLE))
+        return;
+    *entry = (pte & ~PTE_WRITABLE) | PTE_COW;
+    ksm_flush(mm, vaddr);
+}
+
+/**
+ * @brief 把mm中vaddr映射的页合并到内容相同的kphys(调用者持有mm->lock)
+ *
+ * 先写保护并刷新TLB再比较内容，比较通过后改为映射kphys并释放原页。
+ * @return 合并成功返回1，内容不同返回0(恢复原映射)
+ */
+static uint8_t ksm_merge(struct mm_struct *mm, uint64_t *entry, uint64_t vaddr, uint64_t kphys) {
+    uint64_t pte = *entry;
+    uint64_t phys = pte & PTE_ADDR_MASK;
+
+    ksm_write_protect(mm, entry, vaddr);
+    if (memcmp(PHYS_TO_VIRT(phys), PHYS_TO_VIRT(kphys), PAGE_4K_SIZE)) {
+        *entry = pte;           // 恢复可写不需要刷新TLB
+        return 0;
+    }
+
+    page_ref_get(kphys);
+    *entry = kphys | (*entry & ~PTE_ADDR_MASK);
+    ksm_flush(mm, vaddr);
+    page_ref_put(phys);
+    nr_merges++;
+    return 1;
+}
+
+/**
+ * @brief 两个地址空间按地址顺序加锁，避免与cow_share_range交叉加锁时死锁
+ */
+static void ksm_lock_two(struct mm_struct *a, struct mm_struct *b) {
+    struct mm_struct *first = (uint64_t)a < (uint64_t)b ? a : b;
+    struct mm_struct *second = first == a ? b : a;
+
+    spin_lock(&first->lock);
+    if (second != first)
+        spin_lock(&second->lock);
+}
+
+static void ksm_unlock_two(struct mm_struct *a, struct mm_struct *b) {
+    spin_unlock(&a->lock);
+    if (b != a)
+        spin_unlock(&b->lock);
+}
+
+/**
+ * @brief 与不稳定表中内容相同的候选页合并：候选页写保护后成为新的稳定页，当前页合并到它
+ */
+static void ksm_merge_unstable(struct mm_struct *mm, uint64_t vaddr, uint64_t phys, struct ksm_unstable_struct *item) {
+    uint32_t level, item_level;
+
+    ksm_lock_two(mm, item->mm);
+    uint64_t *entry = lookup_pte(mm->pml4, vaddr, &level);
+    uint64_t *item_entry = lookup_pte(item->mm->pml4, item->vaddr, &item_level);
+
+    // 解锁期间两边的映射都可能已改变
+    if (ksm_page_mergeable(entry, level) && (*entry & PTE_ADDR_MASK) == phys &&
+        ksm_page_mergeable(item_entry, item_level) && (*item_entry & PTE_ADDR_MASK) == item->phys) {
+        ksm_write_protect(item->mm, item_entry, item->vaddr);
+        if (ksm_merge(mm, entry, vaddr, item->phys)) {
+            struct ksm_stable_struct *stable = kmalloc(sizeof(struct ksm_stable_struct));
+            if (stable) {
+                page_ref_get(item->phys);
+                stable->phys = item->phys;
+                stable->hash = item->hash;
+                list_add(&stable->list, &ksm_stable[item->hash & (KSM_HASH_SIZE - 1)]);
+                nr_stable++;
+            }
+        }
+    }
+    ksm_unlock_two(mm, item->mm);
+
+    list_del(&item->list);
+    kfree(item);
+    nr_unstable--;
+}
+
+/**
+ * @brief 扫描一个页：先在稳定表中查找内容相同的页合并，再在不稳定表中查找，都没有时记入不稳定表
+ */
+static void ksm_scan_page(struct mm_struct *mm, uint64_t vaddr) {
+    struct ksm_stable_struct *stable;
+    struct ksm_unstable_struct *item;
+    uint32_t level;
+
+    nr_pages_scanned++;
+    spin_lock(&mm->lock);
+    uint64_t *entry = lookup_pte(mm->pml4, vaddr, &level);
+    if (!ksm_page_mergeable(entry, level)) {
+        spin_unlock(&mm->lock);
+        return;
+    }
+
+    uint64_t phys = *entry & PTE_ADDR_MASK;
+    uint64_t hash = ksm_page_hash((const uint64_t *)PHYS_TO_VIRT(phys));
+    uint32_t bucket = hash & (KSM_HASH_SIZE - 1);
+
+    list_for_each_entry(stable, &ksm_stable[bucket], list) {
+        if (stable->hash == hash && ksm_merge(mm, entry, vaddr, stable->phys)) {
+            spin_unlock(&mm->lock);
+            return;
+        }
+    }
+
+    list_for_each_entry(item, &ksm_unstable[bucket], list) {
+        if (item->hash == hash && (item->mm != mm || item->vaddr != vaddr)) {
+            spin_unlock(&mm->lock);
+            ksm_merge_unstable(mm, vaddr, phys, item);
+            return;
+        }
+    }
+
+    item = kmalloc(sizeof(struct ksm_unstable_struct));
+    if (item) {
+        item->mm = mm;
+        item->vaddr = vaddr;
+        item->phys = phys;
+        item->hash = hash;
+        list_add(&item->list, &ksm_unstable[bucket]);
+        nr_unstable++;
+    }
+    spin_unlock(&mm->lock);
+}
+
+static int32_t ksm_collect_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    struct ksm_collect_ctx *ctx = (struct ksm_collect_ctx *)arg;
+
+    if (level != PT_LEVEL_PTE)
+        return 0;
+    ctx->addr[ctx->nr++] = vaddr;
+    return ctx->nr == ctx->max;
+}
+
+/**
+ * @brief 从*addr开始在mm的VM_MERGEABLE区域中收集最多max个已映射的4K页，并推进*addr
+ * @return 收集到的页数，0表示该地址空间已扫描完
+ */
+static uint32_t ksm_collect(struct mm_struct *mm, uint64_t *addr, struct ksm_collect_ctx *ctx) {
+    struct vm_area_struct *vma;
+
+    ctx->nr = 0;
+    spin_lock(&mm->lock);
+    list_for_each_entry(vma, &mm->vma_list, list) {
+        if (!(vma->flags & VM_MERGEABLE) || vma->end <= *addr)
+            continue;
+
+        uint64_t start = vma->start > *addr ? vma->start : *addr;
+        if (walk_page_range(mm->pml4, start, vma->end, ksm_collect_entry, ctx)) {
+            *addr = ctx->addr[ctx->nr - 1] + PAGE_4K_SIZE;
+            break;
+        }
+        *addr = vma->end;
+    }
+    spin_unlock(&mm->lock);
+    return ctx->nr;
+}
+
+/**
+ * @brief 一轮扫描结束：清空不稳定表，释放只剩稳定表引用的稳定页
+ */
+static void ksm_pass_done(void) {
+    struct ksm_unstable_struct *item, *n;
+    struct ksm_stable_struct *stable, *sn;
+
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        list_for_each_entry_safe(item, n, &ksm_unstable[i], list) {
+            list_del(&item->list);
+            kfree(item);
+        }
+        list_for_each_entry_safe(stable, sn, &ksm_stable[i], list) {
+            if (page_ref_count(stable->phys) == 1) {
+                list_del(&stable->list);
+                page_ref_put(stable->phys);
+                kfree(stable);
+                nr_stable--;
+            }
+        }
+    }
+    nr_unstable = 0;
+    nr_full_scans++;
+}
+
+/**
+ * @brief 扫描最多pages_to_scan个页(作为空闲任务运行)，一轮扫描结束时本次调用也结束
+ * @return 本次扫描了页返回1，没有需要扫描的地址空间、已停止或未到扫描间隔返回0
+ */
+uint8_t ksm_scan_step(void) {
+    struct ksm_collect_ctx ctx;
+    uint64_t start = rdtsc();
+
+    if (!pages_to_scan || (scan_interval && start - last_scan < scan_interval))
+        return 0;
+    if (list_empty(&ksm_mm_list)) {
+        if (!nr_stable)
+            return 0;
+        // 地址空间都已注销，释放稳定表中剩下的页
+        uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+        ksm_pass_done();
+        spin_unlock_irqrestore(&ksm_lock, irq_flags);
+        return 1;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+    uint32_t budget = pages_to_scan;
+    while (budget && !list_empty(&ksm_mm_list)) {
+        if (!scan_slot) {
+            scan_slot = list_first_entry(&ksm_mm_list, struct ksm_mm_slot_struct, list);
+            scan_addr = 0;
+        }
+
+        ctx.max = budget < KSM_SCAN_BATCH ? budget : KSM_SCAN_BATCH;
+        if (!ksm_collect(scan_slot->mm, &scan_addr, &ctx)) {
+            // 当前地址空间扫描完，换下一个；最后一个扫描完即一轮结束
+            if (scan_slot->list.next == &ksm_mm_list) {
+                scan_slot = NULL;
+                ksm_pass_done();
+                break;
+            }
+            scan_slot = list_entry(scan_slot->list.next, struct ksm_mm_slot_struct, list);
+            scan_addr = 0;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < ctx.nr; i++)
+            ksm_scan_page(scan_slot->mm, ctx.addr[i]);
+        budget -= ctx.nr;
+    }
+    last_scan = rdtsc();
+    scan_cycles += last_scan - start;
+    spin_unlock_irqrestore(&ksm_lock, irq_flags);
+    return 1;
+}
+
+/**
+ * @brief 打印合并情况：稳定页数、映射到稳定页的表项数与节省的内存，以及扫描统计
+ */
+void ksm_info(void) {
+    struct ksm_stable_struct *stable;
+    uint64_t nr_sharing = 0;
+
+    uint64_t irq_flags = spin_lock_irqsave(&ksm_lock);
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        list_for_each_entry(stable, &ksm_stable[i], list)
+            nr_sharing += page_ref_count(stable->phys) - 1;     // 扣除稳定表自身的引用
+    }
+
+    logk("ksm: %lu shared pages mapped %lu times (saving %lu KB), %lu unstable candidates\n", nr_stable, nr_sharing,
+         (nr_sharing - nr_stable) * PAGE_4K_SIZE >> 10, nr_unstable);
+    logk("ksm: %lu pages scanned in %lu full scans, %lu merges, %lu cycles/page, rate %u pages/step\n",
+         nr_pages_scanned, nr_full_scans, nr_merges, nr_pages_scanned ? scan_cycles / nr_pages_scanned : 0,
+         pages_to_scan);
+    spin_unlock_irqrestore(&ksm_lock, irq_flags);
+}
@@ -0,0 +1,51 @@
+#ifndef __KSM_H__
+#define __KSM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "list.h"
+#include "mm.h"
+
+// 同页合并(KSM)：空闲时扫描带VM_MERGEABLE的预留区域，把内容相同的4K页合并为一个只读共享页，
+// 按ref_count共享，任何一方写入时由写时复制缺页拆开
+#define KSM_HASH_BITS           10                  // 稳定表/不稳定表的哈希桶数(2^10)
+#define KSM_PAGES_TO_SCAN       64                  // 默认每次空闲调用扫描的页数
+#define KSM_SCAN_BATCH          16                  // 每次遍历页表收集的页数
+
+// 稳定表项：已合并的页，表本身持有一个引用，保证页内容在合并期间不变
+struct ksm_stable_struct {
+    struct list_head list;
+    uint64_t phys;
+    uint64_t hash;
+};
+
+// 不稳定表项：本轮扫描中见过的候选页，每轮扫描结束时清空
+struct ksm_unstable_struct {
+    struct list_head list;
+    struct mm_struct *mm;
+    uint64_t vaddr;
+    uint64_t phys;
+    uint64_t hash;
+};
+
+// 参与扫描的地址空间
+struct ksm_mm_slot_struct {
+    struct list_head list;
+    struct mm_struct *mm;
+};
+
+void ksm_init(void);
+void ksm_register_mm(struct mm_struct *mm);
+void ksm_unregister_mm(struct mm_struct *mm);
+void ksm_set_rate(uint32_t pages_to_scan, uint64_t interval_cycles);
+uint8_t ksm_scan_step(void);
+void ksm_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
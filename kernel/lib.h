@@ -1,4 +1,4 @@
-#ifndef __LIB__H__
+#ifndef __LIB_H__
 #define __LIB_H__
 
 #ifdef __cplusplus
@@ -15,39 +15,19 @@ extern "C" {
         __res;                                                                                                         \
     })
 
-static inline void __attribute__((always_inline)) *memcpy(void *dest, void *src, size_t n) {
-    int32_t d0, d1, d2;
-    __asm__ __volatile__("cld	\n\t"
-                         "rep	\n\t"
-                         "movsq	\n\t"
-                         "testb	$4,%b4	\n\t"
-                         "je	1f	\n\t"
-                         "movsl	\n\t"
-                         "1:\ttestb	$2,%b4	\n\t"
-                         "je	2f	\n\t"
-                         "movsw	\n\t"
-                         "2:\ttestb	$1,%b4	\n\t"
-                         "je	3f	\n\t"
-                         "movsb	\n\t"
-                         "3:	\n\t"
-                         : "=&c"(d0), "=&D"(d1), "=&S"(d2)
-                         : "0"(n / 8), "q"(n), "1"(dest), "2"(src)
-                         : "memory");
-    return dest;
-}
+// 按长度与CPU特性分派到不同实现(见string.c)
+void *memcpy(void *dest, const void *src, size_t n);
+void *memset(void *dest, int c, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
 
-static inline int32_t strlen(const char *str) {
-    register int32_t __res;
-    __asm__ __volatile__("cld	\n\t"
-                         "repne	\n\t"
-                         "scasb	\n\t"
-                         "notl	%0	\n\t"
-                         "decl	%0	\n\t"
-                         : "=c"(__res)
-                         : "D"(str), "a"(0), "0"(0xffffffff)
-                         :);
-    return __res;
-}
+// 按字(8字节)或SSE2一次处理多个字节的比较与查找(见string.c)
+int32_t memcmp(const void *s1, const void *s2, size_t n);
+void *memchr(const void *s, int c, size_t n);
+size_t strlen(const char *s);
+size_t strnlen(const char *s, size_t maxlen);
+int32_t strcmp(const char *s1, const char *s2);
+char *strchr(const char *s, int c);
+char *strncpy(char *dest, const char *src, size_t n);
 
 static inline uint8_t __attribute__((always_inline)) io_in8(uint16_t port) {
 	unsigned char ret = 0;
@@ -67,33 +47,33 @@ static inline void __attribute__((always_inline)) io_out8(uint16_t port, uint8_t
 				:"memory");
 }
 
-static inline void __attribute__((always_inline)) *memset(void *dest, int c, size_t n) {
-    void *original_dest = dest; // 保存原始指针用于返回
-    unsigned char c8 = (unsigned char)c;
-    uint64_t c64 = (uint64_t)c8 * 0x0101010101010101ULL; // 将单字节扩展为8字节重复模式
+/**
+ * @brief 用非临时存储(movnti)清零，写入绕过缓存，不会把清零的内容挤进调用者的工作集
+ * @param dest 须8字节对齐
+ * @param n 字节数，须为64的倍数
+ */
+static inline void __attribute__((always_inline)) memzero_nt(void *dest, size_t n) {
+    if (!n)
+        return;
 
-    __asm__ __volatile__ (
-        "movq %[c64], %%rax\n\t"     // 将64位填充值加载到RAX
-        "mov %[n], %%rcx\n\t"        // 原始长度存入RCX
-        "mov %%rcx, %%rdx\n\t"       // 备份长度到RDX
-        "shr $3, %%rcx\n\t"         // 计算64位块数量（RCX = n / 8）
-        "jz 1f\n\t"                 // 如果块数为0则跳过STOSQ
-        "rep stosq\n\t"             // 以64位为单位填充内存
-        "1:\n\t"
-        "mov %%rdx, %%rcx\n\t"      // 恢复原始长度到RCX
-        "and $7, %%rcx\n\t"         // 计算剩余字节数（RCX = n % 8）
-        "jz 2f\n\t"                 // 如果无剩余则跳过STOSB
-        "rep stosb\n\t"             // 处理剩余字节
-        "2:\n\t"
-        : "+D" (dest)               // 输出操作数：RDI寄存器（自动更新）
-        : [c64] "r" (c64), [n] "r" (n)
-        : "rax", "rcx", "rdx", "memory"
-    );
-
-    return original_dest;
+    __asm__ __volatile__("1:\n\t"
+                         "movnti %%rax, 0(%0)\n\t"
+                         "movnti %%rax, 8(%0)\n\t"
+                         "movnti %%rax, 16(%0)\n\t"
+                         "movnti %%rax, 24(%0)\n\t"
+                         "movnti %%rax, 32(%0)\n\t"
+                         "movnti %%rax, 40(%0)\n\t"
+                         "movnti %%rax, 48(%0)\n\t"
+                         "movnti %%rax, 56(%0)\n\t"
+                         "addq $64, %0\n\t"
+                         "subq $64, %1\n\t"
+                         "jnz 1b\n\t"
+                         "sfence\n\t"             // 非临时存储是弱序的，返回前保证对其他访问可见
+                         : "+r"(dest), "+r"(n)
+                         : "a"(0UL)
+                         : "memory");
 }
 
-
 #ifdef __cplusplus
 }
 #endif
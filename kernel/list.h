@@ -5,10 +5,77 @@
 extern "C" {
 #endif
 
-// 实现一个链表结构
+#include <stddef.h>
+
+// 实现一个链表结构（带头结点的双向循环链表）
+
+struct list_head {
+    struct list_head *next;
+    struct list_head *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_first_entry(head, type, member) list_entry((head)->next, type, member)
+
+#define list_for_each(pos, head) \
+    for (pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_entry(pos, head, member)                          \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member);      \
+         &pos->member != (head);                                        \
+         pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member)                  \
+    for (pos = list_entry((head)->next, __typeof__(*pos), member),      \
+         n = list_entry(pos->member.next, __typeof__(*pos), member);    \
+         &pos->member != (head);                                        \
+         pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+static inline void list_init(struct list_head *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline void __list_add(struct list_head *node, struct list_head *prev, struct list_head *next) {
+    next->prev = node;
+    node->next = next;
+    node->prev = prev;
+    prev->next = node;
+}
+
+/**
+ * @brief 在head之后插入节点（头插）
+ */
+static inline void list_add(struct list_head *node, struct list_head *head) {
+    __list_add(node, head, head->next);
+}
+
+/**
+ * @brief 在head之前插入节点（尾插）
+ */
+static inline void list_add_tail(struct list_head *node, struct list_head *head) {
+    __list_add(node, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry) {
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    entry->next = entry;
+    entry->prev = entry;
+}
+
+static inline int list_empty(const struct list_head *head) {
+    return head->next == head;
+}
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
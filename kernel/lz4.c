@@ -0,0 +1,185 @@
+#include "lz4.h"
+#include "lib.h"
+
+static inline uint32_t lz4_read32(const uint8_t *p) {
+    return *(const uint32_t *)p;        // x86允许非对齐访问
+}
+
+static inline uint32_t lz4_hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/**
+ * @brief 写入超出token中4位部分的长度(每字节255，最后一字节小于255)
+ */
+static inline uint8_t *lz4_put_length(uint8_t *op, uint32_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/**
+ * @brief 写入一个序列：token、字面量长度、字面量，以及可选的匹配偏移与长度
+ * @param offset 为0时只写字面量(块的最后一个序列)
+ * @return 写入后的输出位置，输出缓冲区不够返回NULL
+ */
+static uint8_t *lz4_put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *literals, uint32_t lit_len,
+                                 uint32_t offset, uint32_t match_len) {
+    // token + 字面量长度 + 字面量 + 偏移 + 匹配长度的最坏情况
+    if ((uint64_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + (offset ? 2 + match_len / 255 + 1 : 0))
+        return NULL;
+
+    uint8_t *token = op++;
+    *token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15)
+        op = lz4_put_length(op, lit_len - 15);
+    memcpy(op, (void *)literals, lit_len);
+    op += lit_len;
+
+    if (offset) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        *token |= match_len >= 15 ? 15 : match_len;
+        if (match_len >= 15)
+            op = lz4_put_length(op, match_len - 15);
+    }
+    return op;
+}
+
+/**
+ * @brief 以LZ4块格式压缩src
+ * @param state 压缩工作区
+ * @return 压缩后的长度，输出超过dst_cap(数据不可压缩)或输入过长返回0
+ *
+ * 单遍贪心匹配：每个位置按前4字节查哈希表取得候选，命中后向前、向后扩展匹配。
+ */
+int32_t lz4_compress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap,
+                     struct lz4_state_struct *state) {
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;            // 尚未输出的字面量起点
+    const uint8_t *iend = src + src_len;
+    const uint8_t *mflimit = iend - LZ4_MFLIMIT;
+    const uint8_t *matchlimit = iend - LZ4_LAST_LITERALS;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_cap;
+
+    if (src_len > LZ4_MAX_INPUT)
+        return 0;
+
+    if (src_len > LZ4_MFLIMIT) {
+        memset(state->table, 0, sizeof(state->table));
+        ip++;
+
+        while (ip < mflimit) {
+            uint32_t sequence = lz4_read32(ip);
+            uint32_t h = lz4_hash(sequence);
+            const uint8_t *ref = src + state->table[h];
+            state->table[h] = (uint16_t)(ip - src);
+
+            // 哈希表清零后的空项指向src开头，同样由内容比较过滤
+            if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE || lz4_read32(ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t *match_end = ip + LZ4_MIN_MATCH;
+            const uint8_t *ref_end = ref + LZ4_MIN_MATCH;
+            while (match_end < matchlimit && *match_end == *ref_end) {
+                match_end++;
+                ref_end++;
+            }
+
+            op = lz4_put_sequence(op, oend, anchor, ip - anchor, ip - ref, match_end - ip - LZ4_MIN_MATCH);
+            if (!op)
+                return 0;
+
+            ip = match_end;
+            anchor = ip;
+            // 补记匹配末尾附近的位置，提高下一次命中率
+            if (ip - 2 > src && ip < mflimit)
+                state->table[lz4_hash(lz4_read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+        }
+    }
+
+    op = lz4_put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (!op)
+        return 0;
+    return op - dst;
+}
+
+/**
+ * @brief 解压LZ4块，对损坏的输入做边界检查
+ * @return 解压后的长度，输入损坏或输出超过dst_cap返回-1
+ */
+int32_t lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_cap;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+        uint64_t len = token >> 4;
+        uint8_t byte;
+
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                byte = *ip++;
+                len += byte;
+            } while (byte == 255);
+        }
+        if (len > (uint64_t)(iend - ip) || len > (uint64_t)(oend - op))
+            return -1;
+        memcpy(op, (void *)ip, len);
+        op += len;
+        ip += len;
+
+        // 最后一个序列只有字面量
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        uint64_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (uint64_t)(op - dst))
+            return -1;
+
+        len = (token & 15) + LZ4_MIN_MATCH;
+        if ((token & 15) == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                byte = *ip++;
+                len += byte;
+            } while (byte == 255);
+        }
+        if (len > (uint64_t)(oend - op))
+            return -1;
+
+        // 匹配可以与输出重叠(偏移小于长度时重复前面的内容)，偏移不小于8时可以按8字节向前复制
+        const uint8_t *ref = op - offset;
+        if (offset >= 8) {
+            while (len >= 8) {
+                *(uint64_t *)op = *(const uint64_t *)ref;
+                op += 8;
+                ref += 8;
+                len -= 8;
+            }
+        }
+        while (len--)
+            *op++ = *ref++;
+    }
+
+    return op - dst;
+}
@@ -0,0 +1,31 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// LZ4块格式(与lz4库的LZ4_compress_default/LZ4_decompress_safe兼容)
+#define LZ4_MIN_MATCH       4               // 最短匹配长度
+#define LZ4_LAST_LITERALS   5               // 块末尾至少5字节为字面量
+#define LZ4_MFLIMIT         12              // 最后一个匹配必须在块末尾12字节之前开始
+#define LZ4_MAX_DISTANCE    65535           // 匹配偏移上限(2字节)
+#define LZ4_HASH_LOG        12              // 哈希表4096项
+#define LZ4_MAX_INPUT       65536           // 哈希表保存16位位置，单次压缩的输入上限
+
+// 压缩工作区(哈希表保存输入中的16位位置)，由调用者提供，不能并发使用
+struct lz4_state_struct {
+    uint16_t table[1 << LZ4_HASH_LOG];
+};
+
+int32_t lz4_compress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap,
+                     struct lz4_state_struct *state);
+int32_t lz4_decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
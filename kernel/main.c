@@ -4,6 +4,20 @@
 #include "idt.h"
 #include "gdt.h"
 #include "memory.h"
+#include "slab.h"
+#include "pgtable.h"
+#include "bench.h"
+#include "idle.h"
+#include "vmalloc.h"
+#include "serial.h"
+#include "mm.h"
+#include "zstore.h"
+#include "ksm.h"
+#include "string.h"
+#include "cpufeature.h"
+#include "alternative.h"
+#include "jump_label.h"
+#include "fpu.h"
 
 void Test_Printk_Function(void) {
     // 1. 基础字符串与换行
@@ -55,6 +69,36 @@ void Test_Printk_Function(void) {
 	fatalk("system down: %d\n", 4);
 }
 
+// 内存规整测试用的可移动页框所有者：迁移时更新数组中的页框指针
+#define COMPACT_TEST_PAGES 64
+struct compact_test_owner {
+    struct movable_owner_struct owner;
+    struct page_frame_struct *pages[COMPACT_TEST_PAGES];
+};
+
+static int32_t compact_test_migrate(struct movable_owner_struct *owner, struct page_frame_struct *old_page,
+                                    struct page_frame_struct *new_page) {
+    struct compact_test_owner *test = container_of(owner, struct compact_test_owner, owner);
+
+    for (uint32_t i = 0; i < COMPACT_TEST_PAGES; i++) {
+        if (test->pages[i] == old_page) {
+            test->pages[i] = new_page;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const struct movable_ops_struct compact_test_ops = { .migrate = compact_test_migrate };
+
+// 换出窗口测试：压缩期间把被换出的页共享给另一个地址空间(相当于此时发生了fork)
+static struct mm_struct *pageout_fork_child;
+static uint64_t pageout_fork_addr;
+
+static void pageout_fork_hook(struct mm_struct *mm) {
+    cow_share_range(pageout_fork_child, pageout_fork_addr, mm, pageout_fork_addr, PAGE_4K_SIZE);
+}
+
 void Start_Kernel(void) {
     init_vbe_info();
 
@@ -105,6 +149,11 @@ void Start_Kernel(void) {
 
     setup_idt();
     setup_tss64();
+    serial_init();
+    cpu_features_init();
+    fpu_init();
+    alternative_instructions();
+    memops_init();
 
     // int i = 1/0;                                        // 除零异常
     // *(volatile uint64_t*)0x23a00000 = 0xDEADBEEF;    // 页错误
@@ -116,23 +165,23 @@ void Start_Kernel(void) {
     struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 64, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
 
     if (page) {
-        logk("Pages allocated successfully, starting at PFN: %lu\n", page->pfn);
+        logk("Pages allocated successfully, starting at PFN: %lu\n", page_to_pfn(page));
         
         // 计算对应的位图位置
-        uint64_t bitmap_word = page->pfn / 64;
-        uint64_t bit_offset = page->pfn % 64;
+        uint64_t bitmap_word = page_to_pfn(page) / 64;
+        uint64_t bit_offset = page_to_pfn(page) % 64;
         
 
         // 打印正确的位图位置
         color_printk(RED,BLACK,"Page PFN: %lu corresponds to bitmap[%lu], bit %lu\n", 
-                    page->pfn, bitmap_word, bit_offset);
+                    page_to_pfn(page), bitmap_word, bit_offset);
         color_printk(RED,BLACK,"After allocation bitmap[%lu]:%#018lx\n", 
                     bitmap_word, global_memory_manager_struct.bitmap.addr[bitmap_word]);
         color_printk(RED,BLACK,"After allocation bitmap[%lu]:%#018lx\n", 
                     bitmap_word + 1, global_memory_manager_struct.bitmap.addr[bitmap_word + 1]);
         
         // 如果分配了连续64页，检查下一个位图字
-        if (page->pfn % 64 + 64 > 64) {
+        if (page_to_pfn(page) % 64 + 64 > 64) {
             color_printk(RED,BLACK,"After allocation bitmap[%lu]:%#018lx\n", 
                         bitmap_word + 1, global_memory_manager_struct.bitmap.addr[bitmap_word + 1]);
         }
@@ -145,11 +194,11 @@ void Start_Kernel(void) {
     
     if (page) {
         // 打印释放前的位图状态
-        uint64_t bitmap_word = page->pfn / 64;
+        uint64_t bitmap_word = page_to_pfn(page) / 64;
         color_printk(BLUE,BLACK,"Before freeing - bitmap[%lu]: %#018lx\n", 
                     bitmap_word, global_memory_manager_struct.bitmap.addr[bitmap_word]);
         
-        if (page->pfn % 64 + 64 > 64) {
+        if (page_to_pfn(page) % 64 + 64 > 64) {
             color_printk(BLUE,BLACK,"Before freeing - bitmap[%lu]: %#018lx\n", 
                         bitmap_word + 1, global_memory_manager_struct.bitmap.addr[bitmap_word + 1]);
         }
@@ -161,20 +210,290 @@ void Start_Kernel(void) {
         color_printk(GREEN,BLACK,"After freeing - bitmap[%lu]: %#018lx\n", 
                     bitmap_word, global_memory_manager_struct.bitmap.addr[bitmap_word]);
         
-        if (page->pfn % 64 + 64 > 64) {
+        if (page_to_pfn(page) % 64 + 64 > 64) {
             color_printk(GREEN,BLACK,"After freeing - bitmap[%lu]: %#018lx\n", 
                         bitmap_word + 1, global_memory_manager_struct.bitmap.addr[bitmap_word + 1]);
         }
 
         // 验证页框状态
-        struct page_frame_struct *check_page = &global_memory_manager_struct.page.addr[page->pfn];
+        struct page_frame_struct *check_page = &global_memory_manager_struct.page.addr[page_to_pfn(page)];
         color_printk(RED,BLACK,"First page flags after free: %#x\n", check_page->flags);
         color_printk(RED,BLACK,"First page ref_count after free: %d\n", check_page->ref_count);
     }
     
 
+    slab_init();
+    pgtable_late_init();
+    tlb_init(kernel_pml4);
+    mm_init();
+    zstore_init();
+    ksm_init();
+
+    // 测试kmalloc/kfree
+    void *small_obj = kmalloc(100);
+    void *large_obj = kmalloc(3 * 1024 * 1024);
+    logk("kmalloc(100): %#018lx, kmalloc(3MB): %#018lx\n", (uint64_t)small_obj, (uint64_t)large_obj);
+    kfree(small_obj);
+    kfree(large_obj);
+    slab_info();
+
+    // 测试4K页分配
+    uint64_t small_page = alloc_pages_4k(4);
+    logk("alloc_pages_4k(4): %#018lx, translated: %#018lx\n", small_page,
+         translate_address(kernel_pml4, (uint64_t)PHYS_TO_VIRT(small_page)));
+    free_pages_4k(small_page, 4);
+
+    // 测试CMA：借出可移动页后整段回收
+    struct page_frame_struct *cma_pages = cma_alloc(4);
+    logk("cma_alloc(4): %#018lx\n", cma_pages ? page_to_phys(cma_pages) : 0);
+    if (cma_pages)
+        cma_release(cma_pages, 4);
+    cma_info();
+
+    // 测试内存规整：分配一批可移动页框后隔一个释放一个，规整后普通zone的最长连续空闲段应变长
+    // (前CMA_DEFAULT_PAGES个可移动页借用CMA区，规整只迁移CMA区之外的页)
+    static struct compact_test_owner compact_test = { .owner = { .ops = &compact_test_ops } };
+    for (uint32_t i = 0; i < COMPACT_TEST_PAGES; i++)
+        compact_test.pages[i] = alloc_movable_page(PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE, &compact_test.owner);
+    for (uint32_t i = 0; i < COMPACT_TEST_PAGES; i += 2) {
+        if (compact_test.pages[i])
+            free_pages(compact_test.pages[i], 1);
+        compact_test.pages[i] = NULL;
+    }
+    drain_pcp_pages();
+    struct memory_zone_struct *compact_zone = cma_area.zone ? cma_area.zone : &global_memory_manager_struct.zone.addr[0];
+    uint64_t run_before = zone_largest_free_run(compact_zone);
+    uint64_t nr_compacted = compact_memory();
+    logk("compaction: migrated %lu pages, largest free run %lu -> %lu pages\n", nr_compacted, run_before,
+         zone_largest_free_run(compact_zone));
+    for (uint32_t i = 0; i < COMPACT_TEST_PAGES; i++) {
+        if (compact_test.pages[i])
+            free_pages(compact_test.pages[i], 1);
+    }
+
+    // 测试NUMA：从每个节点各分配一页，检查实际所在节点(QEMU -numa下可验证回退顺序)
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        struct page_frame_struct *node_page = alloc_pages_node(node, ZONE_NORMAL, 1, PAGE_KERNEL);
+        logk("alloc_pages_node(%u): %#018lx on node %u\n", node, node_page ? page_to_phys(node_page) : 0,
+             node_page ? page_to_nid(node_page) : NUMA_NO_NODE);
+        if (node_page)
+            free_pages(node_page, 1);
+    }
+
+    // 测试写时复制：父地址空间映射一个2M页和一个4K页，fork后各自写入
+    struct mm_struct *parent_mm = mm_create();
+    struct page_frame_struct *cow_page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+    uint64_t cow_4k = alloc_pages_4k(1);
+    if (parent_mm && cow_page && cow_4k) {
+        uint64_t cow_vaddr = 0x40000000UL;
+        map_pages(parent_mm->pml4, cow_vaddr, page_to_phys(cow_page), PAGE_2M_SIZE, PAGE_2M, PAGE_PRESENT | PAGE_WRITABLE);
+        map_pages(parent_mm->pml4, cow_vaddr + PAGE_2M_SIZE, cow_4k, PAGE_4K_SIZE, PAGE_4K, PAGE_PRESENT | PAGE_WRITABLE);
+        mm_switch(parent_mm);
+        *(volatile uint64_t *)cow_vaddr = 0x1111;
+        *(volatile uint64_t *)(cow_vaddr + PAGE_2M_SIZE) = 0x2222;
+
+        struct mm_struct *child_mm = mm_fork(parent_mm);
+        if (child_mm) {
+            mm_switch(child_mm);
+            uint64_t before = *(volatile uint64_t *)cow_vaddr;
+            *(volatile uint64_t *)cow_vaddr = 0x3333;                   // 复制2M页
+            *(volatile uint64_t *)(cow_vaddr + PAGE_2M_SIZE) = 0x4444;  // 复制4K页
+            mm_switch(parent_mm);
+            *(volatile uint64_t *)cow_vaddr = 0x5555;                   // 只剩父进程引用，直接恢复可写
+            logk("COW: child read %#lx, parent sees %#lx/%#lx, child %lu faults/%lu copies, parent %lu/%lu\n", before,
+                 *(volatile uint64_t *)cow_vaddr, *(volatile uint64_t *)(cow_vaddr + PAGE_2M_SIZE),
+                 child_mm->nr_cow_faults, child_mm->nr_cow_copies, parent_mm->nr_cow_faults, parent_mm->nr_cow_copies);
+            mm_destroy(child_mm);
+        }
+        mm_switch(&init_mm);
+        mm_destroy(parent_mm);
+    } else {
+        if (cow_page)
+            free_pages(cow_page, 1);
+        if (cow_4k)
+            free_pages_4k(cow_4k, 1);
+        mm_destroy(parent_mm);
+    }
+
+    // 测试按需分配：预留1GB匿名内存，间隔64MB各写一次，再顺序读开头1MB(fault-around每次映射16页)
+    struct mm_struct *anon_mm = mm_create();
+    if (anon_mm) {
+        mm_switch(anon_mm);
+        uint64_t anon_size = 1UL << 30;
+        uint64_t anon_base = mm_reserve(anon_mm, 0, anon_size, VM_READ | VM_WRITE);
+        if (anon_base) {
+            uint64_t sum = 0;
+            for (uint64_t off = 0; off < anon_size; off += 64UL << 20)
+                ((volatile uint8_t *)anon_base)[off] = 1;
+            for (uint64_t off = 0; off < 256 * PAGE_4K_SIZE; off += PAGE_4K_SIZE)
+                sum += ((volatile uint8_t *)anon_base)[off];
+            logk("Demand paging: reserved 1GB at %#018lx, resident %lu KB, sum %lu\n", anon_base,
+                 mm_resident_pages(anon_mm, anon_base, anon_base + anon_size) * 4, sum);
+
+            // 测试压缩存储：开头256页依次写入全零、递增、重复和不可压缩的数据，整体换出后再读回校验
+            uint64_t checksum = 0, verify = 0;
+            for (uint64_t i = 0; i < 256; i++) {
+                uint64_t *words = (uint64_t *)(anon_base + i * PAGE_4K_SIZE);
+                for (uint64_t w = 0; w < PAGE_4K_SIZE / sizeof(uint64_t); w++) {
+                    words[w] = i % 4 == 0 ? 0 : i % 4 == 1 ? w : i % 4 == 2 ? i : (i * 512 + w) * 0x9e3779b97f4a7c15UL;
+                    checksum += words[w];
+                }
+            }
+            uint64_t nr_out = mm_pageout(anon_mm, anon_base, anon_base + 256 * PAGE_4K_SIZE);
+            uint64_t resident = mm_resident_pages(anon_mm, anon_base, anon_base + 256 * PAGE_4K_SIZE);
+            zstore_info();
+            for (uint64_t i = 0; i < 256; i++) {
+                uint64_t *words = (uint64_t *)(anon_base + i * PAGE_4K_SIZE);
+                for (uint64_t w = 0; w < PAGE_4K_SIZE / sizeof(uint64_t); w++)
+                    verify += words[w];
+            }
+            logk("zstore: paged out %lu pages (%lu left resident), read back %s\n", nr_out, resident,
+                 verify == checksum ? "OK" : "MISMATCH");
+
+            // 换出期间被共享的页应放弃换出并保持写时复制：父地址空间写入后子地址空间仍是原内容
+            pageout_fork_child = mm_create();
+            if (pageout_fork_child) {
+                volatile uint64_t *word = (volatile uint64_t *)anon_base;
+                *word = 0x5a5a5a5a5a5a5a5aUL;
+                pageout_fork_addr = anon_base;
+                mm_pageout_window_hook = pageout_fork_hook;
+                uint64_t nr_forked_out = mm_pageout(anon_mm, anon_base, anon_base + PAGE_4K_SIZE);
+                mm_pageout_window_hook = NULL;
+                *word = 0xa5a5a5a5a5a5a5a5UL;
+                uint64_t child_phys = translate_address(pageout_fork_child->pml4, anon_base);
+                uint64_t child_word = child_phys ? *(uint64_t *)PHYS_TO_VIRT(child_phys) : 0;
+                logk("zstore: fork during pageout: %lu paged out, child sees %#lx (%s)\n", nr_forked_out, child_word,
+                     !nr_forked_out && child_word == 0x5a5a5a5a5a5a5a5aUL ? "OK" : "BROKEN");
+                mm_destroy(pageout_fork_child);
+            }
+            mm_info(anon_mm);
+        }
+        mm_switch(&init_mm);
+        mm_destroy(anon_mm);
+    }
+
+    // 测试同页合并：64页中24对内容两两相同、16页全零，扫描后写入第0页，第1页应保持原内容
+    struct mm_struct *ksm_mm = mm_create();
+    if (ksm_mm) {
+        mm_switch(ksm_mm);
+        uint64_t ksm_base = mm_reserve(ksm_mm, 0, 64 * PAGE_4K_SIZE, VM_READ | VM_WRITE | VM_MERGEABLE);
+        if (ksm_base) {
+            for (uint64_t i = 0; i < 64; i++) {
+                uint64_t *words = (uint64_t *)(ksm_base + i * PAGE_4K_SIZE);
+                for (uint64_t w = 0; w < PAGE_4K_SIZE / sizeof(uint64_t); w++)
+                    words[w] = i < 48 ? (i / 2 + 1) * 0x9e3779b97f4a7c15UL + w : 0;
+            }
+            uint64_t resident = mm_resident_pages(ksm_mm, ksm_base, ksm_base + 64 * PAGE_4K_SIZE);
+            for (uint32_t pass = 0; pass < 4; pass++)
+                ksm_scan_step();
+            ksm_info();
+            *(volatile uint64_t *)ksm_base = 0;
+            logk("ksm: %lu pages resident before merge, page 1 after writing page 0: %s\n", resident,
+                 *(volatile uint64_t *)(ksm_base + PAGE_4K_SIZE) == 0x9e3779b97f4a7c15UL ? "OK" : "CORRUPTED");
+        }
+        mm_switch(&init_mm);
+        mm_destroy(ksm_mm);
+    }
+
+    // 测试vmalloc：2M页框加4K页拼出线性连续的缓冲区
+    uint8_t *vbuf = vmalloc(5 * 1024 * 1024 + 12345);
+    if (vbuf) {
+        memset(vbuf, 0x5a, 5 * 1024 * 1024 + 12345);
+        logk("vmalloc: %#018lx, last byte: %#x\n", (uint64_t)vbuf, vbuf[5 * 1024 * 1024 + 12344]);
+    }
+    vfree(vbuf);
+    vmalloc_info();
+
+    // 测试字符串函数：字符串紧贴vmalloc区间末尾的保护页，与逐字节参考实现逐一对照
+    char *guard_end = vmalloc(PAGE_4K_SIZE);
+    if (guard_end) {
+        const struct strops_variant_struct *ref = &strops_variants[0];
+        char *other = guard_end;
+        uint64_t checks = 0, mismatches = 0;
+
+        guard_end += PAGE_4K_SIZE;
+        for (uint32_t v = 1; v < STROPS_NR_VARIANTS; v++) {
+            const struct strops_variant_struct *x = &strops_variants[v];
+            if (x->requires & ~memops.features)
+                continue;
+            for (uint32_t len = 0; len < 80; len++) {
+                char *str = guard_end - len - 1;
+                for (uint32_t i = 0; i < len; i++)
+                    str[i] = 'a' + (i * 7 + len) % 5;
+                str[len] = '\0';
+
+                // 比较对象放在页内另一个对齐位置，末字节不同
+                char *cmp = other + (len % 16);
+                memcpy(cmp, str, len + 1);
+                if (len)
+                    cmp[len - 1] ^= 1;
+
+                int32_t r1 = x->strcmp(str, cmp), r2 = ref->strcmp(str, cmp);
+                int32_t m1 = x->memcmp(str, cmp, len), m2 = ref->memcmp(str, cmp, len);
+                mismatches += x->strlen(str) != ref->strlen(str);
+                mismatches += x->strnlen(str, len / 2) != ref->strnlen(str, len / 2);
+                mismatches += x->strchr(str, 'e') != ref->strchr(str, 'e');
+                mismatches += x->strchr(str, '\0') != ref->strchr(str, '\0');
+                mismatches += x->memchr(str, 'c', len) != ref->memchr(str, 'c', len);
+                mismatches += (r1 < 0) != (r2 < 0) || (r1 > 0) != (r2 > 0);
+                mismatches += (m1 < 0) != (m2 < 0) || (m1 > 0) != (m2 > 0);
+                checks += 7;
+            }
+        }
+        logk("string: %lu checks against the byte reference at a guard page, %lu mismatches\n", checks, mismatches);
+        vfree(guard_end - PAGE_4K_SIZE);
+    }
+
+    // 测试静态键：切换后所有判断处随之改写；跟踪开启期间分配/释放一个页框应输出两条跟踪信息
+    static DEFINE_STATIC_KEY_FALSE(selftest_key);
+    uint8_t key_off = static_branch_unlikely(&selftest_key) | (static_branch_likely(&selftest_key) << 1);
+    static_key_enable(&selftest_key);
+    uint8_t key_on = static_branch_unlikely(&selftest_key) | (static_branch_likely(&selftest_key) << 1);
+    static_key_disable(&selftest_key);
+    uint8_t key_off_again = static_branch_unlikely(&selftest_key) | (static_branch_likely(&selftest_key) << 1);
+    logk("static key: off %u, on %u, off %u (%s)\n", key_off, key_on, key_off_again,
+         key_off == 0 && key_on == 3 && key_off_again == 0 ? "OK" : "BROKEN");
+
+    // 测试SIMD段嵌套：外层在XMM0/YMM0中放入特征值，内层(相当于中断中的SIMD段)清零后退出，外层的值应已恢复
+    uint64_t fpu_pattern[4] = { 0x0123456789abcdefUL, 0xfedcba9876543210UL, 0x0f1e2d3c4b5a6978UL,
+                                0x8796a5b4c3d2e1f0UL };
+    uint64_t fpu_check[4] = { 0 };
+    uint8_t fpu_ymm = cpu_has(X86_FEATURE_AVX);
+    kernel_fpu_begin();
+    if (fpu_ymm)
+        __asm__ __volatile__("vmovdqu %0, %%ymm0" : : "m"(fpu_pattern));
+    else
+        __asm__ __volatile__("movdqu %0, %%xmm0" : : "m"(fpu_pattern));
+    kernel_fpu_begin();
+    __asm__ __volatile__("pxor %%xmm0, %%xmm0" : : : "memory");
+    kernel_fpu_end();
+    if (fpu_ymm)
+        __asm__ __volatile__("vmovdqu %%ymm0, %0" : "=m"(fpu_check));
+    else
+        __asm__ __volatile__("movdqu %%xmm0, %0" : "=m"(fpu_check));
+    kernel_fpu_end();
+    logk("FPU: nested %s section %s, depth %u after exit\n", fpu_ymm ? "YMM" : "XMM",
+         !memcmp(fpu_pattern, fpu_check, fpu_ymm ? 32 : 16) ? "OK" : "CORRUPTED", kernel_fpu_depth());
+
+    static_key_enable(&trace_key);
+    struct page_frame_struct *trace_page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+    if (trace_page)
+        free_pages(trace_page, 1);
+    static_key_disable(&trace_key);
+
+    bench_page_frames();
+    bench_tlb();
+    bench_memops();
+    bench_strings();
+    bench_kernel_fpu();
+
+    // 输出各zone分配统计与碎片情况
+    memory_stats_show(MEMSTAT_CONSOLE | MEMSTAT_SERIAL);
+
     color_printk(DARK_GREEN, WHITE, "Run into kernel hlt loop.\n");
-    while (1)
-        __asm__ volatile("hlt");
-    ;
+    // 空闲时先完成后台任务(如延迟的页框初始化)，无事可做时才进入等待(hlt或mwait)
+    while (1) {
+        if (!run_idle_tasks())
+            cpu_idle();
+    }
 }
@@ -0,0 +1,422 @@
+#include "memblock.h"
+#include "memory.h"
+#include "numa.h"
+#include "lib.h"
+#include "printk.h"
+
+static struct memblock_region_struct memblock_e820_init[MEMBLOCK_INIT_REGIONS];
+static struct memblock_region_struct memblock_memory_init[MEMBLOCK_INIT_REGIONS];
+static struct memblock_region_struct memblock_reserved_init[MEMBLOCK_INIT_REGIONS];
+
+struct memblock_struct memblock = {
+    .e820 = { .max = MEMBLOCK_INIT_REGIONS, .regions = memblock_e820_init, .name = "e820" },
+    .memory = { .max = MEMBLOCK_INIT_REGIONS, .regions = memblock_memory_init, .name = "memory" },
+    .reserved = { .max = MEMBLOCK_INIT_REGIONS, .regions = memblock_reserved_init, .name = "reserved" },
+    .current_limit = MEMBLOCK_BOOT_LIMIT,
+};
+
+static uint64_t memblock_find_range(uint64_t size, uint64_t align, uint64_t start, uint64_t end);
+
+const char *e820_type_name(uint32_t type) {
+    if (type < sizeof(memory_type_array) / sizeof(memory_type_array[0]) && memory_type_array[type])
+        return memory_type_array[type];
+    return "Unknown";
+}
+
+static inline uint64_t e820_raw_base(struct e820_entry_struct *entry) {
+    return ((uint64_t)entry->base_addr_high << 32) | entry->base_addr_low;
+}
+
+static inline uint64_t e820_raw_length(struct e820_entry_struct *entry) {
+    return ((uint64_t)entry->length_high << 32) | entry->length_low;
+}
+
+/**
+ * @brief 把区域表容量加倍，新表从memblock自身分配
+ *
+ * 新表先从可用内存中找出位置、复制旧内容并切换过去，再把自己登记为保留，
+ * 因此扩充的是reserved表本身时也不会递归。旧表很小且只在启动早期出现，不回收。
+ */
+static int32_t memblock_double_array(struct memblock_type_struct *type) {
+    uint64_t old_size = type->max * sizeof(struct memblock_region_struct);
+    uint64_t new_size = old_size * 2;
+    struct memblock_region_struct *old_regions = type->regions;
+
+    if (memblock.frozen)
+        return -1;
+    // 登记新表时reserved表至少要有一个空位，先扩充它，避免两张新表选中同一段内存
+    if (type != &memblock.reserved && memblock.reserved.count == memblock.reserved.max &&
+        memblock_double_array(&memblock.reserved))
+        return -1;
+
+    uint64_t addr = memblock_find_range(new_size, PAGE_4K_SIZE, 0, memblock.current_limit);
+    if (!addr) {
+        errk("memblock: cannot grow %s array to %lu regions\n", type->name, type->max * 2);
+        return -1;
+    }
+
+    struct memblock_region_struct *new_regions = (struct memblock_region_struct *)PHYS_TO_VIRT(addr);
+    memcpy(new_regions, old_regions, old_size);
+    memset((uint8_t *)new_regions + old_size, 0, new_size - old_size);
+    type->regions = new_regions;
+    type->max *= 2;
+    memblock_reserve(addr, new_size);
+    logk("memblock: %s array grown to %lu regions at %#018lx\n", type->name, type->max, addr);
+    return 0;
+}
+
+/**
+ * @brief 在区域表内移动count个表项(源和目标可以重叠)
+ */
+static void memblock_move_regions(struct memblock_region_struct *dest, struct memblock_region_struct *src,
+                                  uint64_t count) {
+    if (dest < src) {
+        for (uint64_t i = 0; i < count; i++)
+            dest[i] = src[i];
+    } else {
+        for (uint64_t i = count; i > 0; i--)
+            dest[i - 1] = src[i - 1];
+    }
+}
+
+static void memblock_insert_region(struct memblock_type_struct *type, uint64_t index, uint64_t base, uint64_t size,
+                                   uint32_t type_id) {
+    memblock_move_regions(&type->regions[index + 1], &type->regions[index], type->count - index);
+    type->regions[index].base = base;
+    type->regions[index].size = size;
+    type->regions[index].type = type_id;
+    type->count++;
+    type->total_size += size;
+}
+
+static void memblock_remove_region(struct memblock_type_struct *type, uint64_t index) {
+    type->total_size -= type->regions[index].size;
+    type->count--;
+    memblock_move_regions(&type->regions[index], &type->regions[index + 1], type->count - index);
+}
+
+/**
+ * @brief 向区域表加入[base, base + size)，与之重叠或相邻的同类型区域合并为一个
+ */
+static int32_t memblock_add_range(struct memblock_type_struct *type, uint64_t base, uint64_t size,
+                                  uint32_t type_id) {
+    uint64_t end = base + size;
+    uint64_t i = 0;
+
+    if (!size)
+        return 0;
+    if (end < base)
+        end = ~0UL;
+
+    // 扩充区域表可能改变reserved表，必须在定位插入位置之前完成
+    if (type->count == type->max && memblock_double_array(type))
+        return -1;
+
+    while (i < type->count && type->regions[i].base + type->regions[i].size < base)
+        i++;
+    while (i < type->count && type->regions[i].base <= end) {
+        struct memblock_region_struct *region = &type->regions[i];
+        uint64_t region_end = region->base + region->size;
+
+        if (region->type != type_id) {
+            i++;
+            continue;
+        }
+        if (region->base < base)
+            base = region->base;
+        if (region_end > end)
+            end = region_end;
+        memblock_remove_region(type, i);
+    }
+
+    // 同一位置可能残留不同类型的相邻区域，保持按起始地址排序
+    while (i > 0 && type->regions[i - 1].base > base)
+        i--;
+    while (i < type->count && type->regions[i].base < base)
+        i++;
+    memblock_insert_region(type, i, base, end - base, type_id);
+    return 0;
+}
+
+/**
+ * @brief 从区域表中去掉[base, base + size)，跨越两端的区域被拆成两段
+ */
+static int32_t memblock_remove_range(struct memblock_type_struct *type, uint64_t base, uint64_t size) {
+    uint64_t end = base + size;
+
+    if (!size)
+        return 0;
+    if (end < base)
+        end = ~0UL;
+
+    for (uint64_t i = 0; i < type->count;) {
+        struct memblock_region_struct *region = &type->regions[i];
+        uint64_t region_end = region->base + region->size;
+
+        if (region_end <= base) {
+            i++;
+            continue;
+        }
+        if (region->base >= end)
+            break;
+
+        if (region->base < base && region_end > end) {
+            if (type->count == type->max && memblock_double_array(type))
+                return -1;
+            region = &type->regions[i];
+            type->total_size -= region_end - base;
+            region->size = base - region->base;
+            memblock_insert_region(type, i + 1, end, region_end - end, region->type);
+            break;
+        }
+
+        if (region->base >= base && region_end <= end) {
+            memblock_remove_region(type, i);
+            continue;
+        }
+
+        if (region->base < base) {
+            type->total_size -= region_end - base;
+            region->size = base - region->base;
+        } else {
+            type->total_size -= end - region->base;
+            region->size = region_end - end;
+            region->base = end;
+        }
+        i++;
+    }
+    return 0;
+}
+
+int32_t memblock_add(uint64_t base, uint64_t size) {
+    return memblock_add_range(&memblock.memory, base, size, E820_TYPE_RAM);
+}
+
+int32_t memblock_remove(uint64_t base, uint64_t size) {
+    return memblock_remove_range(&memblock.memory, base, size);
+}
+
+int32_t memblock_reserve(uint64_t base, uint64_t size) {
+    return memblock_add_range(&memblock.reserved, base, size, 0);
+}
+
+int32_t memblock_free(uint64_t base, uint64_t size) {
+    return memblock_remove_range(&memblock.reserved, base, size);
+}
+
+/**
+ * @brief 在[start, end)内自高向低查找一段未保留的可用内存
+ * @return 物理地址，找不到返回0(物理地址0位于保留的低端内存中，不会被分配)
+ *
+ * 从高地址开始分配，低端内存(DMA)留给确实需要它的设备。
+ */
+static uint64_t memblock_find_range(uint64_t size, uint64_t align, uint64_t start, uint64_t end) {
+    struct memblock_type_struct *memory = &memblock.memory;
+    struct memblock_type_struct *reserved = &memblock.reserved;
+
+    for (int64_t i = memory->count - 1; i >= 0; i--) {
+        uint64_t mem_start = memory->regions[i].base;
+        uint64_t mem_end = mem_start + memory->regions[i].size;
+
+        // 第j个空闲段位于第j-1个与第j个保留区之间
+        for (int64_t j = reserved->count; j >= 0; j--) {
+            uint64_t lo = j > 0 ? reserved->regions[j - 1].base + reserved->regions[j - 1].size : 0;
+            uint64_t hi = j < (int64_t)reserved->count ? reserved->regions[j].base : ~0UL;
+
+            if (lo < mem_start)
+                lo = mem_start;
+            if (lo < start)
+                lo = start;
+            if (hi > mem_end)
+                hi = mem_end;
+            if (hi > end)
+                hi = end;
+            if (hi <= lo || hi - lo < size)
+                continue;
+
+            uint64_t addr = (hi - size) & ~(align - 1);
+            if (addr >= lo && addr)
+                return addr;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 分配一段物理内存
+ * @param node 优先使用的NUMA节点，NUMA_NO_NODE表示不限；该节点内没有合适的空间时退回任意节点
+ * @return 物理地址，失败返回0
+ */
+uint64_t memblock_phys_alloc(uint64_t size, uint64_t align, uint32_t node) {
+    uint64_t addr = 0;
+
+    if (memblock.frozen) {
+        warnk("memblock: allocation of %#lx bytes after handover\n", size);
+        return 0;
+    }
+    if (!align)
+        align = sizeof(uint64_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    // 按与zone相同的规则枚举节点范围，自高向低依次尝试
+    if (node != NUMA_NO_NODE && numa_info.nr_memblks) {
+        uint64_t limit_pfn = memblock.current_limit >> PAGE_2M_SHIFT;
+        uint64_t pfn = 0;
+
+        while (pfn < limit_pfn && !addr) {
+            uint64_t end_pfn = limit_pfn;
+            if (numa_node_of_range(pfn, &end_pfn) == node)
+                addr = memblock_find_range(size, align, pfn << PAGE_2M_SHIFT, end_pfn << PAGE_2M_SHIFT);
+            pfn = end_pfn;
+        }
+    }
+    if (!addr)
+        addr = memblock_find_range(size, align, 0, memblock.current_limit);
+    if (!addr || memblock_reserve(addr, size))
+        return 0;
+    return addr;
+}
+
+/**
+ * @brief 分配并清零一段内存
+ * @return 直接映射区线性地址，失败返回NULL
+ */
+void *memblock_alloc(uint64_t size, uint64_t align, uint32_t node) {
+    uint64_t addr = memblock_phys_alloc(size, align, node);
+    if (!addr)
+        return NULL;
+
+    memset(PHYS_TO_VIRT(addr), 0, size);
+    return PHYS_TO_VIRT(addr);
+}
+
+/**
+ * @brief 设置分配的物理地址上限(直接映射建立后放开到全部内存)
+ */
+void memblock_set_current_limit(uint64_t limit) {
+    memblock.current_limit = limit;
+}
+
+/**
+ * @brief 清理后e820表覆盖的最高物理地址
+ */
+uint64_t memblock_end_of_e820(void) {
+    struct memblock_type_struct *e820 = &memblock.e820;
+
+    if (!e820->count)
+        return 0;
+    return e820->regions[e820->count - 1].base + e820->regions[e820->count - 1].size;
+}
+
+/**
+ * @brief 页框分配器接管后调用，之后的memblock分配都会失败
+ */
+void memblock_freeze(void) {
+    memblock.frozen = 1;
+    logk("memblock: handed over, %lu regions / %#lx bytes reserved\n", memblock.reserved.count,
+         memblock.reserved.total_size);
+}
+
+/**
+ * @brief 清理BIOS提供的e820表：按地址排序，重叠部分取优先级高的类型(可用内存优先级最低)，
+ *        相邻的同类型区域合并
+ *
+ * 原始条目数不设上限，在引导程序缓冲区中原地排序；结果表不够大时自动扩充。
+ */
+static void memblock_sanitize_e820(struct e820_entry_struct *entries, uint32_t count) {
+    // 原地插入排序(条目为packed结构，整体复制)
+    for (uint32_t i = 1; i < count; i++) {
+        struct e820_entry_struct key = entries[i];
+        uint32_t j = i;
+        while (j > 0 && e820_raw_base(&entries[j - 1]) > e820_raw_base(&key)) {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = key;
+    }
+
+    // 依次取下一个变化点，确定两个变化点之间的类型
+    uint64_t pos = count ? e820_raw_base(&entries[0]) : 0;
+    while (1) {
+        uint64_t next = ~0UL;
+        uint32_t type = 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t base = e820_raw_base(&entries[i]);
+            uint64_t end = base + e820_raw_length(&entries[i]);
+
+            if (end <= base)
+                continue;
+            if (base > pos && base < next)
+                next = base;
+            if (end > pos && end < next)
+                next = end;
+            if (base <= pos && end > pos) {
+                uint32_t t = entries[i].type;
+                // 可用内存优先级最低，其余类型编号越大越优先
+                if (!type || (type == E820_TYPE_RAM && t != E820_TYPE_RAM) ||
+                    (t != E820_TYPE_RAM && t > type))
+                    type = t;
+            }
+        }
+        if (next == ~0UL)
+            break;
+        if (type)
+            memblock_add_range(&memblock.e820, pos, next - pos, type);
+        pos = next;
+    }
+}
+
+/**
+ * @brief 读取引导程序保存的e820表，建立可用内存与保留内存表
+ *
+ * 低端1MB(BIOS数据、引导程序缓冲区)和内核镜像最先登记为保留；之后扩充区域表所需的内存
+ * 只会从已确认可用且不与任何非可用条目重叠的范围中取得。
+ */
+void memblock_init(void) {
+    uint32_t count = *(uint32_t *)MEMORY_STRUCT_BUFFER_ADDR;
+    struct e820_entry_struct *entries = (struct e820_entry_struct *)(MEMORY_STRUCT_BUFFER_ADDR + 4);
+    uint64_t kernel_end = PAGE_4K_ALIGN(VIRT_TO_PHYS(&_end));
+
+    memblock_reserve(0, kernel_end);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t base = e820_raw_base(&entries[i]);
+        uint64_t length = e820_raw_length(&entries[i]);
+        logk("E820 entry[%02u] base:%#018lx length:%#018lx type:%s\n", i, base, length,
+             e820_type_name(entries[i].type));
+    }
+
+    // 每加入一段可用内存立即扣除与之重叠的非可用条目，任何时刻memory表中都只有确认可用的内存
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].type != E820_TYPE_RAM)
+            continue;
+        uint64_t base = e820_raw_base(&entries[i]);
+        uint64_t end = base + e820_raw_length(&entries[i]);
+
+        memblock_add(base, end - base);
+        for (uint32_t j = 0; j < count; j++) {
+            uint64_t other = e820_raw_base(&entries[j]);
+            uint64_t other_end = other + e820_raw_length(&entries[j]);
+            if (entries[j].type != E820_TYPE_RAM && other < end && other_end > base)
+                memblock_remove(other, other_end - other);
+        }
+    }
+
+    memblock_sanitize_e820(entries, count);
+    logk("memblock: %u raw e820 entries -> %lu sanitized, %lu RAM regions (%lu MB)\n", count, memblock.e820.count,
+         memblock.memory.count, memblock.memory.total_size >> 20);
+}
+
+void memblock_dump(void) {
+    struct memblock_type_struct *types[] = { &memblock.e820, &memblock.memory, &memblock.reserved };
+    struct memblock_region_struct *region;
+
+    for (uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        logk("memblock.%s: %lu regions, %#lx bytes\n", types[t]->name, types[t]->count, types[t]->total_size);
+        for_each_memblock(types[t], region) {
+            logk("  [%#018lx - %#018lx) %s\n", region->base, region->base + region->size,
+                 types[t] == &memblock.e820 ? e820_type_name(region->type) : "");
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef __MEMBLOCK_H__
+#define __MEMBLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define MEMBLOCK_INIT_REGIONS   128             // 静态区域表容量，用完后从memblock自身分配加倍的表
+#define MEMBLOCK_BOOT_LIMIT     0xa00000UL      // head.S映射的低端内存(0-10MB)，直接映射建立前只能在此范围内分配
+#define MEMBLOCK_ALLOC_ANYWHERE (~0UL)
+
+#define E820_TYPE_RAM           1
+#define E820_TYPE_RESERVED      2
+#define E820_TYPE_ACPI          3
+#define E820_TYPE_NVS           4
+#define E820_TYPE_UNUSABLE      5
+
+// 一段物理内存区域
+struct memblock_region_struct {
+    uint64_t base;
+    uint64_t size;
+    uint32_t type;                      // E820类型(只有e820表使用)
+};
+
+// 按地址排序、互不重叠的区域表
+struct memblock_type_struct {
+    uint64_t count;
+    uint64_t max;                       // 区域表容量
+    uint64_t total_size;
+    struct memblock_region_struct *regions;
+    const char *name;
+};
+
+// 启动早期物理内存管理：页框分配器就绪前的所有分配都从这里取得
+struct memblock_struct {
+    struct memblock_type_struct e820;       // 清理后的e820表(排序、去重叠，相邻同类型区域合并)
+    struct memblock_type_struct memory;     // 可用内存
+    struct memblock_type_struct reserved;   // 已占用的内存(低端1MB、内核镜像、早期分配)
+    uint64_t current_limit;                 // 分配的物理地址上限(不含)
+    uint8_t frozen;                         // 页框分配器已接管，不再分配
+};
+
+extern struct memblock_struct memblock;
+
+#define for_each_memblock(type, region) \
+    for (region = (type)->regions; region < (type)->regions + (type)->count; region++)
+
+void memblock_init(void);
+int32_t memblock_add(uint64_t base, uint64_t size);
+int32_t memblock_remove(uint64_t base, uint64_t size);
+int32_t memblock_reserve(uint64_t base, uint64_t size);
+int32_t memblock_free(uint64_t base, uint64_t size);
+void memblock_set_current_limit(uint64_t limit);
+uint64_t memblock_phys_alloc(uint64_t size, uint64_t align, uint32_t node);
+void *memblock_alloc(uint64_t size, uint64_t align, uint32_t node);
+uint64_t memblock_end_of_e820(void);
+void memblock_freeze(void);
+void memblock_dump(void);
+const char *e820_type_name(uint32_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
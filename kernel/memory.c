@@ -2,31 +2,42 @@
 #include "lib.h"
 #include "gdt.h"
 #include "printk.h"
+#include "slab.h"
+#include "pgtable.h"
+#include "vbe.h"
+#include "cpu.h"
+#include "idle.h"
+#include "serial.h"
+#include "memblock.h"
 
 struct global_memory_manager_struct global_memory_manager_struct;
+struct cma_area_struct cma_area = { .lock = SPIN_LOCK_UNLOCKED };
+static struct zero_pool_struct zero_pool[MAX_NUMNODES];
+
+// __free_pages的释放方式
+#define FREE_COLD       0x1     // 单页放入per-CPU缓存尾部(内容已不在CPU缓存中)
+#define FREE_NO_PCP     0x2     // 绕过per-CPU缓存直接归还buddy(规整要让旧页立即参与合并)
+
+static int32_t __migrate_page(struct page_frame_struct *old_page, struct page_frame_struct *new_page,
+                              uint32_t free_flags);
 
 uint64_t page_init(struct page_frame_struct *page_frame, uint32_t flags) {
     // 确保传入有效页框
-    if (!page_frame || !page_frame->zone) {
+    if (!page_frame || page_zone_id(page_frame) == PAGE_ZONE_NONE) {
         fatalk("Invalid page frame or zone");
         while (1)
             __asm__ volatile("hlt");
         ;
     }
 
-    struct memory_zone_struct *zone = page_frame->zone;
-
     // 场景1：初始化未使用的页框
     if ((page_frame->flags & PAGE_USED) == 0) {
-        // 注意：不在这里设置位图，由调用者统一管理位图
+        // 注意：不在这里设置位图和区域统计，由调用者(buddy)统一管理
         
         // 更新页框属性
-        page_frame->flags = flags | PAGE_USED; // 默认标记为已使用
+        page_frame->flags = flags | PAGE_USED | (page_frame->flags & PAGE_PERSIST_MASK); // 默认标记为已使用
         page_frame->ref_count = 1;
-
-        // 更新区域统计
-        zone->nr_free--;
-        zone->GMM_struct->huge_page_info.free_2m_pages--;
+        page_frame->private = 0;            // 与空闲链表节点共用，清除残留的链接
 
         return 0;
     }
@@ -44,544 +55,2206 @@ uint64_t page_init(struct page_frame_struct *page_frame, uint32_t flags) {
     return 0;
 }
 
-void init_memory(void) {
-    logk("Start init memory...\n");
+/**
+ * @brief 将位图中[start_pfn, start_pfn + count)范围的位置1(按64位字批量处理)
+ */
+static void bitmap_set_range(uint64_t start_pfn, uint64_t count) {
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
 
-    uint32_t *entry_count_ptr = (uint32_t *)MEMORY_STRUCT_BUFFER_ADDR;
-    struct e820_entry_struct *entries = (struct e820_entry_struct *)(MEMORY_STRUCT_BUFFER_ADDR + 4);
+    while (count) {
+        uint64_t bit = start_pfn % 64;
+        uint64_t n = 64 - bit < count ? 64 - bit : count;
+        uint64_t mask = (n == 64) ? ~0UL : (((1UL << n) - 1) << bit);
 
-    // 1. 保存原始E820数据到内存管理器
-    global_memory_manager_struct.e820_entry_count = *entry_count_ptr;
-    if (global_memory_manager_struct.e820_entry_count > E820_MAX_ENTRIES) {
-        warnk("E820 entry count overflow! Truncated to %d\n", E820_MAX_ENTRIES);
-        global_memory_manager_struct.e820_entry_count = E820_MAX_ENTRIES;
+        bitmap[start_pfn / 64] |= mask;
+        start_pfn += n;
+        count -= n;
     }
+}
+
+/**
+ * @brief 将位图中[start_pfn, start_pfn + count)范围的位清0
+ */
+static void bitmap_clear_range(uint64_t start_pfn, uint64_t count) {
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
 
-    // 拷贝原始E820条目（逐个字段拷贝确保packed结构正确）
-    for (uint32_t i = 0; i < global_memory_manager_struct.e820_entry_count; ++i) {
-        memcpy(&global_memory_manager_struct.e820_entry[i], &entries[i], sizeof(struct e820_entry_struct));
+    while (count) {
+        uint64_t bit = start_pfn % 64;
+        uint64_t n = 64 - bit < count ? 64 - bit : count;
+        uint64_t mask = (n == 64) ? ~0UL : (((1UL << n) - 1) << bit);
+
+        bitmap[start_pfn / 64] &= ~mask;
+        start_pfn += n;
+        count -= n;
     }
+}
 
-    // 2. 处理对齐并统计可用页
-    uint64_t total_memory = 0;
-    global_memory_manager_struct.huge_page_info.total_2m_pages = 0;
+static inline void page_list_init(struct page_list_head *head) {
+    head->first = PFN_NONE;
+    head->last = PFN_NONE;
+}
 
-    uint64_t max_pfn = 0;       // 最大页框号
-    for (uint32_t i = 0; i < global_memory_manager_struct.e820_entry_count; ++i) {
-        struct e820_entry_struct *entry = &global_memory_manager_struct.e820_entry[i];
-        uint64_t base = ((uint64_t)entry->base_addr_high << 32) | entry->base_addr_low;
-        uint64_t length = ((uint64_t)entry->length_high << 32) | entry->length_low;
-        uint64_t end = base + length;
+static inline uint8_t page_list_empty(const struct page_list_head *head) {
+    return head->first == PFN_NONE;
+}
 
-        // 计算该区域的最大PFN（无论是否可用）
-        uint64_t region_max_pfn = end >> PAGE_2M_SHIFT;
-        if (region_max_pfn > max_pfn) {
-            max_pfn = region_max_pfn;
-        }
+/**
+ * @brief 将页框插入链表头部
+ */
+static inline void page_list_add(struct page_list_head *head, struct page_frame_struct *page) {
+    uint32_t pfn = page_to_pfn(page);
 
-        // 打印原始内存信息
-        logk("E820 entry[%02d] base:%#018lx length:%#018lx type:%s\n", i, base, length,
-             memory_type_array[entry->type]);
+    page->lru.prev = PFN_NONE;
+    page->lru.next = head->first;
+    if (head->first != PFN_NONE)
+        pfn_to_page(head->first)->lru.prev = pfn;
+    else
+        head->last = pfn;
+    head->first = pfn;
+}
 
-        // 仅处理可用内存区域
-        if (entry->type != 1 || length == 0)
-            continue;
+/**
+ * @brief 将页框插入链表尾部
+ */
+static inline void page_list_add_tail(struct page_list_head *head, struct page_frame_struct *page) {
+    uint32_t pfn = page_to_pfn(page);
 
-        // 计算对齐后的可用区域
-        uint64_t aligned_base = (base + PAGE_2M_SIZE - 1) & PAGE_2M_MASK;
-        uint64_t aligned_end = end & PAGE_2M_MASK; 
+    page->lru.next = PFN_NONE;
+    page->lru.prev = head->last;
+    if (head->last != PFN_NONE)
+        pfn_to_page(head->last)->lru.next = pfn;
+    else
+        head->first = pfn;
+    head->last = pfn;
+}
 
-        if (aligned_base >= aligned_end) {
-            logk("Skip non-alignable areas: base=%#lx end=%#lx\n", base, end);
-            continue;
-        }
+static inline void page_list_del(struct page_list_head *head, struct page_frame_struct *page) {
+    if (page->lru.prev != PFN_NONE)
+        pfn_to_page(page->lru.prev)->lru.next = page->lru.next;
+    else
+        head->first = page->lru.next;
+    if (page->lru.next != PFN_NONE)
+        pfn_to_page(page->lru.next)->lru.prev = page->lru.prev;
+    else
+        head->last = page->lru.prev;
+}
 
-        // 统计可用页
-        uint64_t aligned_length = aligned_end - aligned_base;
-        uint64_t pages = aligned_length / PAGE_2M_SIZE;
-        global_memory_manager_struct.huge_page_info.total_2m_pages += pages;
+/**
+ * @brief 计算容纳nr_pages个页所需的最小阶数
+ */
+static inline uint32_t get_order(uint64_t nr_pages) {
+    if (nr_pages <= 1)
+        return 0;
+    return 64 - __builtin_clzll(nr_pages - 1);
+}
 
-        // 调试信息
-        logk("Alignment area: base=%#018lx end=%#018lx pages=%lu (%#lx)\n", aligned_base, aligned_end, pages,
-             aligned_length);
+/**
+ * @brief 累加本CPU的zone统计计数
+ *
+ * 单条不带lock前缀的add指令：不会被本CPU的中断打断，其他CPU也不写这份计数，
+ * 因此热路径上不需要原子操作或加锁。
+ */
+#define zone_stat_add(zone, field, n) \
+    __asm__ __volatile__("addq %1, %0" \
+                         : "+m"((zone)->stat[smp_processor_id()].field) \
+                         : "er"((uint64_t)(n)))
+
+static inline uint32_t page_free_list_type(struct page_frame_struct *page) {
+    return (page->flags & PAGE_CMA) ? FREE_LIST_CMA : FREE_LIST_NORMAL;
+}
+
+/**
+ * @brief 更新某一阶的空闲块计数
+ */
+static inline void free_area_account(struct free_area_struct *area, uint32_t type, int64_t nr_blocks) {
+    area->nr_free += nr_blocks;
+    if (type == FREE_LIST_CMA)
+        area->nr_free_cma += nr_blocks;
+}
+
+/**
+ * @brief 更新zone与全局的空闲页统计
+ */
+static inline void buddy_account(struct memory_zone_struct *zone, uint32_t type, int64_t nr_pages) {
+    zone->nr_free += nr_pages;
+    if (type == FREE_LIST_CMA)
+        zone->nr_free_cma += nr_pages;
+    zone->GMM_struct->huge_page_info.free_2m_pages += nr_pages;
+}
+
+/**
+ * @brief 将一个2^order大小的空闲块挂入buddy，并尽可能与伙伴块合并
+ *
+ * 伙伴块按绝对页框号对齐(buddy_pfn = pfn ^ (1 << order))，合并时只与
+ * 同一zone内、同阶、同链表类型(CMA/非CMA)且整体空闲的伙伴块合并。
+ */
+static void buddy_free_block(struct memory_zone_struct *zone, uint64_t pfn, uint32_t order) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint32_t type = page_free_list_type(&pages[pfn]);
 
-        total_memory += length; // 保持原始总内存统计
+    buddy_account(zone, type, 1L << order);
+
+    while (order < MAX_ORDER - 1) {
+        uint64_t buddy_pfn = pfn ^ (1UL << order);
+        struct page_frame_struct *buddy = &pages[buddy_pfn];
+
+        if (buddy_pfn < zone->start_pfn || buddy_pfn + (1UL << order) > zone->end_pfn)
+            break;
+        // 伙伴所在section尚未初始化时其元信息无效，等该section初始化时再从另一侧合并
+        if (!section_initialized(pfn_to_section(buddy_pfn)))
+            break;
+        if (!(buddy->flags & PAGE_BUDDY) || buddy->order != order || page_free_list_type(buddy) != type)
+            break;
+
+        // 伙伴空闲，摘下后合并为更高一阶
+        page_list_del(&zone->free_area[order].free_list[type], buddy);
+        buddy->flags &= ~PAGE_BUDDY;
+        free_area_account(&zone->free_area[order], type, -1);
+
+        pfn &= ~(1UL << order);
+        order++;
     }
 
-    // 输出统计结果
-    logk("Total memory: %#018lx bytes (%#lu MB)\n", total_memory, total_memory >> 20);
-    logk("Total available 2M pages: %#lu (%#018lx bytes)\n", global_memory_manager_struct.huge_page_info.total_2m_pages,
-         global_memory_manager_struct.huge_page_info.total_2m_pages * PAGE_2M_SIZE);
+    struct page_frame_struct *page = &pages[pfn];
+    page->flags |= PAGE_BUDDY;
+    page->order = order;
+    page_list_add(&zone->free_area[order].free_list[type], page);
+    free_area_account(&zone->free_area[order], type, 1);
+}
 
-    logk("System total memory: %#018lx\n", total_memory);
+/**
+ * @brief 将任意长度的连续空闲页归还buddy(拆分为尽可能大的对齐块，且不跨越CMA区边界)
+ */
+static void buddy_free_range(struct memory_zone_struct *zone, uint64_t pfn, uint64_t count) {
+    uint64_t cma_start = cma_area.base_pfn, cma_end = cma_area.base_pfn + cma_area.count;
 
-    // 获取内核代码、数据、结束地址
-    global_memory_manager_struct.kernel_addr_info.start_code = (uint64_t)&_text;
-    global_memory_manager_struct.kernel_addr_info.end_code = (uint64_t)&_etext;
-    global_memory_manager_struct.kernel_addr_info.end_data = (uint64_t)&_edata;
-    global_memory_manager_struct.kernel_addr_info.end_krnl = (uint64_t)&_end;
-    logk("start_code: %#018lx; end_code: %#018lx; end_data: %#018lx; end_krnl: %#018lx\n",
-         global_memory_manager_struct.kernel_addr_info.start_code, global_memory_manager_struct.kernel_addr_info.end_code,
-         global_memory_manager_struct.kernel_addr_info.end_data, global_memory_manager_struct.kernel_addr_info.end_krnl);
-    
-    // 初始化内存页位图
-    global_memory_manager_struct.bitmap.addr = (uint64_t *)((global_memory_manager_struct.kernel_addr_info.end_krnl + PAGE_4K_SIZE - 1) & PAGE_4K_MASK);
-    global_memory_manager_struct.bitmap.count = max_pfn + 1;
-    global_memory_manager_struct.bitmap.size = ((max_pfn + 1 + 63) / 64) * sizeof(uint64_t);
-    memset((void *)global_memory_manager_struct.bitmap.addr, 0x00, global_memory_manager_struct.bitmap.size);
-    
-    logk("Bitmap initialized at %#018lx, size: %#018lx bytes\n", 
-        (uint64_t)global_memory_manager_struct.bitmap.addr, 
-        global_memory_manager_struct.bitmap.size);
-
-    // 非可用区域标记
-    for (uint32_t i = 0; i < global_memory_manager_struct.e820_entry_count; ++i) {
-        struct e820_entry_struct *entry = &global_memory_manager_struct.e820_entry[i];
-        if (entry->type == 1) continue; // 跳过可用区域
-        uint64_t base = ((uint64_t)entry->base_addr_high << 32) | entry->base_addr_low;
-        uint64_t length = ((uint64_t)entry->length_high << 32) | entry->length_low;
-        uint64_t start_pfn = PAGE_2M_ALIGN(base) >> PAGE_2M_SHIFT;
-        uint64_t end_pfn = (base + length) >> PAGE_2M_SHIFT;
-        for (uint64_t pfn = start_pfn; pfn < end_pfn; ++pfn) {
-            uint64_t word = pfn / 64;
-            uint64_t bit = pfn % 64;
-            global_memory_manager_struct.bitmap.addr[word] |= (1UL << bit); // 标记保留区域[^1]
+    while (count) {
+        uint32_t order = pfn ? __builtin_ctzll(pfn) : MAX_ORDER - 1;
+        uint64_t limit = count;
+
+        if (cma_area.zone == zone) {
+            if (pfn < cma_start && pfn + limit > cma_start)
+                limit = cma_start - pfn;
+            else if (pfn < cma_end && pfn + limit > cma_end)
+                limit = cma_end - pfn;
         }
-    }
 
-    // 初始化页框结构体数组
-    global_memory_manager_struct.page.addr = (struct page_frame_struct *)(((uint64_t)global_memory_manager_struct.bitmap.addr + global_memory_manager_struct.bitmap.size + PAGE_4K_SIZE - 1) & PAGE_4K_MASK);
-    global_memory_manager_struct.page.count = max_pfn + 1;
-    global_memory_manager_struct.page.size = (global_memory_manager_struct.page.count * sizeof(struct page_frame_struct) + 63) & ~63;
-    memset(global_memory_manager_struct.page.addr, 0x00, global_memory_manager_struct.page.size);
-    for (uint64_t pfn = 0; pfn <= max_pfn; ++pfn) {
-        struct page_frame_struct *page = &global_memory_manager_struct.page.addr[pfn];
-        page->zone = NULL;
-        page->pfn = pfn;
-        page->ref_count = 0;
-        page->flags = PAGE_RESERVED;  // 默认标记为保留
-        page->page_size = PAGE_2M;
-    }
-
-    // 初始化内存区域结构体数组
-    global_memory_manager_struct.zone.addr = (struct memory_zone_struct *)(((uint64_t)global_memory_manager_struct.page.addr + global_memory_manager_struct.page.size + PAGE_4K_SIZE - 1) & PAGE_4K_MASK);
-    global_memory_manager_struct.zone.count = 0;
-    global_memory_manager_struct.zone.size = (global_memory_manager_struct.e820_entry_count * sizeof(struct memory_zone_struct) + 63) & ~63;        // 这里直接使用e820读出的内存区域数量，虽然这个数量中包含type不是1的内存区域
-    memset(global_memory_manager_struct.zone.addr, 0x00, global_memory_manager_struct.zone.size);
-    
-    // 初始化zone
-    for (uint32_t i = 0; i < global_memory_manager_struct.e820_entry_count; ++i) {
-        uint64_t start, end;
-        
-        // 过滤掉非可用内存区域
-        if (global_memory_manager_struct.e820_entry[i].type != 1)
-            continue;
+        if (order > MAX_ORDER - 1)
+            order = MAX_ORDER - 1;
+        while ((1UL << order) > limit)
+            order--;
 
-        // 处理对齐
-        start = PAGE_2M_ALIGN((uint64_t)global_memory_manager_struct.e820_entry[i].base_addr_high << 32 | 
-                            (uint64_t)global_memory_manager_struct.e820_entry[i].base_addr_low);
-        end = (((uint64_t)global_memory_manager_struct.e820_entry[i].base_addr_high << 32 | 
-            (uint64_t)global_memory_manager_struct.e820_entry[i].base_addr_low) + 
-            ((uint64_t)global_memory_manager_struct.e820_entry[i].length_high << 32 | 
-            (uint64_t)global_memory_manager_struct.e820_entry[i].length_low)) & PAGE_2M_MASK;
+        buddy_free_block(zone, pfn, order);
+        pfn += 1UL << order;
+        count -= 1UL << order;
+    }
+}
 
-        if (end <= start)
+/**
+ * @brief 从zone的buddy中取出一个2^order大小的空闲块
+ *
+ * 从所需阶向上查找第一个非空链表，高阶块对半拆分，多余的后半部分挂回低阶链表。
+ * @param type 从哪类空闲链表分配
+ * @return 块首页页框号，失败返回(uint64_t)-1
+ */
+static uint64_t buddy_alloc_block(struct memory_zone_struct *zone, uint32_t order, uint32_t type) {
+    for (uint32_t current_order = order; current_order < MAX_ORDER; current_order++) {
+        struct free_area_struct *area = &zone->free_area[current_order];
+        if (page_list_empty(&area->free_list[type]))
             continue;
 
-        // 检查是否需要分割区域
-        uint64_t dma_boundary = 0x1000000; // 16MB
-        
-        // 如果区域跨越DMA边界，需要分割
-        if (start < dma_boundary && end > dma_boundary) {
-            // 创建DMA区域 (start到16MB)
-            struct memory_zone_struct *dma_zone;
-            dma_zone = global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.count;
-            global_memory_manager_struct.zone.count++;
-            
-            dma_zone->start_pfn = start >> PAGE_2M_SHIFT;
-            dma_zone->end_pfn = dma_boundary >> PAGE_2M_SHIFT;
-            dma_zone->total_pages = dma_zone->end_pfn - dma_zone->start_pfn;
-            dma_zone->nr_free = dma_zone->total_pages;
-            dma_zone->attr = 0;
-            dma_zone->GMM_struct = &global_memory_manager_struct;
-            dma_zone->type = ZONE_DMA;
-            dma_zone->page_array = &global_memory_manager_struct.page.addr[dma_zone->start_pfn];
-            
-            // 初始化DMA区域的页框
-            struct page_frame_struct *page_frame = dma_zone->page_array;
-            for(int j = 0; j < dma_zone->total_pages; j++, page_frame++) {
-                page_frame->zone = dma_zone;
-                page_frame->pfn = dma_zone->start_pfn + j;
-                page_frame->ref_count = 0;
-                page_frame->flags = 0;
-                page_frame->page_size = PAGE_2M;
-            }
-            
-            logk("Created ZONE_DMA: start_pfn=%#lx, end_pfn=%#lx, pages=%#lx\n", 
-                dma_zone->start_pfn, dma_zone->end_pfn, dma_zone->total_pages);
-                
-            // 创建Normal区域 (16MB到end)
-            struct memory_zone_struct *normal_zone;
-            normal_zone = global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.count;
-            global_memory_manager_struct.zone.count++;
-            
-            normal_zone->start_pfn = dma_boundary >> PAGE_2M_SHIFT;
-            normal_zone->end_pfn = end >> PAGE_2M_SHIFT;
-            normal_zone->total_pages = normal_zone->end_pfn - normal_zone->start_pfn;
-            normal_zone->nr_free = normal_zone->total_pages;
-            normal_zone->attr = 0;
-            normal_zone->GMM_struct = &global_memory_manager_struct;
-            normal_zone->type = ZONE_NORMAL;
-            normal_zone->page_array = &global_memory_manager_struct.page.addr[normal_zone->start_pfn];
-            
-            // 初始化Normal区域的页框
-            page_frame = normal_zone->page_array;
-            for(int j = 0; j < normal_zone->total_pages; j++, page_frame++) {
-                page_frame->zone = normal_zone;
-                page_frame->pfn = normal_zone->start_pfn + j;
-                page_frame->ref_count = 0;
-                page_frame->flags = 0;
-                page_frame->page_size = PAGE_2M;
-            }
-            
-            logk("Created ZONE_NORMAL: start_pfn=%#lx, end_pfn=%#lx, pages=%#lx\n", 
-                normal_zone->start_pfn, normal_zone->end_pfn, normal_zone->total_pages);
-        } 
-        else {
-            // 处理不需要分割的区域，保持原有逻辑
-            struct memory_zone_struct *zone;
-            zone = global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.count;
-            global_memory_manager_struct.zone.count++;
-            
-            zone->total_pages = (end - start) >> PAGE_2M_SHIFT;
-            zone->start_pfn = start >> PAGE_2M_SHIFT;
-            zone->end_pfn = end >> PAGE_2M_SHIFT;
-            zone->nr_free = zone->total_pages;
-            zone->attr = 0;
-            zone->GMM_struct = &global_memory_manager_struct;
-            zone->type = (start < 0x1000000) ? ZONE_DMA : ZONE_NORMAL;
-            zone->page_array = &global_memory_manager_struct.page.addr[zone->start_pfn];
-
-            struct page_frame_struct *page_frame = zone->page_array;
-            for(int j = 0; j < zone->total_pages; j++, page_frame++) {
-                if (zone->end_pfn > max_pfn) {
-                    fatalk("Zone %d end_pfn %lu exceeds max_pfn %lu",
-                        i, zone->end_pfn, max_pfn);
-                    while (1)
-                        __asm__ volatile("hlt");
-                    ;
-                }
+        struct page_frame_struct *page = pfn_to_page(area->free_list[type].first);
+        page_list_del(&area->free_list[type], page);
+        page->flags &= ~PAGE_BUDDY;
+        free_area_account(area, type, -1);
 
-                page_frame->zone = zone;
-                page_frame->pfn = zone->start_pfn + j;
-                page_frame->ref_count = 0;
-                page_frame->flags = 0;
-                page_frame->page_size = PAGE_2M;
-            }
-            
-            logk("Created %s: start_pfn=%#lx, end_pfn=%#lx, pages=%#lx\n", 
-                zone->type == ZONE_DMA ? "ZONE_DMA" : "ZONE_NORMAL",
-                zone->start_pfn, zone->end_pfn, zone->total_pages);
+        uint64_t pfn = page_to_pfn(page);
+
+        // 拆分：将多余的后半块逐级挂回
+        while (current_order > order) {
+            current_order--;
+            struct page_frame_struct *half = page + (1UL << current_order);
+            half->flags |= PAGE_BUDDY;
+            half->order = current_order;
+            page_list_add(&zone->free_area[current_order].free_list[type], half);
+            free_area_account(&zone->free_area[current_order], type, 1);
         }
+
+        buddy_account(zone, type, -(1L << order));
+        return pfn;
     }
 
-    // 单独处理第0页
-    global_memory_manager_struct.page.addr[0].zone = global_memory_manager_struct.zone.addr;
-    global_memory_manager_struct.page.addr[0].pfn = 0;
-    global_memory_manager_struct.page.addr[0].ref_count = 0;
-    global_memory_manager_struct.page.addr[0].flags = 0;
-    global_memory_manager_struct.page.addr[0].page_size = PAGE_2M;
+    return (uint64_t)-1;
+}
 
-    global_memory_manager_struct.zone.size = (global_memory_manager_struct.zone.count * sizeof(struct memory_zone_struct) + 63) & ~63;
+/**
+ * @brief 查找包含pfn的buddy空闲块
+ * @return 空闲块首页，pfn不在任何空闲块中返回NULL
+ */
+static struct page_frame_struct *buddy_find_block(struct memory_zone_struct *zone, uint64_t pfn) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
 
-    // 复位bitmap
-    global_memory_manager_struct.bitmap.addr[0] &= ~(1 << 0);
+    for (uint32_t order = 0; order < MAX_ORDER; order++) {
+        uint64_t head_pfn = pfn & ~((1UL << order) - 1);
+        if (head_pfn < zone->start_pfn)
+            break;
 
-    // 内存布局验证
-    logk("Memory layout verification:\n");
-    logk("Bitmap range: %#018lx - %#018lx\n",
-        (uint64_t)global_memory_manager_struct.bitmap.addr,
-        (uint64_t)global_memory_manager_struct.bitmap.addr + global_memory_manager_struct.bitmap.size);
-    logk("Page array range: %#018lx - %#018lx\n",
-        (uint64_t)global_memory_manager_struct.page.addr,
-        (uint64_t)global_memory_manager_struct.page.addr + global_memory_manager_struct.page.size);
-    logk("Zone array range: %#018lx - %#018lx\n",
-        (uint64_t)global_memory_manager_struct.zone.addr,
-        (uint64_t)global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.size);
-    // 输出所有已初始化的区域结构体信息
-    logk("Zone info:\n");
-    for(int i = 0;i < global_memory_manager_struct.zone.count; i++) {
-        struct memory_zone_struct *zone = global_memory_manager_struct.zone.addr + i;
-        logk("Zone%d: total_pages: %#018lx; start_pfn: %#018lx; end_pfn: %#018lx; nr_free: %#018lx\n", i,
-             zone->total_pages, zone->start_pfn, zone->end_pfn, zone->nr_free);
+        // 未初始化的section中不会有空闲块
+        if (!section_initialized(pfn_to_section(head_pfn)))
+            break;
+
+        struct page_frame_struct *head = &pages[head_pfn];
+        if ((head->flags & PAGE_BUDDY) && pfn - head_pfn < (1UL << head->order))
+            return head;
     }
-    
-    // 添加位图位置计算测试，验证首页和末页的位图位置
-    uint64_t first_pfn = global_memory_manager_struct.zone.addr[0].start_pfn;
-    uint64_t last_pfn = global_memory_manager_struct.zone.addr[global_memory_manager_struct.zone.count-1].end_pfn - 1;
-    
-    logk("First PFN: %lu maps to bitmap[%lu] bit %lu\n", 
-         first_pfn, first_pfn/64, first_pfn%64);
-    logk("Last PFN: %lu maps to bitmap[%lu] bit %lu\n", 
-         last_pfn, last_pfn/64, last_pfn%64);
-    
-    // 测试位图读写操作
-    uint64_t test_pfn = first_pfn + 10;  // 选择一个测试PFN
-    uint64_t test_word = test_pfn / 64;
-    uint64_t test_bit = test_pfn % 64;
-    
-    logk("Test PFN: %lu, bitmap[%lu] before: %#018lx\n", 
-         test_pfn, test_word, global_memory_manager_struct.bitmap.addr[test_word]);
-    
-    // 设置测试位
-    global_memory_manager_struct.bitmap.addr[test_word] |= (1UL << test_bit);
-    
-    logk("After setting bit %lu: %#018lx\n", 
-         test_bit, global_memory_manager_struct.bitmap.addr[test_word]);
-    
-    // 清除测试位（恢复原状）
-    global_memory_manager_struct.bitmap.addr[test_word] &= ~(1UL << test_bit);
-    
-    logk("After clearing bit: %#018lx\n", 
-         global_memory_manager_struct.bitmap.addr[test_word]);
-
-    global_memory_manager_struct.struct_end = (((uint64_t)global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.size) + 63) & ~63;
-
-    uint64_t kernel_struct_start = VIRT_TO_PHYS((uint64_t)global_memory_manager_struct.bitmap.addr);
-    uint64_t kernel_struct_end = VIRT_TO_PHYS(global_memory_manager_struct.struct_end);
-    uint64_t start_pfn = PAGE_2M_ALIGN(kernel_struct_start) >> PAGE_2M_SHIFT;
-    uint64_t end_pfn = (PAGE_2M_ALIGN(kernel_struct_end + PAGE_2M_SIZE - 1)) >> PAGE_2M_SHIFT;
-    for (uint64_t pfn = start_pfn; pfn < end_pfn; ++pfn) {
-        uint64_t word = pfn / 64;
-        uint64_t bit = pfn % 64;
-        global_memory_manager_struct.bitmap.addr[word] |= (1UL << bit); // 直接标记位图
-        struct page_frame_struct *page = &global_memory_manager_struct.page.addr[pfn];
-        page->flags = PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USED;
-        page->ref_count = 1;
-        // 更新zone统计
-        for (int z = 0; z < global_memory_manager_struct.zone.count; z++) {
-            struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
-            if (pfn >= zone->start_pfn && pfn <= zone->end_pfn) {
-                zone->nr_free--;
-                global_memory_manager_struct.huge_page_info.free_2m_pages--;
-                break;
-            }
-        }
+    return NULL;
+}
+
+/**
+ * @brief 将[start_pfn, start_pfn + count)从buddy中整段摘出(调用者需持有zone锁)
+ *
+ * 先确认范围内的页全部空闲再摘取，空闲块超出范围的部分挂回buddy。
+ * @return 成功返回0，范围内有页不空闲返回-1(此时buddy不变)
+ */
+static int32_t buddy_isolate_range(struct memory_zone_struct *zone, uint64_t start_pfn, uint64_t count) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint64_t end_pfn = start_pfn + count;
+    uint64_t pfn;
+
+    for (pfn = start_pfn; pfn < end_pfn;) {
+        struct page_frame_struct *head = buddy_find_block(zone, pfn);
+        if (!head)
+            return -1;
+        pfn = (head - pages) + (1UL << head->order);
     }
 
-    Global_CR3 = Get_gdt();
+    for (pfn = start_pfn; pfn < end_pfn;) {
+        struct page_frame_struct *head = buddy_find_block(zone, pfn);
+        uint64_t head_pfn = head - pages;
+        uint64_t block_end = head_pfn + (1UL << head->order);
 
-    color_printk(GREEN, BLACK,"Global_CR3\t:%#018lx\n",Global_CR3);
-    color_printk(GREEN, BLACK,"*Global_CR3\t:%#018lx\n", *(uint64_t*)PHYS_TO_VIRT(Global_CR3) & (~0xff));
-    color_printk(GREEN, BLACK,"**Global_CR3\t:%#018lx\n",*(uint64_t*)PHYS_TO_VIRT(*(uint64_t*)PHYS_TO_VIRT(Global_CR3) & (~0xff)) & (~0xff));
+        page_list_del(&zone->free_area[head->order].free_list[page_free_list_type(head)], head);
+        head->flags &= ~PAGE_BUDDY;
+        free_area_account(&zone->free_area[head->order], page_free_list_type(head), -1);
+        buddy_account(zone, page_free_list_type(head), -(1L << head->order));
 
-    // PML4页表中的前10个页表项清零
-	for(int i = 0;i < 10;i++)
-		*((uint64_t *)PHYS_TO_VIRT(Global_CR3) + i) = 0UL;
-	
-	flush_tlb_all();
+        if (head_pfn < start_pfn)
+            buddy_free_range(zone, head_pfn, start_pfn - head_pfn);
+        if (block_end > end_pfn)
+            buddy_free_range(zone, end_pfn, block_end - end_pfn);
+        pfn = block_end;
+    }
+    return 0;
+}
 
-    logk("Memory initialized!\n");
+/**
+ * @brief 初始化zone的buddy空闲链表(空闲页在所在section初始化时挂入)
+ */
+static void zone_init_free_area(struct memory_zone_struct *zone) {
+    for (uint32_t order = 0; order < MAX_ORDER; order++) {
+        for (uint32_t type = 0; type < FREE_LIST_TYPES; type++)
+            page_list_init(&zone->free_area[order].free_list[type]);
+        zone->free_area[order].nr_free = 0;
+        zone->free_area[order].nr_free_cma = 0;
+    }
+    zone->nr_free = 0;
+    zone->nr_free_cma = 0;
 }
 
-struct page_frame_struct *alloc_pages(enum memory_zone_type zone_type, 
-                                     uint32_t nr_pages, 
-                                     uint32_t flags) {
-    // TODO 如果有必要，添加降级分配
-    struct memory_zone_struct *target_zone = NULL;
-    
-    // 1. 区域选择逻辑
-    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; ++i) {
+static spinlock_t section_lock = SPIN_LOCK_UNLOCKED;
+static uint64_t deferred_init_cursor = 0;          // 后台初始化的下一个section
+
+/**
+ * @brief 初始化一个section的页框元信息，并将其中的空闲页挂入所属zone的buddy
+ *
+ * section内不属于任何zone的页标记为保留，位图中为0的连续页按zone归还buddy。
+ * 已初始化或没有描述符的section直接返回。
+ */
+static void section_init(uint64_t section) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
+    uint64_t start_pfn = section << PAGE_SECTION_SHIFT;
+    uint64_t end_pfn = start_pfn + PAGE_SECTION_PAGES;
+
+    if (end_pfn > global_memory_manager_struct.page.count)
+        end_pfn = global_memory_manager_struct.page.count;
+
+    // 空洞中的section没有描述符
+    if (!section_present(section))
+        return;
+
+    uint64_t irq_flags = spin_lock_irqsave(&section_lock);
+    if (section_initialized(section)) {
+        spin_unlock_irqrestore(&section_lock, irq_flags);
+        return;
+    }
+
+    // 1. 默认标记为保留且不属于任何zone
+    memset(&pages[start_pfn], 0x00, (end_pfn - start_pfn) * sizeof(struct page_frame_struct));
+    for (uint64_t pfn = start_pfn; pfn < end_pfn; pfn++)
+        pages[pfn].flags = PAGE_RESERVED | PAGE_ZONE_FLAGS(PAGE_ZONE_NONE) | PAGE_SIZE_FLAGS(PAGE_2M);
+
+    // 第0页不在任何zone中，但内核位于其中，归入第一个zone
+    if (start_pfn == 0)
+        pages[0].flags = PAGE_ZONE_FLAGS(0) | PAGE_SIZE_FLAGS(PAGE_2M);
+
+    // 2. 写入zone下标(CMA区的页同时打上PAGE_CMA)
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; i++) {
         struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
-        
-        if (zone->type != zone_type) 
-            continue;
-        if (zone->nr_free >= nr_pages) {
-            target_zone = zone;
-            break;
+        uint64_t lo = zone->start_pfn > start_pfn ? zone->start_pfn : start_pfn;
+        uint64_t hi = zone->end_pfn < end_pfn ? zone->end_pfn : end_pfn;
+        uint32_t flags = PAGE_ZONE_FLAGS(i) | PAGE_SIZE_FLAGS(PAGE_2M);
+
+        for (uint64_t pfn = lo; pfn < hi; pfn++) {
+            uint8_t cma = cma_area.zone == zone && pfn >= cma_area.base_pfn &&
+                          pfn < cma_area.base_pfn + cma_area.count;
+            pages[pfn].flags = flags | (cma ? PAGE_CMA : 0);
         }
     }
-    
-    if (!target_zone) {
-        warnk("No enough pages in zone %d (request %u pages)\n", zone_type, nr_pages);
-        return NULL;
-    }
 
-    // 2. 在位图中查找连续空闲页
-    const uint64_t zone_start_bit = target_zone->start_pfn;
-    const uint64_t zone_end_bit = target_zone->end_pfn;
-    uint64_t found_start = 0;
-    
-    // 添加调试输出，帮助诊断问题
-    logk("Searching for %#u pages in zone type %d (start_pfn=%#lu, end_pfn=%#lu)\n", 
-         nr_pages, zone_type, zone_start_bit, zone_end_bit);
-    
-    // 按64位块遍历位图
-    for (uint64_t bit = zone_start_bit; bit <= zone_end_bit - nr_pages; ) {
-        uint64_t word_idx = bit / 64;
-        uint64_t inword_offset = bit % 64;
-        
-        // 调试输出
-        if(bit == zone_start_bit) {
-            logk("Bitmap word at start: %#018lx\n", global_memory_manager_struct.bitmap.addr[word_idx]);
-        }
-        
-        // 新增大块分配优化（处理64页请求）
-        if (nr_pages >= 64 && inword_offset == 0) {
-            uint64_t needed_words = nr_pages / 64;
-            uint8_t found = 1;
-            for (uint64_t j = 0; j < needed_words; j++) {
-                if (global_memory_manager_struct.bitmap.addr[word_idx + j] != 0) {
-                    found = 0;
-                    break;
-                }
-            }
-            if (found) {
-                found_start = bit;
-                break;
-            }
-            bit += needed_words * 64;
+    global_memory_manager_struct.section.initialized[section / 64] |= 1UL << (section % 64);
+    global_memory_manager_struct.section.nr_initialized++;
+
+    // 3. 位图中为0的连续页挂入buddy
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; i++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
+        uint64_t lo = zone->start_pfn > start_pfn ? zone->start_pfn : start_pfn;
+        uint64_t hi = zone->end_pfn < end_pfn ? zone->end_pfn : end_pfn;
+
+        if (lo >= hi)
             continue;
+
+        uint64_t zone_flags = spin_lock_irqsave(&zone->lock);
+        uint64_t run_start = lo;
+        for (uint64_t pfn = lo; pfn <= hi; pfn++) {
+            if (pfn < hi && !(bitmap[pfn / 64] & (1UL << (pfn % 64))))
+                continue;
+            if (pfn > run_start)
+                buddy_free_range(zone, run_start, pfn - run_start);
+            run_start = pfn + 1;
         }
-        
-        uint64_t remaining = 64 - inword_offset;
-        // 处理单个位图项中的查找
-        if (remaining >= nr_pages) {
-            uint64_t mask = ((1UL << nr_pages) - 1) << inword_offset;
-            if (!(global_memory_manager_struct.bitmap.addr[word_idx] & mask)) {
-                found_start = bit;
-                break;
-            }
-            bit += nr_pages;
-        } 
-        // 处理跨位图项的查找
-        else {
-            uint64_t mask_low = (1UL << remaining) - 1;
-            uint64_t mask_high = (1UL << (nr_pages - remaining)) - 1;
-            
-            if (!(global_memory_manager_struct.bitmap.addr[word_idx] & (mask_low << inword_offset)) &&
-                !(global_memory_manager_struct.bitmap.addr[word_idx + 1] & mask_high)) 
-            {
-                found_start = bit;
-                break;
+        spin_unlock_irqrestore(&zone->lock, zone_flags);
+    }
+
+    spin_unlock_irqrestore(&section_lock, irq_flags);
+}
+
+/**
+ * @brief 按回退列表的顺序按需初始化一个尚未初始化的section
+ * @return 初始化了新的section返回1，回退列表中的zone已全部初始化返回0
+ */
+static uint8_t section_grow(struct zonelist_struct *zonelist) {
+    for (uint32_t i = 0; i < zonelist->nr_zones; i++) {
+        struct memory_zone_struct *zone = zonelist->zones[i];
+
+        for (uint64_t section = pfn_to_section(zone->start_pfn); section <= pfn_to_section(zone->end_pfn - 1);
+             section++) {
+            if (section_present(section) && !section_initialized(section)) {
+                section_init(section);
+                return 1;
             }
-            bit += remaining;
         }
     }
+    return 0;
+}
 
-    if (!found_start) {
-        warnk("No contiguous %u pages in zone %d\n", nr_pages, zone_type);
-        return NULL;
+/**
+ * @brief 初始化下一个尚未初始化的section(作为空闲任务在后台运行)
+ * @return 本次初始化了section返回1，全部完成返回0
+ */
+uint8_t deferred_init_step(void) {
+    uint64_t count = global_memory_manager_struct.section.count;
+
+    while (deferred_init_cursor < count) {
+        uint64_t section = __atomic_fetch_add(&deferred_init_cursor, 1, __ATOMIC_RELAXED);
+        if (section >= count)
+            break;
+        if (!section_present(section) || section_initialized(section))
+            continue;
+
+        section_init(section);
+        if (global_memory_manager_struct.section.nr_initialized == global_memory_manager_struct.section.nr_present)
+            logk("Deferred page init done: %lu sections\n", global_memory_manager_struct.section.nr_present);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 设置zone内所有CPU缓存的水位
+ * @param high  高水位，缓存页数达到该值时归还batch个冷页，0表示关闭缓存
+ * @param low   低水位，缓存页数不高于该值时从buddy补充batch个页
+ * @param batch 每次补充/归还的页数
+ */
+void pcp_set_watermarks(struct memory_zone_struct *zone, uint32_t high, uint32_t low, uint32_t batch) {
+    if (batch == 0)
+        batch = 1;
+    if (high && batch > high)
+        batch = high;
+    if (low >= high)
+        low = 0;
+
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        zone->pcp[cpu].high = high;
+        zone->pcp[cpu].low = low;
+        zone->pcp[cpu].batch = batch;
     }
 
-    // 3. 标记已分配页 - 确保位图正确设置
-    logk("Found start PFN: %lu\n", found_start);
-    
-    for (uint32_t i = 0; i < nr_pages; ++i) {
-        uint64_t pfn = found_start + i;
-        struct page_frame_struct *page = &global_memory_manager_struct.page.addr[pfn];
-        
-        // 先检查该页是否已被分配
-        uint64_t word = pfn / 64;
-        uint64_t bit = pfn % 64;
-        
-        // 添加调试信息查看位图更新
-        if (i == 0) {
-            logk("Setting bitmap - word: %lu, bit: %lu, before: %#018lx\n", 
-                 word, bit, global_memory_manager_struct.bitmap.addr[word]);
-        }
-        
-        // 设置位图标记页已分配
-        global_memory_manager_struct.bitmap.addr[word] |= (1UL << bit);
-        
-        // 验证位图已被更新
-        if (i == 0) {
-            logk("After setting bit: %#018lx\n", global_memory_manager_struct.bitmap.addr[word]);
-        }
-        
-        // 设置页属性
-        page_init(page, flags);
+    // 新的高水位可能低于当前缓存量，将本CPU多余的页归还
+    struct per_cpu_pages_struct *pcp = &zone->pcp[smp_processor_id()];
+    uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+    while (pcp->count && pcp->count >= pcp->high) {
+        struct page_frame_struct *page = pfn_to_page(pcp->list.last);
+        page_list_del(&pcp->list, page);
+        pcp->count--;
+        buddy_free_block(zone, page_to_pfn(page), 0);
     }
+    spin_unlock_irqrestore(&zone->lock, irq_flags);
+}
 
-    // 4. 更新区域统计
-    target_zone->nr_free -= nr_pages;
-    global_memory_manager_struct.huge_page_info.free_2m_pages -= nr_pages;
-    
-    return &global_memory_manager_struct.page.addr[found_start];
+/**
+ * @brief 按zone大小设置per-CPU缓存的默认水位
+ *
+ * 页框为2M，缓存过多会长期占住大量内存，因此小于512MB的zone不启用缓存，
+ * 其余按每2GB内存批量1页计算(最多16页)，高水位为批量的4倍。
+ */
+static void zone_init_pcp(struct memory_zone_struct *zone) {
+    uint32_t batch = zone->total_pages >> 10;
+
+    if (batch < 1)
+        batch = 1;
+    if (batch > 16)
+        batch = 16;
+
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        page_list_init(&zone->pcp[cpu].list);
+        zone->pcp[cpu].count = 0;
+    }
+    pcp_set_watermarks(zone, zone->total_pages < 256 ? 0 : batch * 4, 0, batch);
 }
 
-void free_pages(struct page_frame_struct *page, uint32_t nr_pages) {
-    // 参数检查
-    if (!page || nr_pages == 0) {
-        warnk("Invalid parameters in free_pages: page=%p, nr_pages=%u\n", page, nr_pages);
-        return;
+/**
+ * @brief 从buddy批量补充本CPU缓存(调用者需关中断)
+ */
+static void pcp_refill(struct memory_zone_struct *zone, struct per_cpu_pages_struct *pcp) {
+    spin_lock(&zone->lock);
+    for (uint32_t i = 0; i < pcp->batch; i++) {
+        uint64_t pfn = buddy_alloc_block(zone, 0, FREE_LIST_NORMAL);
+        if (pfn == (uint64_t)-1)
+            break;
+        page_list_add_tail(&pcp->list, pfn_to_page(pfn));
+        pcp->count++;
     }
+    spin_unlock(&zone->lock);
+}
 
-    // 获取起始页框号
-    uint64_t start_pfn = page->pfn;
-    struct memory_zone_struct *zone = page->zone;
+/**
+ * @brief 将本CPU缓存尾部的nr_pages个冷页归还buddy(调用者需关中断)
+ */
+static void pcp_drain(struct memory_zone_struct *zone, struct per_cpu_pages_struct *pcp, uint32_t nr_pages) {
+    spin_lock(&zone->lock);
+    while (nr_pages-- && pcp->count) {
+        struct page_frame_struct *page = pfn_to_page(pcp->list.last);
+        page_list_del(&pcp->list, page);
+        pcp->count--;
+        buddy_free_block(zone, page_to_pfn(page), 0);
+    }
+    spin_unlock(&zone->lock);
+}
 
-    // 检查页框是否属于有效区域
-    if (!zone || start_pfn >= global_memory_manager_struct.page.count) {
-        warnk("Invalid page frame or zone in free_pages: pfn=%lu, zone=%p\n", start_pfn, zone);
-        return;
+/**
+ * @brief 从本CPU缓存取一个页框，缓存不足时批量补充
+ */
+static struct page_frame_struct *pcp_alloc_page(struct memory_zone_struct *zone, uint8_t cold) {
+    struct page_frame_struct *page = NULL;
+    uint64_t irq_flags = local_irq_save();
+    struct per_cpu_pages_struct *pcp = &zone->pcp[smp_processor_id()];
+
+    if (pcp->count <= pcp->low)
+        pcp_refill(zone, pcp);
+
+    if (pcp->count) {
+        page = pfn_to_page(cold ? pcp->list.last : pcp->list.first);
+        page_list_del(&pcp->list, page);
+        pcp->count--;
     }
 
-    // 添加调试信息
-    logk("Freeing %u pages starting from PFN %lu in zone type %d\n", 
-         nr_pages, start_pfn, zone->type);
+    local_irq_restore(irq_flags);
+    return page;
+}
 
-    // 遍历并释放每个页框
-    for (uint32_t i = 0; i < nr_pages; ++i) {
-        struct page_frame_struct *current_page = &global_memory_manager_struct.page.addr[start_pfn + i];
-        
-        // 检查页框是否已被释放
-        if (!(current_page->flags & PAGE_USED)) {
-            warnk("Attempting to free unused page: pfn=%lu\n", current_page->pfn);
-            continue;
-        }
+/**
+ * @brief 将一个页框放回本CPU缓存，达到高水位时批量归还冷页
+ */
+static void pcp_free_page(struct memory_zone_struct *zone, struct page_frame_struct *page, uint8_t cold) {
+    uint64_t irq_flags = local_irq_save();
+    struct per_cpu_pages_struct *pcp = &zone->pcp[smp_processor_id()];
 
-        // 减少引用计数
-        if (current_page->ref_count > 0) {
-            current_page->ref_count--;
-            
-            // 如果引用计数不为0，说明还有其他地方在使用这个页框
-            if (current_page->ref_count > 0) {
-                logk("Page PFN %lu still in use (ref_count=%d)\n", 
-                     current_page->pfn, current_page->ref_count);
-                continue;
-            }
-        }
+    if (cold)
+        page_list_add_tail(&pcp->list, page);
+    else
+        page_list_add(&pcp->list, page);
+    pcp->count++;
 
-        // 清除页框标志位
-        current_page->flags = 0;
+    if (pcp->count >= pcp->high)
+        pcp_drain(zone, pcp, pcp->batch);
 
-        // 更新位图
-        uint64_t pfn = current_page->pfn;
-        uint64_t word = pfn / 64;
-        uint64_t bit = pfn % 64;
-        
-        // 添加调试信息
-        if (i == 0) {
-            logk("Clearing bitmap - word: %lu, bit: %lu, before: %#018lx\n", 
-                 word, bit, global_memory_manager_struct.bitmap.addr[word]);
-        }
-        
-        // 清除位图中的对应位
-        global_memory_manager_struct.bitmap.addr[word] &= ~(1UL << bit);
-        
-        // 验证位图已被更新
-        if (i == 0) {
-            logk("After clearing bit: %#018lx\n", global_memory_manager_struct.bitmap.addr[word]);
-        }
+    local_irq_restore(irq_flags);
+}
 
-        // 更新区域统计
-        zone->nr_free++;
-        global_memory_manager_struct.huge_page_info.free_2m_pages++;
+/**
+ * @brief 将本CPU在所有zone中缓存的页框全部归还buddy
+ */
+void drain_pcp_pages(void) {
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; ++i) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
+        uint64_t irq_flags = local_irq_save();
+        struct per_cpu_pages_struct *pcp = &zone->pcp[smp_processor_id()];
+
+        if (pcp->count)
+            pcp_drain(zone, pcp, pcp->count);
+        local_irq_restore(irq_flags);
     }
+}
 
-    // 刷新TLB
-    flush_tlb_all();
-    
-    logk("Successfully freed %u pages starting from PFN %lu\n", nr_pages, start_pfn);
+/**
+ * @brief 建立物理内存直接映射区(physmap)
+ *
+ * 将清理后的e820表中RAM和ACPI区域映射到PHYS_TO_VIRT对应的线性地址：CPU支持时整1G对齐的区段
+ * 使用1G页，完整覆盖的2M区段使用2M页，区域首尾不满2M的部分使用4K页，不把同一2M中相邻的
+ * 保留区或MMIO映射为写回缓存。帧缓冲区先单独映射并切换打印地址，因为第一个1G的重新映射
+ * 会覆盖head.S中的临时显存映射。
+ */
+static void init_direct_map(void) {
+    uint8_t use_1g = pgtable_gbpages_supported();
+    uint64_t nr_1g = 0, nr_2m = 0, nr_4k = 0;
+
+    vbe_map_framebuffer();
+
+    // 先映射内核所在的第一个2M，其余页表页分配依赖低端内存已映射
+    map_pages(kernel_pml4, (uint64_t)PHYS_TO_VIRT(0), 0, PAGE_2M_SIZE, PAGE_2M, PAGE_PRESENT | PAGE_WRITABLE);
+
+    struct memblock_region_struct *region;
+    for_each_memblock(&memblock.e820, region) {
+        if (region->type != E820_TYPE_RAM && region->type != E820_TYPE_ACPI && region->type != E820_TYPE_NVS)
+            continue;
+
+        // 只映射区域内完整的4K页；第一个2M已整体映射
+        uint64_t start = PAGE_4K_ALIGN(region->base);
+        uint64_t end = (region->base + region->size) & PAGE_4K_MASK;
+        if (start < PAGE_2M_SIZE)
+            start = PAGE_2M_SIZE;
+
+        while (start < end) {
+            enum page_size page_size = PAGE_2M;
+            uint64_t step = PAGE_2M_SIZE;
+
+            if ((start & ~PAGE_2M_MASK) || end - start < PAGE_2M_SIZE) {
+                // 不满2M的首尾部分：映射到下一个2M边界或区域结束
+                uint64_t next = (start & PAGE_2M_MASK) + PAGE_2M_SIZE;
+                page_size = PAGE_4K;
+                step = (next < end ? next : end) - start;
+            } else if (use_1g && !(start & (PAGE_1G_SIZE - 1)) && end - start >= PAGE_1G_SIZE) {
+                page_size = PAGE_1G;
+                step = PAGE_1G_SIZE;
+            }
+
+            if (map_pages(kernel_pml4, (uint64_t)PHYS_TO_VIRT(start), start, step, page_size,
+                          PAGE_PRESENT | PAGE_WRITABLE)) {
+                fatalk("Failed to build direct map at %#018lx\n", start);
+                while (1)
+                    __asm__ volatile("hlt");
+                ;
+            }
+
+            if (page_size == PAGE_1G)
+                nr_1g++;
+            else if (page_size == PAGE_2M)
+                nr_2m++;
+            else
+                nr_4k += step >> PAGE_4K_SHIFT;
+            start += step;
+        }
+    }
+
+    flush_tlb_all();
+    global_memory_manager_struct.huge_page_info.total_1g_pages = nr_1g;
+    logk("Direct map built: %lu x 1G pages, %lu x 2M pages, %lu x 4K pages\n", nr_1g, nr_2m, nr_4k);
+}
+
+/**
+ * @brief 在最大的ZONE_NORMAL高端保留CMA区
+ *
+ * 保留区按自身大小对齐，且必须整段空闲；这里只记录范围，所在section初始化时
+ * 为其中的页打上PAGE_CMA并挂入CMA空闲链表。
+ */
+static void cma_reserve(void) {
+    struct memory_zone_struct *zone = NULL;
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
+    uint64_t count = CMA_DEFAULT_PAGES;
+    uint64_t align = 1UL << get_order(count);
+
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; ++i) {
+        struct memory_zone_struct *z = &global_memory_manager_struct.zone.addr[i];
+        if (z->type == ZONE_NORMAL && (!zone || z->total_pages > zone->total_pages))
+            zone = z;
+    }
+
+    // zone太小时保留区会挤占常规分配，不启用CMA
+    if (!zone || zone->total_pages < count * 4) {
+        logk("CMA disabled: no ZONE_NORMAL larger than %lu MB\n", (count * 4) << (PAGE_2M_SHIFT - 20));
+        return;
+    }
+
+    for (uint64_t base = (zone->end_pfn - count) & ~(align - 1); base >= zone->start_pfn; base -= align) {
+        uint64_t pfn;
+        for (pfn = base; pfn < base + count; pfn++) {
+            if (bitmap[pfn / 64] & (1UL << (pfn % 64)))
+                break;
+        }
+
+        if (pfn == base + count) {
+            cma_area.zone = zone;
+            cma_area.base_pfn = base;
+            cma_area.count = count;
+            cma_area.nr_allocated = 0;
+            memset(cma_area.bitmap, 0, sizeof(cma_area.bitmap));
+            logk("CMA reserved: pfn %#lx - %#lx (%lu MB)\n", base, base + count,
+                 count << (PAGE_2M_SHIFT - 20));
+            return;
+        }
+
+        if (base < zone->start_pfn + align)
+            break;
+    }
+
+    warnk("CMA disabled: no free aligned range of %lu pages\n", count);
+}
+
+/**
+ * @brief 建立各类型分配请求的回退zone列表(NORMAL -> DMA32 -> DMA)
+ */
+static void build_zonelists(void) {
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        uint8_t used[MAX_NUMNODES] = {0};
+        uint32_t order[MAX_NUMNODES];
+
+        // 按SLIT距离由近到远排列节点(距离相同时编号小的在前)，本节点距离最小排在第一位
+        for (uint32_t n = 0; n < numa_info.nr_nodes; n++) {
+            uint32_t best = 0;
+            for (uint32_t other = 0; other < numa_info.nr_nodes; other++) {
+                if (used[other])
+                    continue;
+                if (used[best] || node_distance(node, other) < node_distance(node, best))
+                    best = other;
+            }
+            used[best] = 1;
+            order[n] = best;
+        }
+
+        for (uint32_t type = 0; type < NR_ZONE_TYPES; type++) {
+            struct zonelist_struct *zonelist = &global_memory_manager_struct.zonelist[node][type];
+
+            zonelist->nr_zones = 0;
+            for (uint32_t n = 0; n < numa_info.nr_nodes; n++) {
+                for (int32_t fallback = type; fallback >= 0; fallback--) {
+                    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; i++) {
+                        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
+                        if (zone->node == order[n] && zone->type == (enum memory_zone_type)fallback &&
+                            zonelist->nr_zones < MAX_ZONELIST)
+                            zonelist->zones[zonelist->nr_zones++] = zone;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static uint64_t int_sqrt(uint64_t x) {
+    uint64_t result = 0, bit = 1UL << 62;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit) {
+        if (x >= result + bit) {
+            x -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+/**
+ * @brief 计算各zone的水位与低端保留页
+ *
+ * 与Linux相同，系统min水位总量取sqrt(内存KB数 * 16)KB(限制在128KB~256MB)，按zone大小分摊；
+ * low/high分别为min的5/4与3/2。低端zone为每种更高类型的回退分配保留
+ * (更高类型zone总页数 / lowmem_reserve_ratio)页，ZONE_DMA因此基本只服务DMA请求。
+ */
+static void setup_zone_watermarks(void) {
+    static const uint32_t lowmem_reserve_ratio[NR_ZONE_TYPES] = { 256, 256, 32 };
+    uint64_t type_pages[NR_ZONE_TYPES] = { 0 };
+    uint64_t total_pages = 0;
+
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; i++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
+        type_pages[zone->type] += zone->total_pages;
+        total_pages += zone->total_pages;
+    }
+
+    uint64_t min_free_kb = int_sqrt(total_pages * (PAGE_2M_SIZE >> 10) * 16);
+    if (min_free_kb < 128)
+        min_free_kb = 128;
+    if (min_free_kb > 256 * 1024)
+        min_free_kb = 256 * 1024;
+    uint64_t min_free_pages = (min_free_kb + (PAGE_2M_SIZE >> 10) - 1) / (PAGE_2M_SIZE >> 10);
+
+    for (uint32_t i = 0; i < global_memory_manager_struct.zone.count; i++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[i];
+        uint64_t min = total_pages ? min_free_pages * zone->total_pages / total_pages : 0;
+        uint64_t higher = 0;
+
+        zone->watermark[WMARK_MIN] = min;
+        zone->watermark[WMARK_LOW] = min + min / 4;
+        zone->watermark[WMARK_HIGH] = min + min / 2;
+
+        for (uint32_t type = 0; type < NR_ZONE_TYPES; type++) {
+            if (type > zone->type)
+                higher += type_pages[type];
+            zone->lowmem_reserve[type] = type > zone->type ? higher / lowmem_reserve_ratio[zone->type] : 0;
+        }
+    }
+}
+
+/**
+ * @brief 判断zone在满足本次分配后空闲页是否仍高于水位
+ * @param classzone 请求的zone类型，从更高类型回退到本zone时需额外满足lowmem_reserve
+ */
+static uint8_t zone_watermark_ok(struct memory_zone_struct *zone, uint32_t order, uint32_t mark,
+                                 enum memory_zone_type classzone, uint32_t flags) {
+    int64_t free_pages = zone->nr_free;
+    int64_t min = zone->watermark[mark];
+
+    // CMA空闲页只借给可移动分配；per-CPU缓存中的页可以直接满足单页分配
+    if (!(flags & ALLOC_MOVABLE))
+        free_pages -= zone->nr_free_cma;
+    if (order == 0)
+        free_pages += zone->pcp[smp_processor_id()].count;
+    if (flags & ALLOC_HIGH)
+        min -= min / 2;
+
+    free_pages -= (1L << order) - 1;
+    return free_pages > min + (int64_t)zone->lowmem_reserve[classzone];
+}
+
+/**
+ * @brief 在zone数组末尾追加一个zone
+ */
+static void zone_add(uint64_t start_pfn, uint64_t end_pfn, enum memory_zone_type type, uint32_t node) {
+    struct memory_zone_struct *zone = global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.count;
+    global_memory_manager_struct.zone.count++;
+
+    zone->start_pfn = start_pfn;
+    zone->end_pfn = end_pfn;
+    zone->total_pages = end_pfn - start_pfn;
+    zone->nr_free = zone->total_pages;
+    zone->attr = 0;
+    zone->GMM_struct = &global_memory_manager_struct;
+    zone->type = type;
+    zone->node = node;
+    zone->page_array = &global_memory_manager_struct.page.addr[zone->start_pfn];
+
+    logk("Created %s on node %u: start_pfn=%#lx, end_pfn=%#lx, pages=%#lx\n",
+        type == ZONE_DMA ? "ZONE_DMA" : "ZONE_NORMAL", node,
+        zone->start_pfn, zone->end_pfn, zone->total_pages);
+}
+
+/**
+ * @brief 从节点的预清零池取出一页
+ * @return 池为空返回NULL
+ */
+static struct page_frame_struct *zero_pool_get(uint32_t node) {
+    struct zero_pool_struct *pool = &zero_pool[node];
+    struct page_frame_struct *page = NULL;
+
+    uint64_t irq_flags = spin_lock_irqsave(&pool->lock);
+    if (!page_list_empty(&pool->list)) {
+        page = pfn_to_page(pool->list.first);
+        page_list_del(&pool->list, page);
+        pool->count--;
+        pool->hit++;
+    } else {
+        pool->miss++;
+    }
+    spin_unlock_irqrestore(&pool->lock, irq_flags);
+    return page;
+}
+
+/**
+ * @brief 为一个未满的节点补充一页预清零页(作为空闲任务在后台运行)
+ *
+ * 只在节点首选zone高于high水位时补充，避免在内存紧张时占用空闲页；
+ * 清零使用非临时存储，不会冲掉其他任务留在缓存中的数据。
+ * @return 本次补充了页框返回1，所有池已满或内存不足返回0
+ */
+uint8_t zero_pool_refill(void) {
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        struct zero_pool_struct *pool = &zero_pool[node];
+        struct zonelist_struct *zonelist = &global_memory_manager_struct.zonelist[node][ZONE_NORMAL];
+
+        if (pool->count >= ZERO_POOL_PAGES || !zonelist->nr_zones || zonelist->zones[0]->node != node ||
+            !zone_watermark_ok(zonelist->zones[0], 0, WMARK_HIGH, ZONE_NORMAL, 0))
+            continue;
+
+        struct page_frame_struct *page =
+            alloc_pages_node(node, ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE | ALLOC_COLD);
+        if (!page)
+            continue;
+        if (page_to_nid(page) != node) {
+            free_pages(page, 1);
+            continue;
+        }
+
+        memzero_nt(page_to_virt(page), PAGE_2M_SIZE);
+
+        uint64_t irq_flags = spin_lock_irqsave(&pool->lock);
+        page_list_add(&pool->list, page);
+        pool->count++;
+        spin_unlock_irqrestore(&pool->lock, irq_flags);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 将所有预清零池中的页归还buddy(内存不足时调用)
+ */
+void zero_pool_drain(void) {
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        struct zero_pool_struct *pool = &zero_pool[node];
+
+        for (;;) {
+            struct page_frame_struct *page = NULL;
+            uint64_t irq_flags = spin_lock_irqsave(&pool->lock);
+            if (!page_list_empty(&pool->list)) {
+                page = pfn_to_page(pool->list.first);
+                page_list_del(&pool->list, page);
+                pool->count--;
+            }
+            spin_unlock_irqrestore(&pool->lock, irq_flags);
+
+            if (!page)
+                break;
+            free_pages(page, 1);
+        }
+    }
+}
+
+/**
+ * @brief 按memblock中的可用内存创建zone：在16MB边界和NUMA节点范围边界处拆分
+ * @param create 为0时只统计需要的zone数，不写zone数组
+ * @return zone数
+ *
+ * zone数超过MAX_ZONES后，与上一个zone同节点同类型的区域并入上一个zone(中间的空洞
+ * 在位图中保持占用)，否则丢弃。
+ */
+static uint64_t zone_setup(uint8_t create) {
+    uint64_t dma_boundary_pfn = 0x1000000 >> PAGE_2M_SHIFT;    // 16MB
+    uint64_t nr_zones = 0;
+    struct memblock_region_struct *region;
+
+    for_each_memblock(&memblock.memory, region) {
+        uint64_t pfn = PAGE_2M_ALIGN(region->base) >> PAGE_2M_SHIFT;
+        uint64_t end_pfn = ((region->base + region->size) & PAGE_2M_MASK) >> PAGE_2M_SHIFT;
+
+        while (pfn < end_pfn) {
+            uint64_t limit = end_pfn;
+            enum memory_zone_type type = pfn < dma_boundary_pfn ? ZONE_DMA : ZONE_NORMAL;
+
+            if (pfn < dma_boundary_pfn && limit > dma_boundary_pfn)
+                limit = dma_boundary_pfn;
+            uint32_t node = numa_node_of_range(pfn, &limit);
+
+            if (nr_zones >= MAX_ZONES) {
+                struct memory_zone_struct *last = global_memory_manager_struct.zone.addr + nr_zones - 1;
+                if (create && last->node == node && last->type == type) {
+                    last->total_pages += limit - pfn;
+                    last->nr_free = last->total_pages;
+                    last->end_pfn = limit;
+                } else if (create) {
+                    warnk("Too many zones, drop pfn %#lx - %#lx\n", pfn, limit);
+                }
+            } else {
+                if (create)
+                    zone_add(pfn, limit, type, node);
+                nr_zones++;
+            }
+            pfn = limit;
+        }
+    }
+
+    return nr_zones;
+}
+
+/**
+ * @brief 为与zone相交的section映射页框描述符(vmemmap)
+ *
+ * 描述符从memblock在zone所在节点上分配，按4K页映射到VMEMMAP_START起按页框号索引的位置；
+ * 空洞中的section不映射，其页框号不能用pfn_to_page访问(见pfn_valid)。
+ */
+static void vmemmap_populate(void) {
+    uint64_t section_size = PAGE_SECTION_PAGES * sizeof(struct page_frame_struct);
+
+    for (uint64_t z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+
+        for (uint64_t section = pfn_to_section(zone->start_pfn); section <= pfn_to_section(zone->end_pfn - 1);
+             section++) {
+            if (section_present(section))
+                continue;
+
+            uint64_t phys = memblock_phys_alloc(section_size, PAGE_4K_SIZE, zone->node);
+            if (!phys || map_pages(kernel_pml4, VMEMMAP_START + section * section_size, phys, section_size, PAGE_4K,
+                                   PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX)) {
+                fatalk("Failed to populate vmemmap for section %lu\n", section);
+                while (1)
+                    __asm__ volatile("hlt");
+                ;
+            }
+            global_memory_manager_struct.section.present[section / 64] |= 1UL << (section % 64);
+            global_memory_manager_struct.section.nr_present++;
+        }
+    }
+
+    global_memory_manager_struct.page.size = global_memory_manager_struct.section.nr_present * section_size;
+}
+
+/**
+ * @brief 把memblock的状态交给页框位图：可用内存中完整的2M页框置为空闲，其余(空洞、
+ *        不足2M的边角、memblock保留的区域)置为占用
+ */
+static void memblock_handover(void) {
+    struct memblock_region_struct *region;
+    uint64_t count = global_memory_manager_struct.bitmap.count;
+
+    memset(global_memory_manager_struct.bitmap.addr, 0xff, global_memory_manager_struct.bitmap.size);
+
+    for_each_memblock(&memblock.memory, region) {
+        uint64_t start_pfn = PAGE_2M_ALIGN(region->base) >> PAGE_2M_SHIFT;
+        uint64_t end_pfn = ((region->base + region->size) & PAGE_2M_MASK) >> PAGE_2M_SHIFT;
+        if (end_pfn > start_pfn)
+            bitmap_clear_range(start_pfn, end_pfn - start_pfn);
+    }
+
+    for_each_memblock(&memblock.reserved, region) {
+        uint64_t start_pfn = region->base >> PAGE_2M_SHIFT;
+        uint64_t end_pfn = PAGE_2M_ALIGN(region->base + region->size) >> PAGE_2M_SHIFT;
+        if (end_pfn > count)
+            end_pfn = count;
+        if (end_pfn > start_pfn)
+            bitmap_set_range(start_pfn, end_pfn - start_pfn);
+    }
+
+    memblock_freeze();
+}
+
+void init_memory(void) {
+    logk("Start init memory...\n");
+
+    // 1. 从引导程序提供的e820表建立memblock，再读取NUMA拓扑(zone按节点范围拆分，memblock按节点分配)
+    memblock_init();
+    numa_init();
+
+    // 2. 统计可用页
+    struct memblock_region_struct *region;
+    global_memory_manager_struct.huge_page_info.total_2m_pages = 0;
+    for_each_memblock(&memblock.memory, region) {
+        uint64_t aligned_base = PAGE_2M_ALIGN(region->base);
+        uint64_t aligned_end = (region->base + region->size) & PAGE_2M_MASK;
+
+        if (aligned_base >= aligned_end) {
+            logk("Skip non-alignable areas: base=%#lx end=%#lx\n", region->base, region->base + region->size);
+            continue;
+        }
+
+        uint64_t pages = (aligned_end - aligned_base) / PAGE_2M_SIZE;
+        global_memory_manager_struct.huge_page_info.total_2m_pages += pages;
+        logk("Alignment area: base=%#018lx end=%#018lx pages=%lu (%#lx)\n", aligned_base, aligned_end, pages,
+             aligned_end - aligned_base);
+    }
+
+    // 输出统计结果
+    logk("Total memory: %#018lx bytes (%#lu MB)\n", memblock.memory.total_size, memblock.memory.total_size >> 20);
+    logk("Total available 2M pages: %#lu (%#018lx bytes)\n", global_memory_manager_struct.huge_page_info.total_2m_pages,
+         global_memory_manager_struct.huge_page_info.total_2m_pages * PAGE_2M_SIZE);
+
+    // 获取内核代码、数据、结束地址
+    global_memory_manager_struct.kernel_addr_info.start_code = (uint64_t)&_text;
+    global_memory_manager_struct.kernel_addr_info.end_code = (uint64_t)&_etext;
+    global_memory_manager_struct.kernel_addr_info.end_data = (uint64_t)&_edata;
+    global_memory_manager_struct.kernel_addr_info.end_krnl = (uint64_t)&_end;
+    logk("start_code: %#018lx; end_code: %#018lx; end_data: %#018lx; end_krnl: %#018lx\n",
+         global_memory_manager_struct.kernel_addr_info.start_code, global_memory_manager_struct.kernel_addr_info.end_code,
+         global_memory_manager_struct.kernel_addr_info.end_data, global_memory_manager_struct.kernel_addr_info.end_krnl);
+
+    // 3. 建立直接映射，页表页从memblock在head.S映射的低端内存中分配；之后memblock可以分配任意位置的内存
+    Global_CR3 = Get_gdt();
+    pgtable_init();
+    init_direct_map();
+    memblock_set_current_limit(MEMBLOCK_ALLOC_ANYWHERE);
+
+    // 4. 内存管理结构体都从memblock分配(放在启动CPU所在节点)，不再依赖内核镜像之后的连续空间
+    uint64_t max_pfn = memblock_end_of_e820() >> PAGE_2M_SHIFT;     // 最大页框号
+    uint32_t node = numa_node_id();
+
+    global_memory_manager_struct.bitmap.count = max_pfn + 1;
+    global_memory_manager_struct.bitmap.size = ((max_pfn + 1 + 63) / 64) * sizeof(uint64_t);
+    global_memory_manager_struct.bitmap.addr = memblock_alloc(global_memory_manager_struct.bitmap.size, PAGE_4K_SIZE, node);
+
+    // 页框结构体数组只占线性地址，描述符在zone创建后按section映射(见vmemmap_populate)，在所在section初始化时才写入(见section_init)
+    global_memory_manager_struct.page.count = max_pfn + 1;
+    global_memory_manager_struct.page.size = 0;
+    global_memory_manager_struct.page.addr = (struct page_frame_struct *)VMEMMAP_START;
+
+    global_memory_manager_struct.zone.count = 0;
+    global_memory_manager_struct.zone.size = (zone_setup(0) * sizeof(struct memory_zone_struct) + 63) & ~63;
+    global_memory_manager_struct.zone.addr = memblock_alloc(global_memory_manager_struct.zone.size, PAGE_4K_SIZE, node);
+
+    global_memory_manager_struct.section.count = (global_memory_manager_struct.page.count + PAGE_SECTION_PAGES - 1) >> PAGE_SECTION_SHIFT;
+    global_memory_manager_struct.section.nr_initialized = 0;
+    global_memory_manager_struct.section.initialized =
+        memblock_alloc((global_memory_manager_struct.section.count + 63) / 64 * sizeof(uint64_t), PAGE_4K_SIZE, node);
+    global_memory_manager_struct.section.nr_present = 0;
+    global_memory_manager_struct.section.present =
+        memblock_alloc((global_memory_manager_struct.section.count + 63) / 64 * sizeof(uint64_t), PAGE_4K_SIZE, node);
+
+    if (!global_memory_manager_struct.bitmap.addr || !global_memory_manager_struct.zone.addr ||
+        !global_memory_manager_struct.section.initialized || !global_memory_manager_struct.section.present) {
+        fatalk("Failed to allocate memory management structures from memblock\n");
+        while (1)
+            __asm__ volatile("hlt");
+        ;
+    }
+
+    // 5. 创建zone并映射其页框描述符，然后把memblock的保留信息交给位图
+    zone_setup(1);
+    vmemmap_populate();
+    memblock_handover();
+
+    // 内存布局验证
+    logk("Memory layout verification:\n");
+    logk("Bitmap range: %#018lx - %#018lx\n",
+        (uint64_t)global_memory_manager_struct.bitmap.addr,
+        (uint64_t)global_memory_manager_struct.bitmap.addr + global_memory_manager_struct.bitmap.size);
+    logk("Page array (vmemmap): %#018lx - %#018lx, %lu/%lu sections backed (%#lx bytes, dense array would be %#lx)\n",
+        (uint64_t)global_memory_manager_struct.page.addr,
+        (uint64_t)(global_memory_manager_struct.page.addr + global_memory_manager_struct.page.count),
+        global_memory_manager_struct.section.nr_present, global_memory_manager_struct.section.count,
+        global_memory_manager_struct.page.size, global_memory_manager_struct.page.count * sizeof(struct page_frame_struct));
+    logk("Zone array range: %#018lx - %#018lx\n",
+        (uint64_t)global_memory_manager_struct.zone.addr,
+        (uint64_t)global_memory_manager_struct.zone.addr + global_memory_manager_struct.zone.size);
+    logk("Section bitmap: %#018lx, %lu sections\n",
+        (uint64_t)global_memory_manager_struct.section.initialized, global_memory_manager_struct.section.count);
+    // 输出所有已初始化的区域结构体信息
+    logk("Zone info:\n");
+    for(int i = 0;i < global_memory_manager_struct.zone.count; i++) {
+        struct memory_zone_struct *zone = global_memory_manager_struct.zone.addr + i;
+        logk("Zone%d: total_pages: %#018lx; start_pfn: %#018lx; end_pfn: %#018lx; nr_free: %#018lx\n", i,
+             zone->total_pages, zone->start_pfn, zone->end_pfn, zone->nr_free);
+    }
+    
+    // 添加位图位置计算测试，验证首页和末页的位图位置
+    uint64_t first_pfn = global_memory_manager_struct.zone.addr[0].start_pfn;
+    uint64_t last_pfn = global_memory_manager_struct.zone.addr[global_memory_manager_struct.zone.count-1].end_pfn - 1;
+    
+    logk("First PFN: %lu maps to bitmap[%lu] bit %lu\n", 
+         first_pfn, first_pfn/64, first_pfn%64);
+    logk("Last PFN: %lu maps to bitmap[%lu] bit %lu\n", 
+         last_pfn, last_pfn/64, last_pfn%64);
+
+    global_memory_manager_struct.huge_page_info.free_2m_pages = 0;
+    for (int z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+        spin_lock_init(&zone->lock);
+        zone_init_free_area(zone);
+    }
+
+    cma_reserve();
+
+    // 启动时只初始化memblock保留区域、CMA区以及每个zone开头的section，其余按需或在空闲时初始化
+    uint64_t section_init_start = rdtsc();
+    for_each_memblock(&memblock.reserved, region) {
+        uint64_t start_pfn = region->base >> PAGE_2M_SHIFT;
+        uint64_t end_pfn = PAGE_2M_ALIGN(region->base + region->size) >> PAGE_2M_SHIFT;
+        if (end_pfn > global_memory_manager_struct.page.count)
+            end_pfn = global_memory_manager_struct.page.count;
+        for (uint64_t section = pfn_to_section(start_pfn); start_pfn < end_pfn && section <= pfn_to_section(end_pfn - 1); section++)
+            section_init(section);
+    }
+    if (cma_area.zone) {
+        for (uint64_t section = pfn_to_section(cma_area.base_pfn);
+             section <= pfn_to_section(cma_area.base_pfn + cma_area.count - 1); section++)
+            section_init(section);
+    }
+    for (int z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+        uint64_t first = pfn_to_section(zone->start_pfn);
+        uint64_t last = pfn_to_section(zone->end_pfn - 1);
+
+        for (uint64_t section = first; section <= last && section < first + DEFERRED_INIT_EAGER_SECTIONS; section++)
+            section_init(section);
+    }
+    uint64_t section_init_cycles = rdtsc() - section_init_start;
+
+    // 内核镜像和memblock分配的页框标记为内核占用
+    for_each_memblock(&memblock.reserved, region) {
+        uint64_t start_pfn = region->base >> PAGE_2M_SHIFT;
+        uint64_t end_pfn = PAGE_2M_ALIGN(region->base + region->size) >> PAGE_2M_SHIFT;
+        if (end_pfn > global_memory_manager_struct.page.count)
+            end_pfn = global_memory_manager_struct.page.count;
+        for (uint64_t pfn = start_pfn; pfn < end_pfn; ++pfn) {
+            if (!pfn_valid(pfn))
+                continue;
+            struct page_frame_struct *page = &global_memory_manager_struct.page.addr[pfn];
+            page->flags = (page->flags & PAGE_PERSIST_MASK) | PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USED;
+            page->ref_count = 1;
+        }
+    }
+
+    logk("Page frames: %lu x %lu bytes = %#lx bytes, %lu/%lu sections initialized at boot in %lu cycles\n",
+         global_memory_manager_struct.page.count, sizeof(struct page_frame_struct),
+         global_memory_manager_struct.page.size, global_memory_manager_struct.section.nr_initialized,
+         global_memory_manager_struct.section.count, section_init_cycles);
+    if (DEFERRED_INIT_BACKGROUND)
+        idle_task_register("deferred_init", deferred_init_step);
+    for (uint32_t node = 0; node < MAX_NUMNODES; node++) {
+        spin_lock_init(&zero_pool[node].lock);
+        page_list_init(&zero_pool[node].list);
+    }
+    idle_task_register("zero_pool", zero_pool_refill);
+    idle_task_register("compact", compact_step);
+
+    build_zonelists();
+    setup_zone_watermarks();
+
+    // buddy空闲页数随section初始化增长(nr_free由buddy统计)
+    for (int z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+        zone_init_pcp(zone);
+        logk("Zone%d buddy ready: nr_free: %#018lx, watermark min/low/high: %lu/%lu/%lu\n", z, zone->nr_free,
+             zone->watermark[WMARK_MIN], zone->watermark[WMARK_LOW], zone->watermark[WMARK_HIGH]);
+    }
+
+    color_printk(GREEN, BLACK,"Global_CR3\t:%#018lx\n",Global_CR3);
+    color_printk(GREEN, BLACK,"*Global_CR3\t:%#018lx\n", *(uint64_t*)PHYS_TO_VIRT(Global_CR3) & (~0xff));
+    color_printk(GREEN, BLACK,"**Global_CR3\t:%#018lx\n",*(uint64_t*)PHYS_TO_VIRT(*(uint64_t*)PHYS_TO_VIRT(Global_CR3) & (~0xff)) & (~0xff));
+
+    // PML4页表中的前10个页表项清零
+	for(int i = 0;i < 10;i++)
+		*((uint64_t *)PHYS_TO_VIRT(Global_CR3) + i) = 0UL;
+	
+	flush_tlb_all();
+
+    logk("Memory initialized!\n");
+}
+
+static uint8_t compact_running = 0;    // 同一时间只允许一个规整在运行(迁移回调中的分配不会递归规整)
+
+/**
+ * @brief zone的非CMA空闲链表中是否已有不小于2^order的块
+ */
+static uint8_t compact_suitable(struct memory_zone_struct *zone, uint32_t order) {
+    for (uint32_t o = order; o < MAX_ORDER; o++) {
+        if (!page_list_empty(&zone->free_area[o].free_list[FREE_LIST_NORMAL]))
+            return 1;
+    }
+    return 0;
+}
+
+static inline uint8_t compact_pfn_in_cma(struct memory_zone_struct *zone, uint64_t pfn) {
+    return cma_area.zone == zone && pfn >= cma_area.base_pfn && pfn < cma_area.base_pfn + cma_area.count;
+}
+
+/**
+ * @brief 空闲扫描器：自compact_free_pfn向下找到一个buddy中的空闲页框并摘出，作为迁移目标
+ *
+ * 跳过不存在或未初始化的section、CMA区以及per-CPU缓存中的页(位图已清零但不在buddy中)。
+ * @param low_pfn 迁移扫描器的位置，两个扫描器相遇时停止
+ * @return 已标记为分配的目标页框，找不到返回NULL
+ */
+static struct page_frame_struct *compact_isolate_free(struct memory_zone_struct *zone, uint64_t low_pfn) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
+
+    while (zone->compact_free_pfn > low_pfn) {
+        uint64_t pfn = --zone->compact_free_pfn;
+
+        if (!pfn_valid(pfn) || !section_initialized(pfn_to_section(pfn))) {
+            zone->compact_free_pfn = pfn & ~(PAGE_SECTION_PAGES - 1);
+            continue;
+        }
+        if ((bitmap[pfn / 64] & (1UL << (pfn % 64))) || compact_pfn_in_cma(zone, pfn))
+            continue;
+
+        uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+        struct page_frame_struct *head = buddy_find_block(zone, pfn);
+        int32_t ret = head && page_free_list_type(head) == FREE_LIST_NORMAL ? buddy_isolate_range(zone, pfn, 1) : -1;
+        spin_unlock_irqrestore(&zone->lock, irq_flags);
+        if (ret)
+            continue;
+
+        bitmap_set_range(pfn, 1);
+        page_init(&pages[pfn], PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+        return &pages[pfn];
+    }
+    return NULL;
+}
+
+/**
+ * @brief 规整zone：迁移扫描器自低端向上找可移动页框，迁到空闲扫描器自高端向下找到的空闲页框中，
+ * 使低端腾出的空闲页在buddy中合并成连续的大块
+ *
+ * 扫描位置保存在zone中，后台规整可以分多次完成一轮；两个扫描器相遇时一轮结束，下一次从两端重新开始。
+ * 迁移通过migrate_page完成，由页框所有者的migrate回调更新引用。
+ * @param order 出现不小于2^order的非CMA空闲块时停止(MAX_ORDER表示扫描完整一轮)
+ * @param budget 最多迁移的页框数
+ * @return 迁移的页框数
+ */
+static uint64_t compact_zone(struct memory_zone_struct *zone, uint32_t order, uint64_t budget) {
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    uint64_t migrated = 0;
+
+    if (!zone->compact_free_pfn) {
+        zone->compact_migrate_pfn = zone->start_pfn;
+        zone->compact_free_pfn = zone->end_pfn;
+    }
+
+    while (budget && zone->compact_migrate_pfn < zone->compact_free_pfn && !compact_suitable(zone, order)) {
+        uint64_t pfn = zone->compact_migrate_pfn++;
+
+        // zone可能跨越空洞，不存在或未初始化的section整段跳过
+        if (!pfn_valid(pfn) || !section_initialized(pfn_to_section(pfn))) {
+            zone->compact_migrate_pfn = (pfn | (PAGE_SECTION_PAGES - 1)) + 1;
+            continue;
+        }
+
+        struct page_frame_struct *page = &pages[pfn];
+        if (!(page->flags & PAGE_USED) || !(page->flags & PAGE_MOVABLE) || (page->flags & PAGE_CMA))
+            continue;
+
+        struct page_frame_struct *target = compact_isolate_free(zone, pfn + 1);
+        if (!target)
+            break;
+        // 旧页直接归还buddy，立即与相邻空闲块合并
+        if (__migrate_page(page, target, FREE_NO_PCP)) {
+            free_pages(target, 1);
+            continue;
+        }
+        migrated++;
+        budget--;
+    }
+
+    if (zone->compact_migrate_pfn >= zone->compact_free_pfn)
+        zone->compact_free_pfn = 0;
+    drain_pcp_pages();
+    zone_stat_add(zone, compact_migrated, migrated);
+    return migrated;
+}
+
+/**
+ * @brief 分配连续页框失败后的同步规整：依次规整回退列表中因碎片化(而不是内存不足)而失败的zone
+ * @return 有zone出现了不小于2^order的空闲块返回1
+ */
+static uint8_t compact_zonelist(struct zonelist_struct *zonelist, uint32_t order) {
+    uint8_t success = 0;
+
+    if (__atomic_exchange_n(&compact_running, 1, __ATOMIC_ACQUIRE))
+        return 0;
+
+    for (uint32_t i = 0; i < zonelist->nr_zones && !success; i++) {
+        struct memory_zone_struct *zone = zonelist->zones[i];
+
+        if (zone_fragmentation_index(zone, order) <= COMPACT_FRAG_THRESHOLD)
+            continue;
+        zone_stat_add(zone, compact_stall, 1);
+        zone->compact_free_pfn = 0;
+        compact_zone(zone, order, (uint64_t)-1);
+        if (compact_suitable(zone, order)) {
+            zone_stat_add(zone, compact_success, 1);
+            success = 1;
+        }
+    }
+
+    __atomic_store_n(&compact_running, 0, __ATOMIC_RELEASE);
+    return success;
+}
+
+/**
+ * @brief 对所有zone做一轮完整规整
+ * @return 迁移的页框总数
+ */
+uint64_t compact_memory(void) {
+    uint64_t migrated = 0;
+
+    if (__atomic_exchange_n(&compact_running, 1, __ATOMIC_ACQUIRE))
+        return 0;
+
+    for (uint64_t z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+        zone->compact_free_pfn = 0;
+        migrated += compact_zone(zone, MAX_ORDER, (uint64_t)-1);
+    }
+
+    __atomic_store_n(&compact_running, 0, __ATOMIC_RELEASE);
+    return migrated;
+}
+
+/**
+ * @brief 后台规整(空闲任务)：对2^COMPACT_BG_ORDER的碎片化指数超过阈值的zone迁移最多COMPACT_BG_BATCH个页框
+ * @return 本次迁移了页框返回1
+ */
+uint8_t compact_step(void) {
+    uint64_t migrated = 0;
+
+    if (__atomic_exchange_n(&compact_running, 1, __ATOMIC_ACQUIRE))
+        return 0;
+
+    for (uint64_t z = 0; z < global_memory_manager_struct.zone.count && !migrated; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+
+        if (zone_fragmentation_index(zone, COMPACT_BG_ORDER) > COMPACT_FRAG_THRESHOLD)
+            migrated = compact_zone(zone, COMPACT_BG_ORDER, COMPACT_BG_BATCH);
+    }
+
+    __atomic_store_n(&compact_running, 0, __ATOMIC_RELEASE);
+    return migrated != 0;
+}
+
+/**
+ * @brief 分配nr_pages个物理连续的页框，优先使用当前CPU所在节点的内存
+ */
+struct page_frame_struct *alloc_pages(enum memory_zone_type zone_type, 
+                                     uint32_t nr_pages, 
+                                     uint32_t flags) {
+    return alloc_pages_node(numa_node_id(), zone_type, nr_pages, flags);
+}
+
+/**
+ * @brief 从指定节点开始分配nr_pages个物理连续的页框，不足时按SLIT距离回退到其他节点
+ */
+struct page_frame_struct *alloc_pages_node(uint32_t node, enum memory_zone_type zone_type, uint32_t nr_pages,
+                                           uint32_t flags) {
+    struct memory_zone_struct *target_zone = NULL;
+    uint32_t order = get_order(nr_pages);
+    uint64_t found_start = (uint64_t)-1;
+    uint8_t movable = (flags & ALLOC_MOVABLE) && nr_pages == 1;
+    uint8_t zero = (flags & ALLOC_ZERO) != 0;
+
+    if (nr_pages == 0 || order >= MAX_ORDER || zone_type >= NR_ZONE_TYPES || node >= numa_info.nr_nodes) {
+        warnk("Invalid allocation request: %u pages in zone %d of node %u\n", nr_pages, zone_type, node);
+        return NULL;
+    }
+
+    // 清零的单页优先取预清零池，池中的页已经是分配状态，只需替换属性
+    if (zero && nr_pages == 1 && !movable && zone_type == ZONE_NORMAL) {
+        struct page_frame_struct *page = zero_pool_get(node);
+        if (page) {
+            page->flags = (flags & ~ALLOC_FLAGS_MASK) | PAGE_USED | (page->flags & PAGE_PERSIST_MASK);
+            page->ref_count = 1;
+            page->private = 0;
+            zone_stat_add(page_zone(page), alloc[0], 1);
+            return page;
+        }
+    }
+    
+    // 1. 区域选择逻辑：按回退列表依次尝试满足水位的zone，单页优先走per-CPU缓存，其余走buddy分配
+    struct zonelist_struct *zonelist = &global_memory_manager_struct.zonelist[node][zone_type];
+    uint8_t drained = 0;
+    uint8_t compacted = 0;
+    for (uint32_t attempt = 0; !target_zone; attempt++) {
+        // 首轮要求高于low水位；失败时先按需初始化一个新的section，已全部初始化时
+        // 将本CPU缓存归还buddy(缓存中的页可能阻碍了合并)，之后的重试放宽到min水位；
+        // 多页请求仍失败时规整一次内存再重试
+        uint32_t mark = attempt ? WMARK_MIN : WMARK_LOW;
+        if (attempt && !section_grow(zonelist)) {
+            if (drained) {
+                if (!order || compacted || !compact_zonelist(zonelist, order))
+                    break;
+                compacted = 1;
+            } else {
+                if (order)
+                    drain_pcp_pages();
+                zero_pool_drain();
+                drained = 1;
+            }
+        }
+
+        for (uint32_t i = 0; i < zonelist->nr_zones; ++i) {
+            struct memory_zone_struct *zone = zonelist->zones[i];
+            
+            if (!zone_watermark_ok(zone, order, mark, zone_type, movable ? flags : flags & ~ALLOC_MOVABLE))
+                continue;
+
+            if (movable) {
+                // 可移动单页优先借用CMA区(cma_alloc隔离期间除外)，不经过per-CPU缓存
+                uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+                if (!cma_area.isolating)
+                    found_start = buddy_alloc_block(zone, 0, FREE_LIST_CMA);
+                if (found_start == (uint64_t)-1)
+                    found_start = buddy_alloc_block(zone, 0, FREE_LIST_NORMAL);
+                spin_unlock_irqrestore(&zone->lock, irq_flags);
+                if (found_start != (uint64_t)-1) {
+                    target_zone = zone;
+                    break;
+                }
+                continue;
+            }
+
+            if (nr_pages == 1 && zone->pcp[smp_processor_id()].high) {
+                struct page_frame_struct *page = pcp_alloc_page(zone, (flags & ALLOC_COLD) != 0);
+                if (page) {
+                    found_start = page_to_pfn(page);
+                    target_zone = zone;
+                    zone_stat_add(zone, pcp_hit, 1);
+                    break;
+                }
+                continue;
+            }
+
+            if (zone->nr_free - zone->nr_free_cma < nr_pages)
+                continue;
+
+            uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+            found_start = buddy_alloc_block(zone, order, FREE_LIST_NORMAL);
+            if (found_start != (uint64_t)-1) {
+                target_zone = zone;
+                // 2. 按2^order取得的块超出请求部分归还buddy
+                if ((1UL << order) > nr_pages)
+                    buddy_free_range(zone, found_start + nr_pages, (1UL << order) - nr_pages);
+            }
+            spin_unlock_irqrestore(&zone->lock, irq_flags);
+            if (target_zone)
+                break;
+        }
+    }
+    
+    if (!target_zone) {
+        if (zonelist->nr_zones)
+            zone_stat_add(zonelist->zones[0], alloc_fail, 1);
+        warnk("No contiguous %u pages in zone %d\n", nr_pages, zone_type);
+        return NULL;
+    }
+    zone_stat_add(target_zone, alloc[order], 1);
+
+    // 3. 标记已分配页
+    flags &= ~ALLOC_FLAGS_MASK;
+    bitmap_set_range(found_start, nr_pages);
+    for (uint32_t i = 0; i < nr_pages; ++i) {
+        page_init(&global_memory_manager_struct.page.addr[found_start + i], flags);
+    }
+
+    // 池中没有可用页时在分配路径上清零，同样绕过缓存
+    if (zero)
+        memzero_nt(page_to_virt(pfn_to_page(found_start)), (uint64_t)nr_pages * PAGE_2M_SIZE);
+
+    tracek("alloc_pages: node %u zone %d pfn %#lx, %u pages, flags %#x\n", node, zone_type, found_start, nr_pages,
+           flags);
+    return &global_memory_manager_struct.page.addr[found_start];
+}
+
+static void __free_pages(struct page_frame_struct *page, uint32_t nr_pages, uint32_t free_flags) {
+    // 参数检查
+    if (!page || nr_pages == 0) {
+        warnk("Invalid parameters in free_pages: page=%p, nr_pages=%u\n", page, nr_pages);
+        return;
+    }
+
+    // 获取起始页框号
+    uint64_t start_pfn = page_to_pfn(page);
+    struct memory_zone_struct *zone = page_zone(page);
+
+    // 检查页框是否属于有效区域
+    if (!zone || start_pfn + nr_pages > zone->end_pfn || start_pfn < zone->start_pfn) {
+        warnk("Invalid page frame or zone in free_pages: pfn=%lu, zone=%p\n", start_pfn, zone);
+        return;
+    }
+    zone_stat_add(zone, free[get_order(nr_pages)], 1);
+    tracek("free_pages: pfn %#lx, %u pages%s\n", start_pfn, nr_pages, (free_flags & FREE_COLD) ? " (cold)" : "");
+
+    // 遍历每个页框，引用计数归零的连续页合并成段后一次性归还
+    uint64_t run_start = start_pfn;
+    uint64_t run_len = 0;
+    for (uint32_t i = 0; i < nr_pages; ++i) {
+        struct page_frame_struct *current_page = &global_memory_manager_struct.page.addr[start_pfn + i];
+        uint8_t release = 1;
+        
+        // 检查页框是否已被释放
+        if (!(current_page->flags & PAGE_USED)) {
+            warnk("Attempting to free unused page: pfn=%lu\n", start_pfn + i);
+            release = 0;
+        } else if (current_page->ref_count > 1 &&
+                   __atomic_sub_fetch(&current_page->ref_count, 1, __ATOMIC_ACQ_REL) > 0) {
+            // 引用计数不为0，说明还有其他地方在使用这个页框(如写时复制共享)
+            release = 0;
+        }
+
+        if (release) {
+            if (current_page->flags & PAGE_MOVABLE)
+                current_page->private = 0;
+            current_page->ref_count = 0;
+            current_page->flags &= PAGE_PERSIST_MASK;
+            if (run_len == 0)
+                run_start = start_pfn + i;
+            run_len++;
+            if (i + 1 < nr_pages)
+                continue;
+        }
+
+        if (run_len == 0)
+            continue;
+
+        bitmap_clear_range(run_start, run_len);
+        if (run_len == 1 && zone->pcp[smp_processor_id()].high && !(free_flags & FREE_NO_PCP) &&
+            !(global_memory_manager_struct.page.addr[run_start].flags & PAGE_CMA)) {
+            // 单页进入per-CPU缓存(CMA页直接回到CMA空闲链表)
+            pcp_free_page(zone, &global_memory_manager_struct.page.addr[run_start], free_flags & FREE_COLD);
+        } else {
+            uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+            buddy_free_range(zone, run_start, run_len);
+            spin_unlock_irqrestore(&zone->lock, irq_flags);
+        }
+        run_len = 0;
+    }
+}
+
+void free_pages(struct page_frame_struct *page, uint32_t nr_pages) {
+    __free_pages(page, nr_pages, 0);
+}
+
+/**
+ * @brief 释放一个确定已不在CPU缓存中的页框(如DMA目标页)，放入per-CPU缓存尾部
+ */
+void free_cold_page(struct page_frame_struct *page) {
+    __free_pages(page, 1, FREE_COLD);
+}
+
+/**
+ * @brief 批量分配nr_pages个页框(不要求物理连续)
+ *
+ * 每次持锁从buddy取出不超过剩余需求的最大块再拆成单页，比逐页调用alloc_pages
+ * 少很多次加锁和链表操作，适合vmalloc等只需要零散页框的场景。
+ * @param pages 输出页框指针数组，至少nr_pages项
+ * @return 实际分配的页框数(可能少于nr_pages，由调用者决定是否释放)
+ */
+uint32_t alloc_pages_bulk(enum memory_zone_type zone_type, uint32_t nr_pages, uint32_t flags,
+                          struct page_frame_struct **pages) {
+    uint32_t allocated = 0;
+
+    if (zone_type >= NR_ZONE_TYPES)
+        return 0;
+
+    struct zonelist_struct *zonelist = &global_memory_manager_struct.zonelist[numa_node_id()][zone_type];
+    uint32_t alloc_flags = flags & ALLOC_HIGH;
+
+    flags &= ~ALLOC_FLAGS_MASK;
+    do {
+        for (uint32_t i = 0; i < zonelist->nr_zones && allocated < nr_pages; ++i) {
+            struct memory_zone_struct *zone = zonelist->zones[i];
+
+            uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+            while (allocated < nr_pages && zone_watermark_ok(zone, 0, WMARK_MIN, zone_type, alloc_flags)) {
+                uint32_t order = 63 - __builtin_clzll(nr_pages - allocated);
+                uint64_t pfn = (uint64_t)-1;
+
+                if (order > MAX_ORDER - 1)
+                    order = MAX_ORDER - 1;
+                for (;;) {
+                    pfn = buddy_alloc_block(zone, order, FREE_LIST_NORMAL);
+                    if (pfn != (uint64_t)-1 || order == 0)
+                        break;
+                    order--;
+                }
+                if (pfn == (uint64_t)-1)
+                    break;
+
+                bitmap_set_range(pfn, 1UL << order);
+                zone_stat_add(zone, alloc[order], 1);
+                for (uint64_t j = 0; j < (1UL << order); j++) {
+                    page_init(pfn_to_page(pfn + j), flags);
+                    pages[allocated++] = pfn_to_page(pfn + j);
+                }
+            }
+            spin_unlock_irqrestore(&zone->lock, irq_flags);
+        }
+    } while (allocated < nr_pages && section_grow(zonelist));
+
+    if (allocated < nr_pages && zonelist->nr_zones)
+        zone_stat_add(zonelist->zones[0], alloc_fail, 1);
+
+    return allocated;
+}
+
+// 4K子页分配器：从2M页框拆分出4K页，供页表、内核栈和小缓冲区使用
+static struct list_head split_partial_list = LIST_HEAD_INIT(split_partial_list);
+static spinlock_t split_lock = SPIN_LOCK_UNLOCKED;
+static uint32_t split_empty_frames = 0;            // 完全空闲但仍保留的拆分页框数
+
+#define SPLIT_EMPTY_KEEP 1                          // 保留的完全空闲拆分页框数，避免反复拆分/合并
+
+/**
+ * @brief 在拆分页框位图中查找nr_pages个连续空闲子页
+ * @return 起始子页号，找不到返回-1
+ */
+static int32_t split_find_run(struct split_frame_struct *split, uint32_t nr_pages) {
+    uint32_t run = 0;
+
+    for (uint32_t i = 0; i < SPLIT_SUBPAGES; i++) {
+        // 整字已满时直接跳过
+        if ((i % 64) == 0 && split->bitmap[i / 64] == ~0UL) {
+            run = 0;
+            i += 63;
+            continue;
+        }
+        if (split->bitmap[i / 64] & (1UL << (i % 64))) {
+            run = 0;
+            continue;
+        }
+        if (++run == nr_pages)
+            return i + 1 - nr_pages;
+    }
+    return -1;
+}
+
+static void split_mark(struct split_frame_struct *split, uint32_t index, uint32_t nr_pages, uint8_t used) {
+    for (uint32_t i = index; i < index + nr_pages; i++) {
+        if (used)
+            split->bitmap[i / 64] |= 1UL << (i % 64);
+        else
+            split->bitmap[i / 64] &= ~(1UL << (i % 64));
+        split->ref_count[i] = used;
+    }
+}
+
+/**
+ * @brief 拆分一个新的2M页框加入部分空闲链表(调用时不持有split_lock)
+ */
+static struct split_frame_struct *split_new_frame(void) {
+    struct split_frame_struct *split = kmalloc(sizeof(struct split_frame_struct));
+    if (!split)
+        return NULL;
+
+    struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+    if (!page) {
+        kfree(split);
+        return NULL;
+    }
+
+    memset(split, 0, sizeof(struct split_frame_struct));
+    split->page = page;
+    split->nr_free = SPLIT_SUBPAGES;
+    page_set_size(page, PAGE_4K);
+    page->private = (uint64_t)split;
+    return split;
+}
+
+/**
+ * @brief 分配nr_pages个物理连续的4K页
+ * @param nr_pages 页数(1~512，不能跨越2M页框)
+ * @return 起始物理地址，失败返回0
+ */
+uint64_t alloc_pages_4k(uint32_t nr_pages) {
+    struct split_frame_struct *split;
+    int32_t index = -1;
+
+    if (nr_pages == 0 || nr_pages > SPLIT_SUBPAGES) {
+        warnk("Invalid 4K allocation request: %u pages\n", nr_pages);
+        return 0;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&split_lock);
+    list_for_each_entry(split, &split_partial_list, list) {
+        if (split->nr_free < nr_pages)
+            continue;
+        index = split_find_run(split, nr_pages);
+        if (index >= 0)
+            break;
+    }
+
+    if (index < 0) {
+        spin_unlock_irqrestore(&split_lock, irq_flags);
+        split = split_new_frame();
+        if (!split) {
+            warnk("No memory for %u 4K pages\n", nr_pages);
+            return 0;
+        }
+        irq_flags = spin_lock_irqsave(&split_lock);
+        list_add(&split->list, &split_partial_list);
+        split_empty_frames++;
+        index = 0;
+    }
+
+    if (split->nr_free == SPLIT_SUBPAGES)
+        split_empty_frames--;
+    split_mark(split, index, nr_pages, 1);
+    split->nr_free -= nr_pages;
+    if (split->nr_free == 0)
+        list_del(&split->list);
+    spin_unlock_irqrestore(&split_lock, irq_flags);
+
+    return page_to_phys(split->page) + ((uint64_t)index << PAGE_4K_SHIFT);
+}
+
+/**
+ * @brief 释放alloc_pages_4k分配的4K页，拆分页框完全空闲且超过保留数量时归还2M页框
+ */
+void free_pages_4k(uint64_t phys_addr, uint32_t nr_pages) {
+    struct page_frame_struct *page = &global_memory_manager_struct.page.addr[phys_addr >> PAGE_2M_SHIFT];
+    struct split_frame_struct *split = (struct split_frame_struct *)page->private;
+    uint32_t index = (phys_addr & (PAGE_2M_SIZE - 1)) >> PAGE_4K_SHIFT;
+
+    if (page_get_size(page) != PAGE_4K || !split || index + nr_pages > SPLIT_SUBPAGES) {
+        warnk("Invalid 4K page free: phys=%#018lx, nr_pages=%u\n", phys_addr, nr_pages);
+        return;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&split_lock);
+    // 仍被共享的子页只减少引用计数
+    uint32_t nr_freed = 0;
+    for (uint32_t i = index; i < index + nr_pages; i++) {
+        if (split->ref_count[i] > 1) {
+            split->ref_count[i]--;
+            continue;
+        }
+        if (!(split->bitmap[i / 64] & (1UL << (i % 64)))) {
+            warnk("Attempting to free unused 4K page: phys=%#018lx\n",
+                  page_to_phys(page) + ((uint64_t)i << PAGE_4K_SHIFT));
+            continue;
+        }
+        split_mark(split, i, 1, 0);
+        nr_freed++;
+    }
+    if (nr_freed == 0) {
+        spin_unlock_irqrestore(&split_lock, irq_flags);
+        return;
+    }
+
+    if (split->nr_free == 0)
+        list_add_tail(&split->list, &split_partial_list);
+    split->nr_free += nr_freed;
+
+    if (split->nr_free == SPLIT_SUBPAGES) {
+        if (split_empty_frames >= SPLIT_EMPTY_KEEP) {
+            list_del(&split->list);
+            spin_unlock_irqrestore(&split_lock, irq_flags);
+
+            page_set_size(page, PAGE_2M);
+            page->private = 0;
+            free_pages(page, 1);
+            kfree(split);
+            return;
+        }
+        split_empty_frames++;
+    }
+    spin_unlock_irqrestore(&split_lock, irq_flags);
+}
+
+/**
+ * @brief 增加物理页的引用计数(物理页为拆分页框中的4K子页时计数该子页，否则计数整个2M页框)
+ *
+ * 与page_ref_put配合用于写时复制等共享场景，最后一次put时页被释放。
+ */
+void page_ref_get(uint64_t phys_addr) {
+    struct page_frame_struct *page = pfn_to_page(phys_addr >> PAGE_2M_SHIFT);
+
+    if (page_get_size(page) == PAGE_4K) {
+        struct split_frame_struct *split = (struct split_frame_struct *)page->private;
+        uint64_t irq_flags = spin_lock_irqsave(&split_lock);
+        split->ref_count[(phys_addr & (PAGE_2M_SIZE - 1)) >> PAGE_4K_SHIFT]++;
+        spin_unlock_irqrestore(&split_lock, irq_flags);
+        return;
+    }
+    __atomic_add_fetch(&page->ref_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 减少物理页的引用计数，减到0时释放
+ */
+void page_ref_put(uint64_t phys_addr) {
+    struct page_frame_struct *page = pfn_to_page(phys_addr >> PAGE_2M_SHIFT);
+
+    if (page_get_size(page) == PAGE_4K)
+        free_pages_4k(phys_addr & ~(PAGE_4K_SIZE - 1), 1);
+    else
+        free_pages(page, 1);
+}
+
+uint32_t page_ref_count(uint64_t phys_addr) {
+    struct page_frame_struct *page = pfn_to_page(phys_addr >> PAGE_2M_SHIFT);
+
+    if (page_get_size(page) == PAGE_4K) {
+        struct split_frame_struct *split = (struct split_frame_struct *)page->private;
+        return __atomic_load_n(&split->ref_count[(phys_addr & (PAGE_2M_SIZE - 1)) >> PAGE_4K_SHIFT],
+                               __ATOMIC_RELAXED);
+    }
+    return __atomic_load_n(&page->ref_count, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 分配一个可移动页框
+ *
+ * 可移动页框可以被借出CMA区，也可能在cma_alloc或规整时被迁移到其他页框，
+ * 迁移时通过owner->ops->migrate通知所有者更新引用。目前只有启动自检使用：匿名内存按4K子页
+ * 分配在拆分页框中，没有反向映射，还不能整页迁移。
+ * @param flags 页框属性
+ * @param owner 页框所有者(不能为NULL)
+ */
+struct page_frame_struct *alloc_movable_page(uint32_t flags, struct movable_owner_struct *owner) {
+    if (!owner || !owner->ops || !owner->ops->migrate) {
+        warnk("Invalid movable page owner: %p\n", owner);
+        return NULL;
+    }
+
+    struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 1, flags | ALLOC_MOVABLE);
+    if (!page)
+        return NULL;
+
+    page->flags |= PAGE_MOVABLE;
+    page->private = (uint64_t)owner;
+    return page;
+}
+
+/**
+ * @brief 将可移动页框的内容和所有者引用迁移到new_page，并按free_flags释放old_page
+ */
+static int32_t __migrate_page(struct page_frame_struct *old_page, struct page_frame_struct *new_page,
+                              uint32_t free_flags) {
+    struct movable_owner_struct *owner = (struct movable_owner_struct *)old_page->private;
+
+    if (!(old_page->flags & PAGE_MOVABLE) || !owner)
+        return -1;
+
+    memcpy(page_to_virt(new_page), page_to_virt(old_page), PAGE_2M_SIZE);
+    if (owner->ops->migrate(owner, old_page, new_page))
+        return -1;
+
+    new_page->flags = (old_page->flags & ~PAGE_PERSIST_MASK) | (new_page->flags & PAGE_PERSIST_MASK);
+    new_page->ref_count = old_page->ref_count;
+    new_page->private = old_page->private;
+
+    old_page->ref_count = 1;
+    __free_pages(old_page, 1, free_flags);
+    return 0;
+}
+
+/**
+ * @brief 将可移动页框的内容和所有者引用迁移到new_page，并释放old_page
+ * @param new_page 调用者预先分配的目标页框
+ * @return 成功返回0；页框不可移动或所有者拒绝时返回-1(两个页框均保持不变)
+ */
+int32_t migrate_page(struct page_frame_struct *old_page, struct page_frame_struct *new_page) {
+    return __migrate_page(old_page, new_page, 0);
+}
+
+/**
+ * @brief 检查CMA区中[index, index + nr_pages)能否被cma_alloc使用
+ *
+ * 范围内不能有已被cma_alloc分出的页，被借用的页必须可移动。
+ */
+static uint8_t cma_range_usable(uint64_t index, uint32_t nr_pages) {
+    for (uint64_t i = index; i < index + nr_pages; i++) {
+        struct page_frame_struct *page = &global_memory_manager_struct.page.addr[cma_area.base_pfn + i];
+
+        if (cma_area.bitmap[i / 64] & (1UL << (i % 64)))
+            return 0;
+        if ((page->flags & PAGE_USED) && !(page->flags & PAGE_MOVABLE))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 从CMA区分配nr_pages个物理连续的页框
+ *
+ * 找到可用范围后暂停向可移动分配出借CMA页，把范围内被借用的页迁移到CMA区之外，
+ * 再将整段从buddy中摘出。迁移(分配目标页、复制2M、所有者回调)不持锁、不关中断，
+ * 摘取前在锁内重新检查范围。同一时间只允许一个cma_alloc。用cma_release释放。
+ * @return 首个页框，失败返回NULL
+ */
+struct page_frame_struct *cma_alloc(uint32_t nr_pages) {
+    struct memory_zone_struct *zone = cma_area.zone;
+    struct page_frame_struct *pages = global_memory_manager_struct.page.addr;
+    struct page_frame_struct *result = NULL;
+
+    if (!zone || nr_pages == 0 || nr_pages > cma_area.count) {
+        warnk("Invalid CMA allocation request: %u pages\n", nr_pages);
+        return NULL;
+    }
+
+    uint64_t cma_flags = spin_lock_irqsave(&cma_area.lock);
+    if (cma_area.isolating) {
+        spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+        warnk("CMA allocation of %u pages failed: another allocation in progress\n", nr_pages);
+        return NULL;
+    }
+    cma_area.isolating = 1;
+    spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+
+    for (uint64_t index = 0; index + nr_pages <= cma_area.count && !result; index++) {
+        uint64_t start_pfn = cma_area.base_pfn + index;
+        uint64_t pfn;
+
+        cma_flags = spin_lock_irqsave(&cma_area.lock);
+        uint8_t usable = cma_range_usable(index, nr_pages);
+        spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+        if (!usable)
+            continue;
+
+        // 1. 将借用页迁走，迁移后的旧页回到CMA空闲链表
+        for (pfn = start_pfn; pfn < start_pfn + nr_pages; pfn++) {
+            if (!(pages[pfn].flags & PAGE_USED))
+                continue;
+
+            struct page_frame_struct *new_page = alloc_pages(zone->type, 1, 0);
+            if (!new_page)
+                break;
+            if (migrate_page(&pages[pfn], new_page)) {
+                free_pages(new_page, 1);
+                break;
+            }
+        }
+        if (pfn < start_pfn + nr_pages)
+            continue;
+
+        // 2. 迁移期间范围可能已变化，重新检查后整段从buddy中摘出
+        cma_flags = spin_lock_irqsave(&cma_area.lock);
+        int32_t ret = -1;
+        if (cma_range_usable(index, nr_pages)) {
+            spin_lock(&zone->lock);
+            ret = buddy_isolate_range(zone, start_pfn, nr_pages);
+            spin_unlock(&zone->lock);
+        }
+
+        // 3. 标记已分配
+        if (!ret) {
+            for (uint64_t i = index; i < index + nr_pages; i++)
+                cma_area.bitmap[i / 64] |= 1UL << (i % 64);
+            cma_area.nr_allocated += nr_pages;
+        }
+        spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+        if (ret)
+            continue;
+
+        bitmap_set_range(start_pfn, nr_pages);
+        for (pfn = start_pfn; pfn < start_pfn + nr_pages; pfn++)
+            page_init(&pages[pfn], PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+        result = &pages[start_pfn];
+    }
+
+    cma_flags = spin_lock_irqsave(&cma_area.lock);
+    cma_area.isolating = 0;
+    spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+
+    if (!result)
+        warnk("CMA allocation of %u pages failed\n", nr_pages);
+    return result;
+}
+
+/**
+ * @brief 释放cma_alloc分配的页框，归还后重新可借给可移动分配
+ */
+void cma_release(struct page_frame_struct *page, uint32_t nr_pages) {
+    struct memory_zone_struct *zone = cma_area.zone;
+    uint64_t start_pfn = page ? (uint64_t)(page - global_memory_manager_struct.page.addr) : 0;
+    uint64_t index = start_pfn - cma_area.base_pfn;
+
+    if (!zone || !page || nr_pages == 0 || start_pfn < cma_area.base_pfn ||
+        index + nr_pages > cma_area.count) {
+        warnk("Invalid CMA release: page=%p, nr_pages=%u\n", page, nr_pages);
+        return;
+    }
+
+    uint64_t cma_flags = spin_lock_irqsave(&cma_area.lock);
+    for (uint64_t i = index; i < index + nr_pages; i++) {
+        if (!(cma_area.bitmap[i / 64] & (1UL << (i % 64)))) {
+            spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+            warnk("Releasing CMA page not allocated by cma_alloc: pfn=%lu\n", cma_area.base_pfn + i);
+            return;
+        }
+    }
+
+    for (uint64_t i = index; i < index + nr_pages; i++) {
+        struct page_frame_struct *current_page = &global_memory_manager_struct.page.addr[cma_area.base_pfn + i];
+        current_page->ref_count = 0;
+        current_page->flags &= PAGE_PERSIST_MASK;
+        cma_area.bitmap[i / 64] &= ~(1UL << (i % 64));
+    }
+    cma_area.nr_allocated -= nr_pages;
+    bitmap_clear_range(start_pfn, nr_pages);
+
+    uint64_t irq_flags = spin_lock_irqsave(&zone->lock);
+    buddy_free_range(zone, start_pfn, nr_pages);
+    spin_unlock_irqrestore(&zone->lock, irq_flags);
+    spin_unlock_irqrestore(&cma_area.lock, cma_flags);
+}
+
+/**
+ * @brief 打印CMA区使用情况
+ */
+void cma_info(void) {
+    if (!cma_area.zone) {
+        color_printk(WHITE, BLACK, "CMA: disabled\n");
+        return;
+    }
+
+    color_printk(WHITE, BLACK, "CMA: pfn %#lx - %#lx, total %lu, allocated %lu, free %lu, lent %lu\n",
+                 cma_area.base_pfn, cma_area.base_pfn + cma_area.count, cma_area.count,
+                 cma_area.nr_allocated, cma_area.zone->nr_free_cma,
+                 cma_area.count - cma_area.nr_allocated - cma_area.zone->nr_free_cma);
+}
+
+/**
+ * @brief 统计zone内最长的连续空闲页框段(按位图计算，包含per-CPU缓存中的页和未初始化section，不含CMA区)
+ *
+ * 不持锁读取位图，结果只是一个近似快照，用于诊断和调整zone大小。
+ */
+uint64_t zone_largest_free_run(struct memory_zone_struct *zone) {
+    uint64_t *bitmap = global_memory_manager_struct.bitmap.addr;
+    uint64_t run = 0;
+    uint64_t best = 0;
+
+    for (uint64_t pfn = zone->start_pfn; pfn < zone->end_pfn; pfn++) {
+        // 整字已被占用时一次跳过64个页框
+        if (!(pfn % 64) && pfn + 64 <= zone->end_pfn && bitmap[pfn / 64] == ~0UL) {
+            run = 0;
+            pfn += 63;
+            continue;
+        }
+        if ((bitmap[pfn / 64] & (1UL << (pfn % 64))) ||
+            (cma_area.zone == zone && pfn >= cma_area.base_pfn && pfn < cma_area.base_pfn + cma_area.count)) {
+            run = 0;
+            continue;
+        }
+        if (++run > best)
+            best = run;
+    }
+    return best;
+}
+
+/**
+ * @brief 计算zone对2^order分配的碎片化指数(与Linux extfrag_index相同的定义)
+ *
+ * 以非CMA的buddy空闲块为依据(CMA块只借给可移动分配，与compact_suitable一致)：存在不小于2^order的
+ * 空闲块时返回-1000(分配不会因碎片失败)；否则返回0~1000，越接近0说明失败是因为空闲内存不足，
+ * 越接近1000说明是因为碎片化。
+ * @return 指数乘以1000后的整数值
+ */
+int32_t zone_fragmentation_index(struct memory_zone_struct *zone, uint32_t order) {
+    uint64_t free_blocks_total = 0;
+    uint64_t free_blocks_suitable = 0;
+    uint64_t free_pages = 0;
+
+    if (order >= MAX_ORDER)
+        return 0;
+
+    for (uint32_t o = 0; o < MAX_ORDER; o++) {
+        uint64_t blocks = zone->free_area[o].nr_free - zone->free_area[o].nr_free_cma;
+        free_blocks_total += blocks;
+        free_pages += blocks << o;
+        if (o >= order)
+            free_blocks_suitable += blocks;
+    }
+
+    if (!free_blocks_total)
+        return 0;
+    if (free_blocks_suitable)
+        return -1000;
+    return 1000 - (int32_t)((1000 + free_pages * 1000 / (1UL << order)) / free_blocks_total);
+}
+
+/**
+ * @brief 将一段格式化文本输出到控制台和/或串口
+ */
+static void memstat_print(uint32_t target, const char *fmt, ...) {
+    int8_t buf[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (target & MEMSTAT_CONSOLE)
+        color_printk(WHITE, BLACK, "%s", buf);
+    if (target & MEMSTAT_SERIAL)
+        serial_write((const char *)buf);
+}
+
+/**
+ * @brief 输出各zone的分配统计与碎片情况
+ *
+ * 每个zone输出：按阶的分配/释放次数(汇总所有CPU)、失败次数、per-CPU缓存命中数、规整统计、
+ * buddy各阶空闲块直方图(非CMA与CMA分开)、最长连续空闲段以及各阶的碎片化指数(只计非CMA空闲块，
+ * CMA块只借给可移动分配，不能满足普通分配)。只在调用时汇总，
+ * 分配和释放路径上只做本CPU计数累加。
+ * @param target MEMSTAT_CONSOLE和/或MEMSTAT_SERIAL
+ */
+void memory_stats_show(uint32_t target) {
+    for (uint64_t z = 0; z < global_memory_manager_struct.zone.count; z++) {
+        struct memory_zone_struct *zone = &global_memory_manager_struct.zone.addr[z];
+        struct zone_stat_struct sum;
+        uint64_t pcp_pages = 0;
+
+        memset(&sum, 0, sizeof(sum));
+        for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+            struct zone_stat_struct *stat = &zone->stat[cpu];
+            for (uint32_t o = 0; o < MAX_ORDER; o++) {
+                sum.alloc[o] += stat->alloc[o];
+                sum.free[o] += stat->free[o];
+            }
+            sum.alloc_fail += stat->alloc_fail;
+            sum.pcp_hit += stat->pcp_hit;
+            sum.compact_stall += stat->compact_stall;
+            sum.compact_success += stat->compact_success;
+            sum.compact_migrated += stat->compact_migrated;
+            pcp_pages += zone->pcp[cpu].count;
+        }
+
+        memstat_print(target, "Zone%lu node %u type %d: pfn %#lx - %#lx, total %lu, free %lu (cma %lu, pcp %lu)\n", z,
+                      zone->node, zone->type, zone->start_pfn, zone->end_pfn, zone->total_pages, zone->nr_free,
+                      zone->nr_free_cma, pcp_pages);
+
+        memstat_print(target, "  alloc[0..10]:");
+        for (uint32_t o = 0; o < MAX_ORDER; o++)
+            memstat_print(target, " %lu", sum.alloc[o]);
+        memstat_print(target, "\n  free[0..10]: ");
+        for (uint32_t o = 0; o < MAX_ORDER; o++)
+            memstat_print(target, " %lu", sum.free[o]);
+        memstat_print(target, "\n  failed %lu, pcp hit %lu\n", sum.alloc_fail, sum.pcp_hit);
+        memstat_print(target, "  compaction: stall %lu, success %lu, migrated %lu\n", sum.compact_stall,
+                      sum.compact_success, sum.compact_migrated);
+
+        memstat_print(target, "  free blocks[0..10]:");
+        for (uint32_t o = 0; o < MAX_ORDER; o++)
+            memstat_print(target, " %lu", zone->free_area[o].nr_free - zone->free_area[o].nr_free_cma);
+        if (zone->nr_free_cma) {
+            memstat_print(target, "\n  cma blocks[0..10]: ");
+            for (uint32_t o = 0; o < MAX_ORDER; o++)
+                memstat_print(target, " %lu", zone->free_area[o].nr_free_cma);
+        }
+        memstat_print(target, "\n  frag index[0..10]:");
+        for (uint32_t o = 0; o < MAX_ORDER; o++) {
+            int32_t index = zone_fragmentation_index(zone, o);
+            memstat_print(target, " %s%d.%03d", index < 0 ? "-" : "", (index < 0 ? -index : index) / 1000,
+                          (index < 0 ? -index : index) % 1000);
+        }
+        memstat_print(target, "\n  largest free run: %lu pages\n", zone_largest_free_run(zone));
+    }
+
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        memstat_print(target, "Zero pool node %u: %u pages, hit %lu, miss %lu\n", node, zero_pool[node].count,
+                      zero_pool[node].hit, zero_pool[node].miss);
+    }
 }
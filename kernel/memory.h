@@ -7,6 +7,11 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include "list.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "numa.h"
+#include "tlb.h"
 
 #define MEMORY_STRUCT_BUFFER_ADDR 0xffff800000007e00        // 内存结构体缓冲区线性地址
 
@@ -26,7 +31,19 @@ extern "C" {
 #define PAGE_2M_ALIGN(addr)	(((uint64_t)(addr) + PAGE_2M_SIZE - 1) & PAGE_2M_MASK)
 #define PAGE_4K_ALIGN(addr)	(((uint64_t)(addr) + PAGE_4K_SIZE - 1) & PAGE_4K_MASK)
 
-#define E820_MAX_ENTRIES 64            // 最大e820内存区域结构数量(Linux中设置的是128，实际应该很难用得完)
+#define MAX_ORDER 11                   // buddy分配器阶数上限(0~10阶，最大块为2^10个2M页即2GB)
+
+// 页框元信息按section延迟初始化：启动时只初始化少量section，其余按需或在空闲时初始化
+#define PAGE_SECTION_SHIFT  9                   // 每个section包含2^9个2M页框(1GB)
+#define PAGE_SECTION_PAGES  (1UL << PAGE_SECTION_SHIFT)
+#define DEFERRED_INIT_EAGER_SECTIONS 1          // 启动时每个zone立即初始化的section数
+#define DEFERRED_INIT_BACKGROUND     1          // 空闲时在后台初始化剩余section(0则只按需初始化)
+
+// 页框描述符数组位于固定的线性地址(vmemmap)，按页框号直接索引；只有含可用内存的section
+// 映射了描述符，空洞不占用元信息
+#define VMEMMAP_START       0xffffea0000000000UL    // 可容纳2^46字节物理地址的描述符(512MB)
+
+#define MAX_ZONES 128                  // zone数组上限，超出后同节点同类型的区域并入上一个zone
 
 #define PHYS_TO_VIRT(pa) ((void*)((uintptr_t)(pa) + 0xFFFF800000000000))
 #define VIRT_TO_PHYS(va) ((uintptr_t)(va) - 0xFFFF800000000000)
@@ -46,6 +63,7 @@ const char *memory_type_array[] = {
     [2] = "ROM or Reserved",
     [3] = "ACPI Reclaim Memory",
     [4] = "ACPI NVS Memory",
+    [5] = "Unusable",
 };
 
 // 页框属性标志位定义（低8位用于通用状态）
@@ -53,6 +71,10 @@ const char *memory_type_array[] = {
 #define PAGE_USED        0x0002  // 页已分配
 #define PAGE_RESERVED    0x0004  // 页被保留
 #define PAGE_KERNEL      0x0008  // 内核专用页
+#define PAGE_BUDDY       0x0010  // 页为buddy空闲块的首页(此时order字段有效)
+#define PAGE_SLAB        0x0020  // 页被slab分配器用作对象页
+#define PAGE_CMA         0x0040  // 页属于CMA保留区(初始化时设置，分配/释放时保持)
+#define PAGE_MOVABLE     0x0080  // 页为可移动分配，private指向movable_owner_struct
 // 页表映射属性（高56位继承自页表项）
 #define PAGE_PRESENT     0x0100  // Present位（继承自PTE）
 #define PAGE_WRITABLE    0x0200  // 可写属性（R/W位）
@@ -60,6 +82,23 @@ const char *memory_type_array[] = {
 #define PAGE_NOCACHE     0x0800  // 禁用缓存（PCD位）
 #define PAGE_WRITETHROUGH 0x1000 // 写透模式（PWT位）
 #define PAGE_NX         0x2000   // 禁止执行（XD位，需要IA32_EFER.NXE=1）
+// 页框元信息编码（由内存管理维护，分配/释放时保持）
+#define PAGE_SIZE_SHIFT  14
+#define PAGE_SIZE_MASK   (0x3U << PAGE_SIZE_SHIFT)     // 页大小(enum page_size)
+#define PAGE_ZONE_SHIFT  16
+#define PAGE_ZONE_MASK   (0xffU << PAGE_ZONE_SHIFT)    // 所属zone在zone数组中的下标
+#define PAGE_ZONE_NONE   0xff                          // 不属于任何zone
+#define PAGE_SIZE_FLAGS(size)   ((uint32_t)(size) << PAGE_SIZE_SHIFT)
+#define PAGE_ZONE_FLAGS(id)     ((uint32_t)(id) << PAGE_ZONE_SHIFT)
+
+// 分配控制标志（最高8位，仅影响alloc_pages的行为，不写入页框flags）
+#define ALLOC_COLD       0x01000000  // 单页分配优先取per-CPU缓存中的冷页
+#define ALLOC_MOVABLE    0x02000000  // 单页可移动分配，优先借用CMA区(由alloc_movable_page使用)
+#define ALLOC_HIGH       0x04000000  // 紧急分配，允许使用min水位以下一半的保留页
+#define ALLOC_ZERO       0x08000000  // 返回清零的页框(ZONE_NORMAL单页优先取预清零池)
+#define ALLOC_FLAGS_MASK 0xff000000
+
+#define PAGE_PERSIST_MASK (PAGE_CMA | PAGE_SIZE_MASK | PAGE_ZONE_MASK)   // 页框分配/释放时需要保留的标志位
 
 enum page_size {
     PAGE_4K,
@@ -67,22 +106,152 @@ enum page_size {
     PAGE_1G
 };
 
-// 页框结构体
+#define PFN_NONE 0xffffffffU            // 页框链表空指针
+
+// 以32位页框号链接的页框链表(节点与表头)，比指针链表节省一半空间
+struct page_list_node {
+    uint32_t next;
+    uint32_t prev;
+};
+
+struct page_list_head {
+    uint32_t first;
+    uint32_t last;
+};
+
+// 页框结构体(16字节，一个cache line容纳4个)
+// 页框号由其在页框数组中的位置得出，所属zone与页大小编码在flags中
 struct page_frame_struct {
-    struct memory_zone_struct *zone;    // 指向页所在内存区域结构
-    uint64_t pfn;                       // 页框号
+    uint32_t flags;                     // 状态标志 [31:24]保留 | [23:16]zone下标 | [15:14]页大小 | [13:0]标志位
     uint16_t ref_count;                 // 引用计数
-    uint32_t flags;                     // 状态标志 [31:12]保留 | [11:0]标志位
-    enum page_size page_size;           // 页大小：0=4K,1=2M,2=1G(不过本系统暂时都固定2M页，不一定能用上)
+    uint8_t order;                      // 空闲块阶数(仅PAGE_BUDDY置位时有效)
+    uint8_t reserved;
+    union {
+        struct page_list_node lru;      // 空闲时：buddy空闲链表/per-CPU缓存节点
+        uint64_t private;               // 已分配时：分配者私有数据(如大块kmalloc记录的页数)
+    };
+};
+
+_Static_assert(sizeof(struct page_frame_struct) == 16, "page_frame_struct must stay 16 bytes");
+
+#define SPLIT_SUBPAGES  (PAGE_2M_SIZE / PAGE_4K_SIZE)   // 一个2M页框拆分出的4K子页数
+
+// 拆分为4K子页的2M页框描述符(由页框的private字段指向，此时page_size为PAGE_4K)
+struct split_frame_struct {
+    struct list_head list;              // 挂入部分空闲的拆分页框链表
+    struct page_frame_struct *page;     // 被拆分的2M页框
+    uint32_t nr_free;                   // 空闲4K子页数
+    uint64_t bitmap[SPLIT_SUBPAGES / 64];   // 4K子页占用位图
+    uint16_t ref_count[SPLIT_SUBPAGES];     // 4K子页引用计数(写时复制共享时大于1)
+};
+
+// buddy空闲链表类型：CMA区的空闲块单独成链，只借给可移动分配
+enum free_list_type {
+    FREE_LIST_NORMAL,
+    FREE_LIST_CMA,
+    FREE_LIST_TYPES
+};
+
+// buddy空闲块链表(每个阶一个)
+struct free_area_struct {
+    struct page_list_head free_list[FREE_LIST_TYPES];   // 该阶空闲块链表(链接块首页)
+    uint64_t nr_free;                   // 该阶空闲块数量(含CMA)
+    uint64_t nr_free_cma;               // 其中属于CMA区的空闲块数量
+};
+
+struct movable_owner_struct;
+
+// 可移动页框的迁移回调
+struct movable_ops_struct {
+    // 页框内容已复制到new_page后调用，所有者需将对old_page的引用(页表、指针等)改为new_page
+    // 返回0表示迁移完成，非0表示拒绝迁移(old_page保持原样)
+    int32_t (*migrate)(struct movable_owner_struct *owner, struct page_frame_struct *old_page,
+                       struct page_frame_struct *new_page);
+};
+
+// 可移动页框的所有者，通常嵌入在使用者自己的结构体中(用container_of取回)
+struct movable_owner_struct {
+    const struct movable_ops_struct *ops;
+};
+
+#define CMA_MAX_PAGES       512         // CMA区最大页框数(1GB)
+#define CMA_DEFAULT_PAGES   32          // 默认CMA区大小(64MB)
+
+// 连续内存保留区(CMA)：平时借给可移动分配，cma_alloc时迁走借用页后整段分出
+struct cma_area_struct {
+    struct memory_zone_struct *zone;    // 所在zone(NULL表示未保留)
+    uint64_t base_pfn;                  // 起始页框号
+    uint64_t count;                     // 页框数
+    uint64_t nr_allocated;              // 已被cma_alloc分出的页框数
+    uint8_t isolating;                  // cma_alloc进行中，暂停向可移动分配出借
+    spinlock_t lock;                    // 串行化cma_alloc/cma_release
+    uint64_t bitmap[CMA_MAX_PAGES / 64];    // cma_alloc分配位图
+};
+
+// per-CPU页框缓存(仅缓存单个页框，链表头部为热页、尾部为冷页)
+struct per_cpu_pages_struct {
+    struct page_list_head list;         // 缓存页链表
+    uint32_t count;                     // 当前缓存页数
+    uint32_t high;                      // 高水位：缓存页数达到该值时批量归还buddy(0表示不使用缓存)
+    uint32_t low;                       // 低水位：缓存页数不高于该值时批量从buddy补充
+    uint32_t batch;                     // 每次批量补充/归还的页数
 };
 
 // 内存区域类型
 enum memory_zone_type {
     ZONE_DMA,       // < 16MB区域
     ZONE_DMA32,     // 64位系统不适用
-    ZONE_NORMAL     // 内核直接映射区域	16MB-物理内存上限
+    ZONE_NORMAL,    // 内核直接映射区域	16MB-物理内存上限
+    NR_ZONE_TYPES
+};
+
+// zone水位：空闲页低于low时分配改用min水位重试，低于min时只有紧急分配可以继续
+enum zone_watermark {
+    WMARK_MIN,
+    WMARK_LOW,
+    WMARK_HIGH,
+    NR_WMARK
+};
+
+// 一个zonelist最多包含所有zone
+#define MAX_ZONELIST MAX_ZONES
+
+// 按回退顺序排列的zone列表：按节点距离由近到远，每个节点内先是请求类型的zone，再依次是更低类型的zone
+struct zonelist_struct {
+    struct memory_zone_struct *zones[MAX_ZONELIST];
+    uint32_t nr_zones;
+};
+
+// zone分配统计(每个CPU一份，只由本CPU无锁累加，读取时汇总)
+struct zone_stat_struct {
+    uint64_t alloc[MAX_ORDER];          // 按阶统计的成功分配次数
+    uint64_t free[MAX_ORDER];           // 按阶统计的释放次数
+    uint64_t alloc_fail;                // 以该zone为首选的分配失败次数
+    uint64_t pcp_hit;                   // 由per-CPU缓存满足的单页分配次数
+    uint64_t compact_stall;             // 分配失败后同步规整的次数
+    uint64_t compact_success;           // 同步规整后满足了分配的次数
+    uint64_t compact_migrated;          // 规整迁移的页框数
 };
 
+#define COMPACT_BG_ORDER        4       // 后台规整维持的连续空闲块阶数(16个2M页)
+#define COMPACT_FRAG_THRESHOLD  500     // 碎片化指数超过该值(x1000)才规整，否则失败是因为空闲内存不足
+#define COMPACT_BG_BATCH        8       // 后台规整每次空闲调用最多迁移的页框数
+
+#define ZERO_POOL_PAGES     16          // 每个节点预清零池的目标页数(32MB)
+
+// 预清零页池：空闲时用非临时存储清零并保存的页框(已从buddy分出，按已分配计)
+struct zero_pool_struct {
+    struct page_list_head list;
+    uint32_t count;
+    uint64_t hit;                       // 由池满足的清零分配次数
+    uint64_t miss;                      // 池为空、在分配路径上清零的次数
+    spinlock_t lock;
+};
+
+// memory_stats_show的输出目标
+#define MEMSTAT_CONSOLE     0x1
+#define MEMSTAT_SERIAL      0x2
+
 // 内存区域结构
 struct memory_zone_struct {
     struct page_frame_struct *page_array;   // 指向页框元信息数组
@@ -91,17 +260,23 @@ struct memory_zone_struct {
     uint64_t end_pfn;                       // 结束页框号
     uint64_t attr;                          // 内存区域属性
     enum memory_zone_type type;             // 内存区域类型
+    uint32_t node;                          // 所属NUMA节点
     uint64_t nr_free;                       // 总空闲页数
+    uint64_t nr_free_cma;                   // 其中属于CMA区的空闲页数
     struct global_memory_manager_struct *GMM_struct;    // 指向全局内存管理结构
+    struct free_area_struct free_area[MAX_ORDER];       // buddy各阶空闲链表
+    struct per_cpu_pages_struct pcp[NR_CPUS];           // per-CPU单页缓存
+    uint64_t watermark[NR_WMARK];                       // 空闲页水位
+    uint64_t lowmem_reserve[NR_ZONE_TYPES];             // 为更高类型的回退分配保留的页数(保护低端zone)
+    struct zone_stat_struct stat[NR_CPUS];              // per-CPU分配统计
+    uint64_t compact_migrate_pfn;                       // 规整迁移扫描器位置(自低端向上)
+    uint64_t compact_free_pfn;                          // 规整空闲扫描器位置(自高端向下，0表示下一轮重新开始)
 
-    // spinlock_t lock;                     // 区域自旋锁(预留)
+    spinlock_t lock;                        // 区域自旋锁(保护buddy与nr_free)
 };
 
 // 内存管理结构
 struct global_memory_manager_struct {
-    struct e820_entry_struct e820_entry[E820_MAX_ENTRIES];      // e820内存区域信息
-    uint32_t e820_entry_count;                                  // 这里记录了实际长度
-
     struct {
         uint64_t *addr;                 // 内存页位图起始地址
         uint64_t count;                 // 总页数(逻辑数量)
@@ -109,9 +284,9 @@ struct global_memory_manager_struct {
     } bitmap;
     
     struct {
-        struct page_frame_struct *addr;                 // 页框结构体数组起始地址
+        struct page_frame_struct *addr;                 // 页框结构体数组起始地址(VMEMMAP_START)
         uint64_t count;                                 // 总页框结构体数
-        uint64_t size;                                // 内存页位图长度
+        uint64_t size;                                // 已映射的描述符占用的物理内存长度
     } page;
  
     struct {
@@ -120,6 +295,16 @@ struct global_memory_manager_struct {
         uint64_t size;                                // 内存区域长度
     } zone;
 
+    struct {
+        uint64_t *present;                              // section描述符已映射位图(section与某个zone相交)
+        uint64_t nr_present;                            // 描述符已映射的section数
+        uint64_t *initialized;                          // section已初始化位图
+        uint64_t count;                                 // section总数
+        uint64_t nr_initialized;                        // 已初始化的section数
+    } section;
+
+    struct zonelist_struct zonelist[MAX_NUMNODES][NR_ZONE_TYPES];  // 各节点上各类型分配请求的回退zone列表
+
     struct {
         uint64_t total_2m_pages;
         uint64_t free_2m_pages;
@@ -132,8 +317,6 @@ struct global_memory_manager_struct {
         uint64_t end_data;                  // 内核数据段结束地址
         uint64_t end_krnl;                  // 内核程序结束地址
     } kernel_addr_info;
-
-    uint64_t struct_end;                // 所有内存结构体结束地址
 };
 
 uint64_t *Global_CR3 = NULL;
@@ -142,26 +325,70 @@ void init_memory(void);
 struct page_frame_struct *alloc_pages(enum memory_zone_type zone_type, 
                                      uint32_t nr_pages, 
                                      uint32_t flags);
+struct page_frame_struct *alloc_pages_node(uint32_t node, enum memory_zone_type zone_type, uint32_t nr_pages,
+                                           uint32_t flags);
+uint32_t alloc_pages_bulk(enum memory_zone_type zone_type, uint32_t nr_pages, uint32_t flags,
+                          struct page_frame_struct **pages);
 void free_pages(struct page_frame_struct *page, uint32_t nr_pages);
+void free_cold_page(struct page_frame_struct *page);
+void pcp_set_watermarks(struct memory_zone_struct *zone, uint32_t high, uint32_t low, uint32_t batch);
+void drain_pcp_pages(void);
+uint8_t deferred_init_step(void);
+uint8_t zero_pool_refill(void);
+void zero_pool_drain(void);
+
+struct page_frame_struct *alloc_movable_page(uint32_t flags, struct movable_owner_struct *owner);
+int32_t migrate_page(struct page_frame_struct *old_page, struct page_frame_struct *new_page);
+
+struct page_frame_struct *cma_alloc(uint32_t nr_pages);
+void cma_release(struct page_frame_struct *page, uint32_t nr_pages);
+void cma_info(void);
+
+uint64_t zone_largest_free_run(struct memory_zone_struct *zone);
+int32_t zone_fragmentation_index(struct memory_zone_struct *zone, uint32_t order);
+uint64_t compact_memory(void);
+uint8_t compact_step(void);
+void memory_stats_show(uint32_t target);
+
+uint64_t alloc_pages_4k(uint32_t nr_pages);
+void free_pages_4k(uint64_t phys_addr, uint32_t nr_pages);
+
+void page_ref_get(uint64_t phys_addr);
+void page_ref_put(uint64_t phys_addr);
+uint32_t page_ref_count(uint64_t phys_addr);
 
 extern struct global_memory_manager_struct global_memory_manager_struct;
+extern struct cma_area_struct cma_area;
+
+// 页框号、所属zone与页大小(参数名避开.page成员)
+#define page_to_pfn(pg)     ((uint64_t)((pg) - global_memory_manager_struct.page.addr))
+#define pfn_to_page(pfn)    (&global_memory_manager_struct.page.addr[pfn])
+#define page_zone_id(pg)    (((pg)->flags & PAGE_ZONE_MASK) >> PAGE_ZONE_SHIFT)
+#define page_zone(pg)       (page_zone_id(pg) == PAGE_ZONE_NONE ? NULL : \
+                             &global_memory_manager_struct.zone.addr[page_zone_id(pg)])
+#define page_to_nid(pg)     (page_zone(pg)->node)
+#define page_get_size(pg)   ((enum page_size)(((pg)->flags & PAGE_SIZE_MASK) >> PAGE_SIZE_SHIFT))
+#define page_set_size(pg, size) \
+    ((pg)->flags = ((pg)->flags & ~PAGE_SIZE_MASK) | PAGE_SIZE_FLAGS(size))
+
+#define pfn_to_section(pfn) ((uint64_t)(pfn) >> PAGE_SECTION_SHIFT)
+#define section_present(sec) \
+    (global_memory_manager_struct.section.present[(sec) / 64] & (1UL << ((sec) % 64)))
+// 页框号有对应的页框描述符(不在空洞中)
+#define pfn_valid(pfn)      ((uint64_t)(pfn) < global_memory_manager_struct.page.count && \
+                             section_present(pfn_to_section(pfn)))
+#define section_initialized(sec) \
+    (global_memory_manager_struct.section.initialized[(sec) / 64] & (1UL << ((sec) % 64)))
+
+// 页框与直接映射区线性地址互相转换
+#define page_to_phys(pg)    (page_to_pfn(pg) << PAGE_2M_SHIFT)
+#define page_to_virt(pg)    PHYS_TO_VIRT(page_to_phys(pg))
+#define virt_to_page(va)    (&global_memory_manager_struct.page.addr[VIRT_TO_PHYS(va) >> PAGE_2M_SHIFT])
 extern char _text; 
 extern char _etext; 
 extern char _edata; 
 extern char _end;
 
-// 刷新单个TLB条目
-#define flush_tlb(addr) \
-    __asm__ __volatile__("invlpg (%0)" : : "r"(addr) : "memory")
-
-// 刷新所有非全局TLB条目
-#define flush_tlb_all() do { \
-    unsigned long cr3_val; \
-    __asm__ __volatile__("mov %%cr3, %0\n\t" \
-                         "mov %0, %%cr3" \
-                         : "=r"(cr3_val) : : "memory"); \
-} while (0)
-
 #ifdef __cplusplus
 }
 #endif
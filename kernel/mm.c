@@ -0,0 +1,768 @@
+#include "mm.h"
+#include "memory.h"
+#include "pgtable.h"
+#include "slab.h"
+#include "printk.h"
+#include "cpu.h"
+#include "zstore.h"
+#include "ksm.h"
+
+struct mm_struct init_mm = { .lock = SPIN_LOCK_UNLOCKED, .vma_list = LIST_HEAD_INIT(init_mm.vma_list) };
+struct mm_struct *current_mm = &init_mm;
+
+#define PAGEOUT_BATCH TLB_FLUSH_ALL_THRESHOLD  // mm_pageout每批先解除映射、刷新TLB再压缩的页数
+
+// mm_pageout的遍历上下文
+struct pageout_ctx {
+    struct mm_struct *mm;
+    struct tlb_batch_struct batch;      // 本批改写了表项的页
+    uint64_t vaddr[PAGEOUT_BATCH];      // 本批页的地址、写保护前的表项与压缩得到的句柄
+    uint64_t pte[PAGEOUT_BATCH];
+    uint64_t handle[PAGEOUT_BATCH];
+    uint32_t nr;
+    uint64_t next;                      // 下一批的起始地址
+    uint64_t nr_pageout;                // 已换出的页数
+};
+
+// 匿名缺页在mm->lock之外预先分配并清零的4K页
+struct anon_prealloc_struct {
+    uint64_t phys[FAULT_AROUND_PAGES];
+    uint32_t nr;                        // 可用页数
+    uint32_t want;                      // 持锁检查时需要的页数(缺页页 + 窗口内尚未映射的相邻页)
+};
+
+#define FAULT_RETRY 1                   // 需要先在锁外准备页框，再重新检查并处理缺页
+
+#define MM_RELEASE_BATCH 64            // mm_release_range每批解除映射、刷新TLB后再释放的页数
+
+// mm_release_range的遍历上下文
+struct mm_release_ctx {
+    uint64_t phys[MM_RELEASE_BATCH];    // 本批待释放页的物理地址
+    uint32_t nr;
+    uint64_t next;                      // 本批已遍历到的位置(下一批的起点)
+};
+
+// cow_share_range的遍历上下文
+struct cow_share_ctx {
+    struct mm_struct *dst_mm;
+    uint64_t start;                     // 源区间
+    uint64_t end;
+    int64_t delta;                      // 目标地址 - 源地址
+    struct tlb_batch_struct batch;      // 源地址空间中改为只读的表项(结束后统一刷新TLB)
+};
+
+static inline uint8_t mm_is_current(struct mm_struct *mm) {
+    return VIRT_TO_PHYS(mm->pml4) == (read_cr3() & PTE_ADDR_MASK);
+}
+
+/**
+ * @brief 物理页是否由页框分配器管理(可以按引用计数共享和释放)
+ */
+static inline uint8_t mm_page_managed(uint64_t phys) {
+    uint64_t pfn = phys >> PAGE_2M_SHIFT;
+    return pfn_valid(pfn) && (pfn_to_page(pfn)->flags & PAGE_USED);
+}
+
+/**
+ * @brief 初始化内核地址空间，并开启CR0.WP使内核写只读页同样触发#PF(写时复制依赖于此)
+ */
+void mm_init(void) {
+    init_mm.pml4 = kernel_pml4;
+    write_cr0(read_cr0() | CR0_WP);
+    logk("mm: kernel address space at %#018lx, CR0.WP enabled\n", (uint64_t)init_mm.pml4);
+}
+
+/**
+ * @brief 创建新地址空间，高半部分共享内核页表
+ * @return 失败返回NULL
+ */
+struct mm_struct *mm_create(void) {
+    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    if (!mm)
+        return NULL;
+
+    uint64_t phys = alloc_pages_4k(1);
+    if (!phys) {
+        kfree(mm);
+        return NULL;
+    }
+
+    memset(mm, 0, sizeof(struct mm_struct));
+    mm->pml4 = (uint64_t *)PHYS_TO_VIRT(phys);
+    spin_lock_init(&mm->lock);
+    list_init(&mm->vma_list);
+    memset(mm->pml4, 0, KERNEL_PML4_START * sizeof(uint64_t));
+    memcpy(&mm->pml4[KERNEL_PML4_START], &kernel_pml4[KERNEL_PML4_START],
+           (PTRS_PER_TABLE - KERNEL_PML4_START) * sizeof(uint64_t));
+    return mm;
+}
+
+static int32_t mm_release_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    struct mm_release_ctx *ctx = (struct mm_release_ctx *)arg;
+    uint64_t phys = *entry & PTE_ADDR_MASK & ~(PT_LEVEL_SIZE(level) - 1);
+
+    if (level <= PT_LEVEL_PDE && mm_page_managed(phys))
+        ctx->phys[ctx->nr++] = phys;
+    if (ctx->nr == MM_RELEASE_BATCH) {
+        ctx->next = vaddr + PT_LEVEL_SIZE(level);
+        return 1;
+    }
+    return 0;
+}
+
+static int32_t mm_release_swap_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    zstore_free(swap_pte_handle(*entry));
+    *entry = 0;
+    return 0;
+}
+
+/**
+ * @brief 解除[start, end)的映射并释放其中的页和换出页(调用者持有mm->lock)
+ *
+ * 每批先记下页的物理地址，解除映射并刷新TLB后才放掉引用，页框不会在仍被TLB缓存时回到分配器。
+ */
+static void mm_release_range(struct mm_struct *mm, uint64_t start, uint64_t end) {
+    struct mm_release_ctx ctx;
+    int32_t more;
+
+    walk_swap_range(mm->pml4, start, end, mm_release_swap_entry, NULL);
+    do {
+        ctx.nr = 0;
+        ctx.next = end;
+        more = walk_page_range(mm->pml4, start, end, mm_release_entry, &ctx);
+        unmap_pages(mm->pml4, start, ctx.next - start);
+        for (uint32_t i = 0; i < ctx.nr; i++)
+            page_ref_put(ctx.phys[i]);
+        start = ctx.next;
+    } while (more && start < end);
+}
+
+/**
+ * @brief 销毁地址空间：释放低半部分映射的页(共享页只减少引用计数)、换出页和页表
+ */
+void mm_destroy(struct mm_struct *mm) {
+    if (!mm || mm == &init_mm)
+        return;
+    if (mm_is_current(mm))
+        mm_switch(&init_mm);
+    ksm_unregister_mm(mm);
+
+    mm_release_range(mm, 0, USER_SPACE_END);
+    tlb_release_mm(VIRT_TO_PHYS(mm->pml4));
+    free_pages_4k(VIRT_TO_PHYS(mm->pml4), 1);
+
+    struct vm_area_struct *vma, *n;
+    list_for_each_entry_safe(vma, n, &mm->vma_list, list) {
+        list_del(&vma->list);
+        kfree(vma);
+    }
+    kfree(mm);
+}
+
+/**
+ * @brief 切换到mm地址空间
+ *
+ * 内核空间新建的PML4项只出现在内核页表中，切换前先同步到目标页表的高半部分。
+ * 开启PCID时最近使用过的地址空间保留各自的TLB条目，内核空间为全局页，都不必刷新。
+ */
+void mm_switch(struct mm_struct *mm) {
+    if (mm != &init_mm)
+        memcpy(&mm->pml4[KERNEL_PML4_START], &kernel_pml4[KERNEL_PML4_START],
+               (PTRS_PER_TABLE - KERNEL_PML4_START) * sizeof(uint64_t));
+    tlb_switch_mm(VIRT_TO_PHYS(mm->pml4));
+    current_mm = mm;
+}
+
+static int32_t cow_share_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    struct cow_share_ctx *ctx = (struct cow_share_ctx *)arg;
+    uint64_t size = PT_LEVEL_SIZE(level);
+    uint64_t pte = *entry;
+    uint64_t phys = pte & PTE_ADDR_MASK & ~(size - 1);
+
+    if (level > PT_LEVEL_PDE || vaddr < ctx->start || vaddr + size > ctx->end || (ctx->delta & (size - 1))) {
+        warnk("cow: cannot share %s mapping at %#018lx\n", level > PT_LEVEL_PDE ? "1G" : "partial", vaddr);
+        return -1;
+    }
+
+    // 不由分配器管理的页(如MMIO)原样共享，不计数也不做写时复制
+    if (mm_page_managed(phys)) {
+        if (pte & PTE_WRITABLE) {
+            pte = (pte & ~PTE_WRITABLE) | PTE_COW;
+            *entry = pte;
+            tlb_batch_add(&ctx->batch, vaddr);
+        }
+        page_ref_get(phys);
+    }
+
+    if (install_pte(ctx->dst_mm->pml4, vaddr + ctx->delta, level, pte)) {
+        if (mm_page_managed(phys))
+            page_ref_put(phys);
+        errk("cow: out of memory for page tables at %#018lx\n", vaddr + ctx->delta);
+        return -1;
+    }
+    return 0;
+}
+
+// 换出页在两个地址空间中共享同一个句柄，各自缺页时取回私有副本
+static int32_t cow_share_swap_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    struct cow_share_ctx *ctx = (struct cow_share_ctx *)arg;
+
+    if (vaddr < ctx->start || vaddr >= ctx->end)
+        return 0;
+    // 拿不到引用时不能安装共享的换出页表项，否则另一方释放后该表项会指向已回收的槽
+    if (zstore_dup(swap_pte_handle(*entry)))
+        return -1;
+    if (install_pte(ctx->dst_mm->pml4, vaddr + ctx->delta, PT_LEVEL_PTE, *entry)) {
+        zstore_free(swap_pte_handle(*entry));
+        errk("cow: out of memory for page tables at %#018lx\n", vaddr + ctx->delta);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 以写时复制方式把src_mm中[src, src + size)的映射共享到dst_mm的dst处
+ *
+ * 只复制页表项并增加页的引用计数：两边原本可写的映射都改为只读并打上PTE_COW，
+ * 任何一方第一次写入时在#PF中复制出私有页(见handle_mm_fault)。换出页共享压缩存储中的句柄。src与dst可以是同一地址空间，
+ * 用于零拷贝复制大缓冲区。区间内的大页必须被完整覆盖，且dst - src按大页大小对齐。
+ * @return 成功返回0，失败返回-1(已共享的部分保持共享)
+ */
+int32_t cow_share_range(struct mm_struct *dst_mm, uint64_t dst, struct mm_struct *src_mm, uint64_t src, uint64_t size) {
+    struct cow_share_ctx ctx = {
+        .dst_mm = dst_mm, .start = src, .end = src + size, .delta = (int64_t)(dst - src)
+    };
+    uint64_t irq_flags;
+    int32_t ret;
+
+    if ((src | dst | size) & (PAGE_4K_SIZE - 1)) {
+        warnk("cow: unaligned range src=%#018lx dst=%#018lx size=%#lx\n", src, dst, size);
+        return -1;
+    }
+
+    // 两个地址空间按地址顺序加锁，避免交叉共享时死锁
+    struct mm_struct *first = (uint64_t)src_mm < (uint64_t)dst_mm ? src_mm : dst_mm;
+    struct mm_struct *second = first == src_mm ? dst_mm : src_mm;
+    irq_flags = spin_lock_irqsave(&first->lock);
+    if (second != first)
+        spin_lock(&second->lock);
+
+    tlb_batch_init(&ctx.batch, VIRT_TO_PHYS(src_mm->pml4));
+    ret = walk_page_range(src_mm->pml4, src, src + size, cow_share_entry, &ctx);
+    tlb_batch_flush(&ctx.batch);
+    if (!ret)
+        ret = walk_swap_range(src_mm->pml4, src, src + size, cow_share_swap_entry, &ctx);
+
+    if (second != first)
+        spin_unlock(&second->lock);
+    spin_unlock_irqrestore(&first->lock, irq_flags);
+    return ret;
+}
+
+/**
+ * @brief 复制地址空间：低半部分的映射以写时复制方式共享给新地址空间
+ * @return 新地址空间，失败返回NULL
+ */
+struct mm_struct *mm_fork(struct mm_struct *mm) {
+    struct mm_struct *child = mm_create();
+    struct vm_area_struct *vma;
+    if (!child)
+        return NULL;
+
+    // 子地址空间继承预留区域，尚未访问过的部分在子进程中同样按需分配
+    list_for_each_entry(vma, &mm->vma_list, list) {
+        struct vm_area_struct *copy = kmalloc(sizeof(struct vm_area_struct));
+        if (!copy) {
+            mm_destroy(child);
+            return NULL;
+        }
+        copy->start = vma->start;
+        copy->end = vma->end;
+        copy->flags = vma->flags;
+        list_add_tail(&copy->list, &child->vma_list);
+    }
+
+    if (cow_share_range(child, 0, mm, 0, USER_SPACE_END)) {
+        mm_destroy(child);
+        return NULL;
+    }
+    return child;
+}
+
+/**
+ * @brief 处理写时复制共享页上的写缺页(调用者持有mm->lock，*irq_flags为加锁时保存的标志)
+ *
+ * 页只剩当前一个引用时直接恢复可写；否则复制出私有页并释放对原页的引用。分配和复制(2M页为2MB)
+ * 在锁外进行：复制期间持有原页的一个额外引用，其他共享者不会把它恢复为可写；重新加锁后表项
+ * 已被改变(其他CPU已处理、换出或解除预留)时放弃复制结果，由重新执行的指令再次判断。
+ */
+static int32_t cow_break(struct mm_struct *mm, uint64_t *entry, uint32_t level, uint64_t vaddr, uint64_t *irq_flags) {
+    uint64_t size = PT_LEVEL_SIZE(level);
+    uint64_t base = vaddr & ~(size - 1);
+    uint64_t pte = *entry;
+    uint64_t phys = pte & PTE_ADDR_MASK & ~(size - 1);
+    uint64_t attr = pte & ~(PTE_ADDR_MASK & ~(size - 1));
+    struct page_frame_struct *page = NULL;
+    uint64_t new_phys;
+    uint32_t new_level;
+
+    mm->nr_cow_faults++;
+    if (page_ref_count(phys) == 1) {
+        *entry = (pte & ~PTE_COW) | PTE_WRITABLE;
+        flush_tlb(base);
+        return 0;
+    }
+
+    page_ref_get(phys);
+    spin_unlock_irqrestore(&mm->lock, *irq_flags);
+
+    if (level == PT_LEVEL_PDE) {
+        page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+        new_phys = page ? page_to_phys(page) : 0;
+    } else {
+        new_phys = alloc_pages_4k(1);
+    }
+    if (new_phys)
+        memcpy(PHYS_TO_VIRT(new_phys), PHYS_TO_VIRT(phys), size);
+
+    *irq_flags = spin_lock_irqsave(&mm->lock);
+    if (!new_phys) {
+        page_ref_put(phys);
+        errk("cow: out of memory copying page at %#018lx\n", base);
+        return -1;
+    }
+
+    entry = lookup_pte(mm->pml4, vaddr, &new_level);
+    if (!entry || *entry != pte || new_level != level) {
+        if (page)
+            free_pages(page, 1);
+        else
+            free_pages_4k(new_phys, 1);
+        page_ref_put(phys);
+        return 0;
+    }
+
+    *entry = new_phys | ((attr & ~PTE_COW) | PTE_WRITABLE);
+    flush_tlb(base);
+    page_ref_put(phys);                 // 锁外复制期间持有的引用
+    page_ref_put(phys);                 // 本地址空间原来的映射
+    mm->nr_cow_copies++;
+    return 0;
+}
+
+/**
+ * @brief 查找包含vaddr的预留区域(调用者持有mm->lock)
+ */
+static struct vm_area_struct *find_vma(struct mm_struct *mm, uint64_t vaddr) {
+    struct vm_area_struct *vma;
+
+    list_for_each_entry(vma, &mm->vma_list, list) {
+        if (vaddr < vma->start)
+            break;
+        if (vaddr < vma->end)
+            return vma;
+    }
+    return NULL;
+}
+
+static uint64_t vma_pte_bits(struct vm_area_struct *vma) {
+    uint32_t prot = PAGE_PRESENT;
+
+    if (vma->flags & VM_WRITE)
+        prot |= PAGE_WRITABLE;
+    if (vma->flags & VM_USER)
+        prot |= PAGE_USER;
+    if (!(vma->flags & VM_EXEC))
+        prot |= PAGE_NX;
+    return prot_to_pte(prot) | PTE_PRESENT;
+}
+
+/**
+ * @brief 在锁外按prealloc->want分配并清零页框(分配失败时准备到的页数可能少于want)
+ */
+static void anon_prealloc_fill(struct anon_prealloc_struct *prealloc) {
+    while (prealloc->nr < prealloc->want && prealloc->nr < FAULT_AROUND_PAGES) {
+        uint64_t phys = alloc_pages_4k(1);
+        if (!phys)
+            break;
+        memset(PHYS_TO_VIRT(phys), 0, PAGE_4K_SIZE);
+        prealloc->phys[prealloc->nr++] = phys;
+    }
+}
+
+/**
+ * @brief 释放未用上的预先分配页(在锁外调用)
+ */
+static void anon_prealloc_release(struct anon_prealloc_struct *prealloc) {
+    while (prealloc->nr)
+        free_pages_4k(prealloc->phys[--prealloc->nr], 1);
+}
+
+/**
+ * @brief 用一个预先分配的清零页框为预留区域中的一个4K页建立映射
+ */
+static int32_t anon_map_page(struct mm_struct *mm, uint64_t vaddr, uint64_t pte_bits,
+                             struct anon_prealloc_struct *prealloc) {
+    uint64_t phys = prealloc->phys[--prealloc->nr];
+
+    if (install_pte(mm->pml4, vaddr, PT_LEVEL_PTE, phys | pte_bits)) {
+        prealloc->phys[prealloc->nr++] = phys;
+        return -1;
+    }
+    mm->nr_anon_pages++;
+    return 0;
+}
+
+/**
+ * @brief 匿名内存缺页：映射缺页地址所在的页，并顺带映射同一64KB窗口内其余尚未映射的页
+ *
+ * 顺序访问大缓冲区时每FAULT_AROUND_PAGES页只陷入一次。页框在锁外分配并清零：没有预先分配的页时
+ * 记下所需页数并返回FAULT_RETRY，由handle_mm_fault准备后重新检查；准备到的页不够时少映射相邻页，
+ * 不影响本次缺页。
+ */
+static int32_t do_anonymous_fault(struct mm_struct *mm, struct vm_area_struct *vma, uint64_t vaddr,
+                                  struct anon_prealloc_struct *prealloc) {
+    uint64_t page = vaddr & ~(PAGE_4K_SIZE - 1);
+    uint64_t window = FAULT_AROUND_PAGES * PAGE_4K_SIZE;
+    uint64_t start = page & ~(window - 1);
+    uint64_t end = start + window;
+    uint64_t pte_bits = vma_pte_bits(vma);
+
+    // 其他CPU可能已经处理了同一页
+    if (lookup_pte(mm->pml4, page, NULL))
+        return 0;
+
+    if (start < vma->start)
+        start = vma->start;
+    if (end > vma->end)
+        end = vma->end;
+
+    if (!prealloc->nr) {
+        prealloc->want = 1;
+        for (uint64_t addr = start; addr < end; addr += PAGE_4K_SIZE) {
+            if (addr != page && !lookup_pte(mm->pml4, addr, NULL) && !lookup_swap_pte(mm->pml4, addr))
+                prealloc->want++;
+        }
+        return FAULT_RETRY;
+    }
+
+    if (anon_map_page(mm, page, pte_bits, prealloc)) {
+        errk("mm: out of memory mapping anonymous page at %#018lx\n", page);
+        return -1;
+    }
+    for (uint64_t addr = start; addr < end && prealloc->nr; addr += PAGE_4K_SIZE) {
+        if (addr == page || lookup_pte(mm->pml4, addr, NULL) || lookup_swap_pte(mm->pml4, addr))
+            continue;
+        if (anon_map_page(mm, addr, pte_bits, prealloc))
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief 换出页缺页：从压缩存储取回页并重新映射
+ */
+static int32_t do_swap_fault(struct mm_struct *mm, struct vm_area_struct *vma, uint64_t *entry, uint64_t vaddr) {
+    uint64_t handle = swap_pte_handle(*entry);
+    uint64_t phys = alloc_pages_4k(1);
+
+    if (!phys) {
+        errk("mm: out of memory swapping in page at %#018lx\n", vaddr);
+        return -1;
+    }
+    if (zstore_load(handle, PHYS_TO_VIRT(phys))) {
+        free_pages_4k(phys, 1);
+        return -1;
+    }
+
+    // 原表项不存在，不需要刷新TLB
+    *entry = phys | vma_pte_bits(vma);
+    zstore_free(handle);
+    mm->nr_swap_faults++;
+    return 0;
+}
+
+/**
+ * @brief 缺页处理入口(由#PF处理函数调用)
+ * @param error_code CPU压入的#PF错误码
+ * @return 已处理返回0，不是可以修复的缺页返回-1
+ */
+int32_t handle_mm_fault(struct mm_struct *mm, uint64_t vaddr, uint64_t error_code) {
+    struct anon_prealloc_struct prealloc = { .nr = 0 };
+    uint32_t level;
+    int32_t ret = -1;
+
+    if (!mm)
+        return -1;
+
+    uint64_t irq_flags = spin_lock_irqsave(&mm->lock);
+    if (!(error_code & PF_PRESENT)) {
+        // 访问预留区域中尚未分配或已换出的页，按区域属性检查访问类型
+        uint64_t start = rdtsc();
+
+        do {
+            struct vm_area_struct *vma = find_vma(mm, vaddr);
+
+            ret = -1;
+            if (vma && (!(error_code & PF_WRITE) || (vma->flags & VM_WRITE)) &&
+                (!(error_code & PF_INSTR) || (vma->flags & VM_EXEC)) &&
+                (!(error_code & PF_USER) || (vma->flags & VM_USER))) {
+                uint64_t *swap_entry = lookup_swap_pte(mm->pml4, vaddr);
+                ret = swap_entry ? do_swap_fault(mm, vma, swap_entry, vaddr)
+                                 : do_anonymous_fault(mm, vma, vaddr, &prealloc);
+            }
+            if (ret == FAULT_RETRY) {
+                // 锁外分配并清零，重新加锁后预留区域和表项可能已变化，从头检查
+                spin_unlock_irqrestore(&mm->lock, irq_flags);
+                anon_prealloc_fill(&prealloc);
+                irq_flags = spin_lock_irqsave(&mm->lock);
+                if (!prealloc.nr) {
+                    errk("mm: out of memory for anonymous page at %#018lx\n", vaddr);
+                    ret = -1;
+                }
+            }
+        } while (ret == FAULT_RETRY);
+
+        if (!ret) {
+            mm->nr_anon_faults++;
+            mm->fault_cycles += rdtsc() - start;
+        }
+    } else if (error_code & PF_WRITE) {
+        // 写入存在但只读的写时复制页
+        uint64_t *entry = lookup_pte(mm->pml4, vaddr, &level);
+        if (entry && (*entry & PTE_COW) && level <= PT_LEVEL_PDE)
+            ret = cow_break(mm, entry, level, vaddr, &irq_flags);
+    }
+
+    spin_unlock_irqrestore(&mm->lock, irq_flags);
+    anon_prealloc_release(&prealloc);
+    return ret;
+}
+
+/**
+ * @brief 在地址空间中插入预留区域(调用者持有mm->lock)
+ * @param addr 指定起始地址，为0时从MMAP_BASE开始首次适配
+ */
+static int32_t mm_insert_vma(struct mm_struct *mm, struct vm_area_struct *vma, uint64_t addr, uint64_t size) {
+    struct vm_area_struct *pos;
+    uint64_t start = addr ? addr : MMAP_BASE;
+
+    list_for_each_entry(pos, &mm->vma_list, list) {
+        if (pos->end <= start)
+            continue;
+        if (start + size <= pos->start) {
+            vma->start = start;
+            vma->end = start + size;
+            list_add_tail(&vma->list, &pos->list);
+            return 0;
+        }
+        if (addr)
+            return -1;          // 指定地址与已有区域重叠
+        start = pos->end;
+    }
+
+    if (start + size < start || start + size > USER_SPACE_END)
+        return -1;
+    vma->start = start;
+    vma->end = start + size;
+    list_add_tail(&vma->list, &mm->vma_list);
+    return 0;
+}
+
+/**
+ * @brief 预留一段匿名内存，只记录区域不分配页框，首次访问时按需分配并清零
+ * @param addr 起始地址(4K对齐)，为0时自动选择
+ * @param flags VM_READ/VM_WRITE/VM_EXEC/VM_USER的组合
+ * @return 区域起始地址，失败返回0
+ */
+uint64_t mm_reserve(struct mm_struct *mm, uint64_t addr, uint64_t size, uint32_t flags) {
+    size = (size + PAGE_4K_SIZE - 1) & ~(PAGE_4K_SIZE - 1);
+    if (!mm || !size || (addr & (PAGE_4K_SIZE - 1)))
+        return 0;
+
+    struct vm_area_struct *vma = kmalloc(sizeof(struct vm_area_struct));
+    if (!vma)
+        return 0;
+    vma->flags = flags;
+
+    uint64_t irq_flags = spin_lock_irqsave(&mm->lock);
+    int32_t ret = mm_insert_vma(mm, vma, addr, size);
+    spin_unlock_irqrestore(&mm->lock, irq_flags);
+
+    if (ret) {
+        warnk("mm: cannot reserve %#lx bytes at %#018lx\n", size, addr);
+        kfree(vma);
+        return 0;
+    }
+    if (flags & VM_MERGEABLE)
+        ksm_register_mm(mm);
+    return vma->start;
+}
+
+/**
+ * @brief 取消以addr开头的预留区域，释放其中已分配的页和页表
+ * @return 成功返回0，没有以addr开头的区域返回-1
+ */
+int32_t mm_unreserve(struct mm_struct *mm, uint64_t addr) {
+    struct vm_area_struct *vma, *found = NULL;
+
+    uint64_t irq_flags = spin_lock_irqsave(&mm->lock);
+    list_for_each_entry(vma, &mm->vma_list, list) {
+        if (vma->start == addr) {
+            found = vma;
+            break;
+        }
+    }
+    if (!found) {
+        spin_unlock_irqrestore(&mm->lock, irq_flags);
+        return -1;
+    }
+
+    list_del(&found->list);
+    mm_release_range(mm, found->start, found->end);
+    spin_unlock_irqrestore(&mm->lock, irq_flags);
+
+    kfree(found);
+    return 0;
+}
+
+void (*mm_pageout_window_hook)(struct mm_struct *mm);
+
+/**
+ * @brief 换出期间表项的值：可写页改为只读的写时复制项，写入时由cow_break复制出新页，表项随之改变
+ */
+static inline uint64_t pageout_mark(uint64_t pte) {
+    return (pte & PTE_WRITABLE) ? ((pte & ~PTE_WRITABLE) | PTE_COW) : pte;
+}
+
+/**
+ * @brief 本批页压缩完成后重新加锁调用：表项仍为写保护时的值且没有新的共享者时改为换出页表项并释放页，
+ * 否则丢弃压缩结果并恢复原表项
+ */
+static void pageout_commit(struct pageout_ctx *ctx) {
+    uint32_t level;
+
+    for (uint32_t i = 0; i < ctx->nr; i++) {
+        uint64_t phys = ctx->pte[i] & PTE_ADDR_MASK;
+        uint64_t *entry = lookup_pte(ctx->mm->pml4, ctx->vaddr[i], &level);
+        uint8_t unchanged = entry && level == PT_LEVEL_PTE && *entry == pageout_mark(ctx->pte[i]);
+
+        if (ctx->handle[i] && unchanged && page_ref_count(phys) == 2) {
+            *entry = swap_pte(ctx->handle[i]);
+            tlb_batch_add(&ctx->batch, ctx->vaddr[i]);
+            continue;
+        }
+        if (ctx->handle[i])
+            zstore_free(ctx->handle[i]);
+        ctx->handle[i] = 0;
+        // 压缩期间有了新的共享者(如fork)时保持写时复制项，第一次写入经cow_break复制，不能恢复为可写
+        if (unchanged && *entry != ctx->pte[i] && page_ref_count(phys) == 2) {
+            *entry = ctx->pte[i];
+            tlb_batch_add(&ctx->batch, ctx->vaddr[i]);
+        }
+    }
+    tlb_batch_flush(&ctx->batch);
+
+    // 刷新TLB后才能释放页：换出成功的页放掉原映射的引用，所有页放掉收集时的引用
+    for (uint32_t i = 0; i < ctx->nr; i++) {
+        uint64_t phys = ctx->pte[i] & PTE_ADDR_MASK;
+        if (ctx->handle[i]) {
+            page_ref_put(phys);
+            ctx->nr_pageout++;
+            ctx->mm->nr_pageout++;
+        }
+        page_ref_put(phys);
+    }
+    ctx->nr = 0;
+}
+
+static int32_t pageout_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    struct pageout_ctx *ctx = (struct pageout_ctx *)arg;
+    uint64_t phys = *entry & PTE_ADDR_MASK;
+
+    // 只换出预留区域中未共享的4K页(缺页时按区域属性重新映射)
+    if (level != PT_LEVEL_PTE || !find_vma(ctx->mm, vaddr) || !mm_page_managed(phys) || page_ref_count(phys) != 1)
+        return 0;
+
+    // 先写保护并刷新TLB，压缩期间页内容不会再被修改；持有一个引用，解除预留也不会释放该页
+    ctx->vaddr[ctx->nr] = vaddr;
+    ctx->pte[ctx->nr++] = *entry;
+    page_ref_get(phys);
+    if (*entry != pageout_mark(*entry)) {
+        *entry = pageout_mark(*entry);
+        tlb_batch_add(&ctx->batch, vaddr);
+    }
+    if (ctx->nr == PAGEOUT_BATCH) {
+        ctx->next = vaddr + PAGE_4K_SIZE;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 把[start, end)内预留区域中已映射的页压缩换出到压缩存储，再次访问时在#PF中取回
+ *
+ * 用于调用者确定为冷数据的缓冲区；共享页和大页不换出，压缩存储内存不足的页保持映射。
+ * 每批页在mm->lock内写保护，压缩不持锁进行，再加锁确认表项未变后换出；压缩期间被写入的页保持映射。
+ * @return 换出的页数
+ */
+uint64_t mm_pageout(struct mm_struct *mm, uint64_t start, uint64_t end) {
+    struct pageout_ctx ctx = { .mm = mm, .next = start };
+    uint64_t irq_flags;
+    int32_t more;
+
+    do {
+        irq_flags = spin_lock_irqsave(&mm->lock);
+        tlb_batch_init(&ctx.batch, VIRT_TO_PHYS(mm->pml4));
+        more = walk_page_range(mm->pml4, ctx.next, end, pageout_entry, &ctx);
+        tlb_batch_flush(&ctx.batch);
+        spin_unlock_irqrestore(&mm->lock, irq_flags);
+
+        if (mm_pageout_window_hook)
+            mm_pageout_window_hook(mm);
+        for (uint32_t i = 0; i < ctx.nr; i++)
+            ctx.handle[i] = zstore_store(PHYS_TO_VIRT(ctx.pte[i] & PTE_ADDR_MASK));
+
+        irq_flags = spin_lock_irqsave(&mm->lock);
+        pageout_commit(&ctx);
+        spin_unlock_irqrestore(&mm->lock, irq_flags);
+    } while (more);
+    return ctx.nr_pageout;
+}
+
+static int32_t mm_count_entry(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    *(uint64_t *)arg += PT_LEVEL_SIZE(level) >> PAGE_4K_SHIFT;
+    return 0;
+}
+
+/**
+ * @brief 统计[start, end)内已映射的内存(按4K页计)
+ */
+uint64_t mm_resident_pages(struct mm_struct *mm, uint64_t start, uint64_t end) {
+    uint64_t count = 0;
+
+    uint64_t irq_flags = spin_lock_irqsave(&mm->lock);
+    walk_page_range(mm->pml4, start, end, mm_count_entry, &count);
+    spin_unlock_irqrestore(&mm->lock, irq_flags);
+    return count;
+}
+
+/**
+ * @brief 打印地址空间的预留区域与缺页统计
+ */
+void mm_info(struct mm_struct *mm) {
+    struct vm_area_struct *vma;
+    uint64_t nr_vmas = 0, reserved = 0;
+
+    uint64_t irq_flags = spin_lock_irqsave(&mm->lock);
+    list_for_each_entry(vma, &mm->vma_list, list) {
+        nr_vmas++;
+        reserved += vma->end - vma->start;
+    }
+    printk("mm %#018lx: %lu areas, %lu KB reserved, anon faults %lu (%lu pages, %lu swap-ins, %lu cycles/fault), "
+           "cow faults %lu (%lu copies), %lu pages paged out\n",
+           (uint64_t)mm->pml4, nr_vmas, reserved >> 10, mm->nr_anon_faults, mm->nr_anon_pages, mm->nr_swap_faults,
+           mm->nr_anon_faults ? mm->fault_cycles / mm->nr_anon_faults : 0, mm->nr_cow_faults, mm->nr_cow_copies,
+           mm->nr_pageout);
+    spin_unlock_irqrestore(&mm->lock, irq_flags);
+}
@@ -0,0 +1,75 @@
+#ifndef __MM_H__
+#define __MM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "spinlock.h"
+#include "list.h"
+
+#define USER_SPACE_END  0x0000800000000000UL    // 低半部分地址空间上限(各地址空间私有)
+#define KERNEL_PML4_START 256                   // 内核空间(高半部分)起始的PML4项
+#define MMAP_BASE       0x0000100000000000UL    // mm_reserve自动选择地址时的起点
+#define FAULT_AROUND_PAGES 16                   // 匿名缺页时一并映射的相邻4K页数(按64KB对齐的窗口)
+
+// 虚拟内存区域属性
+#define VM_READ         0x1
+#define VM_WRITE        0x2
+#define VM_EXEC         0x4
+#define VM_USER         0x8
+#define VM_MERGEABLE    0x10                    // 内容相同的页可以被KSM合并(见ksm.c)
+
+// 已预留的匿名内存区域：预留时不分配页框，首次访问时在#PF中按需分配并清零；
+// 其中的页可以被换出到压缩存储(见mm_pageout)，再次访问时取回
+struct vm_area_struct {
+    struct list_head list;              // 按地址顺序挂入mm->vma_list
+    uint64_t start;
+    uint64_t end;
+    uint32_t flags;                     // VM_*
+};
+
+// #PF错误码
+#define PF_PRESENT      (1UL << 0)      // 页存在(权限冲突)，为0表示页不存在
+#define PF_WRITE        (1UL << 1)      // 写访问
+#define PF_USER         (1UL << 2)      // 用户态访问
+#define PF_INSTR        (1UL << 4)      // 取指访问
+
+// 地址空间：高半部分与内核页表共享，低半部分私有
+struct mm_struct {
+    uint64_t *pml4;                     // 顶级页表线性地址
+    spinlock_t lock;                    // 保护页表与vma_list
+    struct list_head vma_list;          // 匿名内存区域(按地址升序)
+    uint64_t nr_cow_faults;             // 写时复制缺页次数
+    uint64_t nr_cow_copies;             // 其中实际复制了页的次数(其余为最后一个共享者直接恢复可写)
+    uint64_t nr_anon_faults;            // 匿名内存缺页次数
+    uint64_t nr_anon_pages;             // 缺页时映射的页数(含fault-around预先映射的相邻页)
+    uint64_t nr_swap_faults;            // 其中从压缩存储取回换出页的次数
+    uint64_t nr_pageout;                // 换出到压缩存储的页数
+    uint64_t fault_cycles;              // 匿名缺页处理总周期数
+};
+
+extern struct mm_struct init_mm;
+extern struct mm_struct *current_mm;
+// 启动自检用：mm_pageout每批写保护后、压缩前(不持锁)调用，模拟此时并发的fork
+extern void (*mm_pageout_window_hook)(struct mm_struct *mm);
+
+void mm_init(void);
+struct mm_struct *mm_create(void);
+void mm_destroy(struct mm_struct *mm);
+void mm_switch(struct mm_struct *mm);
+struct mm_struct *mm_fork(struct mm_struct *mm);
+int32_t cow_share_range(struct mm_struct *dst_mm, uint64_t dst, struct mm_struct *src_mm, uint64_t src, uint64_t size);
+int32_t handle_mm_fault(struct mm_struct *mm, uint64_t vaddr, uint64_t error_code);
+uint64_t mm_reserve(struct mm_struct *mm, uint64_t addr, uint64_t size, uint32_t flags);
+int32_t mm_unreserve(struct mm_struct *mm, uint64_t addr);
+uint64_t mm_pageout(struct mm_struct *mm, uint64_t start, uint64_t end);
+uint64_t mm_resident_pages(struct mm_struct *mm, uint64_t start, uint64_t end);
+void mm_info(struct mm_struct *mm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+#include "numa.h"
+#include "acpi.h"
+#include "memory.h"
+#include "printk.h"
+#include "cpu.h"
+
+struct numa_info_struct numa_info;
+
+/**
+ * @brief 将ACPI邻近域编号映射为连续的节点编号，首次出现时分配新节点
+ * @return 节点编号，节点数超过MAX_NUMNODES时返回NUMA_NO_NODE
+ */
+static uint32_t numa_pxm_to_node(uint32_t pxm) {
+    for (uint32_t node = 0; node < numa_info.nr_nodes; node++) {
+        if (numa_info.pxm[node] == pxm)
+            return node;
+    }
+
+    if (numa_info.nr_nodes >= MAX_NUMNODES) {
+        warnk("NUMA: too many proximity domains, ignore pxm %u\n", pxm);
+        return NUMA_NO_NODE;
+    }
+    numa_info.pxm[numa_info.nr_nodes] = pxm;
+    return numa_info.nr_nodes++;
+}
+
+/**
+ * @brief 记录一段节点内存，保持按起始页框号升序
+ *
+ * 两端都向上对齐到2M，相邻的范围对齐后仍然相邻，跨节点的2M页框归入较低的节点。
+ */
+static void numa_add_memblk(uint32_t node, uint64_t base, uint64_t length) {
+    uint64_t start_pfn = PAGE_2M_ALIGN(base) >> PAGE_2M_SHIFT;
+    uint64_t end_pfn = PAGE_2M_ALIGN(base + length) >> PAGE_2M_SHIFT;
+
+    if (start_pfn >= end_pfn)
+        return;
+    if (numa_info.nr_memblks >= NUMA_MAX_MEMBLKS) {
+        warnk("NUMA: too many memory affinity ranges, ignore %#lx - %#lx\n", base, base + length);
+        return;
+    }
+
+    uint32_t i = numa_info.nr_memblks++;
+    while (i > 0 && numa_info.memblk[i - 1].start_pfn > start_pfn) {
+        numa_info.memblk[i] = numa_info.memblk[i - 1];
+        i--;
+    }
+    numa_info.memblk[i].start_pfn = start_pfn;
+    numa_info.memblk[i].end_pfn = end_pfn;
+    numa_info.memblk[i].node = node;
+}
+
+static void numa_parse_srat(struct acpi_srat_struct *srat) {
+    uint8_t *entry = (uint8_t *)(srat + 1);
+    uint8_t *end = (uint8_t *)srat + srat->header.length;
+
+    while (entry + sizeof(struct acpi_srat_entry_header_struct) <= end) {
+        struct acpi_srat_entry_header_struct *header = (struct acpi_srat_entry_header_struct *)entry;
+        if (header->length == 0 || entry + header->length > end)
+            break;
+
+        if (header->type == ACPI_SRAT_CPU_AFFINITY) {
+            struct acpi_srat_cpu_affinity_struct *cpu = (struct acpi_srat_cpu_affinity_struct *)entry;
+            if (cpu->flags & ACPI_SRAT_ENABLED) {
+                uint32_t pxm = cpu->proximity_domain_lo;
+                // SRAT修订版1中高24位为保留字段
+                if (srat->header.revision >= 2)
+                    pxm |= (uint32_t)cpu->proximity_domain_hi[0] << 8 | (uint32_t)cpu->proximity_domain_hi[1] << 16 |
+                           (uint32_t)cpu->proximity_domain_hi[2] << 24;
+                numa_info.apicid_to_node[cpu->apic_id] = numa_pxm_to_node(pxm);
+            }
+        } else if (header->type == ACPI_SRAT_X2APIC_AFFINITY) {
+            struct acpi_srat_x2apic_affinity_struct *cpu = (struct acpi_srat_x2apic_affinity_struct *)entry;
+            if ((cpu->flags & ACPI_SRAT_ENABLED) && cpu->x2apic_id < 256)
+                numa_info.apicid_to_node[cpu->x2apic_id] = numa_pxm_to_node(cpu->proximity_domain);
+        } else if (header->type == ACPI_SRAT_MEMORY_AFFINITY) {
+            struct acpi_srat_memory_affinity_struct *mem = (struct acpi_srat_memory_affinity_struct *)entry;
+            if ((mem->flags & ACPI_SRAT_ENABLED) && mem->length) {
+                uint32_t node = numa_pxm_to_node(mem->proximity_domain);
+                if (node != NUMA_NO_NODE)
+                    numa_add_memblk(node, mem->base_address, mem->length);
+            }
+        }
+        entry += header->length;
+    }
+}
+
+static void numa_parse_slit(struct acpi_slit_struct *slit) {
+    uint64_t count = slit->locality_count;
+
+    if (sizeof(*slit) + count * count > slit->header.length) {
+        warnk("NUMA: SLIT truncated, use default distances\n");
+        return;
+    }
+
+    for (uint32_t a = 0; a < numa_info.nr_nodes; a++) {
+        for (uint32_t b = 0; b < numa_info.nr_nodes; b++) {
+            uint32_t pa = numa_info.pxm[a];
+            uint32_t pb = numa_info.pxm[b];
+            if (pa >= count || pb >= count)
+                continue;
+
+            uint8_t distance = slit->entry[pa * count + pb];
+            // 规范要求自身距离为10、其他节点大于10，不合法的值保留默认距离
+            if ((a == b && distance != LOCAL_DISTANCE) || (a != b && distance <= LOCAL_DISTANCE))
+                continue;
+            numa_info.distance[a][b] = distance;
+        }
+    }
+}
+
+/**
+ * @brief 从ACPI SRAT/SLIT读取NUMA拓扑
+ *
+ * 必须在init_memory创建zone之前、init_direct_map之前调用(通过早期映射窗口访问ACPI表)。
+ * 没有SRAT时所有内存和CPU都属于节点0。
+ */
+void numa_init(void) {
+    struct acpi_srat_struct *srat;
+    struct acpi_slit_struct *slit;
+
+    memset(&numa_info, 0x00, sizeof(numa_info));
+    memset(numa_info.apicid_to_node, NUMA_NO_NODE, sizeof(numa_info.apicid_to_node));
+
+    srat = acpi_find_table("SRAT");
+    if (srat)
+        numa_parse_srat(srat);
+
+    if (numa_info.nr_nodes == 0 || numa_info.nr_memblks == 0) {
+        // 没有可用的NUMA信息，退化为单节点
+        numa_info.nr_nodes = 1;
+        numa_info.nr_memblks = 0;
+        numa_info.pxm[0] = 0;
+        memset(numa_info.apicid_to_node, 0, sizeof(numa_info.apicid_to_node));
+    }
+
+    for (uint32_t a = 0; a < numa_info.nr_nodes; a++) {
+        for (uint32_t b = 0; b < numa_info.nr_nodes; b++)
+            numa_info.distance[a][b] = a == b ? LOCAL_DISTANCE : REMOTE_DISTANCE;
+    }
+
+    if (numa_info.nr_nodes > 1) {
+        slit = acpi_find_table("SLIT");
+        if (slit)
+            numa_parse_slit(slit);
+    }
+    acpi_early_unmap();
+
+    // 目前只有BSP在运行，AP启动时再调用numa_set_cpu_node登记
+    int32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    numa_set_cpu_node(smp_processor_id(), ((uint32_t)ebx >> 24) & 0xff);
+
+    logk("NUMA: %u node(s), boot CPU on node %u\n", numa_info.nr_nodes, numa_node_id());
+    for (uint32_t i = 0; i < numa_info.nr_memblks; i++) {
+        logk("NUMA: node %u pfn %#lx - %#lx\n", numa_info.memblk[i].node, numa_info.memblk[i].start_pfn,
+             numa_info.memblk[i].end_pfn);
+    }
+    for (uint32_t a = 0; a < numa_info.nr_nodes && numa_info.nr_nodes > 1; a++) {
+        logk("NUMA: node %u distance:", a);
+        for (uint32_t b = 0; b < numa_info.nr_nodes; b++)
+            printk(" %d", numa_info.distance[a][b]);
+        printk("\n");
+    }
+}
+
+/**
+ * @brief 查询从start_pfn开始的内存所属节点
+ * @param end_pfn 输入为范围末尾，输出时缩小到该节点范围的末尾(或下一段节点范围的开头)
+ * @return 节点编号，不在任何SRAT范围内的内存归入前一段范围的节点
+ */
+uint32_t numa_node_of_range(uint64_t start_pfn, uint64_t *end_pfn) {
+    uint32_t node = 0;
+
+    for (uint32_t i = 0; i < numa_info.nr_memblks; i++) {
+        struct numa_memblk_struct *blk = &numa_info.memblk[i];
+
+        if (start_pfn < blk->start_pfn) {
+            if (blk->start_pfn < *end_pfn)
+                *end_pfn = blk->start_pfn;
+            return node;
+        }
+        node = blk->node;
+        if (start_pfn < blk->end_pfn) {
+            if (blk->end_pfn < *end_pfn)
+                *end_pfn = blk->end_pfn;
+            return node;
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief 根据Local APIC ID登记逻辑CPU所属节点
+ */
+void numa_set_cpu_node(uint32_t cpu, uint32_t apic_id) {
+    uint8_t node = numa_info.apicid_to_node[apic_id & 0xff];
+
+    if (cpu >= NR_CPUS)
+        return;
+    numa_info.cpu_to_node[cpu] = node == NUMA_NO_NODE ? 0 : node;
+}
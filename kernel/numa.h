@@ -0,0 +1,54 @@
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "smp.h"
+
+#define MAX_NUMNODES        8           // 支持的最大NUMA节点数
+#define NUMA_MAX_MEMBLKS    32          // SRAT内存亲和范围的最大数量
+#define NUMA_NO_NODE        0xff
+
+#define LOCAL_DISTANCE      10          // SLIT中节点到自身的距离
+#define REMOTE_DISTANCE     20          // 没有SLIT时节点间的默认距离
+
+// 属于某个节点的一段物理内存(以2M页框号表示，边界对齐到2M)
+struct numa_memblk_struct {
+    uint64_t start_pfn;
+    uint64_t end_pfn;
+    uint32_t node;
+};
+
+struct numa_info_struct {
+    uint32_t nr_nodes;                                  // 节点数(没有SRAT时为1)
+    uint32_t pxm[MAX_NUMNODES];                         // 节点对应的ACPI邻近域编号
+    uint32_t nr_memblks;
+    struct numa_memblk_struct memblk[NUMA_MAX_MEMBLKS]; // 按起始页框号升序排列
+    uint8_t distance[MAX_NUMNODES][MAX_NUMNODES];       // 节点间距离(来自SLIT)
+    uint8_t apicid_to_node[256];                        // Local APIC ID所属节点
+    uint8_t cpu_to_node[NR_CPUS];                       // 逻辑CPU所属节点
+};
+
+extern struct numa_info_struct numa_info;
+
+void numa_init(void);
+uint32_t numa_node_of_range(uint64_t start_pfn, uint64_t *end_pfn);
+void numa_set_cpu_node(uint32_t cpu, uint32_t apic_id);
+
+#define node_distance(a, b) (numa_info.distance[a][b])
+
+/**
+ * @brief 当前CPU所在的NUMA节点
+ */
+static inline uint32_t __attribute__((always_inline)) numa_node_id(void) {
+    return numa_info.cpu_to_node[smp_processor_id()];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,523 @@
+#include "pgtable.h"
+#include "lib.h"
+#include "cpu.h"
+#include "cpufeature.h"
+#include "printk.h"
+#include "memblock.h"
+
+#define PGTABLE_FREE_BATCH 16           // 区间操作中暂存的待释放页表页数，攒满后先刷新TLB再释放
+
+uint64_t *kernel_pml4 = NULL;
+
+static uint8_t nx_enabled = 0;          // EFER.NXE已开启，可以使用PTE_NX
+static uint8_t gbpages_supported = 0;   // CPU支持1G页(X86_FEATURE_GBPAGES)
+
+// 区间操作类型
+enum pt_range_op_type {
+    PT_OP_UNMAP,
+    PT_OP_PROTECT
+};
+
+// 区间操作上下文
+struct pt_range_op_struct {
+    enum pt_range_op_type op;           // 操作类型
+    uint64_t prot_bits;                 // PT_OP_PROTECT时写入的权限位
+    uint8_t lazy;                       // 不刷新TLB且保留清空的页表页(由调用者稍后统一刷新)
+    struct tlb_batch_struct batch;      // 待失效的映射
+    uint64_t *free_tables[PGTABLE_FREE_BATCH];  // 已清空的页表页，TLB刷新后才能释放
+    uint32_t nr_free_tables;
+};
+
+uint64_t prot_to_pte(uint32_t prot) {
+    uint64_t pte = 0;
+
+    if (prot & PAGE_PRESENT)
+        pte |= PTE_PRESENT;
+    if (prot & PAGE_WRITABLE)
+        pte |= PTE_WRITABLE;
+    if (prot & PAGE_USER)
+        pte |= PTE_USER;
+    if (prot & PAGE_NOCACHE)
+        pte |= PTE_PCD;
+    if (prot & PAGE_WRITETHROUGH)
+        pte |= PTE_PWT;
+    if ((prot & PAGE_NX) && nx_enabled)
+        pte |= PTE_NX;
+    return pte;
+}
+
+uint32_t pte_to_prot(uint64_t pte) {
+    uint32_t prot = 0;
+
+    if (pte & PTE_PRESENT)
+        prot |= PAGE_PRESENT;
+    if (pte & PTE_WRITABLE)
+        prot |= PAGE_WRITABLE;
+    if (pte & PTE_USER)
+        prot |= PAGE_USER;
+    if (pte & PTE_PCD)
+        prot |= PAGE_NOCACHE;
+    if (pte & PTE_PWT)
+        prot |= PAGE_WRITETHROUGH;
+    if (pte & PTE_NX)
+        prot |= PAGE_NX;
+    return prot;
+}
+
+// 启动阶段页表页来源：4K子页分配器依赖slab，slab就绪前先使用内核镜像内的静态页，
+// 用完后在页框分配器接管前从memblock分配，接管后从整2M页框中顺序切分(这些页表页常驻，不会被释放)
+#define EARLY_PGTABLE_PAGES 4
+static uint64_t early_pgtable_pool[EARLY_PGTABLE_PAGES][PTRS_PER_TABLE] __attribute__((aligned(PAGE_4K_SIZE)));
+static uint32_t early_pgtable_used = 0;
+static uint64_t boot_table_next = 0;
+static uint64_t boot_table_end = 0;
+static uint8_t pgtable_boot_mode = 1;
+
+static uint64_t pgtable_boot_alloc(void) {
+    if (early_pgtable_used < EARLY_PGTABLE_PAGES)
+        return VIRT_TO_PHYS(early_pgtable_pool[early_pgtable_used++]);
+    if (!memblock.frozen)
+        return memblock_phys_alloc(PAGE_4K_SIZE, PAGE_4K_SIZE, NUMA_NO_NODE);
+
+    if (boot_table_next >= boot_table_end) {
+        struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+        if (!page)
+            return 0;
+        boot_table_next = page_to_phys(page);
+        boot_table_end = boot_table_next + PAGE_2M_SIZE;
+    }
+
+    uint64_t phys = boot_table_next;
+    boot_table_next += PAGE_4K_SIZE;
+    return phys;
+}
+
+/**
+ * @brief 分配一个清零的4K页表页
+ */
+static uint64_t *pgtable_alloc_table(void) {
+    uint64_t phys = pgtable_boot_mode ? pgtable_boot_alloc() : alloc_pages_4k(1);
+    if (!phys)
+        return NULL;
+
+    uint64_t *table = (uint64_t *)PHYS_TO_VIRT(phys);
+    memset(table, 0, PAGE_4K_SIZE);
+    return table;
+}
+
+static void pgtable_free_table(uint64_t *table) {
+    uint64_t phys = VIRT_TO_PHYS(table);
+
+    // head.S及启动阶段分配的页表位于内核镜像、memblock保留区或整2M页框内，不能释放
+    if (!memblock.frozen)
+        return;
+    if (page_get_size(pfn_to_page(phys >> PAGE_2M_SHIFT)) != PAGE_4K)
+        return;
+    free_pages_4k(phys, 1);
+}
+
+// 换出页表项(PTE_SWAP)不存在但仍占用页表
+static uint8_t pgtable_table_empty(uint64_t *table) {
+    for (uint32_t i = 0; i < PTRS_PER_TABLE; i++) {
+        if (table[i])
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 释放以table为根的整棵页表子树(不释放其映射的页框)
+ */
+static void pgtable_free_tree(uint64_t *table, uint32_t level) {
+    if (level > PT_LEVEL_PTE) {
+        for (uint32_t i = 0; i < PTRS_PER_TABLE; i++) {
+            if ((table[i] & PTE_PRESENT) && !(table[i] & PTE_PS))
+                pgtable_free_tree((uint64_t *)PHYS_TO_VIRT(table[i] & PTE_ADDR_MASK), level - 1);
+        }
+    }
+    pgtable_free_table(table);
+}
+
+/**
+ * @brief 将大页表项拆分为下一级的512个表项，映射与属性保持不变
+ * @param entry 指向PDPTE(1G)或PDE(2M)
+ * @param level entry所在层级
+ */
+static int32_t split_large_entry(uint64_t *entry, uint32_t level) {
+    uint64_t *table = pgtable_alloc_table();
+    if (!table)
+        return -1;
+
+    uint64_t large = *entry;
+    uint64_t base = large & PTE_ADDR_MASK & ~(PT_LEVEL_SIZE(level) - 1);
+    uint64_t attr = large & ~PTE_ADDR_MASK;
+    if (level - 1 == PT_LEVEL_PTE)
+        attr &= ~PTE_PS;
+
+    for (uint32_t i = 0; i < PTRS_PER_TABLE; i++)
+        table[i] = (base + i * PT_LEVEL_SIZE(level - 1)) | attr;
+
+    *entry = VIRT_TO_PHYS(table) | PTE_PRESENT | PTE_WRITABLE | (large & PTE_USER);
+    return 0;
+}
+
+/**
+ * @brief 向下查找vaddr在target_level层的表项，途中缺失的页表自动创建、大页自动拆分
+ */
+static uint64_t *walk_create(uint64_t *pml4, uint64_t vaddr, uint32_t target_level, uint8_t user) {
+    uint64_t *table = pml4;
+
+    for (uint32_t level = PT_LEVEL_PML4E; level > target_level; level--) {
+        uint64_t *entry = &table[PT_INDEX(vaddr, level)];
+
+        if (!(*entry & PTE_PRESENT)) {
+            uint64_t *new_table = pgtable_alloc_table();
+            if (!new_table)
+                return NULL;
+            *entry = VIRT_TO_PHYS(new_table) | PTE_PRESENT | PTE_WRITABLE;
+        } else if (*entry & PTE_PS) {
+            if (split_large_entry(entry, level))
+                return NULL;
+        }
+        if (user)
+            *entry |= PTE_USER;
+
+        table = (uint64_t *)PHYS_TO_VIRT(*entry & PTE_ADDR_MASK);
+    }
+
+    return &table[PT_INDEX(vaddr, target_level)];
+}
+
+static void pt_range_flush(struct pt_range_op_struct *ctx, uint64_t vaddr) {
+    if (!ctx->lazy)
+        tlb_batch_add(&ctx->batch, vaddr);
+}
+
+/**
+ * @brief 刷新已记录的映射，再释放暂存的页表页(分页结构缓存可能还引用着它们)
+ */
+static void pt_range_commit(struct pt_range_op_struct *ctx) {
+    tlb_batch_flush(&ctx->batch);
+    for (uint32_t i = 0; i < ctx->nr_free_tables; i++)
+        pgtable_free_table(ctx->free_tables[i]);
+    ctx->nr_free_tables = 0;
+}
+
+static void pt_range_free_table(struct pt_range_op_struct *ctx, uint64_t *table) {
+    if (ctx->nr_free_tables == PGTABLE_FREE_BATCH)
+        pt_range_commit(ctx);
+    ctx->free_tables[ctx->nr_free_tables++] = table;
+}
+
+/**
+ * @brief 在level层的table上对[start, end)执行区间操作，部分覆盖的大页先拆分
+ */
+static int32_t pt_range_level(struct pt_range_op_struct *ctx, uint64_t *table, uint32_t level, uint64_t start,
+                              uint64_t end) {
+    uint64_t size = PT_LEVEL_SIZE(level);
+    uint64_t addr = start;
+
+    while (addr < end) {
+        uint64_t entry_start = addr & ~(size - 1);
+        uint64_t entry_last = entry_start + size - 1;       // 使用闭区间避免地址空间末尾溢出
+        uint64_t sub_end = entry_last < end - 1 ? entry_last + 1 : end;
+        uint64_t *entry = &table[PT_INDEX(addr, level)];
+
+        if (*entry & PTE_PRESENT) {
+            uint8_t leaf = level == PT_LEVEL_PTE || (*entry & PTE_PS);
+
+            if (leaf && (addr != entry_start || sub_end - 1 != entry_last)) {
+                if (split_large_entry(entry, level))
+                    return -1;
+                leaf = 0;
+            }
+
+            if (leaf) {
+                if (ctx->op == PT_OP_UNMAP)
+                    *entry = 0;
+                else if (*entry & PTE_COW)
+                    *entry = (*entry & ~PTE_PROT_MASK) | (ctx->prot_bits & ~PTE_WRITABLE);  // 共享页保持只读，写入时再复制
+                else
+                    *entry = (*entry & ~PTE_PROT_MASK) | ctx->prot_bits;
+                pt_range_flush(ctx, entry_start);
+            } else {
+                uint64_t *child = (uint64_t *)PHYS_TO_VIRT(*entry & PTE_ADDR_MASK);
+                if (pt_range_level(ctx, child, level - 1, addr, sub_end))
+                    return -1;
+                // 延迟刷新时TLB/分页结构缓存中可能还引用着下级页表，不能释放
+                if (ctx->op == PT_OP_UNMAP && !ctx->lazy && pgtable_table_empty(child)) {
+                    *entry = 0;
+                    pt_range_free_table(ctx, child);
+                }
+            }
+        }
+
+        if (sub_end - 1 == entry_last && entry_last == ~0UL)
+            break;
+        addr = sub_end;
+    }
+    return 0;
+}
+
+static int32_t pt_range_apply(uint64_t *pml4, struct pt_range_op_struct *ctx, uint64_t vaddr, uint64_t size) {
+    if ((vaddr | size) & (PAGE_4K_SIZE - 1)) {
+        warnk("Unaligned page table range: vaddr=%#018lx size=%#lx\n", vaddr, size);
+        return -1;
+    }
+    if (size == 0)
+        return 0;
+
+    tlb_batch_init(&ctx->batch, VIRT_TO_PHYS(pml4));
+    ctx->nr_free_tables = 0;
+    int32_t ret = pt_range_level(ctx, pml4, PT_LEVEL_PML4E, vaddr, vaddr + size);
+    pt_range_commit(ctx);
+    return ret;
+}
+
+/**
+ * @brief 建立映射 [vaddr, vaddr + size) -> [paddr, paddr + size)
+ * @param page_size 映射粒度，地址和长度都必须按该粒度对齐
+ * @param prot      PAGE_WRITABLE/PAGE_USER/PAGE_NOCACHE/PAGE_WRITETHROUGH/PAGE_NX的组合
+ * @return 成功返回0，失败返回-1
+ *
+ * 已存在的映射会被替换，被替换的下级页表一并释放。
+ */
+int32_t map_pages(uint64_t *pml4, uint64_t vaddr, uint64_t paddr, uint64_t size, enum page_size page_size,
+                  uint32_t prot) {
+    uint32_t level = page_size == PAGE_1G ? PT_LEVEL_PDPTE : page_size == PAGE_2M ? PT_LEVEL_PDE : PT_LEVEL_PTE;
+    uint64_t step = PT_LEVEL_SIZE(level);
+
+    if ((vaddr | paddr | size) & (step - 1)) {
+        warnk("Unaligned mapping: vaddr=%#018lx paddr=%#018lx size=%#lx\n", vaddr, paddr, size);
+        return -1;
+    }
+    if (page_size == PAGE_1G && !gbpages_supported) {
+        warnk("1G pages are not supported by this CPU\n");
+        return -1;
+    }
+
+    struct tlb_batch_struct batch;
+    uint64_t pte_bits = prot_to_pte(prot) | PTE_PRESENT | (level > PT_LEVEL_PTE ? PTE_PS : 0);
+
+    // 内核空间为所有地址空间共享，映射为全局页，切换地址空间时不被刷新
+    if (vaddr >= KERNEL_SPACE_START && tlb_global_enabled())
+        pte_bits |= PTE_GLOBAL;
+    tlb_batch_init(&batch, VIRT_TO_PHYS(pml4));
+
+    for (uint64_t offset = 0; offset < size; offset += step) {
+        uint64_t *entry = walk_create(pml4, vaddr + offset, level, (prot & PAGE_USER) != 0);
+        if (!entry) {
+            errk("map_pages: out of memory for page tables at %#018lx\n", vaddr + offset);
+            return -1;
+        }
+
+        uint64_t old = *entry;
+        *entry = (paddr + offset) | pte_bits;
+        if (!(old & PTE_PRESENT))
+            continue;
+
+        if (level > PT_LEVEL_PTE && !(old & PTE_PS)) {
+            // 被替换的页表子树须在TLB刷新后释放
+            tlb_batch_add_range(&batch, vaddr + offset, step);
+            tlb_batch_flush(&batch);
+            pgtable_free_tree((uint64_t *)PHYS_TO_VIRT(old & PTE_ADDR_MASK), level - 1);
+        } else {
+            tlb_batch_add(&batch, vaddr + offset);
+        }
+    }
+
+    tlb_batch_flush(&batch);
+    return 0;
+}
+
+/**
+ * @brief 解除 [vaddr, vaddr + size) 的映射(4K对齐)，清空的页表页随之释放
+ */
+int32_t unmap_pages(uint64_t *pml4, uint64_t vaddr, uint64_t size) {
+    struct pt_range_op_struct ctx = { .op = PT_OP_UNMAP };
+    return pt_range_apply(pml4, &ctx, vaddr, size);
+}
+
+/**
+ * @brief 解除 [vaddr, vaddr + size) 的映射但不刷新TLB，页表页保留供之后复用
+ *
+ * 调用者必须在该线性地址区间被重新使用前刷新TLB(如vmalloc的延迟回收)。
+ */
+int32_t unmap_pages_lazy(uint64_t *pml4, uint64_t vaddr, uint64_t size) {
+    struct pt_range_op_struct ctx = { .op = PT_OP_UNMAP, .lazy = 1 };
+    return pt_range_apply(pml4, &ctx, vaddr, size);
+}
+
+/**
+ * @brief 修改 [vaddr, vaddr + size) 内已有映射的权限(4K对齐)，未映射的部分跳过
+ */
+int32_t protect_pages(uint64_t *pml4, uint64_t vaddr, uint64_t size, uint32_t prot) {
+    struct pt_range_op_struct ctx = { .op = PT_OP_PROTECT, .prot_bits = prot_to_pte(prot) | PTE_PRESENT };
+    return pt_range_apply(pml4, &ctx, vaddr, size);
+}
+
+/**
+ * @brief 直接写入vaddr在level层的叶子表项，途中缺失的页表自动创建
+ * @param pte 完整的表项值(含物理地址、属性及软件位，level大于PT_LEVEL_PTE时须带PTE_PS)
+ * @return 成功返回0，页表页分配失败返回-1
+ */
+int32_t install_pte(uint64_t *pml4, uint64_t vaddr, uint32_t level, uint64_t pte) {
+    uint64_t *entry = walk_create(pml4, vaddr, level, (pte & PTE_USER) != 0);
+    if (!entry)
+        return -1;
+
+    uint64_t old = *entry;
+    *entry = pte;
+    if (!(old & PTE_PRESENT))
+        return 0;
+
+    struct tlb_batch_struct batch;
+    tlb_batch_init(&batch, VIRT_TO_PHYS(pml4));
+    if (level > PT_LEVEL_PTE && !(old & PTE_PS))
+        tlb_batch_add_range(&batch, vaddr & ~(PT_LEVEL_SIZE(level) - 1), PT_LEVEL_SIZE(level));
+    else
+        tlb_batch_add(&batch, vaddr & ~(PT_LEVEL_SIZE(level) - 1));
+    tlb_batch_flush(&batch);
+    if (level > PT_LEVEL_PTE && !(old & PTE_PS))
+        pgtable_free_tree((uint64_t *)PHYS_TO_VIRT(old & PTE_ADDR_MASK), level - 1);
+    return 0;
+}
+
+static int32_t walk_page_level(uint64_t *table, uint32_t level, uint64_t start, uint64_t end, pte_walk_fn fn,
+                               void *arg, uint8_t swap) {
+    uint64_t size = PT_LEVEL_SIZE(level);
+    uint64_t addr = start;
+
+    while (addr < end) {
+        uint64_t entry_start = addr & ~(size - 1);
+        uint64_t entry_last = entry_start + size - 1;
+        uint64_t sub_end = entry_last < end - 1 ? entry_last + 1 : end;
+        uint64_t *entry = &table[PT_INDEX(addr, level)];
+
+        if (*entry & PTE_PRESENT) {
+            int32_t ret = 0;
+            if (level == PT_LEVEL_PTE || (*entry & PTE_PS)) {
+                if (!swap)
+                    ret = fn(entry, level, entry_start, arg);
+            } else {
+                ret = walk_page_level((uint64_t *)PHYS_TO_VIRT(*entry & PTE_ADDR_MASK), level - 1, addr, sub_end, fn,
+                                      arg, swap);
+            }
+            if (ret)
+                return ret;
+        } else if (swap && level == PT_LEVEL_PTE && (*entry & PTE_SWAP)) {
+            int32_t ret = fn(entry, level, entry_start, arg);
+            if (ret)
+                return ret;
+        }
+
+        if (entry_last == ~0UL)
+            break;
+        addr = sub_end;
+    }
+    return 0;
+}
+
+/**
+ * @brief 对[start, end)内每个已映射的叶子表项调用fn，只访问存在的页表
+ *
+ * 与区间两端部分重叠的大页同样会被回调，由fn根据vaddr和level自行判断。
+ * @return 全部遍历完返回0，否则返回fn的非0返回值
+ */
+int32_t walk_page_range(uint64_t *pml4, uint64_t start, uint64_t end, pte_walk_fn fn, void *arg) {
+    if (start >= end)
+        return 0;
+    return walk_page_level(pml4, PT_LEVEL_PML4E, start, end, fn, arg, 0);
+}
+
+/**
+ * @brief 对[start, end)内每个换出页表项(不存在且带PTE_SWAP的4K表项)调用fn
+ * @return 全部遍历完返回0，否则返回fn的非0返回值
+ */
+int32_t walk_swap_range(uint64_t *pml4, uint64_t start, uint64_t end, pte_walk_fn fn, void *arg) {
+    if (start >= end)
+        return 0;
+    return walk_page_level(pml4, PT_LEVEL_PML4E, start, end, fn, arg, 1);
+}
+
+/**
+ * @brief 查找vaddr对应的叶子表项
+ * @param level 若非NULL，返回叶子所在层级(PT_LEVEL_PTE/PDE/PDPTE)
+ * @return 叶子表项指针，未映射返回NULL
+ */
+uint64_t *lookup_pte(uint64_t *pml4, uint64_t vaddr, uint32_t *level) {
+    uint64_t *table = pml4;
+
+    for (uint32_t current = PT_LEVEL_PML4E;; current--) {
+        uint64_t *entry = &table[PT_INDEX(vaddr, current)];
+
+        if (!(*entry & PTE_PRESENT))
+            return NULL;
+        if (current == PT_LEVEL_PTE || (*entry & PTE_PS)) {
+            if (level)
+                *level = current;
+            return entry;
+        }
+        table = (uint64_t *)PHYS_TO_VIRT(*entry & PTE_ADDR_MASK);
+    }
+}
+
+/**
+ * @brief 查找vaddr对应的换出页表项
+ * @return 表项指针，vaddr不是换出页(已映射、未映射或所在页表不存在)返回NULL
+ */
+uint64_t *lookup_swap_pte(uint64_t *pml4, uint64_t vaddr) {
+    uint64_t *table = pml4;
+
+    for (uint32_t level = PT_LEVEL_PML4E; level > PT_LEVEL_PTE; level--) {
+        uint64_t entry = table[PT_INDEX(vaddr, level)];
+
+        if (!(entry & PTE_PRESENT) || (entry & PTE_PS))
+            return NULL;
+        table = (uint64_t *)PHYS_TO_VIRT(entry & PTE_ADDR_MASK);
+    }
+
+    uint64_t *entry = &table[PT_INDEX(vaddr, PT_LEVEL_PTE)];
+    return !(*entry & PTE_PRESENT) && (*entry & PTE_SWAP) ? entry : NULL;
+}
+
+/**
+ * @brief 通过页表将线性地址转换为物理地址
+ * @return 物理地址，未映射返回(uint64_t)-1
+ */
+uint64_t translate_address(uint64_t *pml4, uint64_t vaddr) {
+    uint32_t level;
+    uint64_t *entry = lookup_pte(pml4, vaddr, &level);
+
+    if (!entry)
+        return (uint64_t)-1;
+
+    uint64_t size = PT_LEVEL_SIZE(level);
+    return (*entry & PTE_ADDR_MASK & ~(size - 1)) | (vaddr & (size - 1));
+}
+
+void pgtable_init(void) {
+    kernel_pml4 = (uint64_t *)PHYS_TO_VIRT((uint64_t)Global_CR3 & PTE_ADDR_MASK);
+
+    gbpages_supported = cpu_has(X86_FEATURE_GBPAGES);
+
+    // CPU支持NX时开启EFER.NXE，否则页表中的NX位是保留位
+    if (cpu_has(X86_FEATURE_NX)) {
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+        nx_enabled = 1;
+    }
+
+    logk("Page table: kernel PML4 at %#018lx, NX %s, 1G pages %s\n", (uint64_t)kernel_pml4,
+         nx_enabled ? "enabled" : "unsupported", gbpages_supported ? "supported" : "unsupported");
+}
+
+/**
+ * @brief slab就绪后调用，此后页表页由4K子页分配器提供，并可随映射解除而释放
+ */
+void pgtable_late_init(void) {
+    pgtable_boot_mode = 0;
+}
+
+uint8_t pgtable_gbpages_supported(void) {
+    return gbpages_supported;
+}
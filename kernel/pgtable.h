@@ -0,0 +1,72 @@
+#ifndef __PGTABLE_H__
+#define __PGTABLE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "memory.h"
+
+// 页表项硬件标志位
+#define PTE_PRESENT     (1UL << 0)      // 存在
+#define PTE_WRITABLE    (1UL << 1)      // 可写
+#define PTE_USER        (1UL << 2)      // 用户态可访问
+#define PTE_PWT         (1UL << 3)      // 写透
+#define PTE_PCD         (1UL << 4)      // 禁用缓存
+#define PTE_ACCESSED    (1UL << 5)      // 已访问
+#define PTE_DIRTY       (1UL << 6)      // 已写入(仅叶子项)
+#define PTE_PS          (1UL << 7)      // PDPTE/PDE：映射1G/2M大页
+#define PTE_GLOBAL      (1UL << 8)      // 全局页(仅叶子项)
+#define PTE_COW         (1UL << 9)      // 软件位：写时复制共享页，原映射可写(仅叶子项)
+#define PTE_SWAP        (1UL << 10)     // 软件位：不存在的4K表项中保存换出页的句柄(见swap_pte)
+#define PTE_NX          (1UL << 63)     // 禁止执行(需要EFER.NXE)
+
+#define PTE_ADDR_MASK   0x000ffffffffff000UL
+#define PTE_PROT_MASK   (PTE_PRESENT | PTE_WRITABLE | PTE_USER | PTE_PWT | PTE_PCD | PTE_NX)
+
+#define PTRS_PER_TABLE  512
+
+// 换出页表项：句柄放在地址字段，访问时#PF按句柄取回
+#define swap_pte(handle)        (((uint64_t)(handle) << PAGE_4K_SHIFT) | PTE_SWAP)
+#define swap_pte_handle(pte)    (((pte) & PTE_ADDR_MASK) >> PAGE_4K_SHIFT)
+
+// 页表层级(数字越大越靠近CR3)
+#define PT_LEVEL_PTE    0
+#define PT_LEVEL_PDE    1
+#define PT_LEVEL_PDPTE  2
+#define PT_LEVEL_PML4E  3
+
+#define PT_LEVEL_SHIFT(level)   (PAGE_4K_SHIFT + 9 * (level))
+#define PT_LEVEL_SIZE(level)    (1UL << PT_LEVEL_SHIFT(level))
+#define PT_INDEX(addr, level)   (((uint64_t)(addr) >> PT_LEVEL_SHIFT(level)) & (PTRS_PER_TABLE - 1))
+
+extern uint64_t *kernel_pml4;           // 内核页表(PML4)线性地址
+
+void pgtable_init(void);
+void pgtable_late_init(void);
+uint8_t pgtable_gbpages_supported(void);
+
+int32_t map_pages(uint64_t *pml4, uint64_t vaddr, uint64_t paddr, uint64_t size, enum page_size page_size,
+                  uint32_t prot);
+int32_t unmap_pages(uint64_t *pml4, uint64_t vaddr, uint64_t size);
+int32_t unmap_pages_lazy(uint64_t *pml4, uint64_t vaddr, uint64_t size);
+int32_t protect_pages(uint64_t *pml4, uint64_t vaddr, uint64_t size, uint32_t prot);
+int32_t install_pte(uint64_t *pml4, uint64_t vaddr, uint32_t level, uint64_t pte);
+uint64_t *lookup_pte(uint64_t *pml4, uint64_t vaddr, uint32_t *level);
+uint64_t *lookup_swap_pte(uint64_t *pml4, uint64_t vaddr);
+uint64_t translate_address(uint64_t *pml4, uint64_t vaddr);
+
+// 页表遍历回调：entry为叶子表项，vaddr为该叶子映射的起始线性地址，返回非0时终止遍历
+typedef int32_t (*pte_walk_fn)(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg);
+int32_t walk_page_range(uint64_t *pml4, uint64_t start, uint64_t end, pte_walk_fn fn, void *arg);
+int32_t walk_swap_range(uint64_t *pml4, uint64_t start, uint64_t end, pte_walk_fn fn, void *arg);
+
+uint64_t prot_to_pte(uint32_t prot);
+uint32_t pte_to_prot(uint64_t pte);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
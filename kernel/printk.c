@@ -1,6 +1,8 @@
 #include "printk.h"
 #include "lib.h"
 
+DEFINE_STATIC_KEY_FALSE(trace_key);
+
 /**
  * @brief 在当前打印位置绘制一个颜色字符。
  *
@@ -296,10 +298,7 @@ int32_t vsnprintf(int8_t *buf, size_t size, const char *fmt, va_list args) {
                 s = "(null)";
 
             /* 计算实际拷贝长度（考虑精度） */
-            size_t len = strlen(s);
-            if (precision >= 0 && len > (size_t)precision) {
-                len = precision;
-            }
+            size_t len = precision >= 0 ? strnlen(s, precision) : strlen(s);
 
             /* 计算填充空格数 */
             int32_t padding = (field_width > len) ? (field_width - len) : 0;
@@ -584,3 +583,14 @@ int32_t fatalk(const char *fmt, ...) {
     va_end(args);
     return ret;
 }
+
+/**
+ * @brief 跟踪输出实现，经tracek调用，trace_key开启时才会执行到
+ */
+int32_t __tracek(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int32_t ret = logk_impl(GRAY, BLACK, "[TRCE] ", fmt, args);
+    va_end(args);
+    return ret;
+}
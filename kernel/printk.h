@@ -9,6 +9,7 @@ extern "C" {
 #include <stdarg.h>
 #include <stddef.h>
 #include "font.h"
+#include "jump_label.h"
 
 // 打包ARGB色彩值
 #define ARGB_PACK(a,r,g,b) \
@@ -51,11 +52,22 @@ extern unsigned char font_ascii[256][16];
 void put_color_char(uint32_t char_color, uint32_t bg_color, uint8_t font);
 int32_t color_printk(uint32_t char_color, uint32_t bg_color, const char *fmt, ...);
 int32_t printk(const char *fmt, ...);
+int32_t vsnprintf(int8_t *buf, size_t size, const char *fmt, va_list args);
 
 int32_t logk(const char *fmt, ...);
 int32_t warnk(const char *fmt, ...);
 int32_t errk(const char *fmt, ...);
 int32_t fatalk(const char *fmt, ...);
+int32_t __tracek(const char *fmt, ...);
+
+// 跟踪开关：关闭时每个跟踪点只剩一条NOP
+extern struct static_key_struct trace_key;
+
+#define tracek(fmt, ...)                                                                                               \
+    do {                                                                                                               \
+        if (static_branch_unlikely(&trace_key))                                                                        \
+            __tracek(fmt, ##__VA_ARGS__);                                                                              \
+    } while (0)
 
 /**
  * 内核打印信息结构
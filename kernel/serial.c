@@ -0,0 +1,70 @@
+#include "serial.h"
+#include "lib.h"
+#include "printk.h"
+#include "spinlock.h"
+
+static uint8_t serial_present = 0;
+static int8_t serial_buf[1024];
+static spinlock_t serial_lock = SPIN_LOCK_UNLOCKED;     // 保护serial_buf并保证整行输出不被打断
+
+/**
+ * @brief 初始化COM1为115200 8N1，不使用中断
+ *
+ * 初始化时用回环模式自检，读回的字节不一致则认为没有串口，之后的输出全部丢弃。
+ */
+void serial_init(void) {
+    io_out8(SERIAL_COM1 + SERIAL_IER, 0x00);                    // 关闭UART中断
+    io_out8(SERIAL_COM1 + SERIAL_LCR, 0x80);                    // DLAB=1，设置波特率除数
+    io_out8(SERIAL_COM1 + SERIAL_DATA, SERIAL_BAUD_DIVISOR & 0xff);
+    io_out8(SERIAL_COM1 + SERIAL_IER, SERIAL_BAUD_DIVISOR >> 8);
+    io_out8(SERIAL_COM1 + SERIAL_LCR, 0x03);                    // 8位数据、无校验、1位停止位
+    io_out8(SERIAL_COM1 + SERIAL_FCR, 0xc7);                    // 启用并清空FIFO，14字节触发
+    io_out8(SERIAL_COM1 + SERIAL_MCR, 0x1e);                    // 回环模式自检
+    io_out8(SERIAL_COM1 + SERIAL_DATA, 0xae);
+
+    if (io_in8(SERIAL_COM1 + SERIAL_DATA) != 0xae) {
+        warnk("Serial port COM1 not present\n");
+        return;
+    }
+
+    io_out8(SERIAL_COM1 + SERIAL_MCR, 0x0f);                    // 退出回环，DTR/RTS/OUT1/OUT2置位
+    serial_present = 1;
+    logk("Serial port COM1 initialized\n");
+}
+
+/**
+ * @brief 轮询发送一个字符，'\n'前补'\r'
+ */
+void serial_putc(char c) {
+    if (!serial_present)
+        return;
+
+    if (c == '\n')
+        serial_putc('\r');
+    while (!(io_in8(SERIAL_COM1 + SERIAL_LSR) & SERIAL_LSR_THRE))
+        __asm__ __volatile__("pause");
+    io_out8(SERIAL_COM1 + SERIAL_DATA, (uint8_t)c);
+}
+
+void serial_write(const char *str) {
+    while (*str)
+        serial_putc(*str++);
+}
+
+/**
+ * @brief 格式化输出到串口(格式与printk相同，单次输出超过缓冲区的部分被截断)
+ * @return 格式化后的字符数
+ */
+int32_t serial_printk(const char *fmt, ...) {
+    va_list args;
+    int32_t len;
+
+    uint64_t irq_flags = spin_lock_irqsave(&serial_lock);
+    va_start(args, fmt);
+    len = vsnprintf(serial_buf, sizeof(serial_buf), fmt, args);
+    va_end(args);
+
+    serial_write((const char *)serial_buf);
+    spin_unlock_irqrestore(&serial_lock, irq_flags);
+    return len;
+}
@@ -0,0 +1,32 @@
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SERIAL_COM1         0x3f8       // COM1基地址
+#define SERIAL_BAUD_DIVISOR 1           // 115200 / 1 = 115200波特率
+
+// UART寄存器偏移(相对基地址)
+#define SERIAL_DATA         0           // 数据寄存器(DLAB=1时为除数低字节)
+#define SERIAL_IER          1           // 中断使能寄存器(DLAB=1时为除数高字节)
+#define SERIAL_FCR          2           // FIFO控制寄存器
+#define SERIAL_LCR          3           // 线路控制寄存器
+#define SERIAL_MCR          4           // Modem控制寄存器
+#define SERIAL_LSR          5           // 线路状态寄存器
+
+#define SERIAL_LSR_THRE     0x20        // 发送保持寄存器空
+
+void serial_init(void);
+void serial_putc(char c);
+void serial_write(const char *str);
+int32_t serial_printk(const char *fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,424 @@
+#include "slab.h"
+#include "memory.h"
+#include "lib.h"
+#include "printk.h"
+
+#define KMEM_FREE_SLABS_KEEP 1          // 每个cache保留的空闲slab数，避免频繁向页框分配器申请/归还
+
+#define ALIGN_UP(x, a) (((uint64_t)(x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+// cache的cache：所有kmem_cache_struct都从这里分配
+static struct kmem_cache_struct kmem_cache_boot;
+
+// 全局cache链表
+static struct list_head cache_chain = LIST_HEAD_INIT(cache_chain);
+static spinlock_t cache_chain_lock = SPIN_LOCK_UNLOCKED;
+
+// kmalloc大小分级
+static const uint64_t kmalloc_sizes[] = {
+    8, 16, 32, 64, 96, 128, 192, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536, 131072
+};
+static const char *kmalloc_names[] = {
+    "kmalloc-8", "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-96", "kmalloc-128",
+    "kmalloc-192", "kmalloc-256", "kmalloc-512", "kmalloc-1k", "kmalloc-2k", "kmalloc-4k",
+    "kmalloc-8k", "kmalloc-16k", "kmalloc-32k", "kmalloc-64k", "kmalloc-128k"
+};
+#define KMALLOC_CACHES (sizeof(kmalloc_sizes) / sizeof(kmalloc_sizes[0]))
+
+static struct kmem_cache_struct *kmalloc_caches[KMALLOC_CACHES];
+
+static inline void *get_free_ptr(struct kmem_cache_struct *cache, void *obj) {
+    return *(void **)((uint8_t *)obj + cache->free_offset);
+}
+
+static inline void set_free_ptr(struct kmem_cache_struct *cache, void *obj, void *next) {
+    *(void **)((uint8_t *)obj + cache->free_offset) = next;
+}
+
+static inline struct slab_struct *obj_to_slab(const void *obj) {
+    return (struct slab_struct *)((uint64_t)obj & PAGE_2M_MASK);
+}
+
+/**
+ * @brief 初始化cache描述符的布局与弹匣参数
+ * @return 成功返回0，对象无法放入一个slab时返回-1
+ */
+static int32_t kmem_cache_setup(struct kmem_cache_struct *cache, const char *name, uint64_t size, uint64_t align,
+                                void (*ctor)(void *obj)) {
+    uint32_t i;
+
+    for (i = 0; name[i] && i < KMEM_CACHE_NAME_LEN - 1; i++)
+        cache->name[i] = name[i];
+    cache->name[i] = '\0';
+
+    if (align < KMEM_MIN_ALIGN)
+        align = KMEM_MIN_ALIGN;
+    if (align & (align - 1))
+        return -1;
+    if (size < sizeof(void *))
+        size = sizeof(void *);
+
+    cache->object_size = size;
+    cache->align = align;
+    cache->ctor = ctor;
+
+    // 有构造函数时对象空闲期间也要保持构造状态，空闲指针只能放在对象之后
+    if (ctor) {
+        cache->free_offset = ALIGN_UP(size, sizeof(void *));
+        cache->stride = ALIGN_UP(cache->free_offset + sizeof(void *), align);
+    } else {
+        cache->free_offset = 0;
+        cache->stride = ALIGN_UP(size, align);
+    }
+
+    cache->first_offset = ALIGN_UP(sizeof(struct slab_struct), align);
+    if (cache->first_offset >= PAGE_2M_SIZE)
+        return -1;
+    cache->objs_per_slab = (PAGE_2M_SIZE - cache->first_offset) / cache->stride;
+    if (cache->objs_per_slab == 0)
+        return -1;
+
+    spin_lock_init(&cache->lock);
+    list_init(&cache->slabs_full);
+    list_init(&cache->slabs_partial);
+    list_init(&cache->slabs_free);
+    cache->nr_slabs = 0;
+    cache->nr_free_slabs = 0;
+
+    // 对象越大弹匣越小，避免每个CPU囤积过多内存
+    uint32_t limit = size <= 256 ? KMEM_MAGAZINE_SIZE : size <= 4096 ? 16 : size <= 32768 ? 8 : 2;
+    if (limit > cache->objs_per_slab)
+        limit = cache->objs_per_slab;
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        memset(&cache->magazine[cpu], 0, sizeof(struct kmem_magazine_struct));
+        cache->magazine[cpu].limit = limit;
+        cache->magazine[cpu].batch = (limit + 1) / 2;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 为cache新建一个slab(占用一个2M页框)
+ */
+static struct slab_struct *kmem_cache_grow(struct kmem_cache_struct *cache) {
+    struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, 1, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE | PAGE_SLAB);
+    if (!page)
+        return NULL;
+
+    struct slab_struct *slab = (struct slab_struct *)page_to_virt(page);
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->freelist = NULL;
+
+    // 逆序建立空闲链表，使分配按地址递增进行
+    uint8_t *base = (uint8_t *)slab + cache->first_offset;
+    for (int64_t i = cache->objs_per_slab - 1; i >= 0; i--) {
+        void *obj = base + i * cache->stride;
+        if (cache->ctor)
+            cache->ctor(obj);
+        set_free_ptr(cache, obj, slab->freelist);
+        slab->freelist = obj;
+    }
+
+    return slab;
+}
+
+/**
+ * @brief 从slab批量取对象填充弹匣(调用者需关中断)
+ */
+static void magazine_refill(struct kmem_cache_struct *cache, struct kmem_magazine_struct *magazine) {
+    spin_lock(&cache->lock);
+    while (magazine->avail < magazine->batch) {
+        struct slab_struct *slab = NULL;
+
+        if (!list_empty(&cache->slabs_partial)) {
+            slab = list_first_entry(&cache->slabs_partial, struct slab_struct, list);
+        } else if (!list_empty(&cache->slabs_free)) {
+            slab = list_first_entry(&cache->slabs_free, struct slab_struct, list);
+            cache->nr_free_slabs--;
+        } else {
+            // 申请页框时不持有cache锁
+            spin_unlock(&cache->lock);
+            slab = kmem_cache_grow(cache);
+            spin_lock(&cache->lock);
+            if (!slab)
+                break;
+            list_add(&slab->list, &cache->slabs_free);
+            cache->nr_slabs++;
+            cache->nr_free_slabs++;
+            continue;
+        }
+
+        while (slab->freelist && magazine->avail < magazine->batch) {
+            void *obj = slab->freelist;
+            slab->freelist = get_free_ptr(cache, obj);
+            slab->inuse++;
+            magazine->objs[magazine->avail++] = obj;
+        }
+
+        list_del(&slab->list);
+        list_add(&slab->list, slab->freelist ? &cache->slabs_partial : &cache->slabs_full);
+    }
+    spin_unlock(&cache->lock);
+}
+
+/**
+ * @brief 将对象归还所属slab(调用者持有cache锁)
+ */
+static void slab_put_obj(struct kmem_cache_struct *cache, void *obj) {
+    struct slab_struct *slab = obj_to_slab(obj);
+    uint8_t was_full = slab->freelist == NULL;
+
+    set_free_ptr(cache, obj, slab->freelist);
+    slab->freelist = obj;
+    slab->inuse--;
+
+    if (slab->inuse == 0) {
+        list_del(&slab->list);
+        list_add(&slab->list, &cache->slabs_free);
+        cache->nr_free_slabs++;
+    } else if (was_full) {
+        list_del(&slab->list);
+        list_add(&slab->list, &cache->slabs_partial);
+    }
+}
+
+/**
+ * @brief 释放超出保留数量的空闲slab
+ * @param keep 保留的空闲slab数
+ */
+static void kmem_cache_release_free_slabs(struct kmem_cache_struct *cache, uint64_t keep) {
+    struct list_head release;
+    list_init(&release);
+
+    uint64_t irq_flags = spin_lock_irqsave(&cache->lock);
+    while (cache->nr_free_slabs > keep) {
+        struct slab_struct *slab = list_entry(cache->slabs_free.prev, struct slab_struct, list);
+        list_del(&slab->list);
+        list_add(&slab->list, &release);
+        cache->nr_free_slabs--;
+        cache->nr_slabs--;
+    }
+    spin_unlock_irqrestore(&cache->lock, irq_flags);
+
+    while (!list_empty(&release)) {
+        struct slab_struct *slab = list_first_entry(&release, struct slab_struct, list);
+        list_del(&slab->list);
+        free_pages(virt_to_page(slab), 1);
+    }
+}
+
+/**
+ * @brief 将弹匣底部(最早放入、最冷)的nr_objs个对象归还slab(调用者需关中断)
+ */
+static void magazine_flush(struct kmem_cache_struct *cache, struct kmem_magazine_struct *magazine, uint32_t nr_objs) {
+    if (nr_objs > magazine->avail)
+        nr_objs = magazine->avail;
+
+    spin_lock(&cache->lock);
+    for (uint32_t i = 0; i < nr_objs; i++)
+        slab_put_obj(cache, magazine->objs[i]);
+    spin_unlock(&cache->lock);
+
+    for (uint32_t i = nr_objs; i < magazine->avail; i++)
+        magazine->objs[i - nr_objs] = magazine->objs[i];
+    magazine->avail -= nr_objs;
+}
+
+void *kmem_cache_alloc(struct kmem_cache_struct *cache) {
+    void *obj = NULL;
+    uint64_t irq_flags = local_irq_save();
+    struct kmem_magazine_struct *magazine = &cache->magazine[smp_processor_id()];
+
+    if (!magazine->avail) {
+        magazine->misses++;
+        magazine_refill(cache, magazine);
+    }
+    if (magazine->avail) {
+        obj = magazine->objs[--magazine->avail];
+        magazine->allocs++;
+    }
+
+    local_irq_restore(irq_flags);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache_struct *cache, void *obj) {
+    if (!obj)
+        return;
+
+    uint64_t irq_flags = local_irq_save();
+    struct kmem_magazine_struct *magazine = &cache->magazine[smp_processor_id()];
+    uint8_t release = 0;
+
+    if (magazine->avail >= magazine->limit) {
+        magazine_flush(cache, magazine, magazine->batch);
+        release = cache->nr_free_slabs > KMEM_FREE_SLABS_KEEP;
+    }
+    magazine->objs[magazine->avail++] = obj;
+    magazine->frees++;
+
+    local_irq_restore(irq_flags);
+
+    if (release)
+        kmem_cache_release_free_slabs(cache, KMEM_FREE_SLABS_KEEP);
+}
+
+/**
+ * @brief 清空弹匣并释放cache中所有空闲slab
+ *
+ * 目前只有BSP运行，直接清空所有CPU的弹匣；启用SMP后需改为向各CPU发起清空请求。
+ */
+void kmem_cache_shrink(struct kmem_cache_struct *cache) {
+    uint64_t irq_flags = local_irq_save();
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct kmem_magazine_struct *magazine = &cache->magazine[cpu];
+        if (magazine->avail)
+            magazine_flush(cache, magazine, magazine->avail);
+    }
+    local_irq_restore(irq_flags);
+
+    kmem_cache_release_free_slabs(cache, 0);
+}
+
+struct kmem_cache_struct *kmem_cache_create(const char *name, uint64_t size, uint64_t align, void (*ctor)(void *obj)) {
+    struct kmem_cache_struct *cache = kmem_cache_alloc(&kmem_cache_boot);
+    if (!cache) {
+        errk("kmem_cache_create: no memory for cache %s\n", name);
+        return NULL;
+    }
+
+    if (kmem_cache_setup(cache, name, size, align, ctor)) {
+        errk("kmem_cache_create: invalid layout for cache %s (size=%lu, align=%lu)\n", name, size, align);
+        kmem_cache_free(&kmem_cache_boot, cache);
+        return NULL;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&cache_chain_lock);
+    list_add_tail(&cache->next, &cache_chain);
+    spin_unlock_irqrestore(&cache_chain_lock, irq_flags);
+
+    return cache;
+}
+
+/**
+ * @brief 销毁cache，cache中仍有对象在使用时失败
+ * @return 成功返回0，失败返回-1
+ */
+int32_t kmem_cache_destroy(struct kmem_cache_struct *cache) {
+    kmem_cache_shrink(cache);
+    if (cache->nr_slabs) {
+        errk("kmem_cache_destroy: cache %s still has %lu slabs in use\n", cache->name, cache->nr_slabs);
+        return -1;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&cache_chain_lock);
+    list_del(&cache->next);
+    spin_unlock_irqrestore(&cache_chain_lock, irq_flags);
+
+    kmem_cache_free(&kmem_cache_boot, cache);
+    return 0;
+}
+
+void kmem_cache_stats(struct kmem_cache_struct *cache, struct kmem_cache_stats_struct *stats) {
+    memset(stats, 0, sizeof(struct kmem_cache_stats_struct));
+
+    stats->object_size = cache->object_size;
+    stats->objs_per_slab = cache->objs_per_slab;
+
+    uint64_t irq_flags = spin_lock_irqsave(&cache->lock);
+    struct slab_struct *slab;
+    stats->nr_slabs = cache->nr_slabs;
+    stats->total_objs = cache->nr_slabs * cache->objs_per_slab;
+    list_for_each_entry(slab, &cache->slabs_full, list)
+        stats->active_objs += slab->inuse;
+    list_for_each_entry(slab, &cache->slabs_partial, list)
+        stats->active_objs += slab->inuse;
+    spin_unlock_irqrestore(&cache->lock, irq_flags);
+
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct kmem_magazine_struct *magazine = &cache->magazine[cpu];
+        stats->cached_objs += magazine->avail;
+        stats->allocs += magazine->allocs;
+        stats->frees += magazine->frees;
+        stats->misses += magazine->misses;
+    }
+    stats->active_objs -= stats->cached_objs;
+}
+
+void *kmalloc(uint64_t size) {
+    if (size == 0)
+        return NULL;
+
+    if (size <= KMALLOC_MAX_SIZE) {
+        for (uint32_t i = 0; i < KMALLOC_CACHES; i++) {
+            if (size <= kmalloc_sizes[i])
+                return kmem_cache_alloc(kmalloc_caches[i]);
+        }
+    }
+
+    // 大块直接分配连续页框，页数记录在首页中供kfree使用
+    uint32_t nr_pages = (size + PAGE_2M_SIZE - 1) >> PAGE_2M_SHIFT;
+    struct page_frame_struct *page = alloc_pages(ZONE_NORMAL, nr_pages, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE);
+    if (!page)
+        return NULL;
+    page->private = nr_pages;
+    return page_to_virt(page);
+}
+
+void kfree(const void *ptr) {
+    if (!ptr)
+        return;
+
+    struct page_frame_struct *page = virt_to_page(ptr);
+    if (page->flags & PAGE_SLAB) {
+        struct slab_struct *slab = obj_to_slab(ptr);
+        kmem_cache_free(slab->cache, (void *)ptr);
+    } else {
+        free_pages(page, page->private);
+    }
+}
+
+/**
+ * @brief 打印所有cache的使用情况
+ */
+void slab_info(void) {
+    struct kmem_cache_struct *cache;
+    struct kmem_cache_stats_struct stats;
+
+    printk("slab cache       active    total  objsize objs/slab  slabs   allocs    frees   misses\n");
+    uint64_t irq_flags = spin_lock_irqsave(&cache_chain_lock);
+    list_for_each_entry(cache, &cache_chain, next) {
+        kmem_cache_stats(cache, &stats);
+        printk("%-16s %6lu %8lu %8lu %9lu %6lu %8lu %8lu %8lu\n", cache->name, stats.active_objs,
+               stats.total_objs, stats.object_size, stats.objs_per_slab, stats.nr_slabs, stats.allocs, stats.frees,
+               stats.misses);
+    }
+    spin_unlock_irqrestore(&cache_chain_lock, irq_flags);
+}
+
+void slab_init(void) {
+    logk("Start init slab...\n");
+
+    if (kmem_cache_setup(&kmem_cache_boot, "kmem_cache", sizeof(struct kmem_cache_struct), KMEM_MIN_ALIGN, NULL)) {
+        fatalk("slab_init: cannot setup kmem_cache\n");
+        while (1)
+            __asm__ volatile("hlt");
+        ;
+    }
+    list_add_tail(&kmem_cache_boot.next, &cache_chain);
+
+    for (uint32_t i = 0; i < KMALLOC_CACHES; i++) {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], kmalloc_sizes[i], KMEM_MIN_ALIGN, NULL);
+        if (!kmalloc_caches[i]) {
+            fatalk("slab_init: cannot create %s\n", kmalloc_names[i]);
+            while (1)
+                __asm__ volatile("hlt");
+            ;
+        }
+    }
+
+    logk("Slab initialized!\n");
+}
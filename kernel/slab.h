@@ -0,0 +1,91 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "list.h"
+#include "spinlock.h"
+#include "smp.h"
+
+#define KMEM_CACHE_NAME_LEN     32          // cache名称最大长度(含结尾'\0')
+#define KMEM_MAGAZINE_SIZE      32          // 每个per-CPU弹匣最多缓存的对象数
+#define KMEM_MIN_ALIGN          8           // 对象最小对齐
+#define KMALLOC_MAX_SIZE        (128 * 1024) // 超过该大小的kmalloc直接分配整页框
+
+// per-CPU对象弹匣：最近释放的对象优先被再次分配(热对象)
+struct kmem_magazine_struct {
+    uint32_t avail;                         // 当前弹匣中的对象数
+    uint32_t limit;                         // 弹匣容量，满时归还batch个对象
+    uint32_t batch;                         // 每次从slab补充/向slab归还的对象数
+    uint64_t allocs;                        // 本CPU分配次数
+    uint64_t frees;                         // 本CPU释放次数
+    uint64_t misses;                        // 弹匣为空需要访问slab的次数
+    void *objs[KMEM_MAGAZINE_SIZE];         // 对象指针栈
+};
+
+// slab描述符，位于每个2M页框的开头，对象紧随其后
+struct slab_struct {
+    struct list_head list;                  // 挂入cache的full/partial/free链表
+    struct kmem_cache_struct *cache;        // 所属cache
+    void *freelist;                         // slab内空闲对象链表
+    uint32_t inuse;                         // 已分出(含在弹匣中)的对象数
+};
+
+// 对象cache
+struct kmem_cache_struct {
+    char name[KMEM_CACHE_NAME_LEN];         // cache名称
+    uint64_t object_size;                   // 对象大小
+    uint64_t align;                         // 对象对齐
+    uint64_t stride;                        // 对象实际占用大小(含对齐与空闲指针)
+    uint64_t free_offset;                   // 空闲链表指针在对象内的偏移(有构造函数时放在对象之后)
+    uint64_t first_offset;                  // 首个对象相对slab起始的偏移
+    uint32_t objs_per_slab;                 // 每个slab的对象数
+    void (*ctor)(void *obj);                // 对象构造函数(slab创建时对每个对象调用一次)
+
+    spinlock_t lock;                        // 保护slab链表
+    struct list_head slabs_full;            // 对象全部分出的slab
+    struct list_head slabs_partial;         // 部分分出的slab
+    struct list_head slabs_free;            // 完全空闲的slab
+    uint64_t nr_slabs;                      // slab总数
+    uint64_t nr_free_slabs;                 // 空闲slab数
+
+    struct list_head next;                  // 全局cache链表节点
+    struct kmem_magazine_struct magazine[NR_CPUS];  // per-CPU弹匣
+};
+
+// cache使用统计
+struct kmem_cache_stats_struct {
+    uint64_t object_size;                   // 对象大小
+    uint64_t objs_per_slab;                 // 每个slab的对象数
+    uint64_t nr_slabs;                      // slab总数
+    uint64_t total_objs;                    // 对象总数
+    uint64_t active_objs;                   // 正在被使用的对象数
+    uint64_t cached_objs;                   // 缓存在per-CPU弹匣中的对象数
+    uint64_t allocs;                        // 累计分配次数
+    uint64_t frees;                         // 累计释放次数
+    uint64_t misses;                        // 弹匣未命中次数
+};
+
+void slab_init(void);
+
+struct kmem_cache_struct *kmem_cache_create(const char *name, uint64_t size, uint64_t align, void (*ctor)(void *obj));
+int32_t kmem_cache_destroy(struct kmem_cache_struct *cache);
+void *kmem_cache_alloc(struct kmem_cache_struct *cache);
+void kmem_cache_free(struct kmem_cache_struct *cache, void *obj);
+void kmem_cache_shrink(struct kmem_cache_struct *cache);
+void kmem_cache_stats(struct kmem_cache_struct *cache, struct kmem_cache_stats_struct *stats);
+
+void *kmalloc(uint64_t size);
+void kfree(const void *ptr);
+
+void slab_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define NR_CPUS 64                      // 支持的最大逻辑处理器数量
+
+/**
+ * @brief 获取当前处理器编号
+ *
+ * AP尚未启动，目前只有BSP在运行，固定返回0。
+ * 启用SMP后改为从per-CPU区域(或APIC ID映射表)读取。
+ */
+static inline uint32_t __attribute__((always_inline)) smp_processor_id(void) {
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
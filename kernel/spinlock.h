@@ -0,0 +1,68 @@
+#ifndef __SPINLOCK_H__
+#define __SPINLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// 自旋锁(测试并设置实现，持有期间不可睡眠)
+typedef struct {
+    volatile uint32_t lock;
+} spinlock_t;
+
+#define SPIN_LOCK_UNLOCKED { 0 }
+
+#define RFLAGS_IF 0x200                 // RFLAGS中断允许位
+
+static inline void spin_lock_init(spinlock_t *lock) {
+    lock->lock = 0;
+}
+
+static inline void __attribute__((always_inline)) spin_lock(spinlock_t *lock) {
+    while (__atomic_exchange_n(&lock->lock, 1, __ATOMIC_ACQUIRE)) {
+        while (lock->lock)
+            __asm__ __volatile__("pause" ::: "memory");
+    }
+}
+
+static inline void __attribute__((always_inline)) spin_unlock(spinlock_t *lock) {
+    __atomic_store_n(&lock->lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 关闭本地中断并返回之前的RFLAGS
+ */
+static inline uint64_t __attribute__((always_inline)) local_irq_save(void) {
+    uint64_t flags;
+    __asm__ __volatile__("pushfq	\n\t"
+                         "popq	%0	\n\t"
+                         "cli	\n\t"
+                         : "=r"(flags)
+                         :
+                         : "memory");
+    return flags;
+}
+
+static inline void __attribute__((always_inline)) local_irq_restore(uint64_t flags) {
+    if (flags & RFLAGS_IF)
+        __asm__ __volatile__("sti" ::: "memory");
+}
+
+static inline uint64_t __attribute__((always_inline)) spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags = local_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void __attribute__((always_inline)) spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_unlock(lock);
+    local_irq_restore(flags);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
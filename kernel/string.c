@@ -0,0 +1,691 @@
+#include "string.h"
+#include "cpu.h"
+#include "cpufeature.h"
+#include "alternative.h"
+#include "fpu.h"
+#include "printk.h"
+
+// 启动早期(apply_alternatives之前)各档都使用不依赖任何扩展特性的rep movsq/stosq
+struct memops_struct memops = {
+    .variant = { &memops_variants[0], &memops_variants[0], &memops_variants[0], &memops_variants[0] },
+};
+
+static inline void __attribute__((always_inline)) rep_movsb(void *dest, const void *src, size_t n) {
+    __asm__ __volatile__("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+}
+
+static inline void __attribute__((always_inline)) rep_stosb(void *dest, int c, size_t n) {
+    __asm__ __volatile__("rep stosb" : "+D"(dest), "+c"(n) : "a"(c) : "memory");
+}
+
+/**
+ * @brief rep movsq加movsl/movsw/movsb处理尾部，不依赖任何扩展特性
+ */
+static void *memcpy_movsq(void *dest, const void *src, size_t n) {
+    int32_t d0, d1, d2;
+    __asm__ __volatile__("cld	\n\t"
+                         "rep	\n\t"
+                         "movsq	\n\t"
+                         "testb	$4,%b4	\n\t"
+                         "je	1f	\n\t"
+                         "movsl	\n\t"
+                         "1:\ttestb	$2,%b4	\n\t"
+                         "je	2f	\n\t"
+                         "movsw	\n\t"
+                         "2:\ttestb	$1,%b4	\n\t"
+                         "je	3f	\n\t"
+                         "movsb	\n\t"
+                         "3:	\n\t"
+                         : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                         : "0"(n / 8), "q"(n), "1"(dest), "2"(src)
+                         : "memory");
+    return dest;
+}
+
+static void *memset_stosq(void *dest, int c, size_t n) {
+    uint64_t c64 = (uint64_t)(uint8_t)c * 0x0101010101010101UL;     // 将单字节扩展为8字节重复模式
+    void *p = dest;
+    size_t words = n / 8;
+
+    __asm__ __volatile__("rep stosq" : "+D"(p), "+c"(words) : "a"(c64) : "memory");
+    rep_stosb(p, c, n & 7);
+    return dest;
+}
+
+/**
+ * @brief ERMS：由微码按缓存行搬运，较大长度下与向量循环相当且不占用向量寄存器
+ */
+static void *memcpy_erms(void *dest, const void *src, size_t n) {
+    rep_movsb(dest, src, n);
+    return dest;
+}
+
+static void *memset_erms(void *dest, int c, size_t n) {
+    rep_stosb(dest, c, n);
+    return dest;
+}
+
+/**
+ * @brief AVX2：每次循环以4个YMM寄存器搬运128字节，尾部用rep movsb
+ *
+ * 向量寄存器只在kernel_fpu_begin/end之间使用，被打断的SIMD段由嵌套的kernel_fpu_begin保存。内核以
+ * -mgeneral-regs-only编译，编译器不会在向量寄存器中保存值，内联汇编不需要(也不能)把它们列为破坏。
+ */
+static void *memcpy_avx2(void *dest, const void *src, size_t n) {
+    size_t blocks = n / 128;
+    void *d = dest;
+
+    if (blocks) {
+        kernel_fpu_begin();
+        __asm__ __volatile__("1:\n\t"
+                             "vmovdqu 0(%1), %%ymm0\n\t"
+                             "vmovdqu 32(%1), %%ymm1\n\t"
+                             "vmovdqu 64(%1), %%ymm2\n\t"
+                             "vmovdqu 96(%1), %%ymm3\n\t"
+                             "vmovdqu %%ymm0, 0(%0)\n\t"
+                             "vmovdqu %%ymm1, 32(%0)\n\t"
+                             "vmovdqu %%ymm2, 64(%0)\n\t"
+                             "vmovdqu %%ymm3, 96(%0)\n\t"
+                             "addq $128, %0\n\t"
+                             "addq $128, %1\n\t"
+                             "decq %2\n\t"
+                             "jnz 1b\n\t"
+                             : "+r"(d), "+r"(src), "+r"(blocks)
+                             :
+                             : "memory");
+        kernel_fpu_end();
+    }
+    rep_movsb(d, src, n & 127);
+    return dest;
+}
+
+static void *memset_avx2(void *dest, int c, size_t n) {
+    size_t blocks = n / 128;
+    void *d = dest;
+
+    if (blocks) {
+        kernel_fpu_begin();
+        __asm__ __volatile__("vmovd %2, %%xmm0\n\t"
+                             "vpbroadcastb %%xmm0, %%ymm0\n\t"
+                             "1:\n\t"
+                             "vmovdqu %%ymm0, 0(%0)\n\t"
+                             "vmovdqu %%ymm0, 32(%0)\n\t"
+                             "vmovdqu %%ymm0, 64(%0)\n\t"
+                             "vmovdqu %%ymm0, 96(%0)\n\t"
+                             "addq $128, %0\n\t"
+                             "decq %1\n\t"
+                             "jnz 1b\n\t"
+                             : "+r"(d), "+r"(blocks)
+                             : "r"(c)
+                             : "memory");
+        kernel_fpu_end();
+    }
+    rep_stosb(d, c, n & 127);
+    return dest;
+}
+
+/**
+ * @brief 非临时存储(movnti)：目标绕过缓存写入，适合超过缓存容量、写完不会马上再读的长度
+ *
+ * 先把目标对齐到8字节，每次循环经通用寄存器搬运64字节并预取后面的源数据，最后sfence。
+ */
+static void *memcpy_nt(void *dest, const void *src, size_t n) {
+    size_t head = -(uintptr_t)dest & 7;
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (head > n)
+        head = n;
+    rep_movsb(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t blocks = n / 64;
+    if (blocks) {
+        __asm__ __volatile__("1:\n\t"
+                             "prefetchnta 512(%1)\n\t"
+                             "movq 0(%1), %%rax\n\t"
+                             "movq 8(%1), %%rdx\n\t"
+                             "movq 16(%1), %%r8\n\t"
+                             "movq 24(%1), %%r9\n\t"
+                             "movnti %%rax, 0(%0)\n\t"
+                             "movnti %%rdx, 8(%0)\n\t"
+                             "movnti %%r8, 16(%0)\n\t"
+                             "movnti %%r9, 24(%0)\n\t"
+                             "movq 32(%1), %%rax\n\t"
+                             "movq 40(%1), %%rdx\n\t"
+                             "movq 48(%1), %%r8\n\t"
+                             "movq 56(%1), %%r9\n\t"
+                             "movnti %%rax, 32(%0)\n\t"
+                             "movnti %%rdx, 40(%0)\n\t"
+                             "movnti %%r8, 48(%0)\n\t"
+                             "movnti %%r9, 56(%0)\n\t"
+                             "addq $64, %0\n\t"
+                             "addq $64, %1\n\t"
+                             "decq %2\n\t"
+                             "jnz 1b\n\t"
+                             "sfence\n\t"
+                             : "+r"(d), "+r"(s), "+r"(blocks)
+                             :
+                             : "rax", "rdx", "r8", "r9", "memory");
+    }
+    rep_movsb(d, s, n & 63);
+    return dest;
+}
+
+static void *memset_nt(void *dest, int c, size_t n) {
+    uint64_t c64 = (uint64_t)(uint8_t)c * 0x0101010101010101UL;
+    size_t head = -(uintptr_t)dest & 7;
+    uint8_t *d = (uint8_t *)dest;
+
+    if (head > n)
+        head = n;
+    rep_stosb(d, c, head);
+    d += head;
+    n -= head;
+
+    size_t blocks = n / 64;
+    if (blocks) {
+        __asm__ __volatile__("1:\n\t"
+                             "movnti %2, 0(%0)\n\t"
+                             "movnti %2, 8(%0)\n\t"
+                             "movnti %2, 16(%0)\n\t"
+                             "movnti %2, 24(%0)\n\t"
+                             "movnti %2, 32(%0)\n\t"
+                             "movnti %2, 40(%0)\n\t"
+                             "movnti %2, 48(%0)\n\t"
+                             "movnti %2, 56(%0)\n\t"
+                             "addq $64, %0\n\t"
+                             "decq %1\n\t"
+                             "jnz 1b\n\t"
+                             "sfence\n\t"
+                             : "+r"(d), "+r"(blocks)
+                             : "r"(c64)
+                             : "memory");
+    }
+    rep_stosb(d, c, n & 63);
+    return dest;
+}
+
+// 按MEMOPS_VARIANT_*顺序排列，第0项是不需要任何特性的后备实现
+#define MEMOPS_VARIANT_MOVSQ    0
+#define MEMOPS_VARIANT_ERMS     1
+#define MEMOPS_VARIANT_AVX2     2
+#define MEMOPS_VARIANT_NT       3
+
+const struct memops_variant_struct memops_variants[MEMOPS_NR_VARIANTS] = {
+    [MEMOPS_VARIANT_MOVSQ] = { "movsq", 0, memcpy_movsq, memset_stosq },
+    [MEMOPS_VARIANT_ERMS] = { "erms", MEMOPS_ERMS, memcpy_erms, memset_erms },
+    [MEMOPS_VARIANT_AVX2] = { "avx2", MEMOPS_AVX2, memcpy_avx2, memset_avx2 },
+    [MEMOPS_VARIANT_NT] = { "nt", MEMOPS_SSE2, memcpy_nt, memset_nt },
+};
+
+static inline uint32_t __attribute__((always_inline)) memops_tier(size_t n) {
+    if (n < MEMOPS_VECTOR_SIZE)
+        return MEMOPS_TIER_SMALL;
+    if (n < MEMOPS_REP_SIZE)
+        return MEMOPS_TIER_VECTOR;
+    if (n < MEMOPS_NT_SIZE)
+        return MEMOPS_TIER_REP;
+    return MEMOPS_TIER_NT;
+}
+
+/*
+ * 各档经启动时改写的直接调用分派，不经函数指针：默认调用f0，apply_alternatives按特性换成f1/f2。
+ * 参数按SysV约定放在rdi/rsi/rdx，其余调用者保存的通用寄存器列为破坏。各实现只在kernel_fpu_begin/end
+ * 之间使用向量寄存器，也不依赖16字节栈对齐(内联汇编中的call不保证对齐)。
+ */
+#define memops_call(ret, insn, a1, a2, a3, fn0, fn1, fn2)                                                              \
+    __asm__ __volatile__(insn                                                                                          \
+                         : "=a"(ret), "+D"(a1), "+S"(a2), "+d"(a3)                                                     \
+                         : [f0] "i"(fn0), [f1] "i"(fn1), [f2] "i"(fn2)                                                 \
+                         : "rcx", "r8", "r9", "r10", "r11", "memory", "cc")
+
+// 选择规则与memops_init中记录的各档实现一致，ALTERNATIVE_2中后一个候选优先
+void *memcpy(void *dest, const void *src, size_t n) {
+    void *ret;
+
+    switch (memops_tier(n)) {
+    case MEMOPS_TIER_SMALL:
+        memops_call(ret, ALTERNATIVE("call %P[f0]", "call %P[f1]", X86_FEATURE_FSRM), dest, src, n, memcpy_movsq,
+                    memcpy_erms, memcpy_erms);
+        break;
+    case MEMOPS_TIER_VECTOR:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_ERMS, "call %P[f2]", X86_FEATURE_AVX2),
+                    dest, src, n, memcpy_movsq, memcpy_erms, memcpy_avx2);
+        break;
+    case MEMOPS_TIER_REP:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_AVX2, "call %P[f2]", X86_FEATURE_ERMS),
+                    dest, src, n, memcpy_movsq, memcpy_avx2, memcpy_erms);
+        break;
+    default:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_ERMS, "call %P[f2]", X86_FEATURE_XMM2),
+                    dest, src, n, memcpy_movsq, memcpy_erms, memcpy_nt);
+        break;
+    }
+    return ret;
+}
+
+void *memset(void *dest, int c, size_t n) {
+    void *ret;
+
+    switch (memops_tier(n)) {
+    case MEMOPS_TIER_SMALL:
+        memops_call(ret, ALTERNATIVE("call %P[f0]", "call %P[f1]", X86_FEATURE_FSRM), dest, c, n, memset_stosq,
+                    memset_erms, memset_erms);
+        break;
+    case MEMOPS_TIER_VECTOR:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_ERMS, "call %P[f2]", X86_FEATURE_AVX2),
+                    dest, c, n, memset_stosq, memset_erms, memset_avx2);
+        break;
+    case MEMOPS_TIER_REP:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_AVX2, "call %P[f2]", X86_FEATURE_ERMS),
+                    dest, c, n, memset_stosq, memset_avx2, memset_erms);
+        break;
+    default:
+        memops_call(ret,
+                    ALTERNATIVE_2("call %P[f0]", "call %P[f1]", X86_FEATURE_ERMS, "call %P[f2]", X86_FEATURE_XMM2),
+                    dest, c, n, memset_stosq, memset_erms, memset_nt);
+        break;
+    }
+    return ret;
+}
+
+/**
+ * @brief 允许源和目标重叠的复制
+ *
+ * 各memcpy实现都从低地址向高地址复制，且每次写入前已读完对应的源数据，目标在源之前(或不重叠)时
+ * 可以直接使用；目标在源之后且重叠时从高地址向低地址按8字节复制。
+ */
+void *memmove(void *dest, const void *src, size_t n) {
+    if ((uintptr_t)dest - (uintptr_t)src >= n)
+        return memcpy(dest, src, n);
+
+    uint8_t *d = (uint8_t *)dest + n;
+    const uint8_t *s = (const uint8_t *)src + n;
+    for (size_t tail = n & 7; tail; tail--)
+        *--d = *--s;
+
+    // 中断/异常入口都会cld，反向复制期间被打断不会影响处理函数中的串操作
+    size_t words = n / 8;
+    if (words) {
+        d -= 8;
+        s -= 8;
+        __asm__ __volatile__("std\n\t"
+                             "rep movsq\n\t"
+                             "cld\n\t"
+                             : "+D"(d), "+S"(s), "+c"(words)
+                             :
+                             : "memory");
+    }
+    return dest;
+}
+
+// 按字处理：字中任一字节为0时word_zero_bytes在该字节置最高位。借位只会让真正的0字节之后的字节误报，
+// 最低的置位总是准确的
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#define WORD_ONES               0x0101010101010101UL
+#define WORD_HIGHS              0x8080808080808080UL
+#define WORD_PAGE_MASK          (4096UL - 1)        // 按最小页大小判断未对齐的读取是否跨页
+
+static inline uint64_t __attribute__((always_inline)) word_zero_bytes(uint64_t v) {
+    return (v - WORD_ONES) & ~v & WORD_HIGHS;
+}
+
+// 逐字节的参考实现
+static size_t strlen_byte(const char *s) {
+    const char *p = s;
+    while (*p)
+        p++;
+    return p - s;
+}
+
+static size_t strnlen_byte(const char *s, size_t maxlen) {
+    size_t len = 0;
+    while (len < maxlen && s[len])
+        len++;
+    return len;
+}
+
+static int32_t strcmp_byte(const char *s1, const char *s2) {
+    const uint8_t *a = (const uint8_t *)s1, *b = (const uint8_t *)s2;
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a - *b;
+}
+
+static char *strchr_byte(const char *s, int c) {
+    for (;; s++) {
+        if (*s == (char)c)
+            return (char *)s;
+        if (!*s)
+            return NULL;
+    }
+}
+
+static int32_t memcmp_byte(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1, *b = (const uint8_t *)s2;
+    for (; n; n--, a++, b++) {
+        if (*a != *b)
+            return *a - *b;
+    }
+    return 0;
+}
+
+static void *memchr_byte(const void *s, int c, size_t n) {
+    const uint8_t *p = (const uint8_t *)s;
+    for (; n; n--, p++) {
+        if (*p == (uint8_t)c)
+            return (void *)p;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 按对齐的8字节字查找结尾，对齐读取不会跨页；首个字中起始位置之前的字节置为非零
+ */
+static size_t strlen_word(const char *s) {
+    const word_t *p = (const word_t *)((uintptr_t)s & ~7UL);
+    uint64_t v = *p | ((1UL << ((uintptr_t)s & 7) * 8) - 1);
+    uint64_t mask;
+
+    while (!(mask = word_zero_bytes(v)))
+        v = *++p;
+    return (const char *)p + __builtin_ctzll(mask) / 8 - s;
+}
+
+static size_t strnlen_word(const char *s, size_t maxlen) {
+    const word_t *p = (const word_t *)((uintptr_t)s & ~7UL);
+    uint64_t v = *p | ((1UL << ((uintptr_t)s & 7) * 8) - 1);
+
+    if (!maxlen)
+        return 0;
+    for (;;) {
+        uint64_t mask = word_zero_bytes(v);
+        if (mask) {
+            size_t len = (const char *)p + __builtin_ctzll(mask) / 8 - s;
+            return len < maxlen ? len : maxlen;
+        }
+        if ((size_t)((const char *)(p + 1) - s) >= maxlen)
+            return maxlen;
+        v = *++p;
+    }
+}
+
+/**
+ * @brief 同时查找c和结尾：两个掩码中最低的置位就是第一个c或0
+ */
+static char *strchr_word(const char *s, int c) {
+    const word_t *p = (const word_t *)((uintptr_t)s & ~7UL);
+    uint64_t pattern = (uint8_t)c * WORD_ONES;
+    uint64_t head = (1UL << ((uintptr_t)s & 7) * 8) - 1;
+    uint64_t v = *p;
+    uint64_t mask = word_zero_bytes(v | head) | word_zero_bytes((v ^ pattern) | head);
+
+    while (!mask) {
+        v = *++p;
+        mask = word_zero_bytes(v) | word_zero_bytes(v ^ pattern);
+    }
+
+    const char *hit = (const char *)p + __builtin_ctzll(mask) / 8;
+    return *hit == (char)c ? (char *)hit : NULL;
+}
+
+/**
+ * @brief 先逐字节对齐s1再按字比较；s2未对齐时读取可能跨页，此时这8个字节逐字节比较
+ */
+static int32_t strcmp_word(const char *s1, const char *s2) {
+    const uint8_t *a = (const uint8_t *)s1, *b = (const uint8_t *)s2;
+
+    for (; (uintptr_t)a & 7; a++, b++) {
+        if (*a != *b || !*a)
+            return *a - *b;
+    }
+
+    for (;;) {
+        if (((uintptr_t)b & WORD_PAGE_MASK) <= WORD_PAGE_MASK + 1 - 8) {
+            uint64_t va = *(const word_t *)a;
+            if (va == *(const word_t *)b && !word_zero_bytes(va)) {
+                a += 8;
+                b += 8;
+                continue;
+            }
+        }
+        // 这8个字节中有不同或结尾(或者读取会跨页)
+        for (uint32_t i = 0; i < 8; i++, a++, b++) {
+            if (*a != *b || !*a)
+                return *a - *b;
+        }
+    }
+}
+
+/**
+ * @brief 长度已知，不会读到范围之外：先按字比较，遇到不同的字再逐字节定位
+ */
+static int32_t memcmp_word(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1, *b = (const uint8_t *)s2;
+
+    while (n >= 8 && *(const word_t *)a == *(const word_t *)b) {
+        a += 8;
+        b += 8;
+        n -= 8;
+    }
+    return memcmp_byte(a, b, n);
+}
+
+static void *memchr_word(const void *s, int c, size_t n) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint64_t pattern = (uint8_t)c * WORD_ONES;
+
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t mask = word_zero_bytes(*(const word_t *)p ^ pattern);
+        if (mask)
+            return (void *)(p + __builtin_ctzll(mask) / 8);
+    }
+    return memchr_byte(p, c, n);
+}
+
+/**
+ * @brief SSE2：对齐的16字节块与全零比较，pmovmskb取出每字节结果；首块中起始位置之前的位先移出
+ *
+ * 与memcpy_avx2相同，XMM寄存器只在kernel_fpu_begin/end之间使用。
+ */
+static size_t strlen_sse2(const char *s) {
+    const char *p = (const char *)((uintptr_t)s & ~15UL);
+    uint32_t mask;
+
+    kernel_fpu_begin();
+    __asm__ __volatile__("pxor %%xmm0, %%xmm0\n\t"
+                         "movdqa (%0), %%xmm1\n\t"
+                         "pcmpeqb %%xmm0, %%xmm1\n\t"
+                         "pmovmskb %%xmm1, %1\n\t"
+                         "shrl %%cl, %1\n\t"
+                         "shll %%cl, %1\n\t"
+                         "testl %1, %1\n\t"
+                         "jnz 2f\n\t"
+                         "1:\n\t"
+                         "addq $16, %0\n\t"
+                         "movdqa (%0), %%xmm1\n\t"
+                         "pcmpeqb %%xmm0, %%xmm1\n\t"
+                         "pmovmskb %%xmm1, %1\n\t"
+                         "testl %1, %1\n\t"
+                         "jz 1b\n\t"
+                         "2:\n\t"
+                         : "+r"(p), "=&r"(mask)
+                         : "c"((uint32_t)((uintptr_t)s & 15))
+                         : "memory", "cc");
+    kernel_fpu_end();
+    return p + __builtin_ctz(mask) - s;
+}
+
+/**
+ * @brief SSE2：每次比较16字节(未对齐读取都在[s1, s1 + n)与[s2, s2 + n)内)，不足16字节的尾部按字比较
+ */
+static int32_t memcmp_sse2(const void *s1, const void *s2, size_t n) {
+    const uint8_t *a = (const uint8_t *)s1, *b = (const uint8_t *)s2;
+    uint32_t mask = 0xffff;
+
+    if (n >= 16) {
+        kernel_fpu_begin();
+        __asm__ __volatile__("1:\n\t"
+                             "movdqu (%0), %%xmm0\n\t"
+                             "movdqu (%1), %%xmm1\n\t"
+                             "pcmpeqb %%xmm1, %%xmm0\n\t"
+                             "pmovmskb %%xmm0, %3\n\t"
+                             "cmpl $0xffff, %3\n\t"
+                             "jne 2f\n\t"
+                             "addq $16, %0\n\t"
+                             "addq $16, %1\n\t"
+                             "subq $16, %2\n\t"
+                             "cmpq $16, %2\n\t"
+                             "jae 1b\n\t"
+                             "2:\n\t"
+                             : "+r"(a), "+r"(b), "+r"(n), "=&r"(mask)
+                             :
+                             : "memory", "cc");
+        kernel_fpu_end();
+        if (mask != 0xffff) {
+            uint32_t i = __builtin_ctz(~mask);
+            return a[i] - b[i];
+        }
+    }
+    return memcmp_word(a, b, n);
+}
+
+static void *memchr_sse2(const void *s, int c, size_t n) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint32_t mask = 0;
+
+    if (n >= 16) {
+        kernel_fpu_begin();
+        __asm__ __volatile__("movd %3, %%xmm1\n\t"
+                             "punpcklbw %%xmm1, %%xmm1\n\t"
+                             "punpcklwd %%xmm1, %%xmm1\n\t"
+                             "pshufd $0, %%xmm1, %%xmm1\n\t"
+                             "1:\n\t"
+                             "movdqu (%0), %%xmm0\n\t"
+                             "pcmpeqb %%xmm1, %%xmm0\n\t"
+                             "pmovmskb %%xmm0, %2\n\t"
+                             "testl %2, %2\n\t"
+                             "jnz 2f\n\t"
+                             "addq $16, %0\n\t"
+                             "subq $16, %1\n\t"
+                             "cmpq $16, %1\n\t"
+                             "jae 1b\n\t"
+                             "2:\n\t"
+                             : "+r"(p), "+r"(n), "=&r"(mask)
+                             : "r"(c)
+                             : "memory", "cc");
+        kernel_fpu_end();
+        if (mask)
+            return (void *)(p + __builtin_ctz(mask));
+    }
+    return memchr_word(p, c, n);
+}
+
+#define STROPS_VARIANT_BYTE     0
+#define STROPS_VARIANT_WORD     1
+#define STROPS_VARIANT_SSE2     2
+
+// SSE2一组中strnlen/strcmp/strchr仍按字处理(通常很短，不值得进出SIMD段)
+const struct strops_variant_struct strops_variants[STROPS_NR_VARIANTS] = {
+    [STROPS_VARIANT_BYTE] = { "byte", 0, strlen_byte, strnlen_byte, strcmp_byte, strchr_byte, memcmp_byte,
+                              memchr_byte },
+    [STROPS_VARIANT_WORD] = { "word", 0, strlen_word, strnlen_word, strcmp_word, strchr_word, memcmp_word,
+                              memchr_word },
+    [STROPS_VARIANT_SSE2] = { "sse2", MEMOPS_XMM, strlen_sse2, strnlen_word, strcmp_word, strchr_word, memcmp_sse2,
+                              memchr_sse2 },
+};
+
+const struct strops_variant_struct *strops = &strops_variants[STROPS_VARIANT_WORD];
+
+size_t strlen(const char *s) {
+    return strops->strlen(s);
+}
+
+size_t strnlen(const char *s, size_t maxlen) {
+    return strops->strnlen(s, maxlen);
+}
+
+int32_t strcmp(const char *s1, const char *s2) {
+    return strops->strcmp(s1, s2);
+}
+
+char *strchr(const char *s, int c) {
+    return strops->strchr(s, c);
+}
+
+int32_t memcmp(const void *s1, const void *s2, size_t n) {
+    return strops->memcmp(s1, s2, n);
+}
+
+void *memchr(const void *s, int c, size_t n) {
+    return strops->memchr(s, c, n);
+}
+
+/**
+ * @brief 复制至多n个字节，src较短时其余部分补0(src不短于n时dest不以0结尾)
+ */
+char *strncpy(char *dest, const char *src, size_t n) {
+    size_t len = strnlen(src, n);
+
+    memcpy(dest, src, len);
+    memset(dest + len, 0, n - len);
+    return dest;
+}
+
+static void memops_select(uint32_t tier, uint32_t variant) {
+    memops.variant[tier] = &memops_variants[variant];
+}
+
+/**
+ * @brief 按特性位图记录memcpy/memset各长度档选用的实现，并选择字符串函数的实现
+ *
+ * memcpy/memset本身由apply_alternatives改写调用指令完成切换，这里只记录结果供日志和bench使用。
+ */
+void memops_init(void) {
+    uint32_t features = 0;
+
+    if (cpu_has(X86_FEATURE_XMM2))
+        features |= MEMOPS_SSE2 | MEMOPS_XMM;   // fpu_init已开启CR4.OSFXSR
+    if (cpu_has(X86_FEATURE_ERMS))
+        features |= MEMOPS_ERMS;
+    if (cpu_has(X86_FEATURE_FSRM))
+        features |= MEMOPS_FSRM;
+    if (cpu_has(X86_FEATURE_AVX2))
+        features |= MEMOPS_AVX2;                // fpu_init已确认XCR0开启了YMM状态
+    memops.features = features;
+
+    // 短长度：只有FSRM的CPU上rep movsb的启动开销才足够低
+    memops_select(MEMOPS_TIER_SMALL, (features & MEMOPS_FSRM) ? MEMOPS_VARIANT_ERMS : MEMOPS_VARIANT_MOVSQ);
+    // 中等长度：向量循环 > ERMS > rep movsq
+    memops_select(MEMOPS_TIER_VECTOR, (features & MEMOPS_AVX2)   ? MEMOPS_VARIANT_AVX2
+                                      : (features & MEMOPS_ERMS) ? MEMOPS_VARIANT_ERMS
+                                                                 : MEMOPS_VARIANT_MOVSQ);
+    // 较大长度：ERMS已不慢于向量循环，且不进入SIMD段(嵌套时的XSAVE/XRSTOR、退出时的vzeroupper)，不占用嵌套层数
+    memops_select(MEMOPS_TIER_REP, (features & MEMOPS_ERMS)   ? MEMOPS_VARIANT_ERMS
+                                   : (features & MEMOPS_AVX2) ? MEMOPS_VARIANT_AVX2
+                                                              : MEMOPS_VARIANT_MOVSQ);
+    // 超过缓存容量：非临时存储(x86-64都有SSE2，后备只在位图被清除时用到)
+    memops_select(MEMOPS_TIER_NT, (features & MEMOPS_SSE2)   ? MEMOPS_VARIANT_NT
+                                  : (features & MEMOPS_ERMS) ? MEMOPS_VARIANT_ERMS
+                                                             : MEMOPS_VARIANT_MOVSQ);
+
+    // 字符串比较/查找：有XMM时使用SSE2
+    strops = &strops_variants[(features & MEMOPS_XMM) ? STROPS_VARIANT_SSE2 : STROPS_VARIANT_WORD];
+
+    logk("memops: sse2 %u erms %u fsrm %u avx2 %u, tiers <%u: %s, <%u: %s, <%lu: %s, above: %s, strings: %s\n",
+         !!(features & MEMOPS_SSE2), !!(features & MEMOPS_ERMS), !!(features & MEMOPS_FSRM),
+         !!(features & MEMOPS_AVX2), MEMOPS_VECTOR_SIZE, memops.variant[MEMOPS_TIER_SMALL]->name, MEMOPS_REP_SIZE,
+         memops.variant[MEMOPS_TIER_VECTOR]->name, MEMOPS_NT_SIZE, memops.variant[MEMOPS_TIER_REP]->name,
+         memops.variant[MEMOPS_TIER_NT]->name, strops->name);
+}
@@ -0,0 +1,74 @@
+#ifndef __STRING_H__
+#define __STRING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// memcpy/memset按长度分档，每档在启动时按特性位图选出最合适的实现(依据见bench_memops的扫描结果)
+#define MEMOPS_VECTOR_SIZE      256                 // 从该长度起向量循环优于短拷贝的启动开销
+#define MEMOPS_REP_SIZE         2048                // ERMS下rep movsb/stosb从该长度起追平向量循环
+#define MEMOPS_NT_SIZE          (1UL << 20)         // 从该长度起使用非临时存储，目标绕过缓存(不挤出调用者的工作集)
+
+enum memops_tier {
+    MEMOPS_TIER_SMALL = 0,              // [0, MEMOPS_VECTOR_SIZE)
+    MEMOPS_TIER_VECTOR,                 // [MEMOPS_VECTOR_SIZE, MEMOPS_REP_SIZE)
+    MEMOPS_TIER_REP,                    // [MEMOPS_REP_SIZE, MEMOPS_NT_SIZE)
+    MEMOPS_TIER_NT,                     // [MEMOPS_NT_SIZE, ...)
+    MEMOPS_NR_TIERS
+};
+
+// memops_struct.features
+#define MEMOPS_SSE2             (1U << 0)           // movnti
+#define MEMOPS_ERMS             (1U << 1)           // 增强rep movsb/stosb(CPUID.(EAX=07H,ECX=0):EBX[9])
+#define MEMOPS_FSRM             (1U << 2)           // 短rep movsb同样快速(CPUID.(EAX=07H,ECX=0):EDX[4])
+#define MEMOPS_AVX2             (1U << 3)           // AVX2且操作系统已在XCR0中开启YMM状态
+#define MEMOPS_XMM              (1U << 4)           // SSE2且CR4.OSFXSR已开启，可以使用XMM寄存器
+
+typedef void *(*memcpy_fn)(void *dest, const void *src, size_t n);
+typedef void *(*memset_fn)(void *dest, int c, size_t n);
+
+// 一组memcpy/memset实现
+struct memops_variant_struct {
+    const char *name;
+    uint32_t requires;                  // 需要的MEMOPS_*特性
+    memcpy_fn copy;
+    memset_fn set;
+};
+
+#define MEMOPS_NR_VARIANTS      4
+
+struct memops_struct {
+    uint32_t features;                  // 检测到的MEMOPS_*特性
+    const struct memops_variant_struct *variant[MEMOPS_NR_TIERS];   // 各档选用的实现(调用处由alternatives改写)
+};
+
+// 一组字符串比较/查找实现
+struct strops_variant_struct {
+    const char *name;
+    uint32_t requires;                  // 需要的MEMOPS_*特性
+    size_t (*strlen)(const char *s);
+    size_t (*strnlen)(const char *s, size_t maxlen);
+    int32_t (*strcmp)(const char *s1, const char *s2);
+    char *(*strchr)(const char *s, int c);
+    int32_t (*memcmp)(const void *s1, const void *s2, size_t n);
+    void *(*memchr)(const void *s, int c, size_t n);
+};
+
+#define STROPS_NR_VARIANTS      3       // 逐字节(参考实现)、按字、SSE2
+
+extern struct memops_struct memops;
+extern const struct memops_variant_struct memops_variants[MEMOPS_NR_VARIANTS];
+extern const struct strops_variant_struct *strops;
+extern const struct strops_variant_struct strops_variants[STROPS_NR_VARIANTS];
+
+void memops_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#include "tlb.h"
+#include "pgtable.h"
+#include "cpu.h"
+#include "cpufeature.h"
+#include "jump_label.h"
+#include "printk.h"
+
+// 启动后不再改变的模式用静态键判断，刷新路径上不必读标志再分支
+static DEFINE_STATIC_KEY_FALSE(tlb_pge_key);        // CR4.PGE已开启，内核映射为全局页
+static DEFINE_STATIC_KEY_FALSE(tlb_pcid_key);       // CR4.PCIDE已开启
+static DEFINE_STATIC_KEY_FALSE(tlb_invpcid_key);    // 已开启PCID且CPU支持INVPCID指令
+
+static struct tlb_cpu_state_struct tlb_cpu_state[NR_CPUS];
+
+// 统计
+static uint64_t nr_invlpg = 0;          // 单页刷新次数
+static uint64_t nr_flush_local = 0;     // 当前地址空间整体刷新次数
+static uint64_t nr_flush_all = 0;       // 含全局页的完全刷新次数
+static uint64_t nr_switch_noflush = 0;  // 切换地址空间时保留TLB的次数
+static uint64_t nr_switch_flush = 0;    // 切换地址空间时刷新TLB的次数
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t addr) {
+    struct { uint64_t pcid, addr; } desc = { pcid, addr };
+    __asm__ __volatile__("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+static int32_t tlb_set_global(uint64_t *entry, uint32_t level, uint64_t vaddr, void *arg) {
+    *entry |= PTE_GLOBAL;
+    (*(uint64_t *)arg)++;
+    return 0;
+}
+
+/**
+ * @brief 开启全局页和PCID
+ * @param kernel_pml4 内核页表，其高半部分已有的叶子映射(head.S建立的映射、直接映射区)补上全局位
+ *
+ * 须在低半部分的恒等映射撤销之后调用，否则恒等映射也会共享同一批页表而被标为全局页。
+ */
+void tlb_init(uint64_t *kernel_pml4) {
+    uint64_t nr_global = 0;
+
+    if (cpu_has(X86_FEATURE_PGE)) {
+        walk_page_range(kernel_pml4, KERNEL_SPACE_START, ~0UL, tlb_set_global, &nr_global);
+        write_cr4(read_cr4() | CR4_PGE);
+        static_key_enable(&tlb_pge_key);
+    }
+
+    // 开启PCIDE时CR3[11:0]必须为0，内核页表使用PCID 0，随后的切换再分配动态PCID
+    if (cpu_has(X86_FEATURE_PCID) && !(read_cr3() & CR3_PCID_MASK)) {
+        write_cr4(read_cr4() | CR4_PCIDE);
+        static_key_enable(&tlb_pcid_key);
+        if (cpu_has(X86_FEATURE_INVPCID))
+            static_key_enable(&tlb_invpcid_key);
+    }
+
+    tlb_flush_all();
+    logk("TLB: global pages %s (%lu kernel leaves), PCID %s, INVPCID %s\n",
+         static_key_enabled(&tlb_pge_key) ? "on" : "off", nr_global, static_key_enabled(&tlb_pcid_key) ? "on" : "off",
+         static_key_enabled(&tlb_invpcid_key) ? "on" : "off");
+}
+
+uint8_t tlb_global_enabled(void) {
+    return static_key_enabled(&tlb_pge_key);
+}
+
+/**
+ * @brief 刷新所有TLB条目，包括全局页和其他PCID的条目
+ */
+void tlb_flush_all(void) {
+    nr_flush_all++;
+    if (static_branch_likely(&tlb_invpcid_key)) {
+        invpcid(INVPCID_TYPE_ALL_GLOBAL, 0, 0);
+    } else if (static_branch_likely(&tlb_pge_key)) {
+        // 翻转CR4.PGE会使全部TLB条目失效(含所有PCID)
+        uint64_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        // 只能刷新当前PCID，其余PCID留待下次切换时刷新
+        write_cr3(read_cr3());
+        for (uint32_t i = 0; i < TLB_NR_ASIDS; i++)
+            tlb_cpu_state[smp_processor_id()].asid_stale[i] = 1;
+        return;
+    }
+    for (uint32_t i = 0; i < TLB_NR_ASIDS; i++)
+        tlb_cpu_state[smp_processor_id()].asid_stale[i] = 0;
+}
+
+/**
+ * @brief 只刷新当前地址空间的非全局条目(读出的CR3第63位恒为0，写回即刷新当前PCID)
+ */
+void tlb_flush_local(void) {
+    nr_flush_local++;
+    write_cr3(read_cr3());
+}
+
+/**
+ * @brief 切换到pml4_phys对应的地址空间
+ *
+ * 开启PCID时每个CPU保存最近使用的TLB_NR_ASIDS个地址空间，切换回其中之一且没有过期条目时
+ * 带CR3_NOFLUSH写CR3，保留其TLB条目；否则轮转占用一个PCID并刷新。
+ */
+void tlb_switch_mm(uint64_t pml4_phys) {
+    if (!static_branch_likely(&tlb_pcid_key)) {
+        nr_switch_flush++;
+        write_cr3(pml4_phys);
+        return;
+    }
+
+    struct tlb_cpu_state_struct *state = &tlb_cpu_state[smp_processor_id()];
+    uint32_t asid;
+    uint8_t flush = 1;
+
+    for (asid = 0; asid < TLB_NR_ASIDS; asid++) {
+        if (state->asid_owner[asid] == pml4_phys)
+            break;
+    }
+
+    if (asid < TLB_NR_ASIDS) {
+        flush = state->asid_stale[asid];
+    } else {
+        for (asid = 0; asid < TLB_NR_ASIDS; asid++) {
+            if (!state->asid_owner[asid])
+                break;
+        }
+        if (asid == TLB_NR_ASIDS) {
+            asid = state->next_asid;
+            state->next_asid = (state->next_asid + 1) % TLB_NR_ASIDS;
+        }
+        state->asid_owner[asid] = pml4_phys;
+    }
+    state->asid_stale[asid] = 0;
+
+    if (flush)
+        nr_switch_flush++;
+    else
+        nr_switch_noflush++;
+    // PCID 0 留给tlb_init之前的内核页表，动态PCID从1开始
+    write_cr3(pml4_phys | (asid + 1) | (flush ? 0 : CR3_NOFLUSH));
+}
+
+/**
+ * @brief 标记pml4_phys在各CPU上的PCID含有过期条目，下次切换过去时刷新
+ *
+ * 用于修改了非当前地址空间的用户部分映射；未开启PCID时切换CR3本就会刷新，无需处理。
+ */
+void tlb_invalidate_mm(uint64_t pml4_phys) {
+    if (!static_branch_likely(&tlb_pcid_key))
+        return;
+
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        for (uint32_t asid = 0; asid < TLB_NR_ASIDS; asid++) {
+            if (tlb_cpu_state[cpu].asid_owner[asid] == pml4_phys)
+                tlb_cpu_state[cpu].asid_stale[asid] = 1;
+        }
+    }
+}
+
+/**
+ * @brief 地址空间销毁时归还其PCID，避免同一物理页被新页表复用时继承旧条目
+ */
+void tlb_release_mm(uint64_t pml4_phys) {
+    for (uint32_t cpu = 0; cpu < NR_CPUS; cpu++) {
+        for (uint32_t asid = 0; asid < TLB_NR_ASIDS; asid++) {
+            if (tlb_cpu_state[cpu].asid_owner[asid] == pml4_phys) {
+                tlb_cpu_state[cpu].asid_owner[asid] = 0;
+                tlb_cpu_state[cpu].asid_stale[asid] = 0;
+            }
+        }
+    }
+}
+
+void tlb_batch_init(struct tlb_batch_struct *batch, uint64_t pml4_phys) {
+    batch->pml4_phys = pml4_phys;
+    batch->nr = 0;
+    batch->full = 0;
+    batch->kernel = 0;
+    batch->user = 0;
+}
+
+/**
+ * @brief 记录一个需要失效的叶子映射(大页给出其中任意地址即可)
+ */
+void tlb_batch_add(struct tlb_batch_struct *batch, uint64_t vaddr) {
+    if (vaddr >= KERNEL_SPACE_START)
+        batch->kernel = 1;
+    else
+        batch->user = 1;
+
+    if (batch->full)
+        return;
+    if (batch->nr == TLB_FLUSH_ALL_THRESHOLD) {
+        batch->full = 1;
+        return;
+    }
+    batch->addr[batch->nr++] = vaddr;
+}
+
+/**
+ * @brief 记录[vaddr, vaddr + size)内可能存在的所有4K映射(如被整体替换掉的页表子树)
+ */
+void tlb_batch_add_range(struct tlb_batch_struct *batch, uint64_t vaddr, uint64_t size) {
+    if (size / PAGE_4K_SIZE > TLB_FLUSH_ALL_THRESHOLD - batch->nr) {
+        tlb_batch_add(batch, vaddr);
+        batch->full = 1;
+        return;
+    }
+    for (uint64_t offset = 0; offset < size; offset += PAGE_4K_SIZE)
+        tlb_batch_add(batch, vaddr + offset);
+}
+
+/**
+ * @brief 使批量记录的映射失效，之后批次清空可以继续使用
+ *
+ * 内核空间由所有地址空间共享且为全局页，不论修改的是哪个页表都要立即刷新；
+ * 用户空间只在页表为当前地址空间时刷新，否则标记其PCID过期。
+ */
+void tlb_batch_flush(struct tlb_batch_struct *batch) {
+    if (!batch->nr && !batch->full)
+        return;
+
+    uint8_t current = batch->pml4_phys == (read_cr3() & PTE_ADDR_MASK);
+
+    if (batch->user && !current)
+        tlb_invalidate_mm(batch->pml4_phys);
+
+    if (batch->full) {
+        if (batch->kernel)
+            tlb_flush_all();
+        else if (current)
+            tlb_flush_local();
+    } else {
+        for (uint32_t i = 0; i < batch->nr; i++) {
+            if (current || batch->addr[i] >= KERNEL_SPACE_START) {
+                flush_tlb(batch->addr[i]);
+                nr_invlpg++;
+            }
+        }
+    }
+
+    tlb_batch_init(batch, batch->pml4_phys);
+}
+
+void tlb_info(void) {
+    logk("TLB: invlpg %lu, local flush %lu, full flush %lu, switch keep/flush %lu/%lu\n", nr_invlpg,
+         nr_flush_local, nr_flush_all, nr_switch_noflush, nr_switch_flush);
+}
@@ -0,0 +1,67 @@
+#ifndef __TLB_H__
+#define __TLB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "smp.h"
+
+#define KERNEL_SPACE_START      0xffff800000000000UL    // 高半部分(内核空间，各地址空间共享，映射为全局页)
+
+#define TLB_FLUSH_ALL_THRESHOLD 33      // 批量刷新超过该页数时改为整体刷新(与Linux的tlb_single_page_flush_ceiling相同)
+#define TLB_NR_ASIDS            6       // 每个CPU轮转使用的PCID数，最近使用过的地址空间切换回来时无需刷新
+
+#define CR3_PCID_MASK           0xfffUL
+#define CR3_NOFLUSH             (1UL << 63)     // 写CR3时保留该PCID的TLB条目
+#define CR4_PGE                 (1UL << 7)      // 启用全局页
+#define CR4_PCIDE               (1UL << 17)     // 启用PCID
+
+#define INVPCID_TYPE_ADDR       0       // 指定PCID的单个地址
+#define INVPCID_TYPE_SINGLE     1       // 指定PCID的全部非全局条目
+#define INVPCID_TYPE_ALL_GLOBAL 2       // 所有PCID的全部条目(含全局页)
+
+// 每个CPU的PCID分配状态
+struct tlb_cpu_state_struct {
+    uint64_t asid_owner[TLB_NR_ASIDS];  // 占用该PCID的顶级页表物理地址(0表示空闲)
+    uint8_t asid_stale[TLB_NR_ASIDS];   // 该PCID中可能残留过期条目，下次切换过来时须刷新
+    uint32_t next_asid;                 // 没有空闲PCID时轮转替换的位置
+};
+
+// 批量TLB刷新：修改页表时记录需要失效的地址，全部修改完成后统一刷新
+struct tlb_batch_struct {
+    uint64_t pml4_phys;                 // 被修改页表的物理地址
+    uint64_t addr[TLB_FLUSH_ALL_THRESHOLD];
+    uint32_t nr;
+    uint8_t full;                       // 超过阈值，改为整体刷新
+    uint8_t kernel;                     // 包含内核空间地址(所有地址空间共享，且为全局页)
+    uint8_t user;                       // 包含用户空间地址
+};
+
+// 刷新单个TLB条目(对全局页同样有效)
+#define flush_tlb(addr) \
+    __asm__ __volatile__("invlpg (%0)" : : "r"(addr) : "memory")
+
+// 刷新所有TLB条目(含全局页和所有PCID)
+#define flush_tlb_all() tlb_flush_all()
+
+void tlb_init(uint64_t *kernel_pml4);
+uint8_t tlb_global_enabled(void);
+void tlb_flush_all(void);
+void tlb_flush_local(void);
+void tlb_switch_mm(uint64_t pml4_phys);
+void tlb_invalidate_mm(uint64_t pml4_phys);
+void tlb_release_mm(uint64_t pml4_phys);
+
+void tlb_batch_init(struct tlb_batch_struct *batch, uint64_t pml4_phys);
+void tlb_batch_add(struct tlb_batch_struct *batch, uint64_t vaddr);
+void tlb_batch_add_range(struct tlb_batch_struct *batch, uint64_t vaddr, uint64_t size);
+void tlb_batch_flush(struct tlb_batch_struct *batch);
+void tlb_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
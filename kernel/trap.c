@@ -1,5 +1,7 @@
 #include "trap.h"
 #include "printk.h"
+#include "mm.h"
+#include "cpu.h"
 
 // 异常处理函数指针数组
 static exception_handler_t exception_handlers[32] = {
@@ -83,7 +85,14 @@ void invalid_opcode_handler(uint64_t error_code, void* frame) {               /*
 
 void device_not_available_handler(uint64_t error_code, void* frame) {         /* 7 - #NM */
     struct register_frame* ctx = frame;
-    fatalk("#NM(7) FPU Not Available RIP=%#llx\n", ctx->rip);
+    uint64_t cr0 = read_cr0();
+
+    // 扩展状态按SIMD段即时保存，不做惰性切换：CR0.TS只可能是引导程序遗留的，清除后重新执行即可
+    if ((cr0 & CR0_TS) && !(cr0 & CR0_EM)) {
+        write_cr0(cr0 & ~CR0_TS);
+        return;
+    }
+    fatalk("#NM(7) FPU Not Available RIP=%#llx, CR0=%#lx (x87/SIMD used before fpu_init)\n", ctx->rip, cr0);
     for(;;);
 }
 
@@ -119,9 +128,17 @@ void general_protection_handler(uint64_t error_code, void* frame) {           /*
 }
 
 void page_fault_handler(uint64_t error_code, void* frame) {                   /* 14 - #PF */
-    // struct register_frame* ctx = frame;
+    struct register_frame* ctx = frame;
     uint64_t cr2;
     __asm__ __volatile__("mov %%cr2, %0" : "=r"(cr2));  // 必须通过汇编获取CR2
+
+    // 中断门进入时已关中断；读取CR2后按被打断代码的状态恢复，缺页处理中的分配和复制不必关中断进行
+    local_irq_restore(ctx->rflags);
+
+    // 可修复的缺页(如写时复制)处理完后返回，重新执行触发缺页的指令
+    if (!handle_mm_fault(current_mm, cr2, error_code))
+        return;
+
     fatalk("#PF(14) Page Fault CR2=%#llx  Error Code=%#llx [%c%c%c]\n",
            cr2, error_code,
            (error_code & 0x01) ? 'P' : '-',  // Present
@@ -1,5 +1,7 @@
 #include "vbe.h"
 #include "printk.h"
+#include "memory.h"
+#include "pgtable.h"
 
 /**
  * 初始化VBE信息
@@ -19,3 +21,24 @@ void init_vbe_info(void) {
     printk_pos.frame_buffer_length = (printk_pos.x_resolution * printk_pos.y_resolution * 4);
     printk_pos.bpp = vbe_info->BitsPerPixel;
 }
+
+/**
+ * @brief 在直接映射区中映射帧缓冲区，并将打印输出切换到该地址
+ *
+ * 由init_memory在建立物理内存直接映射、覆盖head.S中临时的显存映射之前调用。
+ */
+void vbe_map_framebuffer(void) {
+    uint64_t fb_base = vbe_info->PhysBasePtr;
+    uint64_t map_start = fb_base & PAGE_2M_MASK;
+    uint64_t map_end = PAGE_2M_ALIGN(fb_base + printk_pos.frame_buffer_length);
+
+    if (map_pages(kernel_pml4, (uint64_t)PHYS_TO_VIRT(map_start), map_start, map_end - map_start, PAGE_2M,
+                  PAGE_PRESENT | PAGE_WRITABLE)) {
+        errk("Failed to map frame buffer %#018lx\n", fb_base);
+        return;
+    }
+
+    // 低端恒等映射即将被清除，VBE信息也改为经直接映射区访问
+    vbe_info = (vbe_mode_info_block_struct *)PHYS_TO_VIRT(VBE_INFO_VIRT_ADDR);
+    printk_pos.frame_buffer_addr = (uint32_t *)PHYS_TO_VIRT(fb_base);
+}
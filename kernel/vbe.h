@@ -69,6 +69,7 @@ typedef struct {
 vbe_mode_info_block_struct* vbe_info = (vbe_mode_info_block_struct*)VBE_INFO_VIRT_ADDR;
 
 void init_vbe_info(void);
+void vbe_map_framebuffer(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,226 @@
+#include "vmalloc.h"
+#include "pgtable.h"
+#include "slab.h"
+#include "printk.h"
+#include "lib.h"
+
+static struct list_head vmap_area_list = LIST_HEAD_INIT(vmap_area_list);   // 占用线性地址的区间(含等待回收的)
+static spinlock_t vmap_lock = SPIN_LOCK_UNLOCKED;
+static uint64_t vmap_lazy_bytes = 0;        // 已解除映射但尚未刷新TLB的线性地址总量
+static uint64_t vmap_nr_purges = 0;         // 统一刷新TLB的次数
+
+/**
+ * @brief 在vmalloc区首次适配一段线性地址并按地址顺序插入区间链表(调用者持有vmap_lock)
+ * @return 成功返回0，线性地址不足返回-1
+ */
+static int32_t vmap_insert_area(struct vmap_area_struct *area, uint64_t size, uint64_t align) {
+    struct vmap_area_struct *pos;
+    uint64_t addr = VMALLOC_START;
+    uint64_t start;
+
+    list_for_each_entry(pos, &vmap_area_list, list) {
+        start = (addr + align - 1) & ~(align - 1);
+        if (start + size + VMALLOC_GUARD_SIZE <= pos->va_start) {
+            area->va_start = start;
+            area->va_end = start + size;
+            list_add_tail(&area->list, &pos->list);
+            return 0;
+        }
+        addr = pos->va_end + VMALLOC_GUARD_SIZE;
+    }
+
+    start = (addr + align - 1) & ~(align - 1);
+    if (start < addr || start + size > VMALLOC_END)
+        return -1;
+    area->va_start = start;
+    area->va_end = start + size;
+    list_add_tail(&area->list, &vmap_area_list);
+    return 0;
+}
+
+/**
+ * @brief 刷新TLB并回收所有延迟区间的线性地址(调用者持有vmap_lock)
+ */
+static void __vmalloc_purge(void) {
+    struct vmap_area_struct *pos, *n;
+
+    if (!vmap_lazy_bytes)
+        return;
+
+    flush_tlb_all();
+    list_for_each_entry_safe(pos, n, &vmap_area_list, list) {
+        if (!(pos->flags & VMAP_LAZY))
+            continue;
+        list_del(&pos->list);
+        kfree(pos);
+    }
+    vmap_lazy_bytes = 0;
+    vmap_nr_purges++;
+}
+
+/**
+ * @brief 立即回收所有延迟区间
+ */
+void vmalloc_purge(void) {
+    uint64_t irq_flags = spin_lock_irqsave(&vmap_lock);
+    __vmalloc_purge();
+    spin_unlock_irqrestore(&vmap_lock, irq_flags);
+}
+
+/**
+ * @brief 释放区间持有的页框与页框数组
+ */
+static void vmap_free_frames(struct vmap_area_struct *area) {
+    for (uint32_t i = 0; i < area->nr_2m; i++)
+        free_pages(pfn_to_page(area->frames[i] >> PAGE_2M_SHIFT), 1);
+    for (uint32_t i = 0; i < area->nr_4k; i++)
+        free_pages_4k(area->frames[area->nr_2m + i], 1);
+    kfree(area->frames);
+    area->frames = NULL;
+    area->nr_2m = 0;
+    area->nr_4k = 0;
+}
+
+/**
+ * @brief 分配size字节线性连续、物理上可以不连续的内核内存
+ *
+ * 整2M部分用批量分配的2M页框以大页映射，剩余部分用4K页补齐；size不小于2M时
+ * 线性地址按2M对齐。
+ * @return 线性地址，失败返回NULL
+ */
+void *vmalloc(uint64_t size) {
+    if (size == 0 || size > VMALLOC_END - VMALLOC_START)
+        return NULL;
+
+    size = PAGE_4K_ALIGN(size);
+    uint32_t nr_2m = size >> PAGE_2M_SHIFT;
+    uint32_t nr_4k = (size & (PAGE_2M_SIZE - 1)) >> PAGE_4K_SHIFT;
+    uint32_t prot = PAGE_PRESENT | PAGE_WRITABLE | PAGE_NX;
+
+    struct vmap_area_struct *area = kmalloc(sizeof(struct vmap_area_struct));
+    if (!area)
+        return NULL;
+    memset(area, 0, sizeof(struct vmap_area_struct));
+    area->frames = kmalloc((uint64_t)(nr_2m + nr_4k) * sizeof(uint64_t));
+    if (!area->frames) {
+        kfree(area);
+        return NULL;
+    }
+
+    // 1. 批量分配2M页框(页框指针先暂存在frames中，再原地换成物理地址)
+    if (nr_2m) {
+        struct page_frame_struct **pages = (struct page_frame_struct **)area->frames;
+        area->nr_2m = alloc_pages_bulk(ZONE_NORMAL, nr_2m, PAGE_KERNEL | PAGE_PRESENT | PAGE_WRITABLE, pages);
+        for (uint32_t i = 0; i < area->nr_2m; i++)
+            area->frames[i] = page_to_phys(pages[i]);
+    }
+
+    // 2. 不足2M的部分使用4K页
+    if (area->nr_2m == nr_2m) {
+        for (uint32_t i = 0; i < nr_4k; i++) {
+            uint64_t phys = alloc_pages_4k(1);
+            if (!phys)
+                break;
+            area->frames[nr_2m + i] = phys;
+            area->nr_4k++;
+        }
+    }
+
+    if (area->nr_2m != nr_2m || area->nr_4k != nr_4k) {
+        warnk("vmalloc: out of memory for %lu bytes\n", size);
+        vmap_free_frames(area);
+        kfree(area);
+        return NULL;
+    }
+
+    // 3. 分配线性地址，不足时先回收延迟区间
+    uint64_t irq_flags = spin_lock_irqsave(&vmap_lock);
+    uint64_t align = nr_2m ? PAGE_2M_SIZE : PAGE_4K_SIZE;
+    int32_t ret = vmap_insert_area(area, size, align);
+    if (ret && vmap_lazy_bytes) {
+        __vmalloc_purge();
+        ret = vmap_insert_area(area, size, align);
+    }
+    spin_unlock_irqrestore(&vmap_lock, irq_flags);
+
+    if (ret) {
+        warnk("vmalloc: no virtual space for %lu bytes\n", size);
+        vmap_free_frames(area);
+        kfree(area);
+        return NULL;
+    }
+
+    // 4. 建立映射
+    uint64_t va = area->va_start;
+    for (uint32_t i = 0; i < nr_2m && !ret; i++, va += PAGE_2M_SIZE)
+        ret = map_pages(kernel_pml4, va, area->frames[i], PAGE_2M_SIZE, PAGE_2M, prot);
+    for (uint32_t i = 0; i < nr_4k && !ret; i++, va += PAGE_4K_SIZE)
+        ret = map_pages(kernel_pml4, va, area->frames[nr_2m + i], PAGE_4K_SIZE, PAGE_4K, prot);
+
+    if (ret) {
+        irq_flags = spin_lock_irqsave(&vmap_lock);
+        list_del(&area->list);
+        spin_unlock_irqrestore(&vmap_lock, irq_flags);
+
+        unmap_pages(kernel_pml4, area->va_start, size);
+        vmap_free_frames(area);
+        kfree(area);
+        return NULL;
+    }
+
+    return (void *)area->va_start;
+}
+
+/**
+ * @brief 释放vmalloc分配的内存
+ *
+ * 页框立即归还，映射解除但不刷新TLB；该线性地址区间在累计的延迟回收量超过
+ * VMALLOC_LAZY_MAX后统一刷新TLB时才会被再次分配。
+ */
+void vfree(const void *addr) {
+    struct vmap_area_struct *pos, *area = NULL;
+
+    if (!addr)
+        return;
+
+    uint64_t irq_flags = spin_lock_irqsave(&vmap_lock);
+    list_for_each_entry(pos, &vmap_area_list, list) {
+        if (pos->va_start == (uint64_t)addr && !(pos->flags & VMAP_LAZY)) {
+            area = pos;
+            break;
+        }
+    }
+
+    if (!area) {
+        spin_unlock_irqrestore(&vmap_lock, irq_flags);
+        warnk("vfree: bad address %p\n", addr);
+        return;
+    }
+
+    unmap_pages_lazy(kernel_pml4, area->va_start, area->va_end - area->va_start);
+    vmap_free_frames(area);
+    area->flags |= VMAP_LAZY;
+    vmap_lazy_bytes += area->va_end - area->va_start;
+    if (vmap_lazy_bytes > VMALLOC_LAZY_MAX)
+        __vmalloc_purge();
+    spin_unlock_irqrestore(&vmap_lock, irq_flags);
+}
+
+/**
+ * @brief 打印vmalloc区使用情况
+ */
+void vmalloc_info(void) {
+    struct vmap_area_struct *pos;
+    uint64_t nr_areas = 0, used = 0;
+
+    uint64_t irq_flags = spin_lock_irqsave(&vmap_lock);
+    list_for_each_entry(pos, &vmap_area_list, list) {
+        if (pos->flags & VMAP_LAZY)
+            continue;
+        nr_areas++;
+        used += pos->va_end - pos->va_start;
+    }
+    printk("vmalloc: %lu areas, %lu KB used, %lu KB lazy, %lu purges\n", nr_areas, used >> 10,
+           vmap_lazy_bytes >> 10, vmap_nr_purges);
+    spin_unlock_irqrestore(&vmap_lock, irq_flags);
+}
@@ -0,0 +1,40 @@
+#ifndef __VMALLOC_H__
+#define __VMALLOC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "list.h"
+#include "memory.h"
+
+// vmalloc区：位于直接映射区之后的内核高半部分，用零散页框拼出线性连续的缓冲区
+#define VMALLOC_START       0xffffc90000000000UL
+#define VMALLOC_END         0xffffe90000000000UL    // 32TB
+#define VMALLOC_GUARD_SIZE  PAGE_4K_SIZE            // 相邻区间之间保留的未映射保护页
+#define VMALLOC_LAZY_MAX    (64UL << 20)            // 延迟回收的线性地址累计超过该值时统一刷新TLB
+
+#define VMAP_LAZY           0x1                     // 已解除映射，等待TLB刷新后回收线性地址
+
+// vmalloc区间描述符
+struct vmap_area_struct {
+    struct list_head list;              // 按地址排序的区间链表节点
+    uint64_t va_start;                  // 起始线性地址
+    uint64_t va_end;                    // 结束线性地址(不含保护页)
+    uint64_t *frames;                   // 各页框物理地址：前nr_2m项为2M页框，其后为4K页
+    uint32_t nr_2m;                     // 2M页框数
+    uint32_t nr_4k;                     // 4K页数
+    uint32_t flags;                     // VMAP_*
+};
+
+void *vmalloc(uint64_t size);
+void vfree(const void *addr);
+void vmalloc_purge(void);
+void vmalloc_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
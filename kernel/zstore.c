@@ -0,0 +1,341 @@
+#include "zstore.h"
+#include "lz4.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "printk.h"
+#include "cpu.h"
+#include "lib.h"
+
+#define ZSTORE_INIT_ARENAS 64           // arena表初始容量，用完后加倍
+
+static spinlock_t zstore_lock = SPIN_LOCK_UNLOCKED;
+static struct zstore_class_struct zstore_class[ZSTORE_NR_CLASSES];
+static struct zstore_arena_struct **zstore_arenas = NULL;   // 按编号索引，空位为NULL
+static uint32_t zstore_nr_ids = 0;                          // 已使用过的最大编号加1
+static uint32_t zstore_max_ids = 0;
+
+// 压缩工作区与输出缓冲区(在zstore_lock内使用)
+static struct lz4_state_struct zstore_lz4_state;
+static uint8_t zstore_buffer[PAGE_4K_SIZE];
+
+// 统计
+static uint64_t nr_stored = 0;          // 存放的页数(不含全零页)
+static uint64_t nr_zero = 0;            // 全零页句柄数
+static uint64_t nr_incompressible = 0;  // 按原样存放的页数
+static uint64_t stored_bytes = 0;       // 对象总长度
+static uint64_t arena_pages = 0;        // arena占用的4K页数
+static uint64_t nr_store_failed = 0;
+static uint64_t nr_stores = 0;          // 累计存放次数
+static uint64_t nr_loads = 0;           // 累计读取次数
+static uint64_t store_cycles = 0;
+static uint64_t load_cycles = 0;
+
+/**
+ * @brief 为每个size class选择arena页数：1~ZSTORE_MAX_ARENA_PAGES页中末尾浪费比例最小的
+ */
+void zstore_init(void) {
+    for (uint32_t i = 0; i < ZSTORE_NR_CLASSES; i++) {
+        struct zstore_class_struct *class = &zstore_class[i];
+        uint32_t best_waste = ~0U;
+
+        class->size = (i + 1) * ZSTORE_CLASS_SIZE;
+        for (uint32_t pages = 1; pages <= ZSTORE_MAX_ARENA_PAGES; pages++) {
+            uint32_t bytes = pages * PAGE_4K_SIZE;
+            uint32_t waste = (bytes % class->size) * ZSTORE_MAX_ARENA_PAGES / pages;    // 换算为同一总量下的浪费
+            if (waste < best_waste) {
+                best_waste = waste;
+                class->nr_pages = pages;
+                class->nr_slots = bytes / class->size;
+            }
+        }
+        class->nr_arenas = 0;
+        list_init(&class->partial);
+    }
+
+    logk("zstore: %u size classes of %u bytes, arenas up to %u pages, LZ4 compression\n", ZSTORE_NR_CLASSES,
+         ZSTORE_CLASS_SIZE, ZSTORE_MAX_ARENA_PAGES);
+}
+
+static inline struct zstore_arena_struct *zstore_handle_arena(uint64_t handle, uint32_t *slot) {
+    uint64_t id = (handle >> ZSTORE_SLOT_BITS) - 1;
+
+    if (handle >> ZSTORE_HANDLE_BITS || id >= zstore_nr_ids || !zstore_arenas[id])
+        return NULL;
+    *slot = handle & ((1UL << ZSTORE_SLOT_BITS) - 1);
+    if (*slot >= zstore_class[zstore_arenas[id]->class_idx].nr_slots ||
+        !(zstore_arenas[id]->bitmap[*slot / 64] & (1UL << (*slot % 64))))
+        return NULL;
+    return zstore_arenas[id];
+}
+
+/**
+ * @brief 为arena分配编号，arena表满时加倍(调用者持有zstore_lock)
+ * @return 成功返回0，内存不足返回-1
+ */
+static int32_t zstore_assign_id(struct zstore_arena_struct *arena) {
+    for (uint32_t id = 0; id < zstore_nr_ids; id++) {
+        if (!zstore_arenas[id]) {
+            arena->id = id;
+            zstore_arenas[id] = arena;
+            return 0;
+        }
+    }
+
+    if (zstore_nr_ids == zstore_max_ids) {
+        uint32_t new_max = zstore_max_ids ? zstore_max_ids * 2 : ZSTORE_INIT_ARENAS;
+        if ((uint64_t)new_max << ZSTORE_SLOT_BITS >= 1UL << ZSTORE_HANDLE_BITS)
+            return -1;
+
+        struct zstore_arena_struct **table = kmalloc(new_max * sizeof(struct zstore_arena_struct *));
+        if (!table)
+            return -1;
+        memset(table, 0, new_max * sizeof(struct zstore_arena_struct *));
+        if (zstore_arenas) {
+            memcpy(table, zstore_arenas, zstore_nr_ids * sizeof(struct zstore_arena_struct *));
+            kfree(zstore_arenas);
+        }
+        zstore_arenas = table;
+        zstore_max_ids = new_max;
+    }
+
+    arena->id = zstore_nr_ids++;
+    zstore_arenas[arena->id] = arena;
+    return 0;
+}
+
+/**
+ * @brief 从页框分配器取得连续4K页作为新的arena(调用者持有zstore_lock)
+ */
+static struct zstore_arena_struct *zstore_arena_create(uint32_t class_idx) {
+    struct zstore_class_struct *class = &zstore_class[class_idx];
+    struct zstore_arena_struct *arena = kmalloc(sizeof(struct zstore_arena_struct));
+    if (!arena)
+        return NULL;
+
+    uint64_t phys = alloc_pages_4k(class->nr_pages);
+    if (!phys) {
+        kfree(arena);
+        return NULL;
+    }
+
+    memset(arena, 0, sizeof(struct zstore_arena_struct));
+    arena->base = (uint64_t)PHYS_TO_VIRT(phys);
+    arena->class_idx = class_idx;
+    if (zstore_assign_id(arena)) {
+        free_pages_4k(phys, class->nr_pages);
+        kfree(arena);
+        return NULL;
+    }
+
+    list_add(&arena->list, &class->partial);
+    class->nr_arenas++;
+    arena_pages += class->nr_pages;
+    return arena;
+}
+
+static void zstore_arena_destroy(struct zstore_arena_struct *arena) {
+    struct zstore_class_struct *class = &zstore_class[arena->class_idx];
+
+    list_del(&arena->list);
+    zstore_arenas[arena->id] = NULL;
+    while (zstore_nr_ids && !zstore_arenas[zstore_nr_ids - 1])
+        zstore_nr_ids--;
+    class->nr_arenas--;
+    arena_pages -= class->nr_pages;
+    free_pages_4k(VIRT_TO_PHYS(arena->base), class->nr_pages);
+    kfree(arena);
+}
+
+/**
+ * @brief 将长度为len的对象写入对应size class的空闲槽(调用者持有zstore_lock)
+ * @return 句柄，内存不足返回0
+ */
+static uint64_t zstore_alloc_object(void *data, uint32_t len) {
+    uint32_t class_idx = (len + ZSTORE_CLASS_SIZE - 1) / ZSTORE_CLASS_SIZE - 1;
+    struct zstore_class_struct *class = &zstore_class[class_idx];
+    struct zstore_arena_struct *arena;
+
+    if (list_empty(&class->partial)) {
+        arena = zstore_arena_create(class_idx);
+        if (!arena)
+            return 0;
+    } else {
+        arena = list_first_entry(&class->partial, struct zstore_arena_struct, list);
+    }
+
+    uint32_t slot = 0;
+    while (arena->bitmap[slot / 64] & (1UL << (slot % 64)))
+        slot++;
+
+    arena->bitmap[slot / 64] |= 1UL << (slot % 64);
+    arena->length[slot] = len;
+    arena->ref_count[slot] = 1;
+    if (++arena->nr_used == class->nr_slots)
+        list_del(&arena->list);
+
+    memcpy((void *)(arena->base + slot * class->size), data, len);
+    stored_bytes += len;
+    nr_stored++;
+    return ((uint64_t)(arena->id + 1) << ZSTORE_SLOT_BITS) | slot;
+}
+
+static uint8_t zstore_page_is_zero(void *src) {
+    uint64_t *words = (uint64_t *)src;
+
+    for (uint32_t i = 0; i < PAGE_4K_SIZE / sizeof(uint64_t); i++) {
+        if (words[i])
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief 压缩并存放一个4K页
+ * @param src 页的线性地址
+ * @return 句柄(非0，不超过ZSTORE_HANDLE_BITS位)，内存不足返回0
+ *
+ * 全零页只记录为ZSTORE_HANDLE_ZERO；压缩后超过ZSTORE_MAX_COMPRESSED的页按原样存放。
+ */
+uint64_t zstore_store(void *src) {
+    uint64_t start = rdtsc();
+    uint64_t handle;
+
+    uint64_t irq_flags = spin_lock_irqsave(&zstore_lock);
+    if (zstore_page_is_zero(src)) {
+        nr_zero++;
+        handle = ZSTORE_HANDLE_ZERO;
+    } else {
+        int32_t len = lz4_compress((const uint8_t *)src, PAGE_4K_SIZE, zstore_buffer, ZSTORE_MAX_COMPRESSED,
+                                   &zstore_lz4_state);
+        if (len > 0) {
+            handle = zstore_alloc_object(zstore_buffer, len);
+        } else {
+            handle = zstore_alloc_object(src, PAGE_4K_SIZE);
+            if (handle)
+                nr_incompressible++;
+        }
+        if (!handle)
+            nr_store_failed++;
+    }
+    nr_stores++;
+    store_cycles += rdtsc() - start;
+    spin_unlock_irqrestore(&zstore_lock, irq_flags);
+    return handle;
+}
+
+/**
+ * @brief 把句柄对应的页解压到dst(4K)，句柄保持有效
+ * @return 成功返回0，句柄无效或数据损坏返回-1
+ */
+int32_t zstore_load(uint64_t handle, void *dst) {
+    uint64_t start = rdtsc();
+    int32_t ret = 0;
+    uint32_t slot;
+
+    if (handle == ZSTORE_HANDLE_ZERO) {
+        memset(dst, 0, PAGE_4K_SIZE);
+        return 0;
+    }
+
+    uint64_t irq_flags = spin_lock_irqsave(&zstore_lock);
+    struct zstore_arena_struct *arena = zstore_handle_arena(handle, &slot);
+    if (!arena) {
+        spin_unlock_irqrestore(&zstore_lock, irq_flags);
+        errk("zstore: invalid handle %#lx\n", handle);
+        return -1;
+    }
+
+    uint8_t *object = (uint8_t *)(arena->base + slot * zstore_class[arena->class_idx].size);
+    uint32_t len = arena->length[slot];
+    if (len == PAGE_4K_SIZE)
+        memcpy(dst, object, PAGE_4K_SIZE);
+    else if (lz4_decompress(object, len, (uint8_t *)dst, PAGE_4K_SIZE) != PAGE_4K_SIZE)
+        ret = -1;
+    nr_loads++;
+    load_cycles += rdtsc() - start;
+    spin_unlock_irqrestore(&zstore_lock, irq_flags);
+
+    if (ret)
+        errk("zstore: corrupted object %#lx (%u bytes)\n", handle, len);
+    return ret;
+}
+
+/**
+ * @brief 增加句柄的引用(共享同一份压缩数据，如写时复制地址空间中的换出页)
+ * @return 成功返回0；句柄无效或引用计数已满返回-1，此时调用者不持有引用，不能共享该句柄
+ */
+int32_t zstore_dup(uint64_t handle) {
+    uint32_t slot;
+    int32_t ret = 0;
+
+    uint64_t irq_flags = spin_lock_irqsave(&zstore_lock);
+    if (handle == ZSTORE_HANDLE_ZERO) {
+        nr_zero++;
+    } else {
+        struct zstore_arena_struct *arena = zstore_handle_arena(handle, &slot);
+        if (arena && arena->ref_count[slot] < 255)
+            arena->ref_count[slot]++;
+        else
+            ret = -1;
+    }
+    spin_unlock_irqrestore(&zstore_lock, irq_flags);
+
+    if (ret)
+        warnk("zstore: cannot share handle %#lx\n", handle);
+    return ret;
+}
+
+/**
+ * @brief 释放句柄的一个引用，最后一个引用释放时回收槽，arena全空时归还页框
+ */
+void zstore_free(uint64_t handle) {
+    uint32_t slot;
+
+    uint64_t irq_flags = spin_lock_irqsave(&zstore_lock);
+    if (handle == ZSTORE_HANDLE_ZERO) {
+        nr_zero--;
+        spin_unlock_irqrestore(&zstore_lock, irq_flags);
+        return;
+    }
+
+    struct zstore_arena_struct *arena = zstore_handle_arena(handle, &slot);
+    if (!arena) {
+        spin_unlock_irqrestore(&zstore_lock, irq_flags);
+        warnk("zstore: free of invalid handle %#lx\n", handle);
+        return;
+    }
+    if (--arena->ref_count[slot]) {
+        spin_unlock_irqrestore(&zstore_lock, irq_flags);
+        return;
+    }
+
+    struct zstore_class_struct *class = &zstore_class[arena->class_idx];
+    if (arena->length[slot] == PAGE_4K_SIZE)
+        nr_incompressible--;
+    stored_bytes -= arena->length[slot];
+    nr_stored--;
+    arena->bitmap[slot / 64] &= ~(1UL << (slot % 64));
+    if (arena->nr_used-- == class->nr_slots)
+        list_add(&arena->list, &class->partial);
+    if (!arena->nr_used)
+        zstore_arena_destroy(arena);
+    spin_unlock_irqrestore(&zstore_lock, irq_flags);
+}
+
+/**
+ * @brief 打印存放的页数、压缩率(原始大小/实际占用的arena内存)与平均开销
+ */
+void zstore_info(void) {
+    uint64_t irq_flags = spin_lock_irqsave(&zstore_lock);
+    uint64_t orig = (nr_stored + nr_zero) * PAGE_4K_SIZE;
+    uint64_t used = arena_pages * PAGE_4K_SIZE;
+    uint64_t ratio = used ? orig * 100 / used : 0;
+
+    logk("zstore: %lu pages (%lu zero, %lu incompressible), %lu KB -> %lu KB objects in %lu KB arenas, "
+         "ratio %lu.%02lux\n", nr_stored + nr_zero, nr_zero, nr_incompressible, orig >> 10, stored_bytes >> 10,
+         used >> 10, ratio / 100, ratio % 100);
+    logk("zstore: store %lu cycles/page, load %lu cycles/page, %lu failed stores, %u arena ids\n",
+         nr_stores ? store_cycles / nr_stores : 0, nr_loads ? load_cycles / nr_loads : 0,
+         nr_store_failed, zstore_nr_ids);
+    spin_unlock_irqrestore(&zstore_lock, irq_flags);
+}
@@ -0,0 +1,56 @@
+#ifndef __ZSTORE_H__
+#define __ZSTORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "list.h"
+#include "memory.h"
+
+// 压缩页存储：4K页以LZ4压缩后按大小分类存放在由页框分配器提供的arena中，以句柄访问
+#define ZSTORE_CLASS_SHIFT      6
+#define ZSTORE_CLASS_SIZE       (1U << ZSTORE_CLASS_SHIFT)          // size class粒度(64字节)
+#define ZSTORE_NR_CLASSES       (PAGE_4K_SIZE / ZSTORE_CLASS_SIZE)  // 第i类存放(i + 1) * 64字节以内的对象
+#define ZSTORE_MAX_ARENA_PAGES  4                                   // arena最多由4个连续4K页组成(按类选择浪费最少的页数)
+#define ZSTORE_MAX_SLOTS        (ZSTORE_MAX_ARENA_PAGES * PAGE_4K_SIZE / ZSTORE_CLASS_SIZE)
+#define ZSTORE_MAX_COMPRESSED   (PAGE_4K_SIZE * 3 / 4)              // 压缩后超过该长度的页按原样存放
+
+// 句柄：高位为arena编号加1，低ZSTORE_SLOT_BITS位为槽号；共ZSTORE_HANDLE_BITS位，可以放进页表项的地址字段
+#define ZSTORE_SLOT_BITS        16
+#define ZSTORE_HANDLE_BITS      40
+#define ZSTORE_HANDLE_ZERO      1UL                                 // 全零页，不占存储
+
+// arena：一段物理连续的4K页，切分为同一size class的槽
+struct zstore_arena_struct {
+    struct list_head list;              // 有空闲槽时挂入所属size class的链表
+    uint64_t base;                      // 首页线性地址(直接映射区)
+    uint32_t id;                        // 在arena表中的下标
+    uint16_t class_idx;
+    uint16_t nr_used;                   // 已占用的槽数
+    uint64_t bitmap[ZSTORE_MAX_SLOTS / 64];     // 槽占用位图
+    uint16_t length[ZSTORE_MAX_SLOTS];          // 对象长度(等于PAGE_4K_SIZE表示未压缩)
+    uint8_t ref_count[ZSTORE_MAX_SLOTS];        // 句柄引用计数(写时复制共享的地址空间各持有一个引用)
+};
+
+struct zstore_class_struct {
+    uint32_t size;                      // 槽大小
+    uint32_t nr_pages;                  // 每个arena的4K页数
+    uint32_t nr_slots;                  // 每个arena的槽数
+    uint64_t nr_arenas;
+    struct list_head partial;           // 有空闲槽的arena
+};
+
+void zstore_init(void);
+uint64_t zstore_store(void *src);
+int32_t zstore_load(uint64_t handle, void *dst);
+int32_t zstore_dup(uint64_t handle);
+void zstore_free(uint64_t handle);
+void zstore_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif